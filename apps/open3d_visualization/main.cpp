@@ -2,10 +2,12 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <memory>
 #include <thread>
 
 #include "sim/particles.h"
+#include "utils/trace.h"
 namespace o3d = open3d;
 
 double GetRandom() { return double(std::rand()) / double(RAND_MAX); }
@@ -91,13 +93,21 @@ int main() {
 
   bool first = true;
   while (running && visualizer.PollEvents()) {
+    TRACE_ZONE("Frame");
     if (!paused) {
       par_sys.Update(Fext_x, Fext_y, Fext_z, 0., 0, 0.);
-      // TODO Parallel copy
-      for (size_t i = 0; i < num_particles; ++i) {
-        point_cloud->points_[i] = {par_sys.x[i], par_sys.y[i], par_sys.z[i]};
+      {
+        TRACE_ZONE("CopyPoints");
+        // TODO Parallel copy
+        for (size_t i = 0; i < num_particles; ++i) {
+          point_cloud->points_[i] = {par_sys.x[i], par_sys.y[i],
+                                     par_sys.z[i]};
+        }
+      }
+      {
+        TRACE_ZONE("UpdateGeometry");
+        visualizer.UpdateGeometry(point_cloud);
       }
-      visualizer.UpdateGeometry(point_cloud);
 
       // do once after first non-empty geometry
       if (first) {
@@ -105,10 +115,18 @@ int main() {
         first = false;
       }
     }
-    visualizer.UpdateRender();
+    {
+      TRACE_ZONE("UpdateRender");
+      visualizer.UpdateRender();
+    }
     std::this_thread::sleep_for(std::chrono::milliseconds(16));
   }
 
   visualizer.DestroyVisualizerWindow();
+#ifdef PARTICLES_TRACE
+  // the last kTraceCapacity zones per thread
+  WriteChromeTrace("particles_trace.json");
+  std::printf("Trace written to particles_trace.json\n");
+#endif
   return 0;
 }
@@ -1,30 +1,66 @@
 #include <benchmark/benchmark.h>
 
-#include "sim/particles.h"
-#include "utils/logger.h"
-#include "utils/rng.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
 
-// Define benchmark
-static void BM_ParticleUpdate(benchmark::State& state) {
-  const size_t num_particles{4000};
-  const double d_t{1.};
-  Particles<> par_sys(num_particles, d_t);
+#include "sim/direct_sum.h"
+#include "sim/gravity_kernels.h"
+#include "utils/rng.h"
 
-  std::vector<double> Fext_x(num_particles);
-  std::vector<double> Fext_y(num_particles);
-  std::vector<double> Fext_z(num_particles);
+// Direct force summation with the SIMD kernel of instruction set range(0)
+// range(1) != 0 selects ForcePrecision::kMixed (double only)
+template <typename T>
+static void BM_DirectForces(benchmark::State& state) {
+  const auto isa{static_cast<SimdIsa>(state.range(0))};
+  if (isa > DetectSimdIsa()) {
+    state.SkipWithError("instruction set not supported by this CPU");
+    return;
+  }
+  SetSimdIsa(isa);
+  state.SetLabel(SimdIsaName(isa));
 
-  RNG<double> rng;
-  rng.GenerateUniformRandom(Fext_x.data(), num_particles, 0., 0.);
-  rng.GenerateUniformRandom(Fext_y.data(), num_particles, 0., 0.);
-  rng.GenerateUniformRandom(Fext_z.data(), num_particles, 0., 0.);
+  const size_t n{4000};
+  RNG<T> rng;
+  std::vector<T> x(n), y(n), z(n), m(n), Fx(n), Fy(n), Fz(n);
+  rng.GenerateUniformRandom(x.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(y.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(z.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(m.data(), n, 1., 200.);
+  DirectSum<T> direct;
+  if (state.range(1)) {
+    direct.SetPrecision(ForcePrecision::kMixed);
+    state.SetLabel(std::string(SimdIsaName(isa)) + " mixed");
+  }
   for (auto _ : state) {
-    for (size_t step = 0; step < 200; ++step) {
-      par_sys.Update(Fext_x, Fext_y, Fext_z, 0., 0., 0.);
+    std::fill(Fx.begin(), Fx.end(), T(0));
+    std::fill(Fy.begin(), Fy.end(), T(0));
+    std::fill(Fz.begin(), Fz.end(), T(0));
+    direct.AddForces(x.data(), y.data(), z.data(), m.data(), m.data(), n,
+                     Fx.data(), Fy.data(), Fz.data(), T(1e-8));
+    benchmark::DoNotOptimize(Fx.data());
+  }
+  if (state.range(1)) {
+    // RMS force error relative to the pure double kernel
+    std::vector<T> Rx(n), Ry(n), Rz(n);
+    DirectSum<T> reference;
+    reference.AddForces(x.data(), y.data(), z.data(), m.data(), m.data(), n,
+                        Rx.data(), Ry.data(), Rz.data(), T(1e-8));
+    double err2{0}, norm2{0};
+    for (size_t i = 0; i < n; ++i) {
+      err2 += (Fx[i] - Rx[i]) * (Fx[i] - Rx[i]) +
+              (Fy[i] - Ry[i]) * (Fy[i] - Ry[i]) +
+              (Fz[i] - Rz[i]) * (Fz[i] - Rz[i]);
+      norm2 += Rx[i] * Rx[i] + Ry[i] * Ry[i] + Rz[i] * Rz[i];
     }
+    state.counters["rel_error"] = std::sqrt(err2 / norm2);
   }
+  state.counters["interactions/s"] =
+      benchmark::Counter(double(n) * double(n - 1) / 2,
+                         benchmark::Counter::kIsIterationInvariantRate);
+  SetSimdIsa(DetectSimdIsa());
 }
-// Register the function as a benchmark
-BENCHMARK(BM_ParticleUpdate);
+BENCHMARK(BM_DirectForces<float>)->ArgsProduct({{0, 1, 2, 3}, {0}});
+BENCHMARK(BM_DirectForces<double>)->ArgsProduct({{0, 1, 2, 3}, {0, 1}});
 
 BENCHMARK_MAIN();
@@ -0,0 +1,342 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "sim/aos_particle_system.h"
+#include "sim/force_models.h"
+#include "sim/initial_conditions.h"
+#include "sim/particles.h"
+#include "sim/particles_aosoa.h"
+#include "sim/particles_rawpointer.h"
+#include "utils/rng.h"
+#include "utils/thread_pool.h"
+
+/**
+ * One time step of every particle layout, swept over the number of
+ * particles, the precision, the force solver and the number of threads.
+ * Arguments: n, threads, solver (0 direct, 1 Barnes-Hut).
+ *
+ * Counters:
+ *   interactions/s, GFLOP/s  pair interactions n (n - 1) / 2 per step, at
+ *                            kFlopsPerInteraction; direct summation only, the
+ *                            tree does not count its interactions
+ *   bytes/step, bytes/s      particle state the step streams through
+ *   force_ms, integrate_ms   the step of Particles split into the evaluation
+ *                            of its Gravity model, timed on its own on the
+ *                            same n, and the rest. The AoS, AoSoA and raw
+ *                            pointer layouts have pair loops of their own,
+ *                            so they have none.
+ *
+ * JSON for comparing against a baseline: the benchmark_json target, then
+ * benchmark/compare.py baseline.json results.json.
+ */
+
+namespace {
+using benchmark::Counter;
+
+// Flops of one pair interaction, the usual count for softened gravity
+constexpr double kFlopsPerInteraction{20};
+// Particle fields a SoA step reads or writes: x, y, z, m, Gm, v, F
+constexpr size_t kSoaFields{11};
+
+enum : std::int64_t { kDirect, kBarnesHut };
+
+// Sizes the pool of the parallel loops while alive
+class ThreadLimit {
+  size_t previous_;
+
+ public:
+  explicit ThreadLimit(const size_t threads)
+      : previous_{ThreadPool::Global().NumThreads()} {
+    if (threads != previous_) ThreadPool::Global().Resize(threads);
+  }
+  ~ThreadLimit() {
+    if (ThreadPool::Global().NumThreads() != previous_)
+      ThreadPool::Global().Resize(previous_);
+  }
+  ThreadLimit(const ThreadLimit&) = delete;
+  ThreadLimit& operator=(const ThreadLimit&) = delete;
+};
+
+// 1, 2, 4, ... and all hardware threads
+std::vector<std::int64_t> ThreadCounts() {
+  const std::int64_t hardware{
+      std::max<std::int64_t>(1, std::thread::hardware_concurrency())};
+  std::vector<std::int64_t> counts;
+  for (std::int64_t t = 1; t < hardware; t *= 2) counts.push_back(t);
+  counts.push_back(hardware);
+  return counts;
+}
+
+ForceSolver SolverOf(const benchmark::State& state) {
+  return state.range(2) == kBarnesHut ? ForceSolver::kBarnesHut
+                                      : ForceSolver::kDirect;
+}
+
+// Mean seconds of a force evaluation on n particles spread as by
+// Randomize(), over at least 50 ms
+template <typename T>
+double ForceSeconds(const size_t n, const ForceSolver solver) {
+  RNG<T> rng;
+  std::vector<T> x(n), y(n), z(n), m(n), Fx(n), Fy(n), Fz(n);
+  rng.GenerateUniformRandom(x.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(y.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(z.data(), n, -2., 2.);
+  rng.GenerateUniformRandom(m.data(), n, 1., 200.);
+  Gravity<T> gravity;
+  gravity.SetSolver(solver);
+  const ForceState<T> s{.n = n,
+                        .x = x.data(),
+                        .y = y.data(),
+                        .z = z.data(),
+                        .m = m.data(),
+                        .Gm = m.data(),
+                        .Fx = Fx.data(),
+                        .Fy = Fy.data(),
+                        .Fz = Fz.data()};
+  // the first evaluation allocates
+  gravity.AddForces(s);
+  const auto start{std::chrono::steady_clock::now()};
+  for (size_t evaluations = 1;; ++evaluations) {
+    gravity.AddForces(s);
+    const double seconds{std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count()};
+    if (seconds >= 0.05) return seconds / double(evaluations);
+  }
+}
+
+// Runs step() timed, then sets the counters
+template <typename Step>
+void RunSteps(benchmark::State& state, const size_t n,
+              const double state_bytes, const bool direct,
+              const double force_seconds, Step&& step) {
+  const auto start{std::chrono::steady_clock::now()};
+  for (auto _ : state) step();
+  const double seconds{
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count()};
+  if (direct) {
+    const double pairs{double(n) * double(n - 1) / 2};
+    state.counters["interactions/s"] =
+        Counter(pairs, Counter::kIsIterationInvariantRate);
+    state.counters["GFLOP/s"] = Counter(pairs * kFlopsPerInteraction * 1e-9,
+                                        Counter::kIsIterationInvariantRate);
+  }
+  state.counters["bytes/step"] = state_bytes;
+  state.counters["bytes/s"] =
+      Counter(state_bytes, Counter::kIsIterationInvariantRate,
+              Counter::OneK::kIs1024);
+  if (force_seconds >= 0 && state.iterations() > 0) {
+    const double step_seconds{seconds / double(state.iterations())};
+    state.counters["force_ms"] = 1e3 * force_seconds;
+    state.counters["integrate_ms"] =
+        1e3 * std::max(0., step_seconds - force_seconds);
+  }
+}
+}  // namespace
+
+// Array of Structs, direct summation in double over the DirectSum tile
+// schedule, with a pair loop of its own, so there are no phase counters
+static void BM_StepAoS(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  RNG<DType> rng;
+  std::vector<DType> p(3 * n), m(n);
+  rng.GenerateUniformRandom(p.data(), 3 * n, -2., 2.);
+  rng.GenerateUniformRandom(m.data(), n, 1., 200.);
+  std::vector<ParticleStructure> particles;
+  particles.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    particles.emplace_back(PointType{p[3 * i], p[3 * i + 1], p[3 * i + 2]},
+                           m[i], VectorType{}, i);
+  ParticleSystemAoS system(std::move(particles));
+  const std::vector<VectorType> none;
+  RunSteps(state, n, double(n * sizeof(ParticleStructure)), true, -1.,
+           [&] { system.UpdateN2(none, VectorType{}, 1e-3); });
+}
+BENCHMARK(BM_StepAoS)
+    ->ArgsProduct({{100, 1000, 10000}, ThreadCounts(), {kDirect}})
+    ->ArgNames({"n", "threads", "solver"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Particles<T>, the Struct of Arrays with the Gravity force model
+template <typename T>
+static void BM_StepSoA(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  Particles<T> system(n, T(1e-3));
+  system.SetForceSolver(SolverOf(state));
+  const std::vector<T> none;
+  RunSteps(state, n, double(n * kSoaFields * sizeof(T)),
+           state.range(2) == kDirect, ForceSeconds<T>(n, SolverOf(state)),
+           [&] { system.Update(none, none, none, T(0), T(0), T(0)); });
+}
+
+// BM_StepSoA with the StepStats diagnostics measured every step
+template <typename T>
+static void BM_StepSoADiagnostics(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  Particles<T> system(n, T(1e-3));
+  system.SetForceSolver(SolverOf(state));
+  system.SetDiagnostics(true);
+  const std::vector<T> none;
+  RunSteps(state, n, double(n * kSoaFields * sizeof(T)),
+           state.range(2) == kDirect, ForceSeconds<T>(n, SolverOf(state)),
+           [&] { system.Update(none, none, none, T(0), T(0), T(0)); });
+}
+
+// ParticlesRawPointer<T>, the raw pointer Struct of Arrays
+template <typename T>
+static void BM_StepRawPointer(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  ParticlesRawPointer<T> system(n, T(1e-3));
+  system.SetForceSolver(SolverOf(state));
+  RunSteps(state, n, double(n * kSoaFields * sizeof(T)),
+           state.range(2) == kDirect, -1.,
+           [&] {
+             system.Update(nullptr, nullptr, nullptr, T(0), T(0), T(0));
+           });
+}
+
+// ParticlesAoSoA<T>, blocks of one 512-bit register; direct summation only
+template <typename T>
+static void BM_StepAoSoA(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  ParticlesAoSoA<T> system(n, T(1e-3));
+  RunSteps(state, n, double(n * kSoaFields * sizeof(T)), true, -1., [&] {
+    system.Update(nullptr, nullptr, nullptr, T(0), T(0), T(0));
+  });
+}
+
+// Direct summation up to 1e5 (5e9 interactions a step), the tree up to 1e6
+#define BENCHMARK_LAYOUT(function)                                   \
+  BENCHMARK(function)                                                \
+      ->ArgsProduct({{100, 1000, 10000, 100000}, ThreadCounts(),     \
+                     {kDirect}})                                     \
+      ->ArgsProduct({{100, 1000, 10000, 100000, 1000000},            \
+                     ThreadCounts(), {kBarnesHut}})                  \
+      ->ArgNames({"n", "threads", "solver"})                         \
+      ->Unit(benchmark::kMillisecond)                                \
+      ->UseRealTime()
+
+BENCHMARK_LAYOUT(BM_StepSoA<float>);
+BENCHMARK_LAYOUT(BM_StepSoA<double>);
+BENCHMARK_LAYOUT(BM_StepSoADiagnostics<double>);
+BENCHMARK_LAYOUT(BM_StepRawPointer<float>);
+BENCHMARK_LAYOUT(BM_StepRawPointer<double>);
+BENCHMARK(BM_StepAoSoA<float>)
+    ->ArgsProduct({{100, 1000, 10000, 100000}, ThreadCounts(), {kDirect}})
+    ->ArgNames({"n", "threads", "solver"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK(BM_StepAoSoA<double>)
+    ->ArgsProduct({{100, 1000, 10000, 100000}, ThreadCounts(), {kDirect}})
+    ->ArgNames({"n", "threads", "solver"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Initial conditions of BM_StepModel (initial_conditions.h)
+enum : std::int64_t { kPlummer, kHernquist, kDisk, kMerger };
+
+// Particles<double> of n particles set up by the model of argument 3
+static Particles<double> ModelParticles(const benchmark::State& state,
+                                        const size_t n) {
+  switch (state.range(3)) {
+    case kHernquist:
+      return {n, 1e-3, Hernquist{}};
+    case kDisk:
+      return {n, 1e-3, ExponentialDisk{}};
+    case kMerger:
+      return {n, 1e-3, PlummerMerger{}};
+    default:
+      return {n, 1e-3, Plummer{}};
+  }
+}
+
+// BM_StepSoA<double> on a self-gravitating system in equilibrium instead of
+// a uniform cube: the tree is as deep as the cusp or the disk makes it.
+// Arguments: n, threads, solver, model (0 Plummer, 1 Hernquist, 2 disk,
+// 3 merger).
+static void BM_StepModel(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  Particles<double> system{ModelParticles(state, n)};
+  system.SetForceSolver(SolverOf(state));
+  const std::vector<double> none;
+  RunSteps(state, n, double(n * kSoaFields * sizeof(double)),
+           state.range(2) == kDirect, -1.,
+           [&] { system.Update(none, none, none, 0., 0., 0.); });
+}
+BENCHMARK(BM_StepModel)
+    ->ArgsProduct({{10000}, ThreadCounts(), {kDirect},
+                   {kPlummer, kHernquist, kDisk, kMerger}})
+    ->ArgsProduct({{10000, 100000, 1000000}, ThreadCounts(), {kBarnesHut},
+                   {kPlummer, kHernquist, kDisk, kMerger}})
+    ->ArgNames({"n", "threads", "solver", "model"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Generating the initial conditions of a model. Arguments: n, threads,
+// model.
+static void BM_InitialConditions(benchmark::State& state) {
+  const size_t n{size_t(state.range(0))};
+  const ThreadLimit threads(size_t(state.range(1)));
+  std::vector<double> x(n), y(n), z(n), vx(n), vy(n), vz(n), m(n);
+  const ParticleArrays<double> p{.n = n,
+                                 .x = x.data(),
+                                 .y = y.data(),
+                                 .z = z.data(),
+                                 .vx = vx.data(),
+                                 .vy = vy.data(),
+                                 .vz = vz.data(),
+                                 .m = m.data()};
+  for (auto _ : state) {
+    switch (state.range(2)) {
+      case kHernquist:
+        Hernquist{}(p);
+        break;
+      case kDisk:
+        ExponentialDisk{}(p);
+        break;
+      case kMerger:
+        PlummerMerger{}(p);
+        break;
+      default:
+        Plummer{}(p);
+    }
+    benchmark::DoNotOptimize(x.data());
+  }
+  state.SetItemsProcessed(state.iterations() * std::int64_t(n));
+}
+BENCHMARK(BM_InitialConditions)
+    ->ArgsProduct({{1000000}, ThreadCounts(),
+                   {kPlummer, kHernquist, kDisk, kMerger}})
+    ->ArgNames({"n", "threads", "model"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// One job of the pool with a task per thread that does nothing: the start
+// and join cost every ParallelFor of a step pays
+static void BM_ForkJoin(benchmark::State& state) {
+  const ThreadLimit threads(size_t(state.range(0)));
+  ThreadPool& pool{ThreadPool::Global()};
+  for (auto _ : state)
+    pool.Run(pool.NumThreads(),
+             [](const size_t i) { benchmark::DoNotOptimize(i); });
+}
+BENCHMARK(BM_ForkJoin)
+    ->ArgsProduct({ThreadCounts()})
+    ->ArgNames({"threads"})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON files, e.g. a stored baseline and the
+output of the benchmark_json target.
+
+    compare.py baseline.json results.json [--threshold 0.10]
+
+Prints the change of the real time and of every counter per benchmark, the
+medians when the files hold aggregates. Exits with 1 when any benchmark got
+slower by more than the threshold, 0 otherwise.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        runs = json.load(f)["benchmarks"]
+    aggregated = any(r.get("run_type") == "aggregate" for r in runs)
+    result = {}
+    for r in runs:
+        if aggregated:
+            if r.get("aggregate_name") != "median":
+                continue
+            name = r["run_name"]
+        else:
+            name = r["name"]
+        if "error_occurred" in r and r["error_occurred"]:
+            continue
+        result[name] = r
+    return result
+
+
+# Fields of a run that are not counters
+NOT_COUNTERS = {
+    "name", "family_index", "per_family_instance_index", "run_name",
+    "run_type", "repetitions", "repetition_index", "threads", "iterations",
+    "real_time", "cpu_time", "time_unit", "aggregate_name", "aggregate_unit",
+    "label", "error_occurred", "error_message",
+}
+
+
+def change(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return (new - old) / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("baseline")
+    parser.add_argument("results")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown that fails (default 0.10)")
+    args = parser.parse_args()
+
+    baseline, results = load(args.baseline), load(args.results)
+    regressions = []
+    for name in sorted(set(baseline) & set(results)):
+        old, new = baseline[name], results[name]
+        time = change(old["real_time"], new["real_time"])
+        line = [f"{name:60s} time {time:+7.1%}"]
+        for counter in sorted(set(old) & set(new) - NOT_COUNTERS):
+            if isinstance(old[counter], (int, float)):
+                line.append(f"{counter} {change(old[counter], new[counter]):+.1%}")
+        print("  ".join(line))
+        if time > args.threshold:
+            regressions.append(name)
+    for name in sorted(set(baseline) - set(results)):
+        print(f"{name:60s} missing from the results")
+    for name in sorted(set(results) - set(baseline)):
+        print(f"{name:60s} new")
+
+    if regressions:
+        print(f"\n{len(regressions)} slower by more than "
+              f"{args.threshold:.0%}:", *regressions, sep="\n  ")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,21 +1,47 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
+#include "direct_sum.h"
 #include "particle_structure.h"
+#include "utils/checkpoint.h"
 /**
  * A Particle System class, as an Array of Struct of Particle particles.
  * This is mainly for test and sanity check on the physics
  */
 class ParticleSystemAoS {
   std::vector<ParticleStructure> particles_{};
+  // Net force on every particle, computed before any particle moves
+  std::vector<VectorType> forces_{};
+  // Only its tile schedule: the blocks of pairs that run in parallel
+  DirectSum<DType> tiles_{};
 
  public:
   ParticleSystemAoS(const size_t n);
   ParticleSystemAoS(std::vector<ParticleStructure>&& particles);
+  /**
+   * @brief The particles of a checkpoint, copied out of it. Reads the fields
+   * x, y, z, m, vx, vy, vz and id, so also checkpoints of Particles.
+   */
+  explicit ParticleSystemAoS(const Checkpoint& checkpoint);
+
+  // Writes the particles as a checkpoint, one field per component
+  void Save(const std::string& path) const;
 
   void AddParticles(std::vector<ParticleStructure>&& particles);
 
+  /**
+   * @brief One semi-Euler step of all particles. The forces of all pairs
+   * are computed first, from the positions at the start of the step, each
+   * pair once and over the tile schedule of DirectSum in parallel: every
+   * tile is copied into plain arrays for the SIMD gravity kernel. The
+   * kernel computes the pair force of ParticleStructure::ForceFrom(), from
+   * its Gm() and kEpsilon2. Then the particles move in parallel.
+   * @param F_ext External force per particle, looked up by its id: the
+   * particle with id k gets F_ext[k], or none if k >= F_ext.size().
+   * @param F_global Global force applied to all particles, e.g. gravity.
+   */
   void UpdateN2(const std::vector<VectorType>& F_ext,
                 const VectorType& F_global, const DType& d_t);
 
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "sim/diagnostics.h"
+#include "utils/parallel.h"
+
+/**
+ * Barnes-Hut octree over a Struct of Arrays particle set.
+ *
+ * The tree is rebuilt from the x/y/z/m arrays on every call to Build(). Each
+ * node carries its monopole (mass, centre of mass) and traceless quadrupole
+ * moment, so distant nodes are approximated up to second order. The opening
+ * angle theta trades accuracy for speed: theta = 0 opens every node and
+ * reproduces direct summation, typical values are 0.3 - 0.7.
+ */
+template <std::floating_point T = double>
+class BarnesHut {
+  using Index = std::uint32_t;
+  static constexpr size_t kMaxDepth{32};
+  static constexpr Index kNoChild{std::numeric_limits<Index>::max()};
+
+  struct Node {
+    // geometric centre and half of the edge length of the cube
+    T cx, cy, cz, half;
+    // monopole
+    T mass, comx, comy, comz;
+    // quadrupole about the centre of mass: xx, yy, zz, xy, xz, yz
+    std::array<T, 6> q;
+    // children are stored contiguously: [first_child, first_child + n_child)
+    Index first_child, n_child;
+    // particles of this node are idx_[begin, end)
+    Index begin, end;
+  };
+
+  T theta_;
+  size_t leaf_size_;
+
+  // Non-owning view of the particle set of the last Build()
+  const T *x_{nullptr}, *y_{nullptr}, *z_{nullptr}, *m_{nullptr};
+  size_t n_{0};
+
+  std::vector<Node> nodes_{};
+  // permutation of particle indices, in tree order
+  std::vector<Index> idx_{};
+  std::vector<Index> scratch_{};
+
+ public:
+  explicit BarnesHut(const T theta = T(0.5), const size_t leaf_size = 8)
+      : theta_{theta}, leaf_size_{std::max<size_t>(leaf_size, 1)} {}
+
+  void SetTheta(const T theta) { theta_ = theta; }
+  T Theta() const noexcept { return theta_; }
+  size_t NumNodes() const noexcept { return nodes_.size(); }
+
+  /**
+   * @brief Builds the octree and its multipole moments over n particles.
+   * The arrays must stay alive and unchanged until AddForces() returns.
+   */
+  void Build(const T* x, const T* y, const T* z, const T* m, const size_t n) {
+    x_ = x;
+    y_ = y;
+    z_ = z;
+    m_ = m;
+    n_ = n;
+    nodes_.clear();
+    if (n == 0) return;
+
+    idx_.resize(n);
+    scratch_.resize(n);
+    for (size_t i = 0; i < n; ++i) idx_[i] = Index(i);
+
+    // bounding cube
+    const auto [x_min, x_max] = std::minmax_element(x, x + n);
+    const auto [y_min, y_max] = std::minmax_element(y, y + n);
+    const auto [z_min, z_max] = std::minmax_element(z, z + n);
+    T half = std::max({*x_max - *x_min, *y_max - *y_min, *z_max - *z_min}) / 2;
+    // grow slightly, so that particles on the boundary are strictly inside
+    half = half * T(1.0001) + std::numeric_limits<T>::min();
+
+    nodes_.reserve(2 * n / leaf_size_ + 1);
+    nodes_.push_back(Node{});
+    BuildNode(0, 0, Index(n), (*x_min + *x_max) / 2, (*y_min + *y_max) / 2,
+              (*z_min + *z_max) / 2, half, 0);
+  }
+
+  /**
+   * @brief Adds the gravitational force on every particle to Fx/Fy/Fz:
+   * F_i += Gm_i * sum_j m_j r_ij / (|r_ij|² + eps2)^(3/2), with the sum over
+   * distant nodes replaced by their multipole expansion. When potential is
+   * set, half the potential energy of every particle, from the same walk, is
+   * added to it.
+   */
+  void AddForces(const T* Gm, T* Fx, T* Fy, T* Fz, const T eps2,
+                 double* potential = nullptr) const {
+    AddForcesOf(std::span<const Index>(idx_), Gm, Fx, Fy, Fz, eps2,
+                potential);
+  }
+
+  /**
+   * @brief As AddForces(), for the particles in active only.
+   */
+  void AddForcesOn(const std::span<const std::uint32_t> active, const T* Gm,
+                   T* Fx, T* Fy, T* Fz, const T eps2,
+                   double* potential = nullptr) const {
+    AddForcesOf(active, Gm, Fx, Fy, Fz, eps2, potential);
+  }
+
+ private:
+  // Particles per task of the walks, which cost a few hundred interactions
+  // each
+  static constexpr size_t kWalkChunk{64};
+
+  void AddForcesOf(const std::span<const Index> which, const T* Gm, T* Fx,
+                   T* Fy, T* Fz, const T eps2, double* potential) const {
+    if (nodes_.empty()) return;
+    if (!potential) {
+      ParallelFor(
+          which.size(),
+          [&](const size_t begin, const size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+              const Index i{which[k]};
+              T ax{0}, ay{0}, az{0}, phi{0};
+              Walk<false>(i, eps2, ax, ay, az, phi);
+              Fx[i] += Gm[i] * ax;
+              Fy[i] += Gm[i] * ay;
+              Fz[i] += Gm[i] * az;
+            }
+          },
+          kWalkChunk);
+      return;
+    }
+    const CompensatedSum sum{ParallelReduce(
+        which.size(), CompensatedSum{},
+        [&](const size_t begin, const size_t end) {
+          CompensatedSum s;
+          for (size_t k = begin; k < end; ++k) {
+            const Index i{which[k]};
+            T ax{0}, ay{0}, az{0}, phi{0};
+            Walk<true>(i, eps2, ax, ay, az, phi);
+            Fx[i] += Gm[i] * ax;
+            Fy[i] += Gm[i] * ay;
+            Fz[i] += Gm[i] * az;
+            s.Add(double(Gm[i]) * double(phi));
+          }
+          return s;
+        },
+        [](CompensatedSum& total, const CompensatedSum& s) { total.Add(s); },
+        kWalkChunk)};
+    *potential += sum.Value() / 2;
+  }
+
+  void BuildNode(const Index node, const Index begin, const Index end,
+                 const T cx, const T cy, const T cz, const T half,
+                 const size_t depth) {
+    {
+      Node& nd{nodes_[node]};
+      nd.cx = cx;
+      nd.cy = cy;
+      nd.cz = cz;
+      nd.half = half;
+      nd.begin = begin;
+      nd.end = end;
+      nd.first_child = kNoChild;
+      nd.n_child = 0;
+    }
+
+    if (end - begin <= leaf_size_ || depth >= kMaxDepth) {
+      LeafMoments(nodes_[node]);
+      return;
+    }
+
+    // Counting sort of idx_[begin, end) by octant
+    auto octant = [&](const Index i) {
+      return (x_[i] >= cx ? 1 : 0) | (y_[i] >= cy ? 2 : 0) |
+             (z_[i] >= cz ? 4 : 0);
+    };
+    std::array<Index, 9> offset{};
+    for (Index k = begin; k < end; ++k) ++offset[octant(idx_[k]) + 1];
+    for (size_t o = 0; o < 8; ++o) offset[o + 1] += offset[o];
+    std::array<Index, 8> cursor{};
+    for (size_t o = 0; o < 8; ++o) cursor[o] = begin + offset[o];
+    for (Index k = begin; k < end; ++k) {
+      const Index i{idx_[k]};
+      scratch_[cursor[octant(i)]++] = i;
+    }
+    std::copy(scratch_.begin() + begin, scratch_.begin() + end,
+              idx_.begin() + begin);
+
+    Index n_child{0};
+    for (size_t o = 0; o < 8; ++o)
+      if (offset[o + 1] > offset[o]) ++n_child;
+    const Index first_child{Index(nodes_.size())};
+    nodes_.resize(nodes_.size() + n_child);
+    nodes_[node].first_child = first_child;
+    nodes_[node].n_child = n_child;
+
+    const T h{half / 2};
+    Index child{first_child};
+    for (size_t o = 0; o < 8; ++o) {
+      if (offset[o + 1] == offset[o]) continue;
+      BuildNode(child++, begin + offset[o], begin + offset[o + 1],
+                cx + ((o & 1) ? h : -h), cy + ((o & 2) ? h : -h),
+                cz + ((o & 4) ? h : -h), h, depth + 1);
+    }
+    InnerMoments(nodes_[node]);
+  }
+
+  void LeafMoments(Node& nd) const {
+    T mass{0}, mx{0}, my{0}, mz{0};
+    for (Index k = nd.begin; k < nd.end; ++k) {
+      const Index i{idx_[k]};
+      mass += m_[i];
+      mx += m_[i] * x_[i];
+      my += m_[i] * y_[i];
+      mz += m_[i] * z_[i];
+    }
+    SetCentreOfMass(nd, mass, mx, my, mz);
+    nd.q.fill(T(0));
+    for (Index k = nd.begin; k < nd.end; ++k) {
+      const Index i{idx_[k]};
+      AddQuadrupole(nd.q, m_[i], x_[i] - nd.comx, y_[i] - nd.comy,
+                    z_[i] - nd.comz);
+    }
+  }
+
+  void InnerMoments(Node& nd) const {
+    T mass{0}, mx{0}, my{0}, mz{0};
+    for (Index c = nd.first_child; c < nd.first_child + nd.n_child; ++c) {
+      const Node& ch{nodes_[c]};
+      mass += ch.mass;
+      mx += ch.mass * ch.comx;
+      my += ch.mass * ch.comy;
+      mz += ch.mass * ch.comz;
+    }
+    SetCentreOfMass(nd, mass, mx, my, mz);
+    nd.q.fill(T(0));
+    // parallel axis theorem for the quadrupole
+    for (Index c = nd.first_child; c < nd.first_child + nd.n_child; ++c) {
+      const Node& ch{nodes_[c]};
+      for (size_t k = 0; k < 6; ++k) nd.q[k] += ch.q[k];
+      AddQuadrupole(nd.q, ch.mass, ch.comx - nd.comx, ch.comy - nd.comy,
+                    ch.comz - nd.comz);
+    }
+  }
+
+  static void SetCentreOfMass(Node& nd, const T mass, const T mx, const T my,
+                              const T mz) {
+    nd.mass = mass;
+    if (mass > T(0)) {
+      nd.comx = mx / mass;
+      nd.comy = my / mass;
+      nd.comz = mz / mass;
+    } else {
+      nd.comx = nd.cx;
+      nd.comy = nd.cy;
+      nd.comz = nd.cz;
+    }
+  }
+
+  // Q += m (3 d d^T - |d|² I)
+  static void AddQuadrupole(std::array<T, 6>& q, const T m, const T dx,
+                            const T dy, const T dz) {
+    const T d2{dx * dx + dy * dy + dz * dz};
+    q[0] += m * (3 * dx * dx - d2);
+    q[1] += m * (3 * dy * dy - d2);
+    q[2] += m * (3 * dz * dz - d2);
+    q[3] += m * 3 * dx * dy;
+    q[4] += m * 3 * dx * dz;
+    q[5] += m * 3 * dy * dz;
+  }
+
+  /**
+   * Acceleration (per unit G) of particle i:
+   *  a = sum_j m_j r / r³                              for opened leaves,
+   *  a = -M R/R³ + Q R/R⁵ - 5/2 (R^T Q R) R/R⁷           for accepted nodes,
+   * where R points from the node's centre of mass to particle i. With
+   * kPotential also the potential (per unit G),
+   *  phi = -sum_j m_j / r  and  phi = -M / R - 1/2 R^T Q R / R⁵.
+   */
+  template <bool kPotential>
+  void Walk(const Index i, const T eps2, T& ax, T& ay, T& az, T& phi) const {
+    const T xi{x_[i]}, yi{y_[i]}, zi{z_[i]};
+    const T theta2{theta_ * theta_};
+    using std::sqrt;
+
+    std::array<Index, 8 * kMaxDepth + 1> stack;
+    size_t top{0};
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node& nd{nodes_[stack[--top]]};
+      const T rx{xi - nd.comx};
+      const T ry{yi - nd.comy};
+      const T rz{zi - nd.comz};
+      const T d2{rx * rx + ry * ry + rz * rz};
+      const T size{2 * nd.half};
+      const bool inside{std::abs(xi - nd.cx) <= nd.half &&
+                        std::abs(yi - nd.cy) <= nd.half &&
+                        std::abs(zi - nd.cz) <= nd.half};
+
+      if (!inside && size * size < theta2 * d2) {
+        // softened multipole expansion
+        const T r2{d2 + eps2};
+        const T inv_r{T(1) / sqrt(r2)};
+        const T inv_r2{inv_r * inv_r};
+        const T inv_r3{inv_r * inv_r2};
+        const T inv_r5{inv_r3 * inv_r2};
+        const auto& q{nd.q};
+        const T qrx{q[0] * rx + q[3] * ry + q[4] * rz};
+        const T qry{q[3] * rx + q[1] * ry + q[5] * rz};
+        const T qrz{q[4] * rx + q[5] * ry + q[2] * rz};
+        const T rqr{rx * qrx + ry * qry + rz * qrz};
+        const T radial{-nd.mass * inv_r3 - T(2.5) * rqr * inv_r5 * inv_r2};
+        ax += radial * rx + qrx * inv_r5;
+        ay += radial * ry + qry * inv_r5;
+        az += radial * rz + qrz * inv_r5;
+        if constexpr (kPotential)
+          phi -= nd.mass * inv_r + T(0.5) * rqr * inv_r5;
+      } else if (nd.n_child == 0) {
+        for (Index k = nd.begin; k < nd.end; ++k) {
+          const Index j{idx_[k]};
+          if (j == i) continue;
+          const T sx{x_[j] - xi};
+          const T sy{y_[j] - yi};
+          const T sz{z_[j] - zi};
+          const T r2{sx * sx + sy * sy + sz * sz + eps2};
+          const T inv_r{T(1) / sqrt(r2)};
+          const T f{m_[j] * inv_r * inv_r * inv_r};
+          ax += f * sx;
+          ay += f * sy;
+          az += f * sz;
+          if constexpr (kPotential) phi -= m_[j] * inv_r;
+        }
+      } else {
+        for (Index c = nd.first_child; c < nd.first_child + nd.n_child; ++c)
+          stack[top++] = c;
+      }
+    }
+  }
+};
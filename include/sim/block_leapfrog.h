@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "sim/integrators.h"
+#include "utils/parallel.h"
+
+/**
+ * Kick-drift-kick leapfrog with hierarchical block time steps: an integrator
+ * policy (see integrators.h) where every particle i advances with its own
+ * step dt / 2^level_i.
+ *
+ * The level comes from the acceleration criterion
+ *   dt_i <= eta * sqrt(length / |a_i|),
+ * with length a softening-like length scale of the system. The step dt of
+ * Update() is split into 2^L substeps, L the finest level in use. Every
+ * substep drifts all particles (the inactive ones are predicted at their
+ * half-kicked velocity, which is exactly their leapfrog drift), then
+ * evaluates forces on the particles whose step ends there only and kicks
+ * them. Those particles pick their next level: a finer one at any time, a
+ * coarser one only where its step lands on the block grid. Levels never get
+ * finer than L within one Update(), as the substep grid is fixed by then.
+ *
+ * It is stateful (levels, statistics), so Particles keeps an instance; the
+ * force callback must accept a span of active particle indices as well.
+ */
+class BlockLeapfrog {
+ public:
+  static constexpr size_t kScratchFields{0};
+  // Levels are kept in a byte and 2^level substeps in a size_t
+  static constexpr unsigned kMaxLevel{30};
+
+ private:
+  double eta_;
+  double length_;
+  unsigned max_level_;
+  std::vector<std::uint8_t> level_{};
+  std::vector<std::uint32_t> active_{};
+  size_t force_evaluations_{0};
+
+ public:
+  explicit BlockLeapfrog(const double eta = 0.025, const double length = 0.01,
+                         const unsigned max_level = 12)
+      : eta_{eta},
+        length_{length},
+        max_level_{std::min(max_level, kMaxLevel)} {}
+
+  void SetAccuracy(const double eta, const double length) {
+    eta_ = eta;
+    length_ = length;
+  }
+  void SetMaxLevel(const unsigned max_level) {
+    max_level_ = std::min(max_level, kMaxLevel);
+  }
+
+  // Level of every particle during the last Update()'s final step
+  std::span<const std::uint8_t> Levels() const noexcept { return level_; }
+  // Number of single-particle force evaluations so far
+  size_t ForceEvaluations() const noexcept { return force_evaluations_; }
+
+  template <std::floating_point T, class Forces>
+  void Step(const SoaState<T>& s, const T dt, bool& forces_current,
+            Forces&& forces) {
+    const size_t n{s.n};
+    if (n == 0) return;
+    if (!forces_current) {
+      forces();
+      force_evaluations_ += n;
+    }
+
+    // Everyone starts a step here, so any level may be chosen
+    level_.resize(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        level_[i] = std::uint8_t(Level(s, i, dt));
+    });
+    const unsigned L{*std::max_element(level_.begin(), level_.end())};
+    const size_t substeps{size_t(1) << L};
+    const T h{dt / T(substeps)};
+    // length of a step of the level, in substeps
+    auto span_of = [L](const unsigned level) {
+      return size_t(1) << (L - level);
+    };
+
+    active_.resize(n);
+    for (size_t i = 0; i < n; ++i) active_[i] = std::uint32_t(i);
+    HalfKick(s, h, L);
+
+    for (size_t k = 1; k <= substeps; ++k) {
+      SoaSweeps<T>::Drift(s, h);
+
+      active_.clear();
+      for (size_t i = 0; i < n; ++i)
+        if (k % span_of(level_[i]) == 0) active_.push_back(std::uint32_t(i));
+      forces(std::span<const std::uint32_t>(active_));
+      force_evaluations_ += active_.size();
+      HalfKick(s, h, L);
+      if (k == substeps) break;
+
+      ParallelFor(active_.size(), [&](const size_t begin, const size_t end) {
+        for (size_t a = begin; a < end; ++a) {
+          const size_t i{active_[a]};
+          unsigned level{std::min(Level(s, i, dt), L)};
+          // coarser only where the longer step starts on the block grid
+          while (level < level_[i] && k % span_of(level) != 0) ++level;
+          level_[i] = std::uint8_t(level);
+        }
+      });
+      HalfKick(s, h, L);
+    }
+    forces_current = true;
+  }
+
+ private:
+  // Finest level whose step dt / 2^level meets the criterion for particle i
+  template <std::floating_point T>
+  unsigned Level(const SoaState<T>& s, const size_t i, const T dt) const {
+    const T ax{s.Fx[i] + s.ex[i] + s.gx};
+    const T ay{s.Fy[i] + s.ey[i] + s.gy};
+    const T az{s.Fz[i] + s.ez[i] + s.gz};
+    const double a{std::sqrt(double(ax * ax + ay * ay + az * az)) /
+                   double(s.m[i])};
+    if (!(a > 0)) return 0;
+    const double dt_max{eta_ * std::sqrt(length_ / a)};
+    const double level{std::ceil(std::log2(double(dt) / dt_max))};
+    return level <= 0 ? 0 : unsigned(std::min(level, double(max_level_)));
+  }
+
+  // Kick of the active particles by half their own step, h 2^(L - level)
+  template <std::floating_point T>
+  void HalfKick(const SoaState<T>& s, const T h, const unsigned L) const {
+    ParallelFor(active_.size(), [&](const size_t begin, const size_t end) {
+      for (size_t a = begin; a < end; ++a) {
+        const size_t i{active_[a]};
+        const T h_m{h * T(size_t(1) << (L - level_[i])) / (2 * s.m[i])};
+        s.vx[i] += (s.Fx[i] + s.ex[i] + s.gx) * h_m;
+        s.vy[i] += (s.Fy[i] + s.ey[i] + s.gy) * h_m;
+        s.vz[i] += (s.Fz[i] + s.ez[i] + s.gz) * h_m;
+      }
+    });
+  }
+};
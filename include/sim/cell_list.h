@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "utils/parallel.h"
+
+/**
+ * Uniform grid of cells with an edge of at least the cutoff, over the
+ * bounding box of a Struct of Arrays particle set: all neighbours within the
+ * cutoff of a particle are in its own or one of the 26 adjacent cells.
+ *
+ * Build() bins the particles with a parallel counting sort: cell of every
+ * particle, atomic histogram, prefix sum, atomic scatter, then a sort within
+ * each cell so that the order (and the summation order of the forces) does
+ * not depend on the threads. The positions are copied in cell order, so a
+ * row of three adjacent cells is one contiguous range and the pair loops
+ * stream through memory.
+ */
+template <std::floating_point T = double>
+class CellList {
+ public:
+  using Index = std::uint32_t;
+
+ private:
+  // grid origin, inverse cell edges and cells per axis
+  T x0_{0}, y0_{0}, z0_{0};
+  T inv_x_{0}, inv_y_{0}, inv_z_{0};
+  size_t nx_{0}, ny_{0}, nz_{0};
+
+  std::vector<Index> cell_of_{};
+  // particles of cell c are order_[start_[c], start_[c + 1])
+  std::vector<Index> start_{};
+  std::vector<Index> order_{};
+  // slot of particle i in order_
+  std::vector<Index> slot_of_{};
+  std::vector<T> xs_{}, ys_{}, zs_{};
+
+ public:
+  CellList() = default;
+
+  size_t NumCells() const noexcept { return nx_ * ny_ * nz_; }
+  std::array<size_t, 3> Dims() const noexcept { return {nx_, ny_, nz_}; }
+  // particle indices in cell order
+  std::span<const Index> Order() const noexcept { return order_; }
+  std::span<const Index> Starts() const noexcept { return start_; }
+
+  /**
+   * @brief Bins n particles into cells of edge >= cutoff. For a tiny cutoff
+   * the cells grow so that there are at most about 2n of them.
+   */
+  void Build(const T* x, const T* y, const T* z, const size_t n,
+             const T cutoff) {
+    if (n == 0) {
+      nx_ = ny_ = nz_ = 0;
+      start_.assign(1, 0);
+      order_.clear();
+      return;
+    }
+
+    const auto [x_min, x_max] = ParallelMinMax(x, n);
+    const auto [y_min, y_max] = ParallelMinMax(y, n);
+    const auto [z_min, z_max] = ParallelMinMax(z, n);
+    x0_ = x_min;
+    y0_ = y_min;
+    z0_ = z_min;
+    const T ex{x_max - x0_}, ey{y_max - y0_}, ez{z_max - z0_};
+
+    T edge{cutoff};
+    const double max_cells{2. * double(n) + 27};
+    auto cells = [](const T extent, const T e) {
+      return e > T(0) ? std::max<size_t>(1, size_t(extent / e)) : size_t(1);
+    };
+    if (double(cells(ex, edge)) * double(cells(ey, edge)) *
+            double(cells(ez, edge)) >
+        max_cells)
+      edge = std::max(edge, T(std::cbrt(double(ex) * ey * ez / max_cells)));
+    nx_ = cells(ex, edge);
+    ny_ = cells(ey, edge);
+    nz_ = cells(ez, edge);
+    while (double(nx_) * double(ny_) * double(nz_) > max_cells) {
+      nx_ = std::max<size_t>(1, nx_ / 2);
+      ny_ = std::max<size_t>(1, ny_ / 2);
+      nz_ = std::max<size_t>(1, nz_ / 2);
+    }
+    // per axis edge = extent / cells >= edge
+    inv_x_ = ex > T(0) ? T(nx_) / ex : T(0);
+    inv_y_ = ey > T(0) ? T(ny_) / ey : T(0);
+    inv_z_ = ez > T(0) ? T(nz_) / ez : T(0);
+
+    const size_t n_cells{NumCells()};
+    cell_of_.resize(n);
+    start_.assign(n_cells + 1, 0);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const Index c{Index(Cell(x[i], y[i], z[i]))};
+        cell_of_[i] = c;
+        std::atomic_ref<Index>(start_[c + 1])
+            .fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    std::inclusive_scan(start_.begin(), start_.end(), start_.begin());
+
+    order_.resize(n);
+    std::vector<Index> cursor(start_.begin(), start_.end() - 1);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const Index slot{std::atomic_ref<Index>(cursor[cell_of_[i]])
+                             .fetch_add(1, std::memory_order_relaxed)};
+        order_[slot] = Index(i);
+      }
+    });
+
+    slot_of_.resize(n);
+    xs_.resize(n);
+    ys_.resize(n);
+    zs_.resize(n);
+    ParallelFor(
+        n_cells,
+        [&](const size_t begin, const size_t end) {
+          for (size_t c = begin; c < end; ++c) {
+            std::sort(order_.begin() + start_[c],
+                      order_.begin() + start_[c + 1]);
+            for (Index s = start_[c]; s < start_[c + 1]; ++s) {
+              slot_of_[order_[s]] = s;
+              xs_[s] = x[order_[s]];
+              ys_[s] = y[order_[s]];
+              zs_[s] = z[order_[s]];
+            }
+          }
+        },
+        256);
+  }
+
+  /**
+   * @brief Adds a pair force to every particle from its neighbours:
+   * F_i += f r_ij, f = pair(r2, i, j), over the particles j != i of the 27
+   * cells around i, r_ij = x_j - x_i. Each pair is evaluated from both ends,
+   * so particles are processed in parallel without write conflicts. pair
+   * must be 0 beyond the cutoff and for r2 = inf, which stands for j = i so
+   * that the inner loop has no branch.
+   */
+  template <class Pair>
+  void AddPairForces(T* Fx, T* Fy, T* Fz, const Pair& pair) const {
+    ParallelFor(
+        NumCells(),
+        [&](const size_t begin, const size_t end) {
+          for (size_t c = begin; c < end; ++c)
+            for (Index a = start_[c]; a < start_[c + 1]; ++a)
+              AddPairForce(a, c, order_[a], Fx, Fy, Fz, pair);
+        },
+        256);
+  }
+
+  /**
+   * @brief As AddPairForces(), for the particles in active only. Build()
+   * must have seen the current positions.
+   */
+  template <class Pair>
+  void AddPairForcesOn(const std::span<const Index> active, T* Fx, T* Fy,
+                       T* Fz, const Pair& pair) const {
+    ParallelFor(active.size(), [&](const size_t begin, const size_t end) {
+      for (size_t k = begin; k < end; ++k) {
+        const Index i{active[k]};
+        AddPairForce(slot_of_[i], cell_of_[i], i, Fx, Fy, Fz, pair);
+      }
+    });
+  }
+
+  /**
+   * @brief Calls visit(j, r2) for every particle j != i of the 27 cells around
+   * particle i, r2 the squared distance of the positions seen by Build().
+   */
+  template <class Visit>
+  void ForEachCandidate(const Index i, Visit&& visit) const {
+    const Index a{slot_of_[i]};
+    const T xi{xs_[a]}, yi{ys_[a]}, zi{zs_[a]};
+    ForEachRow(cell_of_[i], [&](const Index b0, const Index b1) {
+      for (Index b = b0; b < b1; ++b) {
+        if (b == a) continue;
+        const T rx{xs_[b] - xi};
+        const T ry{ys_[b] - yi};
+        const T rz{zs_[b] - zi};
+        visit(order_[b], rx * rx + ry * ry + rz * rz);
+      }
+    });
+  }
+
+ private:
+  size_t Cell(const T x, const T y, const T z) const noexcept {
+    auto axis = [](const T d, const T inv, const size_t cells) {
+      return std::min(cells - 1, size_t(d * inv));
+    };
+    const size_t cy{axis(y - y0_, inv_y_, ny_)};
+    const size_t cz{axis(z - z0_, inv_z_, nz_)};
+    return axis(x - x0_, inv_x_, nx_) + nx_ * (cy + ny_ * cz);
+  }
+
+  // Calls rows(b0, b1) for the slot ranges of the 27 cells around cell c:
+  // the cells cx - 1 .. cx + 1 of a row are one contiguous range of slots.
+  template <class Rows>
+  void ForEachRow(const size_t c, Rows&& rows) const {
+    const size_t cx{c % nx_}, cy{(c / nx_) % ny_}, cz{c / (nx_ * ny_)};
+    const size_t x_lo{cx > 0 ? cx - 1 : 0}, x_hi{std::min(cx + 1, nx_ - 1)};
+    const size_t y_hi{std::min(cy + 1, ny_ - 1)};
+    const size_t z_hi{std::min(cz + 1, nz_ - 1)};
+    for (size_t z = cz > 0 ? cz - 1 : 0; z <= z_hi; ++z) {
+      for (size_t y = cy > 0 ? cy - 1 : 0; y <= y_hi; ++y) {
+        const size_t row{nx_ * (y + ny_ * z)};
+        rows(start_[row + x_lo], start_[row + x_hi + 1]);
+      }
+    }
+  }
+
+  // Pair forces on the particle i in slot a of cell c
+  template <class Pair>
+  void AddPairForce(const Index a, const size_t c, const Index i, T* Fx,
+                    T* Fy, T* Fz, const Pair& pair) const {
+    const T xi{xs_[a]}, yi{ys_[a]}, zi{zs_[a]};
+    const T inf{std::numeric_limits<T>::infinity()};
+    T fx{0}, fy{0}, fz{0};
+    ForEachRow(c, [&](const Index b0, const Index b1) {
+      for (Index b = b0; b < b1; ++b) {
+        const T rx{xs_[b] - xi};
+        const T ry{ys_[b] - yi};
+        const T rz{zs_[b] - zi};
+        const T r2{b == a ? inf : rx * rx + ry * ry + rz * rz};
+        const T f{pair(r2, i, order_[b])};
+        fx += f * rx;
+        fy += f * ry;
+        fz += f * rz;
+      }
+    });
+    Fx[i] += fx;
+    Fy[i] += fy;
+    Fz[i] += fz;
+  }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "utils/parallel.h"
+
+/**
+ * Conserved quantities and the virial of a particle set, measured as a by-
+ * product of the time step: the potential energy comes out of the force
+ * evaluation (ForceState::potential), the rest out of one pass over the
+ * particles. Sums are compensated, and split into fixed chunks so that they
+ * do not depend on the number of threads.
+ */
+
+// Neumaier's compensated sum: the rounding error of every addition is kept
+// and added back at the end
+class CompensatedSum {
+  double sum_{0};
+  double error_{0};
+
+ public:
+  void Add(const double v) noexcept {
+    const double t{sum_ + v};
+    error_ += std::abs(sum_) >= std::abs(v) ? (sum_ - t) + v : (v - t) + sum_;
+    sum_ = t;
+  }
+  void Add(const CompensatedSum& other) noexcept {
+    Add(other.sum_);
+    error_ += other.error_;
+  }
+  double Value() const noexcept { return sum_ + error_; }
+};
+
+struct StepStats {
+  // Steps taken when measured
+  std::uint64_t step{0};
+  // sum m v² / 2
+  double kinetic{0};
+  // Of the pair forces; NaN when the force model does not report it
+  double potential{std::numeric_limits<double>::quiet_NaN()};
+  // sum m v, and sum m x × v about the origin
+  std::array<double, 3> momentum{};
+  std::array<double, 3> angular_momentum{};
+  // Clausius virial of the pair forces, sum x · F; equals the potential
+  // for unsoftened gravity, and -2 kinetic in virial equilibrium
+  double virial{0};
+
+  double Energy() const noexcept { return kinetic + potential; }
+};
+
+/**
+ * @brief Kinetic energy, momentum, angular momentum and virial of n
+ * particles into stats, in one pass; F is the pair force on every particle.
+ */
+template <std::floating_point T>
+void MeasureMotion(const size_t n, const T* x, const T* y, const T* z,
+                   const T* vx, const T* vy, const T* vz, const T* m,
+                   const T* Fx, const T* Fy, const T* Fz, StepStats& stats) {
+  // kinetic, momentum, angular momentum, virial
+  using Sums = std::array<CompensatedSum, 8>;
+  const Sums sums{ParallelReduce(
+      n, Sums{},
+      [&](const size_t begin, const size_t end) {
+        Sums s;
+        for (size_t i = begin; i < end; ++i) {
+          const double mi{m[i]};
+          const double v[3]{vx[i], vy[i], vz[i]};
+          const double r[3]{x[i], y[i], z[i]};
+          s[0].Add(mi * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) / 2);
+          for (size_t d = 0; d < 3; ++d) s[1 + d].Add(mi * v[d]);
+          s[4].Add(mi * (r[1] * v[2] - r[2] * v[1]));
+          s[5].Add(mi * (r[2] * v[0] - r[0] * v[2]));
+          s[6].Add(mi * (r[0] * v[1] - r[1] * v[0]));
+          s[7].Add(r[0] * double(Fx[i]) + r[1] * double(Fy[i]) +
+                   r[2] * double(Fz[i]));
+        }
+        return s;
+      },
+      [](Sums& total, const Sums& s) {
+        for (size_t k = 0; k < total.size(); ++k) total[k].Add(s[k]);
+      })};
+  stats.kinetic = sums[0].Value();
+  for (size_t d = 0; d < 3; ++d) {
+    stats.momentum[d] = sums[1 + d].Value();
+    stats.angular_momentum[d] = sums[4 + d].Value();
+  }
+  stats.virial = sums[7].Value();
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "sim/diagnostics.h"
+#include "sim/gravity_kernels.h"
+#include "sim/types.hpp"
+#include "utils/parallel.h"
+#include "utils/thread_pool.h"
+
+/**
+ * Cache-blocked, parallel all-pairs gravity over a Struct of Arrays particle
+ * set.
+ *
+ * The particles are split into blocks that fit in L1 together with their
+ * force accumulators. Every pair of blocks (I, J), I <= J, is a tile and each
+ * particle pair is evaluated once, Newton's third law giving the reaction.
+ * Tiles are grouped into rounds (round-robin tournament schedule) in which no
+ * two tiles share a block, so the tiles of one round run in parallel and flush
+ * their per-tile accumulators into Fx/Fy/Fz without races or atomics. The
+ * summation order does not depend on the number of threads, so the result is
+ * deterministic. The pair interactions of a tile run in the SIMD kernel picked
+ * by GetTileKernel().
+ */
+template <std::floating_point T = double>
+class DirectSum {
+ public:
+  // Largest block: 7 streams of the i-block + 7 of the j-block ~ 28 KiB
+  static constexpr size_t kMaxBlock{2048 / sizeof(T)};
+  static constexpr size_t kMinBlock{32};
+
+  // The pairs of [i0, i1) with [j0, j1); on the diagonal the two are equal
+  // and each pair comes once
+  struct Tile {
+    size_t i0, i1, j0, j1;
+  };
+
+ private:
+  // particles and pool threads the rounds were built for
+  size_t n_{0};
+  size_t threads_{0};
+  size_t block_{kMaxBlock};
+  ForcePrecision precision_{ForcePrecision::kNative};
+  std::vector<std::vector<Tile>> rounds_{};
+
+ public:
+  DirectSum() = default;
+
+  void SetPrecision(const ForcePrecision precision) { precision_ = precision; }
+  ForcePrecision Precision() const noexcept { return precision_; }
+  size_t BlockSize() const noexcept { return block_; }
+  size_t NumRounds() const noexcept { return rounds_.size(); }
+
+  /**
+   * @brief Adds the gravitational force on every particle to Fx/Fy/Fz:
+   * F_i += sum_{j != i} Gm_i m_j r_ij / (|r_ij|² + eps2)^(3/2)
+   * and, when potential is set, the potential energy of all pairs to it.
+   * Every tile sums its pairs on its own; the tiles are added in schedule
+   * order.
+   */
+  void AddForces(const T* x, const T* y, const T* z, const T* m, const T* Gm,
+                 const size_t n, T* Fx, T* Fy, T* Fz, const T eps2,
+                 double* potential = nullptr) {
+    if (n != n_ || ThreadPool::Global().NumThreads() != threads_)
+      Schedule(n);
+    const TileKernel<T> kernel{GetTileKernel<T>(precision_)};
+    // the diagonal round has the most tiles
+    std::vector<double> tile_potential(
+        potential && !rounds_.empty() ? rounds_.front().size() : 0);
+    CompensatedSum total;
+    for (const auto& round : rounds_) {
+      std::fill(tile_potential.begin(), tile_potential.end(), 0.);
+      ThreadPool::Global().Run(round.size(), [&](const size_t k) {
+        double* const u{potential ? &tile_potential[k] : nullptr};
+        RunTile(kernel, x, y, z, m, Gm, round[k], Fx, Fy, Fz, eps2, u);
+      });
+      if (potential)
+        for (size_t k = 0; k < round.size(); ++k) total.Add(tile_potential[k]);
+    }
+    if (potential) *potential += total.Value();
+  }
+
+  /**
+   * @brief Adds a generic pair force over the same tile schedule:
+   * F_i += f r_ij, F_j -= f r_ij with f = pair(r2, i, j), r_ij = x_j - x_i and
+   * r2 = |r_ij|². The pair functor is inlined into a plain loop per tile that
+   * the compiler vectorises; it should be branch free (e.g. a cutoff as a
+   * select).
+   */
+  template <class Pair>
+  void AddPairForces(const T* x, const T* y, const T* z, const size_t n, T* Fx,
+                     T* Fy, T* Fz, const Pair& pair) {
+    ForEachTile(n, [&](const Tile& t) {
+      RunPairTile(x, y, z, t, Fx, Fy, Fz, pair);
+    });
+  }
+
+  /**
+   * @brief Calls tile(t) on every tile of the schedule of n particles, the
+   * tiles of a round in parallel. No two tiles of a round share a block, so
+   * tile() may add to the accumulators of both its blocks without races;
+   * other particle layouts use this to run their own pair loops.
+   */
+  template <class F>
+  void ForEachTile(const size_t n, const F& tile) {
+    if (n != n_ || ThreadPool::Global().NumThreads() != threads_)
+      Schedule(n);
+    for (const auto& round : rounds_)
+      ThreadPool::Global().Run(round.size(),
+                               [&](const size_t k) { tile(round[k]); });
+  }
+
+  /**
+   * @brief Adds the gravitational force of all n particles on the active ones
+   * only, e.g. the particles ending their step under block time-stepping.
+   * The active particles are gathered into blocks that run the same kernel
+   * against every j-block; the reactions are discarded. Needs eps2 > 0, as
+   * Gravity enforces: the pair of a particle with itself then contributes
+   * exactly zero force.
+   * When potential is set, half the potential energy of every active
+   * particle with all others is added to it: the potential energy of the
+   * system when all are active.
+   */
+  void AddForcesOn(const T* x, const T* y, const T* z, const T* m,
+                   const T* Gm, const size_t n,
+                   const std::span<const std::uint32_t> active, T* Fx, T* Fy,
+                   T* Fz, const T eps2, double* potential = nullptr) const {
+    const TileKernel<T> kernel{GetTileKernel<T>(precision_)};
+    std::vector<double> block_potential(
+        potential ? (active.size() + kMaxBlock - 1) / kMaxBlock : 0);
+    ParallelFor(
+        active.size(),
+        [&](const size_t begin, const size_t end) {
+          std::array<T, kMaxBlock> xi, yi, zi, Gmi;
+          std::array<T, kMaxBlock> fxi{}, fyi{}, fzi{}, fxj{}, fyj{}, fzj{};
+          const size_t ni{end - begin};
+          double* const u{potential ? &block_potential[begin / kMaxBlock]
+                                    : nullptr};
+          for (size_t k = 0; k < ni; ++k) {
+            const std::uint32_t i{active[begin + k]};
+            xi[k] = x[i];
+            yi[k] = y[i];
+            zi[k] = z[i];
+            Gmi[k] = Gm[i];
+          }
+          for (size_t j0 = 0; j0 < n; j0 += kMaxBlock) {
+            kernel({.xi = xi.data(),
+                    .yi = yi.data(),
+                    .zi = zi.data(),
+                    .Gmi = Gmi.data(),
+                    .ni = ni,
+                    .xj = x + j0,
+                    .yj = y + j0,
+                    .zj = z + j0,
+                    .mj = m + j0,
+                    .nj = std::min(kMaxBlock, n - j0),
+                    .fxi = fxi.data(),
+                    .fyi = fyi.data(),
+                    .fzi = fzi.data(),
+                    .fxj = fxj.data(),
+                    .fyj = fyj.data(),
+                    .fzj = fzj.data(),
+                    .eps2 = eps2,
+                    .diagonal = false,
+                    .potential = u});
+          }
+          for (size_t k = 0; k < ni; ++k) {
+            const std::uint32_t i{active[begin + k]};
+            Fx[i] += fxi[k];
+            Fy[i] += fyi[k];
+            Fz[i] += fzi[k];
+          }
+          // the pairs of the particles with themselves
+          if (u) {
+            using std::sqrt;
+            const T inv_eps{T(1) / sqrt(eps2)};
+            for (size_t k = 0; k < ni; ++k)
+              *u += double(Gmi[k] * m[active[begin + k]] * inv_eps);
+          }
+        },
+        kMaxBlock);
+    if (potential) {
+      CompensatedSum total;
+      for (const double u : block_potential) total.Add(u);
+      *potential += total.Value() / 2;
+    }
+  }
+
+ private:
+  /**
+   * Builds the rounds for n particles. Block size is reduced for small n so
+   * that every round still has about two tiles per thread of the pool that
+   * runs them.
+   */
+  void Schedule(const size_t n) {
+    n_ = n;
+    threads_ = ThreadPool::Global().NumThreads();
+    rounds_.clear();
+    if (n == 0) return;
+
+    block_ = std::clamp(n / (4 * threads_), kMinBlock, kMaxBlock);
+    const size_t nb{(n + block_ - 1) / block_};
+    auto range = [&](const size_t b) {
+      return std::pair{b * block_, std::min(n, (b + 1) * block_)};
+    };
+
+    // diagonal tiles touch one block each, so they all fit in one round
+    std::vector<Tile> diagonal;
+    for (size_t b = 0; b < nb; ++b) {
+      const auto [b0, b1] = range(b);
+      diagonal.push_back({b0, b1, b0, b1});
+    }
+    rounds_.push_back(std::move(diagonal));
+
+    // circle method over an even number of slots; slot nb (if any) is a bye
+    const size_t slots{nb + nb % 2};
+    for (size_t r = 0; r + 1 < slots; ++r) {
+      std::vector<Tile> round;
+      for (size_t k = 0; k < slots / 2; ++k) {
+        const size_t a{k == 0 ? slots - 1 : (r + k) % (slots - 1)};
+        const size_t b{(r + slots - 1 - k) % (slots - 1)};
+        if (a >= nb || b >= nb) continue;
+        const auto [a0, a1] = range(std::min(a, b));
+        const auto [b0, b1] = range(std::max(a, b));
+        round.push_back({a0, a1, b0, b1});
+      }
+      if (!round.empty()) rounds_.push_back(std::move(round));
+    }
+  }
+
+  /**
+   * Runs the kernel on one tile. The j-block accumulates into a zeroed local
+   * buffer that is added to Fx/Fy/Fz once the tile is done; on the diagonal
+   * the i-block is the same block and shares that buffer.
+   */
+  static void RunTile(const TileKernel<T> kernel, const T* x, const T* y,
+                      const T* z, const T* m, const T* Gm, const Tile& t, T* Fx,
+                      T* Fy, T* Fz, const T eps2, double* potential) {
+    std::array<T, kMaxBlock> fx{}, fy{}, fz{};
+    const bool diagonal{t.i0 == t.j0};
+    kernel({.xi = x + t.i0,
+            .yi = y + t.i0,
+            .zi = z + t.i0,
+            .Gmi = Gm + t.i0,
+            .ni = t.i1 - t.i0,
+            .xj = x + t.j0,
+            .yj = y + t.j0,
+            .zj = z + t.j0,
+            .mj = m + t.j0,
+            .nj = t.j1 - t.j0,
+            .fxi = diagonal ? fx.data() : Fx + t.i0,
+            .fyi = diagonal ? fy.data() : Fy + t.i0,
+            .fzi = diagonal ? fz.data() : Fz + t.i0,
+            .fxj = fx.data(),
+            .fyj = fy.data(),
+            .fzj = fz.data(),
+            .eps2 = eps2,
+            .diagonal = diagonal,
+            .potential = potential});
+    for (size_t j = t.j0; j < t.j1; ++j) {
+      Fx[j] += fx[j - t.j0];
+      Fy[j] += fy[j - t.j0];
+      Fz[j] += fz[j - t.j0];
+    }
+  }
+
+  // RunTile() with the pair functor in place of a SIMD kernel
+  template <class Pair>
+  static void RunPairTile(const T* x, const T* y, const T* z, const Tile& t,
+                          T* Fx, T* Fy, T* Fz, const Pair& pair) {
+    std::array<T, kMaxBlock> fx{}, fy{}, fz{};
+    const bool diagonal{t.i0 == t.j0};
+    for (size_t i = t.i0; i < t.i1; ++i) {
+      const T xi{x[i]}, yi{y[i]}, zi{z[i]};
+      T fxi{0}, fyi{0}, fzi{0};
+      for (size_t j = diagonal ? i + 1 : t.j0; j < t.j1; ++j) {
+        const T rx{x[j] - xi};
+        const T ry{y[j] - yi};
+        const T rz{z[j] - zi};
+        const T f{pair(rx * rx + ry * ry + rz * rz, i, j)};
+        fxi += f * rx;
+        fyi += f * ry;
+        fzi += f * rz;
+        fx[j - t.j0] -= f * rx;
+        fy[j - t.j0] -= f * ry;
+        fz[j - t.j0] -= f * rz;
+      }
+      if (diagonal) {
+        fx[i - t.i0] += fxi;
+        fy[i - t.i0] += fyi;
+        fz[i - t.i0] += fzi;
+      } else {
+        Fx[i] += fxi;
+        Fy[i] += fyi;
+        Fz[i] += fzi;
+      }
+    }
+    for (size_t j = t.j0; j < t.j1; ++j) {
+      Fx[j] += fx[j - t.j0];
+      Fy[j] += fy[j - t.j0];
+      Fz[j] += fz[j - t.j0];
+    }
+  }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include "utils/parallel.h"
+
+/**
+ * In-place complex 3D FFT of an n0 x n1 x n2 grid stored row-major (the last
+ * index contiguous). Like FFTW, Forward() uses e^(-2 pi i k x / n), Inverse()
+ * e^(+2 pi i k x / n) and is not normalised: Inverse(Forward(v)) = N v.
+ *
+ * The transform is an iterative radix-2 FFT per axis: the lines of
+ * an axis are independent and run in parallel, the strided ones gathered in
+ * blocks of adjacent lines so that every cache line read is used. Sizes are
+ * rounded up to powers of two.
+ */
+template <std::floating_point T = double>
+class Fft3d {
+ public:
+  using Complex = std::complex<T>;
+
+ private:
+  struct Axis {
+    size_t n{1};
+    // e^(-2 pi i k / n), k < n / 2
+    std::vector<Complex> twiddle{};
+    std::vector<std::uint32_t> bit_reverse{};
+  };
+  std::array<Axis, 3> axes_{};
+  // strided lines gathered at once
+  static constexpr size_t kBlock{8};
+
+ public:
+  Fft3d() : Fft3d(1, 1, 1) {}
+  Fft3d(const size_t n0, const size_t n1, const size_t n2) {
+    const std::array<size_t, 3> n{n0, n1, n2};
+    for (size_t d = 0; d < 3; ++d) axes_[d] = MakeAxis(n[d]);
+  }
+
+  std::array<size_t, 3> Dims() const noexcept {
+    return {axes_[0].n, axes_[1].n, axes_[2].n};
+  }
+  size_t Size() const noexcept { return axes_[0].n * axes_[1].n * axes_[2].n; }
+
+  void Forward(Complex* data) const { Transform(data, false); }
+  void Inverse(Complex* data) const { Transform(data, true); }
+
+ private:
+  static Axis MakeAxis(const size_t n_min) {
+    Axis a;
+    a.n = std::bit_ceil(std::max<size_t>(n_min, 1));
+    a.twiddle.resize(a.n / 2);
+    for (size_t k = 0; k < a.n / 2; ++k) {
+      const double angle{-2 * std::numbers::pi * double(k) / double(a.n)};
+      a.twiddle[k] = {T(std::cos(angle)), T(std::sin(angle))};
+    }
+    const unsigned bits{unsigned(std::countr_zero(a.n))};
+    a.bit_reverse.resize(a.n);
+    for (size_t i = 0; i < a.n; ++i) {
+      size_t r{0};
+      for (unsigned b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+      a.bit_reverse[i] = std::uint32_t(r);
+    }
+    return a;
+  }
+
+  void Transform(Complex* data, const bool inverse) const {
+    const size_t n1{axes_[1].n}, n2{axes_[2].n};
+    TransformAxis(data, axes_[2], 1, inverse);
+    TransformAxis(data, axes_[1], n2, inverse);
+    TransformAxis(data, axes_[0], n1 * n2, inverse);
+  }
+
+  // All lines of the axis with the given stride
+  void TransformAxis(Complex* data, const Axis& a, const size_t stride,
+                     const bool inverse) const {
+    const size_t n{a.n};
+    if (n == 1) return;
+    const size_t outer{Size() / (n * stride)};
+    if (stride == 1) {
+      ParallelFor(
+          outer,
+          [&](const size_t begin, const size_t end) {
+            for (size_t o = begin; o < end; ++o)
+              Transform1d(a, data + o * n, inverse);
+          },
+          std::max<size_t>(1, 4096 / n));
+      return;
+    }
+    const size_t blocks{(stride + kBlock - 1) / kBlock};
+    ParallelFor(
+        outer * blocks,
+        [&](const size_t begin, const size_t end) {
+          std::vector<Complex> line(kBlock * n);
+          for (size_t b = begin; b < end; ++b) {
+            const size_t first{(b % blocks) * kBlock};
+            const size_t width{std::min(kBlock, stride - first)};
+            Complex* const base{data + (b / blocks) * n * stride + first};
+            for (size_t k = 0; k < n; ++k)
+              for (size_t l = 0; l < width; ++l)
+                line[l * n + k] = base[k * stride + l];
+            for (size_t l = 0; l < width; ++l)
+              Transform1d(a, line.data() + l * n, inverse);
+            for (size_t k = 0; k < n; ++k)
+              for (size_t l = 0; l < width; ++l)
+                base[k * stride + l] = line[l * n + k];
+          }
+        },
+        std::max<size_t>(1, 512 / n));
+  }
+
+  // Iterative radix-2 decimation in time. The products are written out:
+  // std::complex multiplication checks for inf/nan and does not vectorise.
+  static void Transform1d(const Axis& a, Complex* v, const bool inverse) {
+    const size_t n{a.n};
+    for (size_t i = 0; i < n; ++i)
+      if (i < a.bit_reverse[i]) std::swap(v[i], v[a.bit_reverse[i]]);
+    const T sign{inverse ? T(-1) : T(1)};
+    for (size_t half = 1; half < n; half *= 2) {
+      const size_t step{n / (2 * half)};
+      for (size_t i = 0; i < n; i += 2 * half) {
+        for (size_t k = 0; k < half; ++k) {
+          const Complex w{a.twiddle[k * step]};
+          const T wr{w.real()}, wi{sign * w.imag()};
+          const Complex u{v[i + k]}, x{v[i + k + half]};
+          const Complex t{wr * x.real() - wi * x.imag(),
+                          wr * x.imag() + wi * x.real()};
+          v[i + k] = {u.real() + t.real(), u.imag() + t.imag()};
+          v[i + k + half] = {u.real() - t.real(), u.imag() - t.imag()};
+        }
+      }
+    }
+  }
+};
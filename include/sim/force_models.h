@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sim/barnes_hut.h"
+#include "sim/cell_list.h"
+#include "sim/diagnostics.h"
+#include "sim/direct_sum.h"
+#include "sim/particle_mesh.h"
+#include "sim/types.hpp"
+#include "sim/verlet_list.h"
+#include "utils/parallel.h"
+
+/**
+ * Inter-particle force models of Particles, as policy classes: the template
+ * parameter ForceModel. A model provides
+ *   kPairForces: false when there is no inter-particle force at all; the
+ *     force evaluation is then skipped and F stays zero,
+ *   AddForces(state): adds the forces on all particles to state.Fx/Fy/Fz,
+ *   AddForcesOn(state, active): the same for the active particles only (block
+ *     time-stepping),
+ *   Reorder(order), optional: the particles were permuted, the one now at k
+ *     was at order[k]; for models that keep per-particle state,
+ *   WrapPositions(x, y, z), optional: folds the positions back into a
+ *     periodic domain after every step,
+ *   kPotential, optional: true when the evaluations add the potential energy
+ *     to state.potential if it is set; AddForcesOn() adds half the energy of
+ *     every active particle with all others, which sums to the potential
+ *     energy when all are active.
+ * Models with parameters keep them as members; Particles owns an instance.
+ */
+
+// Raw view of a particle set for a force evaluation
+template <std::floating_point T>
+struct ForceState {
+  size_t n;
+  const T *x, *y, *z;
+  const T* m;
+  // G * m
+  const T* Gm;
+  T *Fx, *Fy, *Fz;
+  // Potential energy accumulator, for models with kPotential; may be null
+  double* potential{nullptr};
+};
+
+/**
+ * Softened Newtonian gravity between all pairs, by direct summation (SIMD
+ * tile kernels) or a Barnes-Hut tree.
+ */
+template <std::floating_point T>
+class Gravity {
+  ForceSolver solver_{ForceSolver::kDirect};
+  BarnesHut<T> tree_{};
+  DirectSum<T> direct_{};
+  T eps2_;
+
+ public:
+  static constexpr bool kPairForces{true};
+  static constexpr bool kPotential{true};
+
+  /**
+   * @param epsilon Softening length; must be > 0, as the direct solver's
+   * active-particle path relies on it (DirectSum::AddForcesOn())
+   * @throws std::invalid_argument otherwise
+   */
+  explicit Gravity(const T epsilon = T(0.0001)) : eps2_{epsilon * epsilon} {
+    if (!(epsilon > 0))
+      throw std::invalid_argument("Gravity: softening must be > 0, got " +
+                                  std::to_string(epsilon));
+  }
+
+  /**
+   * @brief Selects the algorithm for the inter-particle forces.
+   * @param theta Opening angle of the Barnes-Hut solver; ignored by kDirect.
+   */
+  void SetSolver(const ForceSolver solver, const T theta = T(0.5)) {
+    solver_ = solver;
+    tree_.SetTheta(theta);
+  }
+  void SetPrecision(const ForcePrecision precision) {
+    direct_.SetPrecision(precision);
+  }
+  T Eps2() const noexcept { return eps2_; }
+
+  void AddForces(const ForceState<T>& s) {
+    if (solver_ == ForceSolver::kBarnesHut) {
+      tree_.Build(s.x, s.y, s.z, s.m, s.n);
+      tree_.AddForces(s.Gm, s.Fx, s.Fy, s.Fz, eps2_, s.potential);
+    } else {
+      direct_.AddForces(s.x, s.y, s.z, s.m, s.Gm, s.n, s.Fx, s.Fy, s.Fz,
+                        eps2_, s.potential);
+    }
+  }
+
+  void AddForcesOn(const ForceState<T>& s,
+                   const std::span<const std::uint32_t> active) {
+    if (solver_ == ForceSolver::kBarnesHut) {
+      tree_.Build(s.x, s.y, s.z, s.m, s.n);
+      tree_.AddForcesOn(active, s.Gm, s.Fx, s.Fy, s.Fz, eps2_, s.potential);
+    } else {
+      direct_.AddForcesOn(s.x, s.y, s.z, s.m, s.Gm, s.n, active, s.Fx, s.Fy,
+                          s.Fz, eps2_, s.potential);
+    }
+  }
+};
+
+/**
+ * Gravity in a periodic cube [0, box)^3 by the Particle-Mesh method: long
+ * range forces in O(n + G log G), smoothed on the scale of a few cells. The
+ * positions are wrapped into the box after every step.
+ */
+template <std::floating_point T>
+class PeriodicGravity {
+  ParticleMesh<T> mesh_;
+
+ public:
+  static constexpr bool kPairForces{true};
+
+  explicit PeriodicGravity(const T box = T(1), const size_t grid = 64)
+      : mesh_{box, grid} {}
+
+  // Box edge and cells per axis (rounded up to a power of two)
+  void SetMesh(const T box, const size_t grid) { mesh_.SetMesh(box, grid); }
+  const ParticleMesh<T>& Mesh() const noexcept { return mesh_; }
+
+  void AddForces(const ForceState<T>& s) {
+    mesh_.AddForces(s.x, s.y, s.z, s.m, s.Gm, s.n, s.Fx, s.Fy, s.Fz);
+  }
+
+  void AddForcesOn(const ForceState<T>& s,
+                   const std::span<const std::uint32_t> active) {
+    mesh_.AddForcesOn(s.x, s.y, s.z, s.m, s.Gm, s.n, active, s.Fx, s.Fy,
+                      s.Fz);
+  }
+
+  void WrapPositions(const std::span<T> x, const std::span<T> y,
+                     const std::span<T> z) const {
+    ParallelFor(x.size(), [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        x[i] = mesh_.Wrap(x[i]);
+        y[i] = mesh_.Wrap(y[i]);
+        z[i] = mesh_.Wrap(z[i]);
+      }
+    });
+  }
+};
+
+/**
+ * No inter-particle force: ballistic motion under the external and global
+ * forces only.
+ */
+struct NoPairForces {
+  static constexpr bool kPairForces{false};
+
+  template <std::floating_point T>
+  void AddForces(const ForceState<T>&) {}
+  template <std::floating_point T>
+  void AddForcesOn(const ForceState<T>&, std::span<const std::uint32_t>) {}
+};
+
+/**
+ * Harmonic springs over a bond list: F_i = k (|r_ij| - r0) r_ij / |r_ij| for
+ * every bond (i, j, k, r0), r_ij = x_j - x_i. The bonds are kept per particle
+ * (CSR, each bond under both ends), so particles are processed in parallel
+ * without write conflicts.
+ */
+template <std::floating_point T>
+class HarmonicSprings {
+ public:
+  struct Bond {
+    std::uint32_t i, j;
+    T k, r0;
+  };
+
+ private:
+  struct HalfBond {
+    std::uint32_t other;
+    T k, r0;
+  };
+  // bonds of particle i: half_[offset_[i], offset_[i + 1])
+  std::vector<size_t> offset_{0};
+  std::vector<HalfBond> half_{};
+
+ public:
+  static constexpr bool kPairForces{true};
+  static constexpr bool kPotential{true};
+
+  HarmonicSprings() = default;
+
+  /**
+   * @brief Replaces the bond list; n is the number of particles.
+   * @throws std::out_of_range for a bond with an end >= n or both ends the
+   * same particle, leaving the bonds as they were
+   */
+  void SetBonds(const std::vector<Bond>& bonds, const size_t n) {
+    for (const Bond& b : bonds)
+      if (b.i >= n || b.j >= n || b.i == b.j)
+        throw std::out_of_range("HarmonicSprings: bond (" +
+                                std::to_string(b.i) + ", " +
+                                std::to_string(b.j) + ") of " +
+                                std::to_string(n) + " particles");
+    offset_.assign(n + 1, 0);
+    for (const Bond& b : bonds) {
+      ++offset_[b.i + 1];
+      ++offset_[b.j + 1];
+    }
+    for (size_t i = 0; i < n; ++i) offset_[i + 1] += offset_[i];
+    half_.resize(offset_[n]);
+    std::vector<size_t> cursor(offset_.begin(), offset_.end() - 1);
+    for (const Bond& b : bonds) {
+      half_[cursor[b.i]++] = {b.j, b.k, b.r0};
+      half_[cursor[b.j]++] = {b.i, b.k, b.r0};
+    }
+  }
+  size_t NumBonds() const noexcept { return half_.size() / 2; }
+
+  // Moves the bonds of every particle to its new index
+  void Reorder(const std::span<const std::uint32_t> order) {
+    const size_t n{offset_.size() - 1};
+    std::vector<std::uint32_t> new_index(order.size());
+    for (size_t k = 0; k < order.size(); ++k)
+      new_index[order[k]] = std::uint32_t(k);
+    std::vector<size_t> offset(order.size() + 1, 0);
+    for (size_t k = 0; k < order.size(); ++k) {
+      const size_t old{order[k]};
+      const size_t bonds{old < n ? offset_[old + 1] - offset_[old] : 0};
+      offset[k + 1] = offset[k] + bonds;
+    }
+    std::vector<HalfBond> half(offset.back());
+    for (size_t k = 0; k < order.size(); ++k) {
+      if (order[k] >= n) continue;
+      size_t to{offset[k]};
+      for (size_t b = offset_[order[k]]; b < offset_[order[k] + 1]; ++b)
+        half[to++] = {new_index[half_[b].other], half_[b].k, half_[b].r0};
+    }
+    offset_ = std::move(offset);
+    half_ = std::move(half);
+  }
+
+  void AddForces(const ForceState<T>& s) {
+    AddForcesOf(std::min(s.n, offset_.size() - 1), s,
+                [](const size_t k) { return k; });
+  }
+
+  void AddForcesOn(const ForceState<T>& s,
+                   const std::span<const std::uint32_t> active) {
+    AddForcesOf(active.size(), s,
+                [&](const size_t k) -> size_t { return active[k]; });
+  }
+
+ private:
+  // Forces on the particles particle(k), k < count; with s.potential also
+  // half the energy of their bonds
+  template <class Particle>
+  void AddForcesOf(const size_t count, const ForceState<T>& s,
+                   const Particle& particle) const {
+    auto bonded = [&](const size_t i) { return i + 1 < offset_.size(); };
+    if (!s.potential) {
+      ParallelFor(count, [&](const size_t begin, const size_t end) {
+        for (size_t k = begin; k < end; ++k)
+          if (bonded(particle(k))) AddForce(s, particle(k));
+      });
+      return;
+    }
+    const CompensatedSum sum{ParallelReduce(
+        count, CompensatedSum{},
+        [&](const size_t begin, const size_t end) {
+          CompensatedSum e;
+          for (size_t k = begin; k < end; ++k)
+            if (bonded(particle(k))) e.Add(AddForce(s, particle(k)));
+          return e;
+        },
+        [](CompensatedSum& total, const CompensatedSum& e) { total.Add(e); })};
+    *s.potential += sum.Value() / 2;
+  }
+
+  // Adds the force on i; returns the energy of its bonds, k (r - r0)² / 2
+  double AddForce(const ForceState<T>& s, const size_t i) const {
+    T fx{0}, fy{0}, fz{0};
+    double energy{0};
+    for (size_t b = offset_[i]; b < offset_[i + 1]; ++b) {
+      const HalfBond& hb{half_[b]};
+      const T rx{s.x[hb.other] - s.x[i]};
+      const T ry{s.y[hb.other] - s.y[i]};
+      const T rz{s.z[hb.other] - s.z[i]};
+      using std::sqrt;
+      const T r{sqrt(rx * rx + ry * ry + rz * rz)};
+      if (r == T(0)) continue;
+      const T f{hb.k * (r - hb.r0) / r};
+      fx += f * rx;
+      fy += f * ry;
+      fz += f * rz;
+      energy += double(hb.k) * double(r - hb.r0) * double(r - hb.r0) / 2;
+    }
+    s.Fx[i] += fx;
+    s.Fy[i] += fy;
+    s.Fz[i] += fz;
+    return energy;
+  }
+};
+
+/**
+ * Lennard-Jones with a cutoff:
+ * U(r) = 4 epsilon ((sigma / r)^12 - (sigma / r)^6) up to r = cutoff, 0 beyond.
+ * Pairs come from Verlet lists of radius cutoff + skin, rebuilt through a
+ * cell list only once some particle has moved by skin / 2, so the cost is
+ * linear in n at a fixed density. When the cutoff spans the system (fewer than
+ * 27 cells) AddForces() runs all pairs through DirectSum's tile schedule
+ * instead, which evaluates every pair once rather than from both ends;
+ * AddForcesOn() then takes the pairs of the active particles from the cell
+ * list. The potential energy is summed in a pass of its own over the same
+ * pairs, only when it is asked for.
+ */
+template <std::floating_point T>
+class LennardJones {
+  T epsilon_;
+  T sigma2_;
+  T cutoff_;
+  T cutoff2_;
+  CellList<T> cells_{};
+  VerletList<T> verlet_;
+  // the cutoff spans the system, the lists are not used
+  bool all_pairs_{false};
+  DirectSum<T> direct_{};
+
+ public:
+  static constexpr bool kPairForces{true};
+  static constexpr bool kPotential{true};
+
+  explicit LennardJones(const T epsilon = T(1), const T sigma = T(1),
+                        const T cutoff = T(2.5), const T skin = T(0.3))
+      : epsilon_{epsilon},
+        sigma2_{sigma * sigma},
+        cutoff_{cutoff},
+        cutoff2_{cutoff * cutoff},
+        verlet_{skin} {}
+
+  void SetParameters(const T epsilon, const T sigma, const T cutoff) {
+    epsilon_ = epsilon;
+    sigma2_ = sigma * sigma;
+    cutoff_ = cutoff;
+    cutoff2_ = cutoff * cutoff;
+    verlet_.Invalidate();
+  }
+  // A larger skin rebuilds less often but lists more pairs
+  void SetSkin(const T skin) { verlet_.SetSkin(skin); }
+
+  /**
+   * F_i = f r_ij with f = U'(r) / r
+   *     = 24 epsilon / r² ((sigma² / r²)^3 - 2 (sigma² / r²)^6)
+   */
+  T PairFactor(const T r2) const noexcept {
+    return Factor(r2, epsilon_, sigma2_, cutoff2_);
+  }
+
+  const VerletList<T>& Neighbours() const noexcept { return verlet_; }
+  // The lists index particles: rebuild them at the next evaluation
+  void Reorder(std::span<const std::uint32_t>) noexcept {
+    verlet_.Invalidate();
+  }
+
+  void AddForces(const ForceState<T>& s) {
+    UpdateNeighbours(s);
+    if (all_pairs_)
+      direct_.AddPairForces(s.x, s.y, s.z, s.n, s.Fx, s.Fy, s.Fz, Pair());
+    else
+      verlet_.AddPairForces(s.x, s.y, s.z, s.Fx, s.Fy, s.Fz, Pair());
+    if (s.potential)
+      AddPotentialOf(s.n, s, [](const size_t k) { return k; });
+  }
+
+  void AddForcesOn(const ForceState<T>& s,
+                   const std::span<const std::uint32_t> active) {
+    UpdateNeighbours(s);
+    if (all_pairs_)
+      cells_.AddPairForcesOn(active, s.Fx, s.Fy, s.Fz, Pair());
+    else
+      verlet_.AddPairForcesOn(active, s.x, s.y, s.z, s.Fx, s.Fy, s.Fz,
+                              Pair());
+    if (s.potential)
+      AddPotentialOf(active.size(), s,
+                     [&](const size_t k) -> size_t { return active[k]; });
+  }
+
+ private:
+  // Rebuilds the lists once they went stale. In the all pairs case the cell
+  // list is rebuilt at every evaluation instead, which also notices when the
+  // system has spread out.
+  void UpdateNeighbours(const ForceState<T>& s) {
+    if (!all_pairs_ && !verlet_.NeedsRebuild(s.x, s.y, s.z, s.n)) return;
+    cells_.Build(s.x, s.y, s.z, s.n, cutoff_ + verlet_.Skin());
+    all_pairs_ = cells_.NumCells() < 27;
+    if (!all_pairs_) verlet_.Build(cells_, s.x, s.y, s.z, s.n, cutoff_);
+  }
+
+  // Adds half the energy of the particles particle(k), k < count, with their
+  // neighbours within the cutoff to s.potential. Both the Verlet and the cell
+  // list hold every pair under both ends.
+  template <class Particle>
+  void AddPotentialOf(const size_t count, const ForceState<T>& s,
+                      const Particle& particle) const {
+    auto energy = [this](const T r2) {
+      if (!(r2 < cutoff2_)) return 0.;
+      const double s6{std::pow(double(sigma2_) / double(r2), 3)};
+      return 4 * double(epsilon_) * (s6 * s6 - s6);
+    };
+    const CompensatedSum sum{ParallelReduce(
+        count, CompensatedSum{},
+        [&](const size_t begin, const size_t end) {
+          CompensatedSum e;
+          for (size_t k = begin; k < end; ++k) {
+            const size_t i{particle(k)};
+            if (all_pairs_)
+              cells_.ForEachCandidate(
+                  typename CellList<T>::Index(i),
+                  [&](const auto, const T r2) { e.Add(energy(r2)); });
+            else
+              verlet_.ForEachNeighbour(i, [&](const size_t j) {
+                const T rx{s.x[j] - s.x[i]};
+                const T ry{s.y[j] - s.y[i]};
+                const T rz{s.z[j] - s.z[i]};
+                e.Add(energy(rx * rx + ry * ry + rz * rz));
+              });
+          }
+          return e;
+        },
+        [](CompensatedSum& total, const CompensatedSum& e) { total.Add(e); })};
+    *s.potential += sum.Value() / 2;
+  }
+
+  // parameters by value, so that the pair loops keep them in registers
+  auto Pair() const noexcept {
+    return [e = epsilon_, s2 = sigma2_, c2 = cutoff2_](const T r2, size_t,
+                                                       size_t) {
+      return Factor(r2, e, s2, c2);
+    };
+  }
+
+  static T Factor(const T r2, const T epsilon, const T sigma2,
+                  const T cutoff2) noexcept {
+    const T inv_r2{T(1) / r2};
+    const T s6{sigma2 * sigma2 * sigma2 * inv_r2 * inv_r2 * inv_r2};
+    // 1 inside the cutoff, 0 beyond. gcc does not vectorise a floating point
+    // comparison under the default -ftrapping-math, copysign is bit logic.
+    using std::copysign;
+    const T inside{T(0.5) + copysign(T(0.5), cutoff2 - r2)};
+    return inside * 24 * epsilon * inv_r2 * (s6 - 2 * s6 * s6);
+  }
+};
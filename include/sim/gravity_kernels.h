@@ -0,0 +1,57 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+
+#include "sim/types.hpp"
+
+/**
+ * Hand-vectorised gravity tile kernels with runtime instruction set dispatch.
+ *
+ * Each instruction set lives in its own translation unit compiled with the
+ * matching -m flags, so the library itself is built for the baseline x86-64
+ * and the best kernel the CPU supports is picked the first time it is asked
+ * for.
+ */
+enum class SimdIsa { kScalar, kSse42, kAvx2, kAvx512 };
+
+/**
+ * A tile is the interaction of an i-block with a j-block of particles.
+ * For every pair the kernel does
+ *   f_i += Gm_i m_j r_ij / (|r_ij|² + eps2)^(3/2),   f_j -= the same,
+ * over all j of the j-block, or only j > i when diagonal (the i- and j-block
+ * are the same block and fxi/fxj may alias). When potential is set, the
+ * potential energy of those pairs, -sum Gm_i m_j / (|r_ij|² + eps2)^(1/2),
+ * is added to it.
+ */
+template <std::floating_point T>
+struct TileArgs {
+  const T *xi, *yi, *zi, *Gmi;
+  size_t ni;
+  const T *xj, *yj, *zj, *mj;
+  size_t nj;
+  T *fxi, *fyi, *fzi;
+  T *fxj, *fyj, *fzj;
+  T eps2;
+  bool diagonal;
+  double* potential{nullptr};
+};
+
+template <std::floating_point T>
+using TileKernel = void (*)(const TileArgs<T>&);
+
+// Best instruction set supported by this CPU and build
+SimdIsa DetectSimdIsa() noexcept;
+
+// Instruction set of the kernels returned by GetTileKernel(); defaults to
+// DetectSimdIsa(). Setting an unsupported one falls back to the detected one.
+SimdIsa ActiveSimdIsa() noexcept;
+void SetSimdIsa(SimdIsa isa) noexcept;
+
+const char* SimdIsaName(SimdIsa isa) noexcept;
+
+// Kernel of the active instruction set. ForcePrecision::kMixed selects the
+// float-pair/double-sum kernel for T = double and is ignored for float.
+template <std::floating_point T>
+TileKernel<T> GetTileKernel(
+    ForcePrecision precision = ForcePrecision::kNative) noexcept;
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/rng.h"
+
+/**
+ * Initial conditions of self-gravitating systems in virial equilibrium, in
+ * units of G = 1 (constants.hpp).
+ *
+ * A generator fills the arrays of n particles: equal masses adding up to
+ * `mass`, with the centre of mass at rest at the origin. Particle i draws
+ * its random numbers only from Philox counters of its own (utils/philox.h),
+ * so the particles are generated in parallel and the result depends on the
+ * seed, the stream and n only, not on the number of threads.
+ *
+ * Particles<T> takes a generator in its constructor, e.g.
+ *   Particles<double> p(n, d_t, Plummer{.scale = 1, .seed = 7});
+ */
+
+// Arrays a generator fills, n elements each
+template <std::floating_point T>
+struct ParticleArrays {
+  size_t n;
+  T *x, *y, *z;
+  T *vx, *vy, *vz;
+  T* m;
+};
+
+/**
+ * Plummer sphere, density ∝ (1 + r²/a²)^(-5/2) with a = scale. Velocities
+ * from its isotropic distribution function (Aarseth, Hénon & Wielen 1974).
+ * The radii are cut at 99.9% of the mass, about 39 a.
+ */
+struct Plummer {
+  double scale{1};
+  double mass{1};
+  std::uint64_t seed{RNG<double>::kDefaultSeed};
+  std::uint32_t stream{0};
+
+  template <std::floating_point T>
+  void operator()(const ParticleArrays<T>& p) const;
+};
+
+/**
+ * Hernquist (1990) sphere, density ∝ 1 / (r (r + a)³) with a = scale: the
+ * cusp of a galaxy or dark halo. Velocities are Gaussian with the isotropic
+ * Jeans dispersion at each radius, below the escape speed. The radii are
+ * cut at 99% of the mass, about 200 a.
+ */
+struct Hernquist {
+  double scale{1};
+  double mass{1};
+  std::uint64_t seed{RNG<double>::kDefaultSeed};
+  std::uint32_t stream{0};
+
+  template <std::floating_point T>
+  void operator()(const ParticleArrays<T>& p) const;
+};
+
+/**
+ * Homogeneous ball of the given radius, with isotropic Gaussian velocities
+ * of dispersion sqrt(M / (5 R)), which gives 2 K = |W|.
+ */
+struct UniformSphere {
+  double radius{1};
+  double mass{1};
+  std::uint64_t seed{RNG<double>::kDefaultSeed};
+  std::uint32_t stream{0};
+
+  template <std::floating_point T>
+  void operator()(const ParticleArrays<T>& p) const;
+};
+
+/**
+ * Exponential disk in the xy plane, surface density ∝ exp(-R / scale_length)
+ * cut at 10 scale lengths, with vertical profile sech²(z / scale_height).
+ * It rotates counterclockwise about z at the circular speed of the mass
+ * inside R (taken as spherical, softened by the scale height), with a
+ * Gaussian dispersion of `dispersion` times that speed in every direction.
+ */
+struct ExponentialDisk {
+  double scale_length{1};
+  double scale_height{0.1};
+  double dispersion{0.1};
+  double mass{1};
+  std::uint64_t seed{RNG<double>::kDefaultSeed};
+  std::uint32_t stream{0};
+
+  template <std::floating_point T>
+  void operator()(const ParticleArrays<T>& p) const;
+};
+
+/**
+ * `clusters` Plummer spheres of equal mass and the given scale, at the
+ * corners of a regular polygon in the xy plane of circumradius
+ * separation / 2, each in equilibrium on its own. They move counterclockwise
+ * at `orbit` times the speed of a circular orbit of the polygon, so they fall
+ * together and merge for orbit < 1. The particles are split as evenly as
+ * possible, in cluster order.
+ */
+struct PlummerMerger {
+  size_t clusters{2};
+  double separation{10};
+  double scale{1};
+  double orbit{0.5};
+  double mass{1};
+  std::uint64_t seed{RNG<double>::kDefaultSeed};
+  std::uint32_t stream{0};
+
+  template <std::floating_point T>
+  void operator()(const ParticleArrays<T>& p) const;
+};
+
+// An initial-condition generator of the particles of type T
+template <class Generator, class T>
+concept InitialConditions =
+    std::floating_point<T> &&
+    std::invocable<const Generator&, const ParticleArrays<T>&>;
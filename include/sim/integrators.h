@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+
+#include "utils/parallel.h"
+#include "utils/trace.h"
+
+/**
+ * Time integrators of the Struct of Arrays particle sets, as policy classes:
+ * the template parameter Integrator of Particles and ParticlesRawPointer.
+ *
+ * A policy provides
+ *   kScratchFields: number of extra arrays of n elements it needs,
+ *   Step(state, dt, forces_current, forces): advances state by dt, calling
+ *     forces() whenever it needs the inter-particle forces of the current
+ *     positions in state.Fx/Fy/Fz.
+ * forces_current tells whether Fx/Fy/Fz already belong to the current
+ * positions; the kick-drift-kick schemes end with a force evaluation and
+ * reuse it for the first kick of the next step.
+ *
+ * External and global forces are added to the inter-particle forces where a
+ * policy needs the acceleration and are constant during a step.
+ */
+
+/**
+ * Raw view of a particle set for one Step(). All arrays have n elements;
+ * ex/ey/ez are never null (zeros when no external force is given).
+ */
+template <std::floating_point T>
+struct SoaState {
+  size_t n;
+  T *x, *y, *z;
+  T *vx, *vy, *vz;
+  const T* m;
+  // inter-particle forces, written by forces()
+  const T *Fx, *Fy, *Fz;
+  const T *ex, *ey, *ez;
+  T gx, gy, gz;
+  // kScratchFields arrays: field k starts at scratch + k * stride
+  T* scratch;
+  size_t stride;
+  // Layout of x, v, m and F: plain arrays when width is 0, else blocks of
+  // width elements, one every pitch elements (utils/aosoa.h); width must
+  // divide the ParallelFor chunk. ex/ey/ez and the scratch are always plain.
+  size_t width{0};
+  size_t pitch{0};
+
+  /**
+   * @brief Calls f(offset, begin, count) on the runs of [begin, end) that
+   * are contiguous in the layout: count particles from begin, at offset in
+   * the particle arrays and at begin in the plain ones.
+   */
+  template <class F>
+  void Runs(const size_t begin, const size_t end, F&& f) const {
+    if (width == 0) {
+      f(begin, begin, end - begin);
+      return;
+    }
+    for (size_t i = begin; i < end; i += width - i % width)
+      f(i / width * pitch + i % width, i,
+        std::min(end, i + width - i % width) - i);
+  }
+};
+
+/**
+ * Element-wise sweeps shared by the policies. Each runs a ParallelFor over
+ * a static loop whose written arrays are restrict, so that it vectorises.
+ * Acceleration: a = (F + F_ext + F_global) / m.
+ */
+template <std::floating_point T>
+class SoaSweeps {
+ public:
+  // v += a h
+  static void Kick(const SoaState<T>& s, const T h) {
+    TRACE_ZONE("SoaSweeps::Kick");
+    ParallelFor(s.n, [&](const size_t b, const size_t e) {
+      s.Runs(b, e, [&](const size_t o, const size_t i, const size_t count) {
+        KickLoop(count, s.Fx + o, s.Fy + o, s.Fz + o, s.ex + i, s.ey + i,
+                 s.ez + i, s.gx, s.gy, s.gz, s.m + o, h, s.vx + o, s.vy + o,
+                 s.vz + o);
+      });
+    });
+  }
+
+  // x += v h
+  static void Drift(const SoaState<T>& s, const T h) {
+    TRACE_ZONE("SoaSweeps::Drift");
+    ParallelFor(s.n, [&](const size_t b, const size_t e) {
+      s.Runs(b, e, [&](const size_t o, size_t, const size_t count) {
+        DriftLoop(count, s.vx + o, s.vy + o, s.vz + o, h, s.x + o, s.y + o,
+                  s.z + o);
+      });
+    });
+  }
+
+  // v += a h, then x += v h, in one pass
+  static void KickDrift(const SoaState<T>& s, const T h) {
+    TRACE_ZONE("SoaSweeps::KickDrift");
+    ParallelFor(s.n, [&](const size_t b, const size_t e) {
+      s.Runs(b, e, [&](const size_t o, const size_t i, const size_t count) {
+        KickLoop(count, s.Fx + o, s.Fy + o, s.Fz + o, s.ex + i, s.ey + i,
+                 s.ez + i, s.gx, s.gy, s.gz, s.m + o, h, s.vx + o, s.vy + o,
+                 s.vz + o);
+        DriftLoop(count, s.vx + o, s.vy + o, s.vz + o, h, s.x + o, s.y + o,
+                  s.z + o);
+      });
+    });
+  }
+
+ private:
+  static void KickLoop(const size_t count, const T* Fx, const T* Fy,
+                       const T* Fz, const T* ex, const T* ey, const T* ez,
+                       const T gx, const T gy, const T gz, const T* m,
+                       const T h, T* __restrict vx, T* __restrict vy,
+                       T* __restrict vz) {
+    for (size_t i = 0; i < count; ++i) {
+      const T h_m{h / m[i]};
+      vx[i] += (Fx[i] + ex[i] + gx) * h_m;
+      vy[i] += (Fy[i] + ey[i] + gy) * h_m;
+      vz[i] += (Fz[i] + ez[i] + gz) * h_m;
+    }
+  }
+
+  static void DriftLoop(const size_t count, const T* vx, const T* vy,
+                        const T* vz, const T h, T* __restrict x,
+                        T* __restrict y, T* __restrict z) {
+    for (size_t i = 0; i < count; ++i) {
+      x[i] += vx[i] * h;
+      y[i] += vy[i] * h;
+      z[i] += vz[i] * h;
+    }
+  }
+};
+
+/**
+ * Semi-implicit (symplectic) Euler: v += a dt, x += v dt. First order, one
+ * force evaluation per step.
+ */
+struct SemiImplicitEuler {
+  static constexpr size_t kScratchFields{0};
+
+  template <std::floating_point T, class Forces>
+  static void Step(const SoaState<T>& s, const T dt, bool& forces_current,
+                   Forces&& forces) {
+    if (!forces_current) forces();
+    SoaSweeps<T>::KickDrift(s, dt);
+    forces_current = false;
+  }
+};
+
+/**
+ * Kick-drift-kick leapfrog: v += a dt/2, x += v dt, a = a(x), v += a dt/2.
+ * Second order and symplectic; the closing force evaluation is reused by the
+ * next step, so it costs one evaluation per step like Euler.
+ */
+struct LeapfrogKDK {
+  static constexpr size_t kScratchFields{0};
+
+  template <std::floating_point T, class Forces>
+  static void Step(const SoaState<T>& s, const T dt, bool& forces_current,
+                   Forces&& forces) {
+    if (!forces_current) forces();
+    SoaSweeps<T>::Kick(s, dt / 2);
+    SoaSweeps<T>::Drift(s, dt);
+    forces();
+    SoaSweeps<T>::Kick(s, dt / 2);
+    forces_current = true;
+  }
+};
+
+// Velocity Verlet is algebraically the kick-drift-kick leapfrog
+using VelocityVerlet = LeapfrogKDK;
+
+/**
+ * Yoshida's fourth order symplectic scheme: three leapfrog steps of
+ * w1 dt, w0 dt, w1 dt with w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 w1. The kicks
+ * between the substeps merge, so it costs three force evaluations per step.
+ */
+struct Yoshida4 {
+  static constexpr size_t kScratchFields{0};
+
+  template <std::floating_point T, class Forces>
+  static void Step(const SoaState<T>& s, const T dt, bool& forces_current,
+                   Forces&& forces) {
+    const T w1{T(1) / (T(2) - std::cbrt(T(2)))};
+    const T w0{T(1) - 2 * w1};
+    if (!forces_current) forces();
+    SoaSweeps<T>::Kick(s, w1 / 2 * dt);
+    SoaSweeps<T>::Drift(s, w1 * dt);
+    forces();
+    SoaSweeps<T>::Kick(s, (w1 + w0) / 2 * dt);
+    SoaSweeps<T>::Drift(s, w0 * dt);
+    forces();
+    SoaSweeps<T>::Kick(s, (w0 + w1) / 2 * dt);
+    SoaSweeps<T>::Drift(s, w1 * dt);
+    forces();
+    SoaSweeps<T>::Kick(s, w1 / 2 * dt);
+    forces_current = true;
+  }
+};
+
+/**
+ * Classical fourth order Runge-Kutta on (x, v). Not symplectic, so the
+ * energy drifts over long runs, but very accurate per step. Four force
+ * evaluations per step; the scratch holds x0, v0 and the weighted sums of the
+ * stage derivatives.
+ */
+struct RungeKutta4 {
+  // x0, y0, z0, vx0, vy0, vz0, then the sums of k_x and k_v
+  static constexpr size_t kScratchFields{12};
+
+  template <std::floating_point T, class Forces>
+  static void Step(const SoaState<T>& s, const T dt, bool& forces_current,
+                   Forces&& forces) {
+    if (!forces_current) forces();
+    // k1 at (x0, v0); the stage sets (x, v) = (x0, v0) + h k and adds w k to
+    // the sums
+    Stage(s, dt / 2, T(1), true);
+    forces();
+    Stage(s, dt / 2, T(2), false);
+    forces();
+    Stage(s, dt, T(2), false);
+    forces();
+    Stage(s, dt / 6, T(1), false, true);
+    forces_current = false;
+  }
+
+ private:
+  template <std::floating_point T>
+  static void Stage(const SoaState<T>& s, const T h, const T w,
+                    const bool first, const bool last = false) {
+    T* const f{s.scratch};
+    const size_t st{s.stride};
+    ParallelFor(s.n, [&](const size_t b, const size_t e) {
+      s.Runs(b, e, [&](const size_t o, const size_t i, const size_t count) {
+        T* const fi{f + i};
+        if (first) {
+          // x0, v0 = x, v; sums = 0
+          const T* const state[]{s.x, s.y, s.z, s.vx, s.vy, s.vz};
+          for (size_t k = 0; k < 6; ++k)
+            std::copy_n(state[k] + o, count, fi + k * st);
+          for (size_t k = 6; k < kScratchFields; ++k)
+            std::fill_n(fi + k * st, count, T(0));
+        }
+        StageLoop(count, s.Fx + o, s.ex + i, s.gx, s.m + o, h, w, last, fi,
+                  fi + 3 * st, fi + 6 * st, fi + 9 * st, s.x + o, s.vx + o);
+        StageLoop(count, s.Fy + o, s.ey + i, s.gy, s.m + o, h, w, last,
+                  fi + st, fi + 4 * st, fi + 7 * st, fi + 10 * st, s.y + o,
+                  s.vy + o);
+        StageLoop(count, s.Fz + o, s.ez + i, s.gz, s.m + o, h, w, last,
+                  fi + 2 * st, fi + 5 * st, fi + 8 * st, fi + 11 * st,
+                  s.z + o, s.vz + o);
+      });
+    });
+  }
+
+  // One component. k = (v, a) at the current (x, v):
+  //   not last: sums += w k, (x, v) = (x0, v0) + h k
+  //   last:     (x, v) = (x0, v0) + h (sums + w k)
+  template <std::floating_point T>
+  static void StageLoop(const size_t count, const T* F, const T* ext,
+                        const T g, const T* m, const T h, const T w,
+                        const bool last, const T* x0, const T* v0,
+                        T* __restrict kx, T* __restrict kv, T* __restrict x,
+                        T* __restrict v) {
+    for (size_t i = 0; i < count; ++i) {
+      const T a{(F[i] + ext[i] + g) / m[i]};
+      const T sx{kx[i] + w * v[i]};
+      const T sv{kv[i] + w * a};
+      if (last) {
+        x[i] = x0[i] + h * sx;
+        v[i] = v0[i] + h * sv;
+      } else {
+        kx[i] = sx;
+        kv[i] = sv;
+        x[i] = x0[i] + h * v[i];
+        v[i] = v0[i] + h * a;
+      }
+    }
+  }
+};
@@ -2,59 +2,201 @@
 #include <cassert>
 #include <cmath>
 #include <concepts>
+#include <cstddef>
+#include <functional>
 #include <limits>
 #include <ostream>
+#include <span>
+#include <type_traits>
 
 #include "types.hpp"
 
-// TODO Add checks for validity of x, y, z (e.g. if NaN)
-template <template <typename> class Child, std::floating_point T = double>
-struct Tuple {
+/**
+ * Point and Vector in 3D. Both are plain x, y, z: standard layout and
+ * trivially copyable, without a vtable, so an array of them is 3 n
+ * consecutive scalars that memcpy and vectorise.
+ *
+ * Arithmetic on vectors builds expression templates that are evaluated
+ * component by component when assigned, e.g. v += dt * (a + b) / m is one
+ * pass without intermediate vectors. Expressions hold their operands by
+ * value (three scalars each at most), so an expression kept in an auto
+ * variable never dangles. Points move by vector expressions, and the
+ * difference of two points is a vector.
+ */
+
+// A vector-valued expression: component I is Get<I>()
+template <class E>
+concept VectorExpression = requires(const E& e) {
+  typename E::value_type;
+  requires E::kVectorExpression;
+  { e.template Get<0>() } -> std::convertible_to<typename E::value_type>;
+};
+
+// Scalars that scale an expression
+template <class K>
+concept VectorScalar = std::is_arithmetic_v<K>;
+
+template <std::floating_point T>
+struct Vector;
+
+// What an expression offers besides its components, through its value
+template <class E>
+struct VectorExpressionBase {
+  static constexpr bool kVectorExpression{true};
+
+  constexpr auto Eval() const noexcept {
+    return Vector<typename E::value_type>{static_cast<const E&>(*this)};
+  }
+  template <class... A>
+  constexpr bool IsAlmostEqual(const A&... a) const noexcept {
+    return Eval().IsAlmostEqual(a...);
+  }
+  constexpr auto Norm() const noexcept { return Eval().Norm(); }
+  constexpr auto Norm2() const noexcept { return Eval().Norm2(); }
+};
+
+template <VectorExpression L, VectorExpression R, class Op>
+struct VectorBinary : VectorExpressionBase<VectorBinary<L, R, Op>> {
+  using value_type = std::common_type_t<typename L::value_type,
+                                        typename R::value_type>;
+  L l;
+  R r;
+  template <size_t I>
+  constexpr value_type Get() const noexcept {
+    return Op{}(l.template Get<I>(), r.template Get<I>());
+  }
+};
+
+// e op k, component by component
+template <VectorExpression E, class K, class Op>
+struct VectorScaled : VectorExpressionBase<VectorScaled<E, K, Op>> {
+  using value_type = decltype(Op{}(typename E::value_type{}, K{}));
+  E e;
+  K k;
+  template <size_t I>
+  constexpr value_type Get() const noexcept {
+    return Op{}(e.template Get<I>(), k);
+  }
+};
+
+template <VectorExpression E>
+struct VectorNegated : VectorExpressionBase<VectorNegated<E>> {
+  using value_type = typename E::value_type;
+  E e;
+  template <size_t I>
+  constexpr value_type Get() const noexcept {
+    return -e.template Get<I>();
+  }
+};
+
+template <VectorExpression L, VectorExpression R>
+constexpr auto operator+(const L& l, const R& r) noexcept {
+  return VectorBinary<L, R, std::plus<>>{{}, l, r};
+}
+template <VectorExpression L, VectorExpression R>
+constexpr auto operator-(const L& l, const R& r) noexcept {
+  return VectorBinary<L, R, std::minus<>>{{}, l, r};
+}
+template <VectorExpression E>
+constexpr auto operator-(const E& e) noexcept {
+  return VectorNegated<E>{{}, e};
+}
+template <VectorExpression E, VectorScalar K>
+constexpr auto operator*(const E& e, const K k) noexcept {
+  return VectorScaled<E, K, std::multiplies<>>{{}, e, k};
+}
+template <VectorExpression E, VectorScalar K>
+constexpr auto operator*(const K k, const E& e) noexcept {
+  return VectorScaled<E, K, std::multiplies<>>{{}, e, k};
+}
+template <VectorExpression E, VectorScalar K>
+constexpr auto operator/(const E& e, const K k) noexcept {
+  return VectorScaled<E, K, std::divides<>>{{}, e, k};
+}
+
+template <VectorExpression L, VectorExpression R>
+constexpr auto Dot(const L& l, const R& r) noexcept {
+  return l.template Get<0>() * r.template Get<0>() +
+         l.template Get<1>() * r.template Get<1>() +
+         l.template Get<2>() * r.template Get<2>();
+}
+
+template <std::floating_point T = float>
+struct Vector {
+  using value_type = T;
+  static constexpr bool kVectorExpression{true};
+
   T x{}, y{}, z{};
 
-  Tuple() = default;
-  Tuple(const T& x, const T& y, const T& z) : x{x}, y{y}, z{z} {}
-  virtual ~Tuple() = default;
+  constexpr Vector() = default;
+  constexpr Vector(const T x, const T y, const T z) noexcept
+      : x{x}, y{y}, z{z} {}
+  // Evaluates an expression; explicit between precisions
+  template <VectorExpression E>
+  constexpr explicit(!std::is_same_v<typename E::value_type, T>)
+      Vector(const E& e) noexcept
+      : x(T(e.template Get<0>())),
+        y(T(e.template Get<1>())),
+        z(T(e.template Get<2>())) {}
+
+  template <size_t I>
+  constexpr T Get() const noexcept {
+    static_assert(I < 3);
+    if constexpr (I == 0)
+      return x;
+    else if constexpr (I == 1)
+      return y;
+    else
+      return z;
+  }
 
-  bool operator==(const Child<T>&) const = delete;
+  bool operator==(const Vector&) const = delete;
 
-  // So we can compare Child<float> and Child<double> e.g.
-  template <typename TT>
-  bool IsAlmostEqual(
-      const Child<TT>& rhs,
+  // So we can compare Vector<float> and Vector<double>, or expressions
+  template <VectorExpression E>
+  constexpr bool IsAlmostEqual(
+      const E& rhs,
       T epsilon = std::numeric_limits<T>::epsilon()) const noexcept {
     using std::abs;
-    return abs(x - rhs.x) < epsilon && abs(y - rhs.y) < epsilon &&
-           abs(z - rhs.z) < epsilon;
+    return abs(x - rhs.template Get<0>()) < epsilon &&
+           abs(y - rhs.template Get<1>()) < epsilon &&
+           abs(z - rhs.template Get<2>()) < epsilon;
   }
 
-  bool operator!=(const Child<T>& q) { return !IsAlmostEqual(q); }
+  constexpr Vector Eval() const noexcept { return *this; }
 
-  // So that we can have Children of different types(Point/Vector)
-  template <typename TT>
-  inline Child<T>& operator+=(const Child<TT>& ch) {
-    x += ch.x;
-    y += ch.y;
-    z += ch.z;
-    return static_cast<Child<T>&>(*this);
+  bool operator!=(const Vector& q) const { return !IsAlmostEqual(q); }
+
+  template <VectorExpression E>
+  constexpr Vector& operator+=(const E& e) noexcept {
+    x += e.template Get<0>();
+    y += e.template Get<1>();
+    z += e.template Get<2>();
+    return *this;
   }
 
-  template <typename K>
-  auto operator*(K k) const -> Child<decltype(T{} * K{})> {
-    return {k * x, k * y, k * z};
+  template <VectorExpression E>
+  constexpr Vector& operator-=(const E& e) noexcept {
+    x -= e.template Get<0>();
+    y -= e.template Get<1>();
+    z -= e.template Get<2>();
+    return *this;
   }
 
-  template <typename K>
-  inline Child<T>& operator*=(const K k) {
+  template <VectorScalar K>
+  constexpr Vector& operator*=(const K k) noexcept {
     x *= k;
     y *= k;
     z *= k;
-    return static_cast<Child<T>&>(*this);
+    return *this;
   }
 
-  template <typename K>
-  auto operator/(K k) const -> Child<decltype(T{} / K{})> {
-    return {x / k, y / k, z / k};
+  template <VectorScalar K>
+  constexpr Vector& operator/=(const K k) noexcept {
+    x /= k;
+    y /= k;
+    z /= k;
+    return *this;
   }
 
   inline T operator[](const size_t i) const noexcept {
@@ -71,154 +213,149 @@ struct Tuple {
     return z;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, const Child<T>& v) {
+  // L2 norm
+  constexpr T Norm() const noexcept {
+    using std::sqrt;
+    return sqrt(Norm2());
+  }
+
+  // (L2 norm)²
+  constexpr T Norm2() const noexcept { return x * x + y * y + z * z; }
+
+  friend std::ostream& operator<<(std::ostream& os, const Vector& v) {
     os << v.x << ", " << v.y << ", " << v.z;
     return os;
   }
 };
 
-template <template <class> class C, typename U, typename K>
-inline auto operator*(const K& k, const Tuple<C, U>& t) {
-  return t * k;
-}
+template <std::floating_point T = float>
+struct Point {
+  using value_type = T;
 
-template <template <class> class C, typename U, typename K>
-inline auto operator/(const K& k, const Tuple<C, U>& t) {
-  return t / k;
-}
+  T x{}, y{}, z{};
 
-template <std::floating_point T = float>
-struct Vector : public Tuple<Vector, T> {
-  using Tuple<Vector, T>::x;
-  using Tuple<Vector, T>::y;
-  using Tuple<Vector, T>::z;
+  constexpr Point() = default;
+  constexpr Point(const T x, const T y, const T z) noexcept
+      : x{x}, y{y}, z{z} {}
 
-  Vector() = default;
-  Vector(const T x, const T y, const T z) : Tuple<Vector, T>(x, y, z) {}
-  template <typename V>
-  explicit Vector(const Vector<V>& v)
-      : Tuple<Vector, T>(T(v.x), T(v.y), T(v.z)) {}
+  template <typename P>
+  constexpr explicit Point(const Point<P>& p) noexcept
+      : x{T(p.x)}, y{T(p.y)}, z{T(p.z)} {}
 
-  ~Vector() = default;
+  bool operator==(const Point&) const = delete;
 
-  template <typename U>
-  friend inline Vector<T> operator+(const Vector<T>& v, const Vector<U> u) {
-    return {v.x + u.x, v.y + u.y, v.z + u.z};
+  template <typename TT>
+  constexpr bool IsAlmostEqual(
+      const Point<TT>& rhs,
+      T epsilon = std::numeric_limits<T>::epsilon()) const noexcept {
+    using std::abs;
+    return abs(x - rhs.x) < epsilon && abs(y - rhs.y) < epsilon &&
+           abs(z - rhs.z) < epsilon;
   }
 
-  // L2 norm
-  inline constexpr T Norm() {
-    using std::sqrt;
-    return sqrt(x * x + y * y + z * z);
+  bool operator!=(const Point& q) const { return !IsAlmostEqual(q); }
+
+  template <VectorExpression E>
+  constexpr Point& operator+=(const E& e) noexcept {
+    x += e.template Get<0>();
+    y += e.template Get<1>();
+    z += e.template Get<2>();
+    return *this;
   }
 
-  // (L2 norm)²
-  inline constexpr T Norm2() { return (x * x + y * y + z * z); }
-};
+  template <VectorExpression E>
+  constexpr Point& operator-=(const E& e) noexcept {
+    x -= e.template Get<0>();
+    y -= e.template Get<1>();
+    z -= e.template Get<2>();
+    return *this;
+  }
 
-template <std::floating_point T = float>
-struct Point : public Tuple<Point, T> {
-  using Tuple<Point, T>::x;
-  using Tuple<Point, T>::y;
-  using Tuple<Point, T>::z;
+  template <VectorExpression E>
+  friend constexpr Point operator+(Point p, const E& e) noexcept {
+    return p += e;
+  }
 
-  Point() { x = y = z = 0; }
-  Point(const T x, const T y, const T z) : Tuple<Point, T>(x, y, z) {}
+  template <VectorExpression E>
+  friend constexpr Point operator-(Point p, const E& e) noexcept {
+    return p -= e;
+  }
 
-  template <typename P>
-  explicit Point(const Point<P>& p) : Tuple<Point, T>(T(p.x), T(p.y), T(p.z)) {}
+  friend constexpr Vector<T> operator-(const Point& e,
+                                       const Point& s) noexcept {
+    return {e.x - s.x, e.y - s.y, e.z - s.z};
+  }
 
-  template <typename V>
-  Point<T>& operator+=(const Vector<V>& v) {
-    x += v.x;
-    y += v.y;
-    z += v.z;
-    return *this;
+  inline T operator[](const size_t i) const noexcept {
+    assert(i < 3);
+    if (i == 0) return x;
+    if (i == 1) return y;
+    return z;
   }
 
-  template <typename U>
-  friend inline Point<T> operator+(const Point<T>& p, const Vector<U> u) {
-    return {p.x + u.x, p.y + u.y, p.z + u.z};
+  inline T& operator[](const size_t i) noexcept {
+    assert(i < 3);
+    if (i == 0) return x;
+    if (i == 1) return y;
+    return z;
   }
-  // template <typename U>
-  // friend inline Vector<U> operator-(const Point<T>& e, const Point<T> s) {
-  //   return Vector<U>(e.x - s.x, e.y - s.y, e.z - s.z);
-  // }
-  friend inline Vector<T> operator-(const Point<T>& e, const Point<T> s) {
-    return Vector<T>(e.x - s.x, e.y - s.y, e.z - s.z);
+
+  friend std::ostream& operator<<(std::ostream& os, const Point& p) {
+    os << p.x << ", " << p.y << ", " << p.z;
+    return os;
   }
 };
 
-template <typename>
-struct is_tuple : std::false_type {};
-
-// For Tuple itself
-template <template <typename> class Child, std::floating_point T>
-struct is_tuple<Tuple<Child, T>> : std::true_type {};
-
-// Specialization for Vector and Point
-template <template <typename> class Child, std::floating_point T>
-struct is_tuple<Child<T>>
-    : std::bool_constant<std::is_base_of_v<Tuple<Child, T>, Child<T>>> {};
-
-// TODO The following works with is_tuple_v<Vector, T>, but not for <Vector<T>>.
-// TODO Solve it
-//  mimic STL approach of the helper
-template <template <typename> class Child, std::floating_point T>
-inline constexpr bool is_tuple_v = is_tuple<Child<T>>::value;
+template <std::floating_point T>
+using Vec3 = Vector<T>;
 
 using Point3d = Point<double>;
 using Point3f = Point<float>;
 using Vec3d = Vector<double>;
 using Vec3f = Vector<float>;
 
-//////////////////////////////////////////
-/*
-inline Vector& operator-=(const Vector& v) {
-  x -= v.x;
-  y -= v.y;
-  z -= v.z;
-  return *this;
-}
-
-friend Vector operator-(Vector v1, const Vector& v2) {
-  v1 -= v2;
-  return v1;
+/**
+ * Batch operations over arrays of vectors. Each is a plain loop over the
+ * components, which the compiler vectorises as one array of 3 n scalars.
+ */
+
+// y += a x
+template <std::floating_point T>
+void Axpy(const T a, const std::span<const Vector<std::type_identity_t<T>>> x,
+          const std::span<Vector<std::type_identity_t<T>>> y) noexcept {
+  assert(x.size() == y.size());
+  for (size_t i = 0; i < y.size(); ++i) {
+    y[i].x += a * x[i].x;
+    y[i].y += a * x[i].y;
+    y[i].z += a * x[i].z;
+  }
 }
 
-friend Vector operator/(const Vector& v, const DType& k) {
-  return operator*(1. / k, v);
+// out[i] = |v[i]|²
+template <std::floating_point T>
+void Norm2(const std::span<const Vector<T>> v,
+           const std::span<std::type_identity_t<T>> out) noexcept {
+  assert(v.size() == out.size());
+  for (size_t i = 0; i < v.size(); ++i)
+    out[i] = v[i].x * v[i].x + v[i].y * v[i].y + v[i].z * v[i].z;
 }
 
-inline Vector& operator/=(const T k) {
-  x /= k;
-  y /= k;
-  z /= k;
-  return *this;
+// sum of a[i] · b[i]. kLanes partial sums, added at the end, so that the
+// loop vectorises without reassociating a single sum
+template <std::floating_point T>
+T Dot(const std::span<const Vector<T>> a,
+      const std::span<const Vector<std::type_identity_t<T>>> b) noexcept {
+  assert(a.size() == b.size());
+  constexpr size_t kLanes{64 / sizeof(T)};
+  T partial[kLanes]{};
+  size_t i{0};
+  for (; i + kLanes <= a.size(); i += kLanes)
+    for (size_t l = 0; l < kLanes; ++l)
+      partial[l] += a[i + l].x * b[i + l].x + a[i + l].y * b[i + l].y +
+                    a[i + l].z * b[i + l].z;
+  for (; i < a.size(); ++i)
+    partial[0] += a[i].x * b[i].x + a[i].y * b[i].y + a[i].z * b[i].z;
+  T sum{0};
+  for (const T p : partial) sum += p;
+  return sum;
 }
-
-
-// using Vec3f = Vector<std::float32_t>;
-using Vec3d = Vector<double>;
-using Vec3i = Vector<IType>;
-
-// requires std::floating_point<T>
-template <typename T>
-struct Point {
-  Point& operator-=(const Vector<T>& v) {
-    x -= v.x;
-    y -= v.y;
-    z -= v.z;
-    return *this;
-  }
-
-  friend Point operator-(Point p, const Vector<T>& v) {
-    p -= v;
-    return p;
-  }
-
-  friend Vector<T> operator-(const Point& p2, const Point& p1) {
-    return Vector<T>(p2.x - p1.x, p2.y - p1.y, p2.z - p1.z);
-  }
-
-  */
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <concepts>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "sim/fft.h"
+#include "sim/spatial_order.h"
+#include "utils/parallel.h"
+
+/**
+ * Particle-Mesh gravity in a periodic cube [0, box)^3, long range forces in
+ * O(n + G log G) for a grid of G cells:
+ *   1. cloud-in-cell (CIC) assignment of G m to the grid,
+ *   2. FFT, multiplication by the Green's function of Poisson's equation
+ *      -4 pi / k^2, inverse FFT: the potential,
+ *   3. CIC interpolation to the particles of the acceleration, the 4-point
+ *      finite difference gradient of the potential.
+ * A spectral gradient would save the differences, but rings (Gibbs) around
+ * every point mass far beyond the cell size. The same CIC kernel both ways
+ * and an antisymmetric difference make the forces antisymmetric: there is no
+ * self force and momentum is conserved to round-off. The mean density is
+ * removed (k = 0), as usual for a periodic box. Forces are smoothed on the
+ * scale of a few cells; the pair forces below that scale need a short range
+ * solver.
+ *
+ * CIC assignment runs in parallel over slabs of cells along x: the particles
+ * are radix sorted by slab, and the even slabs, then the odd ones, each touch
+ * their own slab and the next, so no two threads write the same cell and the
+ * sums do not depend on the threads.
+ */
+template <std::floating_point T = double>
+class ParticleMesh {
+  using Complex = std::complex<T>;
+
+  T box_{1};
+  // cells per axis, a power of two >= 4
+  size_t grid_{0};
+  Fft3d<T> fft_{};
+  // 4 pi / (k^2 N), 0 at k = 0
+  std::vector<T> green_{};
+  // G rho, its transform, then the potential
+  std::vector<Complex> rho_{};
+  std::vector<T> phi_{};
+  // particles in slab order, and the first of every slab
+  std::vector<std::uint64_t> slab_{};
+  std::vector<std::uint32_t> order_{};
+  std::vector<size_t> slab_start_{};
+
+ public:
+  explicit ParticleMesh(const T box = T(1), const size_t grid = 64) {
+    SetMesh(box, grid);
+  }
+
+  /**
+   * @brief Periodic cube [0, box)^3 and cells per axis, rounded up to a power
+   * of two of at least 4.
+   */
+  void SetMesh(const T box, const size_t grid) {
+    box_ = box;
+    grid_ = std::bit_ceil(std::max<size_t>(grid, 4));
+    fft_ = Fft3d<T>(grid_, grid_, grid_);
+    const size_t cells{grid_ * grid_ * grid_};
+    rho_.assign(cells, Complex{});
+    phi_.assign(cells, T(0));
+    green_.resize(cells);
+    const T dk{T(2 * std::numbers::pi) / box_};
+    ParallelFor(cells, [&](const size_t begin, const size_t end) {
+      for (size_t c = begin; c < end; ++c) {
+        const auto k{Wavenumbers(c, dk)};
+        const T k2{k[0] * k[0] + k[1] * k[1] + k[2] * k[2]};
+        green_[c] = c == 0 ? T(0) : T(4 * std::numbers::pi) / (k2 * T(cells));
+      }
+    });
+  }
+
+  T Box() const noexcept { return box_; }
+  size_t Grid() const noexcept { return grid_; }
+
+  // Position folded into [0, box)
+  T Wrap(const T v) const noexcept {
+    const T w{v - box_ * std::floor(v / box_)};
+    return w < box_ ? w : T(0);
+  }
+
+  /**
+   * @brief Adds the mesh force m_i a(x_i) to all n particles; Gm = G m is the
+   * source.
+   */
+  void AddForces(const T* x, const T* y, const T* z, const T* m, const T* Gm,
+                 const size_t n, T* Fx, T* Fy, T* Fz) {
+    Solve(x, y, z, m, Gm, n, Fx, Fy, Fz, [&](auto&& interpolate) {
+      ParallelFor(n, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) interpolate(i);
+      });
+    });
+  }
+
+  // As AddForces(), for the particles in active only; the density still
+  // comes from all
+  void AddForcesOn(const T* x, const T* y, const T* z, const T* m,
+                   const T* Gm, const size_t n,
+                   const std::span<const std::uint32_t> active, T* Fx, T* Fy,
+                   T* Fz) {
+    Solve(x, y, z, m, Gm, n, Fx, Fy, Fz, [&](auto&& interpolate) {
+      ParallelFor(active.size(), [&](const size_t begin, const size_t end) {
+        for (size_t a = begin; a < end; ++a) interpolate(active[a]);
+      });
+    });
+  }
+
+ private:
+  // Signed wavenumbers of the cell with flat index c
+  std::array<T, 3> Wavenumbers(const size_t c, const T dk) const noexcept {
+    const size_t idx[3]{c / (grid_ * grid_), (c / grid_) % grid_, c % grid_};
+    std::array<T, 3> k;
+    for (size_t d = 0; d < 3; ++d)
+      k[d] = dk * (idx[d] < grid_ / 2 ? T(idx[d])
+                                      : T(idx[d]) - T(grid_));
+    return k;
+  }
+
+  // CIC stencil of a position: the lower cell and the weight of the upper one
+  // per axis; cells are centred at (i + 1/2) h
+  struct Stencil {
+    std::array<size_t, 3> lo, hi;
+    std::array<T, 3> w;
+  };
+  Stencil StencilOf(const T x, const T y, const T z) const noexcept {
+    const T inv_h{T(grid_) / box_};
+    const T p[3]{x, y, z};
+    Stencil s;
+    for (size_t d = 0; d < 3; ++d) {
+      const T u{Wrap(p[d]) * inv_h - T(0.5)};
+      const T f{std::floor(u)};
+      s.w[d] = u - f;
+      // u in [-1/2, G - 1/2): f = -1 is the last cell
+      const size_t lo{f < T(0) ? grid_ - 1 : std::min(size_t(f), grid_ - 1)};
+      s.lo[d] = lo;
+      s.hi[d] = (lo + 1) & (grid_ - 1);
+    }
+    return s;
+  }
+
+  size_t Flat(const size_t i, const size_t j, const size_t k) const noexcept {
+    return (i * grid_ + j) * grid_ + k;
+  }
+
+  // Density and potential grids; for_each runs the given per-particle
+  // interpolation over the particles that want forces
+  template <class ForEach>
+  void Solve(const T* x, const T* y, const T* z, const T* m, const T* Gm,
+             const size_t n, T* Fx, T* Fy, T* Fz, ForEach&& for_each) {
+    Assign(x, y, z, Gm, n);
+    fft_.Forward(rho_.data());
+    ParallelFor(rho_.size(), [&](const size_t begin, const size_t end) {
+      for (size_t c = begin; c < end; ++c) rho_[c] *= -green_[c];
+    });
+    fft_.Inverse(rho_.data());
+    ParallelFor(rho_.size(), [&](const size_t begin, const size_t end) {
+      for (size_t c = begin; c < end; ++c) phi_[c] = rho_[c].real();
+    });
+
+    for_each([&](const size_t i) {
+      const Stencil s{StencilOf(x[i], y[i], z[i])};
+      T ax{0}, ay{0}, az{0};
+      for (size_t c = 0; c < 8; ++c) {
+        const T w{(c & 4 ? s.w[0] : 1 - s.w[0]) *
+                  (c & 2 ? s.w[1] : 1 - s.w[1]) *
+                  (c & 1 ? s.w[2] : 1 - s.w[2])};
+        const size_t a{c & 4 ? s.hi[0] : s.lo[0]};
+        const size_t b{c & 2 ? s.hi[1] : s.lo[1]};
+        const size_t d{c & 1 ? s.hi[2] : s.lo[2]};
+        ax -= w * Difference([&](const size_t k) { return Flat(k, b, d); }, a);
+        ay -= w * Difference([&](const size_t k) { return Flat(a, k, d); }, b);
+        az -= w * Difference([&](const size_t k) { return Flat(a, b, k); }, d);
+      }
+      const T inv_h{T(grid_) / box_};
+      Fx[i] += m[i] * ax * inv_h;
+      Fy[i] += m[i] * ay * inv_h;
+      Fz[i] += m[i] * az * inv_h;
+    });
+  }
+
+  // Derivative of the potential along one axis at cell index k of that
+  // axis, times h: (8 (phi_1 - phi_-1) - (phi_2 - phi_-2)) / 12
+  template <class Cell>
+  T Difference(const Cell& cell, const size_t k) const noexcept {
+    const size_t mask{grid_ - 1};
+    return (T(8) * (phi_[cell((k + 1) & mask)] - phi_[cell((k - 1) & mask)]) -
+            (phi_[cell((k + 2) & mask)] - phi_[cell((k - 2) & mask)])) /
+           T(12);
+  }
+
+  void Assign(const T* x, const T* y, const T* z, const T* Gm,
+              const size_t n) {
+    ParallelFor(rho_.size(), [&](const size_t begin, const size_t end) {
+      std::fill(rho_.begin() + begin, rho_.begin() + end, Complex{});
+    });
+    slab_.resize(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        slab_[i] = StencilOf(x[i], y[i], z[i]).lo[0];
+    });
+    order_ = RadixSort(slab_);
+    slab_start_.assign(grid_ + 1, n);
+    for (size_t s = grid_; s-- > 0;)
+      slab_start_[s] = size_t(
+          std::lower_bound(slab_.begin(), slab_.end(), std::uint64_t(s)) -
+          slab_.begin());
+
+    const T inv_volume{std::pow(T(grid_) / box_, T(3))};
+    for (const size_t parity : {0, 1}) {
+      ParallelFor(
+          grid_ / 2,
+          [&](const size_t begin, const size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+              const size_t slab{2 * p + parity};
+              for (size_t k = slab_start_[slab]; k < slab_start_[slab + 1];
+                   ++k)
+                Deposit(order_[k], x, y, z, Gm[order_[k]] * inv_volume);
+            }
+          },
+          1);
+    }
+  }
+
+  void Deposit(const size_t i, const T* x, const T* y, const T* z,
+               const T mass) {
+    const Stencil s{StencilOf(x[i], y[i], z[i])};
+    for (size_t c = 0; c < 8; ++c) {
+      const T w{(c & 4 ? s.w[0] : 1 - s.w[0]) * (c & 2 ? s.w[1] : 1 - s.w[1]) *
+                (c & 1 ? s.w[2] : 1 - s.w[2])};
+      rho_[Flat(c & 4 ? s.hi[0] : s.lo[0], c & 2 ? s.hi[1] : s.lo[1],
+                c & 1 ? s.hi[2] : s.lo[2])] += w * mass;
+    }
+  }
+};
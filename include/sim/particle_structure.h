@@ -1,7 +1,8 @@
 #pragma once
+#include <cmath>
 #include <limits>
-#include <vector>
 
+#include "constants.hpp"
 #include "linear_algebra.h"
 
 using PointType = Point3d;
@@ -21,8 +22,11 @@ struct ParticleStructure {
 
   size_t id;
 
-  ParticleStructure(const PointType position, const DType mass,
-                    const VectorType velocity, const size_t idx)
+  // Softening eps² of ForceFrom()
+  static constexpr DType kEpsilon2{DType(1e-12)};
+
+  constexpr ParticleStructure(const PointType position, const DType mass,
+                              const VectorType velocity, const size_t idx)
       : p{position}, m{mass}, v{velocity}, id{idx} {}
 
   ParticleStructure(const ParticleStructure&) = default;
@@ -38,16 +42,27 @@ struct ParticleStructure {
   /**
    * @brief Updates this particle's velocity and position, using a semi-Euler
    * method
-   * @param particles Vector of particles whose pairwise interactions with
-   * this particle are considered.
-   * @param F_ext External force per particle. Must be the same size and
-   * index-aligned with \p particles so that F_ext[i] applies to particles[i].
-   * If this is not the case, that F_ext is ignored.
-   * @param F_global  Global force applied to all particles, e.g. gravity.
+   * @param F Net force on this particle, e.g. the sum of ForceFrom() over the
+   * other particles plus external forces.
    */
-  void Update(const std::vector<ParticleStructure>& particles,
-              const std::vector<VectorType>& F_ext, const VectorType& F_global,
-              const DType d_t);
+  void Update(const VectorType& F, const DType d_t) noexcept;
+
+  // The coupling of ForceFrom(), -G m: negative, so r points at the source
+  constexpr DType Gm() const noexcept { return -G * m; }
+
+  /**
+   * @brief The pair force of \p other on this particle:
+   * F = -G m1.m2 r / (|r|² + eps²)^(3/2), r = other.p - p.
+   * The force of this particle on \p other is its opposite, so each pair
+   * needs one evaluation.
+   */
+  VectorType ForceFrom(const ParticleStructure& other) const noexcept {
+    auto r{other.p - p};
+    using std::sqrt;
+    auto denom{DType(1) / sqrt(r.Norm2() + kEpsilon2)};
+    denom *= denom * denom;
+    return Gm() * other.m * denom * r;
+  }
 
  private:
   /**
@@ -58,31 +73,4 @@ struct ParticleStructure {
     v += d_t * a;
     p += d_t * v;
   }
-
-  /**
-   * @brief Compute the net force acting on this particle.
-   *
-   * Calculates the total force on this Particle by summing:
-   *  - pairwise interaction forces between this particle and each element of \p
-   * particles (if the container contains this particle instance,
-   * self-interaction is ignored),
-   *  - the per-particle external force taken from \p F_ext at the index
-   * corresponding to the same entry in \p particles,
-   *  - the additional global force \p F_global applied to this particle.
-   *
-   * @param particles Vector of particles whose pairwise interactions with this
-   * particle are considered.
-   * @param F_ext     External force per particle. Must be the same size and
-   * index-aligned with \p particles so that F_ext[i] applies to particles[i].
-   * If this is not the case, that F_ext is ignored.
-   * @param F_global  Global force applied to all particles, e.g. gravity.
-   *
-   * @return The resulting force as a VectorType:
-   * F = -G m1.m2 r / |r|³ + F_ext[i] + F_global
-   *
-   * @note Complexity: O(n) in the number of particles.
-   */
-  VectorType ForceFrom(const std::vector<ParticleStructure>& particles,
-                       const std::vector<VectorType>& F_ext,
-                       const VectorType& F_global) const noexcept;
 };
@@ -1,65 +1,171 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <concepts>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
-#ifdef PARALLEL
-#include <execution>
-#define PAR std::execution::par,
-#else
-#define PAR
-#endif
 
 #include "sim/constants.hpp"
+#include "sim/diagnostics.h"
+#include "sim/force_models.h"
+#include "sim/initial_conditions.h"
+#include "sim/integrators.h"
+#include "sim/spatial_order.h"
+#include "sim/types.hpp"
+#include "utils/checkpoint.h"
+#include "utils/parallel.h"
 #include "utils/rng.h"
+#include "utils/soa_arena.h"
+#include "utils/trace.h"
+#include "utils/trajectory.h"
 
 /**
  * A Particle System, as a Struct of Arrays of properties
+ *
+ * The arrays may be reordered along a space-filling curve (SetReordering())
+ * so that memory order follows space. Particles keep a stable ID: their index
+ * at construction. x/y/z are in storage order, Ids() maps storage to ID, and
+ * external forces are always indexed by ID.
+ *
+ * Save() writes a checkpoint (utils/checkpoint.h) and the Checkpoint
+ * constructor restarts from one, using the arrays in place from the mapped
+ * file when they have the layout of this Particles type.
+ * @tparam Integrator Time integration policy, see integrators.h
+ * @tparam ForceModel Inter-particle forces, see force_models.h
  */
-template <std::floating_point T = double>
+template <std::floating_point T = double,
+          class Integrator = SemiImplicitEuler,
+          class ForceModel = Gravity<T>>
 class Particles {
   // number of particles
   size_t n;
   T d_t;
   using VecT = std::vector<T>;
+  using SpanT = std::span<T>;
+
+  // Fields of the arena, followed by the scratch fields of the Integrator.
+  // kZero stays all zeros: the missing components of F_ext.
+  enum : size_t {
+    kX, kY, kZ, kM, kGm, kVx, kVy, kVz, kFx, kFy, kFz, kZero, kFields
+  };
+  // Checkpoint names of the fields
+  static constexpr const char* kFieldNames[kFields]{
+      "x", "y", "z", "m", "Gm", "vx", "vy", "vz", "Fx", "Fy", "Fz", "zero"};
+  // Checkpoint flags
+  static constexpr std::uint64_t kForcesCurrent{1}, kReordered{2};
+  // Storage of every array below, one aligned allocation
+  SoaArena<T> arena;
 
  public:
   // Positions
-  VecT x, y, z;
+  SpanT x, y, z;
 
  private:
   // Masses
-  VecT m;
-  VecT Gm;
+  SpanT m;
+  SpanT Gm;
   // velocity
-  VecT vx, vy, vz;
+  SpanT vx, vy, vz;
+
+  // Inter-particle force on each particle, from the ForceModel
+  SpanT Fx, Fy, Fz;
+
+  ForceModel force_model{};
+  // Fx/Fy/Fz belong to the current positions
+  bool forces_current{false};
+  // Stateless for most policies; BlockLeapfrog keeps its levels here
+  Integrator integrator{};
 
-  // Force on each particle. This is temporary, if I choose Gravity between
-  // particles as a the simulated force.
-  VecT Fx, Fy, Fz;
-  static T constexpr epsilon{T(0.0001)};
-  static T constexpr eps2{epsilon * epsilon};
+  // Spatial reordering every reorder_every steps, 0 for never
+  SpaceFillingCurve reorder_curve{SpaceFillingCurve::kHilbert};
+  size_t reorder_every{0};
+  size_t steps{0};
+  // id[i]: ID of the particle stored at i; index[id]: where it is stored
+  std::vector<std::uint32_t> id;
+  std::vector<std::uint32_t> index;
+  bool reordered{false};
+  // Trajectory frames every trajectory_every steps, not owned
+  TrajectoryWriter* trajectory{nullptr};
+  size_t trajectory_every{0};
+  // F_ext in storage order, once reordered
+  VecT ext_x{}, ext_y{}, ext_z{};
+  // StepStats at the end of every step
+  bool diagnostics{false};
+  StepStats stats{};
+  // of the last force evaluation, NaN when it did not sum it
+  double potential{std::numeric_limits<double>::quiet_NaN()};
+  static constexpr bool kModelPotential{
+      requires { requires ForceModel::kPotential; }};
 
  public:
-  Particles(const size_t n, const T d_t)
-      : n{n},
-        d_t{d_t},
-        x{VecT(n)},
-        y{VecT(n)},
-        z{VecT(n)},
-        m{VecT(n)},
-        Gm{VecT(n)},
-        vx{VecT(n)},
-        vy{VecT(n)},
-        vz{VecT(n)},
-        Fx{VecT(n)},
-        Fy{VecT(n)},
-        Fz{VecT(n)} {
-    Randomize();
-    std::transform(std::begin(m), std::end(m), std::begin(Gm),
-                   [](auto mi) { return G * mi; });
+  Particles(const size_t n, const T d_t,
+            const std::uint64_t seed = RNG<T>::kDefaultSeed)
+      : Particles(SoaArena<T>{n, kFields + Integrator::kScratchFields}, d_t) {
+    Randomize(seed);
+  }
+
+  /**
+   * @brief n particles set up by an initial-condition generator, e.g.
+   * Plummer{} (initial_conditions.h), which writes straight into the
+   * particle arrays.
+   */
+  template <class Generator>
+    requires InitialConditions<Generator, T>
+  Particles(const size_t n, const T d_t, const Generator& generate)
+      : Particles(SoaArena<T>{n, kFields + Integrator::kScratchFields}, d_t) {
+    generate(ParticleArrays<T>{.n = n,
+                               .x = x.data(),
+                               .y = y.data(),
+                               .z = z.data(),
+                               .vx = vx.data(),
+                               .vy = vy.data(),
+                               .vz = vz.data(),
+                               .m = m.data()});
+    ParallelFor(n, [this](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) Gm[i] = G * m[i];
+    });
+  }
+
+  /**
+   * @brief Restarts from a checkpoint written by Save(). When the file holds
+   * the fields of this Particles type (same T and integrator) they are used
+   * in place, so nothing is read before it is touched; otherwise they are
+   * copied, and converted between float and double. The state of force
+   * models and of stateful integrators starts afresh.
+   */
+  explicit Particles(const Checkpoint& checkpoint)
+      : Particles(Restore(checkpoint), T(checkpoint.Header().d_t)) {
+    const CheckpointHeader& header{checkpoint.Header()};
+    steps = header.steps;
+    reordered = header.flags & kReordered;
+    forces_current = header.flags & kForcesCurrent &&
+                     checkpoint.Find("Fx") && checkpoint.Find("Fy") &&
+                     checkpoint.Find("Fz");
+    if (const CheckpointField* const ids{checkpoint.Find("id")}) {
+      const auto stored{checkpoint.Data<std::uint32_t>(*ids)};
+      if (stored.size() != n)
+        throw std::runtime_error("checkpoint " + checkpoint.Path() +
+                                 ": wrong number of IDs");
+      std::copy(stored.begin(), stored.end(), id.begin());
+      // a permutation of 0 .. n - 1: in range and none twice
+      std::vector<bool> seen(n);
+      for (size_t i = 0; i < n; ++i) {
+        if (id[i] >= n || seen[id[i]])
+          throw std::runtime_error("checkpoint " + checkpoint.Path() +
+                                   ": bad ID");
+        seen[id[i]] = true;
+        index[id[i]] = std::uint32_t(i);
+      }
+    }
   }
 
   Particles(const Particles&) = delete;
@@ -67,124 +173,344 @@ class Particles {
   Particles(Particles&&) noexcept = default;
   Particles& operator=(Particles&&) noexcept = default;
   ~Particles() = default;
+
+  /**
+   * @brief Selects the algorithm for the inter-particle forces.
+   * @param theta Opening angle of the Barnes-Hut solver; ignored by kDirect.
+   */
+  void SetForceSolver(const ForceSolver force_solver, const T theta = T(0.5)) {
+    force_model.SetSolver(force_solver, theta);
+    forces_current = false;
+  }
+
+  /**
+   * @brief Selects the arithmetic of the direct solver. kMixed only changes
+   * Particles<double>: float pair interactions, double sums and state.
+   */
+  void SetForcePrecision(const ForcePrecision precision) {
+    force_model.SetPrecision(precision);
+    forces_current = false;
+  }
+
+  /**
+   * @brief Discards the forces kept from the last step. Needed after changing
+   * positions or masses from outside, as the leapfrog-type integrators reuse
+   * the forces of the end of one step at the start of the next.
+   */
+  void InvalidateForces() { forces_current = false; }
+
+  // The integrator policy object, to configure a stateful one
+  Integrator& GetIntegrator() noexcept { return integrator; }
+  const Integrator& GetIntegrator() const noexcept { return integrator; }
+
+  // The force model object, e.g. to set the bonds of HarmonicSprings. Also
+  // discards the forces kept from the last step.
+  ForceModel& GetForceModel() noexcept {
+    forces_current = false;
+    return force_model;
+  }
+  const ForceModel& GetForceModel() const noexcept { return force_model; }
+
+  /**
+   * @brief Reorders the particle arrays along the curve every `every` steps
+   * of Update(), 0 for never (the default). Tree and grid traversals stay
+   * cache friendly as the particles mix.
+   */
+  void SetReordering(const SpaceFillingCurve curve, const size_t every) {
+    reorder_curve = curve;
+    reorder_every = every;
+  }
+
+  /**
+   * @brief Measures a StepStats at the end of every Update(), off by default.
+   * The potential energy, for force models with kPotential, is summed by the
+   * force evaluation the step closes with. Integrators that do not close with
+   * one (SemiImplicitEuler, RungeKutta4) then evaluate the forces at the end
+   * of the step rather than at the start of the next, so the diagnostics cost
+   * no extra evaluation; the rest is one pass over the particles.
+   */
+  void SetDiagnostics(const bool enabled) { diagnostics = enabled; }
+  // Measured at the end of the last Update() with diagnostics on
+  const StepStats& Stats() const noexcept { return stats; }
+
+  /**
+   * @brief Writes a checkpoint: every field of the arena, padding and
+   * integrator scratch included, the IDs, the time step and the steps taken.
+   */
+  void Save(const std::string& path) const {
+    CheckpointWriter writer;
+    for (size_t k = 0; k < arena.NumFields(); ++k)
+      writer.Add(FieldName(k),
+                 std::span<const T>(arena.Field(k), arena.Stride()));
+    writer.Add("id", std::span<const std::uint32_t>(id));
+    writer.Write(path, n, double(d_t), steps,
+                 (forces_current ? kForcesCurrent : 0) |
+                     (reordered ? kReordered : 0));
+  }
+
   /**
-   * @brief Updates this particle's velocity and position, using a semi-Euler
-   * method
-   *
+   * @brief Queues a trajectory frame every `every` steps of Update(), 0 or a
+   * null writer for never (the default). The writer must outlive the output.
+   */
+  void SetTrajectoryOutput(TrajectoryWriter* writer, const size_t every) {
+    trajectory = writer;
+    trajectory_every = every;
+  }
+
+  // Queues a frame of the current state: positions, velocities and IDs, in
+  // storage order
+  void RecordFrame(TrajectoryWriter& writer) const {
+    TRACE_ZONE("Particles::RecordFrame");
+    writer.Record<T>(steps, x, y, z, vx, vy, vz, id);
+  }
+
+  // ID of the particle stored at every index
+  std::span<const std::uint32_t> Ids() const noexcept { return id; }
+  // Where the particle with ID i is stored
+  size_t IndexOf(const std::uint32_t i) const { return index[i]; }
+
+  /**
+   * @brief Permutes every particle array, the forces included, into the order
+   * of the space-filling curve. Force models keeping per-particle state are
+   * told through their optional Reorder(order).
+   */
+  void Reorder() {
+    TRACE_ZONE("Particles::Reorder");
+    const std::vector<std::uint32_t> order{
+        SpatialOrder(x.data(), y.data(), z.data(), n, reorder_curve)};
+    VecT tmp(n);
+    for (const SpanT field : {x, y, z, m, Gm, vx, vy, vz, Fx, Fy, Fz}) {
+      ParallelFor(n, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) tmp[i] = field[order[i]];
+      });
+      ParallelFor(n, [&](const size_t begin, const size_t end) {
+        std::copy(tmp.data() + begin, tmp.data() + end, field.data() + begin);
+      });
+    }
+    const std::vector<std::uint32_t> old_id{id};
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        id[i] = old_id[order[i]];
+        index[id[i]] = std::uint32_t(i);
+      }
+    });
+    reordered = true;
+    if constexpr (requires { force_model.Reorder(std::span(order)); })
+      force_model.Reorder(std::span<const std::uint32_t>(order));
+  }
+
+  /**
+   * @brief Advances velocities and positions by d_t with the Integrator.
+   * @param F_ext_x External force per particle ID, may be empty (same for y,
+   * z). External and global forces are constant during the step.
    */
-  // @todo: Make different options for Force, F. such as gravity between
-  // particles, no inner-force just initial velocity and global (earth) gravity,
-  // etc.
   void Update(const VecT& F_ext_x, const VecT& F_ext_y, const VecT& F_ext_z,
               const T& F_global_x, const T& F_global_y, const T& F_global_z) {
-    UpdateForces(F_ext_x, F_ext_y, F_ext_z, F_global_x, F_global_y, F_global_z);
-
-    UpdateState();
+    TRACE_ZONE("Particles::Update");
+    const SoaState<T> state{
+        .n = n,
+        .x = x.data(),
+        .y = y.data(),
+        .z = z.data(),
+        .vx = vx.data(),
+        .vy = vy.data(),
+        .vz = vz.data(),
+        .m = m.data(),
+        .Fx = Fx.data(),
+        .Fy = Fy.data(),
+        .Fz = Fz.data(),
+        .ex = External(F_ext_x, ext_x),
+        .ey = External(F_ext_y, ext_y),
+        .ez = External(F_ext_z, ext_z),
+        .gx = F_global_x,
+        .gy = F_global_y,
+        .gz = F_global_z,
+        .scratch = arena.Field(kFields),
+        .stride = arena.Stride()};
+    integrator.Step(state, d_t, forces_current,
+                    [this](auto... active) { UpdateForces(active...); });
+    if (diagnostics && !forces_current) {
+      UpdateForces();
+      forces_current = true;
+    }
+    if constexpr (requires { force_model.WrapPositions(x, y, z); }) {
+      TRACE_ZONE("Particles::WrapPositions");
+      force_model.WrapPositions(x, y, z);
+    }
+    ++steps;
+    if (diagnostics) MeasureStats();
+    if (reorder_every != 0 && steps % reorder_every == 0) Reorder();
+    if (trajectory && trajectory_every != 0 && steps % trajectory_every == 0)
+      RecordFrame(*trajectory);
   }
 
  private:
-  void UpdateForces(const VecT& F_ext_x, const VecT& F_ext_y,
-                    const VecT& F_ext_z, const T& F_global_x,
-                    const T& F_global_y, const T& F_global_z) {
-    std::fill(PAR begin(Fx), end(Fx), T(0));
-    std::fill(PAR begin(Fy), end(Fy), T(0));
-    std::fill(PAR begin(Fz), end(Fz), T(0));
-
-    for (size_t i = 0; i < n; ++i) {
-      for (size_t j = i + 1; j < n; ++j) {
-        const T rx{x[j] - x[i]};
-        const T ry{y[j] - y[i]};
-        const T rz{z[j] - z[i]};
-
-        // eps² for smoothing
-        const T r2{rx * rx + ry * ry + rz * rz + eps2};
-        using std::sqrt;
-        const T inv_r{T(1.) / sqrt(r2)};
-        T inv_r3 = inv_r * inv_r * inv_r;
-
-        T F = Gm[i] * m[j] * inv_r3;
-        T fx{F * rx};
-        T fy{F * ry};
-        T fz{F * rz};
-
-        // Update forces
-        Fx[i] += fx;
-        Fx[j] -= fx;
-        Fy[i] += fy;
-        Fy[j] -= fy;
-        Fz[i] += fz;
-        Fz[j] -= fz;
+  Particles(SoaArena<T>&& storage, const T d_t)
+      : n{storage.Size()},
+        d_t{d_t},
+        arena{std::move(storage)},
+        x{arena.Field(kX), n},
+        y{arena.Field(kY), n},
+        z{arena.Field(kZ), n},
+        m{arena.Field(kM), n},
+        Gm{arena.Field(kGm), n},
+        vx{arena.Field(kVx), n},
+        vy{arena.Field(kVy), n},
+        vz{arena.Field(kVz), n},
+        Fx{arena.Field(kFx), n},
+        Fy{arena.Field(kFy), n},
+        Fz{arena.Field(kFz), n},
+        id(n),
+        index(n) {
+    std::iota(id.begin(), id.end(), std::uint32_t(0));
+    std::iota(index.begin(), index.end(), std::uint32_t(0));
+  }
+
+  static std::string FieldName(const size_t k) {
+    return k < kFields ? kFieldNames[k]
+                       : "scratch" + std::to_string(k - kFields);
+  }
+
+  // Arena of a checkpoint: adopted from the mapping when its blocks are laid
+  // out as in an arena of ours, else a copy
+  static SoaArena<T> Restore(const Checkpoint& checkpoint) {
+    const size_t n{checkpoint.Header().n};
+    const size_t num_fields{kFields + Integrator::kScratchFields};
+    const size_t lanes{SoaArena<T>::kLanes};
+    const size_t stride{(n + lanes - 1) / lanes * lanes};
+    const CheckpointField* const first{checkpoint.Find(FieldName(0))};
+    bool in_place{first != nullptr};
+    for (size_t k = 0; in_place && k < num_fields; ++k) {
+      const CheckpointField* const field{checkpoint.Find(FieldName(k))};
+      in_place = field && field->type == FieldTypeOf<T>() &&
+                 field->count == stride &&
+                 field->offset == first->offset + k * stride * sizeof(T);
+    }
+    if (in_place)
+      return {checkpoint.Data<T>(*first).data(), n, stride, num_fields,
+              checkpoint.Owner()};
+
+    SoaArena<T> storage{n, num_fields};
+    for (size_t k = 0; k < num_fields; ++k) {
+      const CheckpointField* const field{checkpoint.Find(FieldName(k))};
+      // forces, zeros and scratch may be left out
+      if (!field && k >= kFx) continue;
+      if (!field || field->count < n)
+        throw std::runtime_error("checkpoint " + checkpoint.Path() +
+                                 ": field " + FieldName(k) +
+                                 " missing or short");
+      T* const out{storage.Field(k)};
+      auto copy = [&](const auto in) {
+        ParallelFor(n, [&](const size_t begin, const size_t end) {
+          std::transform(in.begin() + begin, in.begin() + end, out + begin,
+                         [](const auto v) { return T(v); });
+        });
+      };
+      if (field->type == FieldType::kFloat32)
+        copy(checkpoint.Data<float>(*field));
+      else
+        copy(checkpoint.Data<double>(*field));
+    }
+    return storage;
+  }
+
+  // External force in storage order: zeros when empty, F as is while the
+  // particles are in ID order, else gathered into `stored`
+  const T* External(const VecT& F, VecT& stored) {
+    if (F.empty()) return arena.Field(kZero);
+    if (!reordered) return F.data();
+    TRACE_ZONE("Particles::External");
+    stored.resize(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) stored[i] = F[id[i]];
+    });
+    return stored.data();
+  }
+
+  // Inter-particle forces of the current positions. Without pair forces F
+  // stays zero from the arena and there is nothing to evaluate.
+  void UpdateForces() {
+    if constexpr (ForceModel::kPairForces) {
+      TRACE_ZONE("Particles::UpdateForces");
+      ParallelFor(n, [&](const size_t b, const size_t e) {
+        std::fill(Fx.begin() + b, Fx.begin() + e, T(0));
+        std::fill(Fy.begin() + b, Fy.begin() + e, T(0));
+        std::fill(Fz.begin() + b, Fz.begin() + e, T(0));
+      });
+      ForceState<T> s{State()};
+      if (kModelPotential && diagnostics) {
+        potential = 0;
+        s.potential = &potential;
       }
+      force_model.AddForces(s);
     }
+  }
 
-    // Add external Force to each particle, if exists
-    if (!F_ext_x.empty())
-      std::transform(PAR std::begin(Fx), std::end(Fx), std::begin(F_ext_x),
-                     std::begin(Fx), std::plus<>{});
-    if (!F_ext_y.empty())
-      std::transform(PAR std::begin(Fy), std::end(Fy), std::begin(F_ext_y),
-                     std::begin(Fy), std::plus<>{});
-    if (!F_ext_z.empty())
-      std::transform(PAR std::begin(Fz), std::end(Fz), std::begin(F_ext_z),
-                     std::begin(Fz), std::plus<>{});
-    // Add global force
-    std::for_each(PAR std::begin(Fx), std::end(Fx),
-                  [f_g = F_global_x](auto& f) { f += f_g; });
-    std::for_each(PAR std::begin(Fy), std::end(Fy),
-                  [f_g = F_global_y](auto& f) { f += f_g; });
-    std::for_each(PAR std::begin(Fz), std::end(Fz),
-                  [f_g = F_global_z](auto& f) { f += f_g; });
+  // Inter-particle forces on the active particles only, block time-stepping
+  void UpdateForces(const std::span<const std::uint32_t> active) {
+    if constexpr (ForceModel::kPairForces) {
+      TRACE_ZONE("Particles::UpdateForces");
+      for (const std::uint32_t i : active) Fx[i] = Fy[i] = Fz[i] = T(0);
+      ForceState<T> s{State()};
+      // only a full set of active particles sums the whole potential
+      potential = std::numeric_limits<double>::quiet_NaN();
+      if (kModelPotential && diagnostics && active.size() == n) {
+        potential = 0;
+        s.potential = &potential;
+      }
+      force_model.AddForcesOn(s, active);
+    }
+  }
+
+  // StepStats of the current state; the forces belong to it
+  void MeasureStats() {
+    TRACE_ZONE("Particles::MeasureStats");
+    stats.step = steps;
+    MeasureMotion(n, x.data(), y.data(), z.data(), vx.data(), vy.data(),
+                  vz.data(), m.data(), Fx.data(), Fy.data(), Fz.data(), stats);
+    if constexpr (!ForceModel::kPairForces)
+      stats.potential = 0;
+    else
+      stats.potential = kModelPotential
+                            ? potential
+                            : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  ForceState<T> State() {
+    return {.n = n,
+            .x = x.data(),
+            .y = y.data(),
+            .z = z.data(),
+            .m = m.data(),
+            .Gm = Gm.data(),
+            .Fx = Fx.data(),
+            .Fy = Fy.data(),
+            .Fz = Fz.data()};
   }
 
+ public:
   /**
-   * @brief Semi-Euler update on this particle's velocity and position.
+   * @brief Positions uniform in [-2, 2)³ and masses in [1, 200), at rest,
+   * in storage order. The same seed gives the same particles bit for bit,
+   * whatever the number of threads.
    */
-  void UpdateState() {
-    using std::begin;
-    using std::end;
-
-    // velocity += F/m * d_t
-    // x
-    std::transform(PAR begin(Fx), end(Fx), begin(m), begin(Fx),
-                   [dt = d_t](const T& f, const T& m) { return f * dt / m; });
-    std::transform(PAR begin(Fx), end(Fx), begin(vx), begin(vx),
-                   [](const T& f, const T& v) { return f + v; });
-    // y
-    std::transform(PAR begin(Fy), end(Fy), begin(m), begin(Fy),
-                   [dt = d_t](const T& f, const T& m) { return f * dt / m; });
-    std::transform(PAR begin(Fy), end(Fy), begin(vy), begin(vy),
-                   [](const T& f, const T& v) { return f + v; });
-    // z
-    std::transform(PAR begin(Fz), end(Fz), begin(m), begin(Fz),
-                   [dt = d_t](const T& f, const T& m) { return f * dt / m; });
-    std::transform(PAR begin(Fz), end(Fz), begin(vz), begin(vz),
-                   [](const T& f, const T& v) { return f + v; });
-
-    // position += velocity * d_t
-    std::transform(PAR begin(vx), end(vx), begin(x), begin(x),
-                   [dt = d_t](const T& v, T& p) { return std::fma(v, dt, p); });
-    std::transform(PAR begin(vy), end(vy), begin(y), begin(y),
-                   [dt = d_t](const T& v, T& p) { return std::fma(v, dt, p); });
-    std::transform(PAR begin(vz), end(vz), begin(z), begin(z),
-                   [dt = d_t](const T& v, T& p) { return std::fma(v, dt, p); });
-  }
-
-  // Temporary for testing purposes
-  // TODO: parametrize. Maybe not a very bad function to have, after all.
-  void Randomize() {
-    RNG<T> rng;
+  void Randomize(const std::uint64_t seed = RNG<T>::kDefaultSeed) {
+    RNG<T> rng(seed);
     rng.GenerateUniformRandom(x.data(), n, -2., 2.);
     rng.GenerateUniformRandom(y.data(), n, -2., 2.);
     rng.GenerateUniformRandom(z.data(), n, -2., 2.);
 
     rng.GenerateUniformRandom(m.data(), n, 1., 200.);
 
-    rng.GenerateUniformRandom(vx.data(), n, 0., 0.);
-    rng.GenerateUniformRandom(vy.data(), n, 0., 0.);
-    rng.GenerateUniformRandom(vz.data(), n, 0., 0.);
+    ParallelFor(n, [this](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        Gm[i] = G * m[i];
+        vx[i] = vy[i] = vz[i] = T(0);
+      }
+    });
+    forces_current = false;
   }
 
- public:
   // TODO: Possibly useless after debug. Clean-up
   void Print(const size_t begin, const size_t end) const {
     for (size_t i = begin; i <= end; ++i) {
@@ -204,4 +530,5 @@ class Particles {
       std::printf("\tF(%.2f, %.2f,%.2f)\n", Fx[i], Fy[i], Fz[i]);
     }
   }
+
 };
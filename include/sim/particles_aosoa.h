@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "../utils/aosoa.h"
+#include "../utils/parallel.h"
+#include "../utils/rng.h"
+#include "../utils/soa_arena.h"
+#include "../utils/trace.h"
+#include "constants.hpp"
+#include "direct_sum.h"
+#include "gravity_kernels.h"
+#include "integrators.h"
+#include "types.hpp"
+
+/**
+ * A Particle System, as an Array of Structs of Arrays (utils/aosoa.h): the
+ * particles in blocks of W, each block holding W values of every field.
+ *
+ * The integrator sweeps run on the blocks through the layout of SoaState,
+ * and the all-pairs gravity runs the SIMD tile kernels over the tile
+ * schedule of DirectSum, on blocks: the W values of a field load as one
+ * register when W is the SIMD width.
+ * @tparam Integrator Time integration policy, see integrators.h; one that
+ * evaluates the forces of all particles at once (not BlockLeapfrog)
+ */
+template <std::floating_point T = double, size_t W = SoaArena<T>::kLanes,
+          class Integrator = SemiImplicitEuler>
+struct ParticlesAoSoA {
+  static_assert(W <= DirectSum<T>::kMaxBlock);
+
+  // Fields of a block
+  enum : size_t { kX, kY, kZ, kM, kGm, kVx, kVy, kVz, kFx, kFy, kFz, kFields };
+
+  // number of particles
+  size_t n;
+  T d_t;
+  AoSoA<T, W> particles;
+  // Plain arrays: zeros for a missing F_ext, then the integrator scratch
+  SoaArena<T> arena;
+
+  static T constexpr epsilon{T(0.0001)};
+  static T constexpr eps2{epsilon * epsilon};
+
+  ForcePrecision precision{ForcePrecision::kNative};
+  // Only its tile schedule, over blocks
+  DirectSum<T> tiles{};
+  // The forces belong to the current positions
+  bool forces_current{false};
+  Integrator integrator{};
+
+  ParticlesAoSoA(const size_t n, const T d_t,
+                 const std::uint64_t seed = RNG<T>::kDefaultSeed)
+      : n{n},
+        d_t{d_t},
+        particles{n, kFields},
+        arena{n, 1 + Integrator::kScratchFields} {
+    Randomize(seed);
+  }
+
+  ParticlesAoSoA(const ParticlesAoSoA&) = delete;
+  ParticlesAoSoA& operator=(const ParticlesAoSoA&) = delete;
+
+  /**
+   * @brief Advances velocities and positions by d_t with the Integrator.
+   * @param F_ext_x External force per particle, may be null (same for y, z).
+   * External and global forces are constant during the step. After changing
+   * positions or masses from outside, reset forces_current; Gm is G m.
+   */
+  void Update(const T* F_ext_x, const T* F_ext_y, const T* F_ext_z,
+              const T F_global_x, const T F_global_y, const T F_global_z) {
+    TRACE_ZONE("ParticlesAoSoA::Update");
+    const T* zero{arena.Field(0)};
+    auto field = [this](const size_t k) {
+      return particles.Lanes(0, k).data();
+    };
+    const SoaState<T> state{.n = n,
+                            .x = field(kX),
+                            .y = field(kY),
+                            .z = field(kZ),
+                            .vx = field(kVx),
+                            .vy = field(kVy),
+                            .vz = field(kVz),
+                            .m = field(kM),
+                            .Fx = field(kFx),
+                            .Fy = field(kFy),
+                            .Fz = field(kFz),
+                            .ex = F_ext_x ? F_ext_x : zero,
+                            .ey = F_ext_y ? F_ext_y : zero,
+                            .ez = F_ext_z ? F_ext_z : zero,
+                            .gx = F_global_x,
+                            .gy = F_global_y,
+                            .gz = F_global_z,
+                            .scratch = arena.Field(1),
+                            .stride = arena.Stride(),
+                            .width = W,
+                            .pitch = particles.Pitch()};
+    integrator.Step(state, d_t, forces_current, [this] { UpdateForces(); });
+  }
+
+ private:
+  /**
+   * Inter-particle forces of the current positions. A tile of the schedule
+   * is a range of blocks. Its j-blocks are gathered, kMaxBlock particles at
+   * a time, into plain arrays that the kernel streams through for every
+   * i-block, which it reads in place; the i forces go straight into the
+   * blocks and the j forces back once the gathered run is done. The padding
+   * is massless.
+   */
+  void UpdateForces() {
+    TRACE_ZONE("ParticlesAoSoA::UpdateForces");
+    const size_t nb{particles.NumBlocks()};
+    ParallelFor(nb, [this](const size_t begin, const size_t end) {
+      for (size_t b = begin; b < end; ++b)
+        for (const size_t k : {kFx, kFy, kFz})
+          std::ranges::fill(particles.Lanes(b, k), T(0));
+    });
+    const TileKernel<T> kernel{GetTileKernel<T>(precision)};
+    tiles.ForEachTile(nb, [&](const typename DirectSum<T>::Tile& t) {
+      constexpr size_t kRun{DirectSum<T>::kMaxBlock / W};
+      std::array<T, kRun * W> xj, yj, zj, mj, fxj, fyj, fzj;
+      const bool diagonal{t.i0 == t.j0};
+      for (size_t j0 = t.j0; j0 < t.j1; j0 += kRun) {
+        const size_t j1{std::min(t.j1, j0 + kRun)};
+        for (size_t b = j0; b < j1; ++b) {
+          const size_t o{(b - j0) * W};
+          std::ranges::copy(particles.Lanes(b, kX), xj.begin() + o);
+          std::ranges::copy(particles.Lanes(b, kY), yj.begin() + o);
+          std::ranges::copy(particles.Lanes(b, kZ), zj.begin() + o);
+          std::ranges::copy(particles.Lanes(b, kM), mj.begin() + o);
+        }
+        const size_t nj{(j1 - j0) * W};
+        std::fill_n(fxj.begin(), nj, T(0));
+        std::fill_n(fyj.begin(), nj, T(0));
+        std::fill_n(fzj.begin(), nj, T(0));
+        // on the diagonal, the i-blocks up to the run: those before it
+        // against all of it, those in it against the rest of it
+        for (size_t bi = t.i0; bi < (diagonal ? j1 : t.i1); ++bi) {
+          auto i = [&](const size_t k) {
+            return particles.Lanes(bi, k).data();
+          };
+          const bool in_run{diagonal && bi >= j0};
+          const size_t o{in_run ? (bi - j0) * W : 0};
+          kernel({.xi = in_run ? xj.data() + o : i(kX),
+                  .yi = in_run ? yj.data() + o : i(kY),
+                  .zi = in_run ? zj.data() + o : i(kZ),
+                  .Gmi = i(kGm),
+                  .ni = W,
+                  .xj = xj.data() + o,
+                  .yj = yj.data() + o,
+                  .zj = zj.data() + o,
+                  .mj = mj.data() + o,
+                  .nj = nj - o,
+                  .fxi = in_run ? fxj.data() + o : i(kFx),
+                  .fyi = in_run ? fyj.data() + o : i(kFy),
+                  .fzi = in_run ? fzj.data() + o : i(kFz),
+                  .fxj = fxj.data() + o,
+                  .fyj = fyj.data() + o,
+                  .fzj = fzj.data() + o,
+                  .eps2 = eps2,
+                  .diagonal = in_run});
+        }
+        for (size_t b = j0; b < j1; ++b) {
+          const size_t o{(b - j0) * W};
+          const T* const f[]{fxj.data() + o, fyj.data() + o, fzj.data() + o};
+          for (size_t d = 0; d < 3; ++d)
+            std::ranges::transform(particles.Lanes(b, kFx + d),
+                                   std::span<const T, W>{f[d], W},
+                                   particles.Lanes(b, kFx + d).begin(),
+                                   std::plus<>{});
+        }
+      }
+    });
+  }
+
+  // As ParticlesRawPointer::Randomize(): the same particles for a seed
+  void Randomize(const std::uint64_t seed) {
+    RNG<T> rng(seed);
+    std::vector<T> values(n);
+    auto fill = [&](const size_t k, const double low, const double high) {
+      rng.GenerateUniformRandom(values.data(), n, low, high);
+      for (size_t i = 0; i < n; ++i) particles(i, k) = values[i];
+    };
+    fill(kX, -2., 2.);
+    fill(kY, -2., 2.);
+    fill(kZ, -2., 2.);
+    fill(kM, 1., 200.);
+    fill(kVx, -20., 20.);
+    fill(kVy, -20., 20.);
+    fill(kVz, -20., 20.);
+    for (auto p : particles) p[kGm] = G * p[kM];
+  }
+};
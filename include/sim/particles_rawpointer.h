@@ -1,26 +1,40 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <concepts>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <span>
 #include <vector>
 
+#include "../utils/parallel.h"
 #include "../utils/rng.h"
+#include "../utils/soa_arena.h"
+#include "../utils/trace.h"
+#include "barnes_hut.h"
 #include "constants.hpp"
+#include "direct_sum.h"
+#include "integrators.h"
+#include "types.hpp"
 
 // TODO: Benchmark and test between using std::vector class, Particles and the
 // raw pointer implementation ParticlesRawPointer
 /**
  * A Particle System, as a Struct of Arrays of properties
  * Using raw pointers.
+ * @tparam Integrator Time integration policy, see integrators.h
  */
 
-template <std::floating_point T = double>
+template <std::floating_point T = double,
+          class Integrator = SemiImplicitEuler>
 struct ParticlesRawPointer {
   // number of particles
   size_t n;
   T d_t;
+  // Storage of every array below, one aligned allocation
+  SoaArena<T> arena;
   // positions
   T *x, *y, *z;
   // mass
@@ -29,146 +43,131 @@ struct ParticlesRawPointer {
   // velocity
   T *vx, *vy, *vz;
 
-  // acceleration, Beschleunigung
-  T *ax, *ay, *az;
   // Force on each particle. This is temporary, if I choose Gravity between
   // particles as a the simulated force.
   T *Fx, *Fy, *Fz;
   static T constexpr epsilon{T(0.0001)};
   static T constexpr eps2{epsilon * epsilon};
 
-  ParticlesRawPointer(const size_t n, const T d_t)
+  ForceSolver solver{ForceSolver::kDirect};
+  BarnesHut<T> tree{};
+  DirectSum<T> direct{};
+  // Fx/Fy/Fz belong to the current positions
+  bool forces_current{false};
+  // Stateless for most policies; BlockLeapfrog keeps its levels here
+  Integrator integrator{};
+
+  ParticlesRawPointer(const size_t n, const T d_t,
+                      const std::uint64_t seed = RNG<T>::kDefaultSeed)
       : n{n},
         d_t{d_t},
-        x{new T[n]},
-        y{new T[n]},
-        z{new T[n]},
-        m{new T[n]},
-        Gm{new T[n]},
-        vx{new T[n]},
-        vy{new T[n]},
-        vz{new T[n]},
-        ax{new T[n]},
-        ay{new T[n]},
-        az{new T[n]},
-        Fx{new T[n]},
-        Fy{new T[n]},
-        Fz{new T[n]} {
-    Randomize();
-    for (size_t i = 0; i < n; ++i) Gm[i] = G * m[i];
+        // field 11: zeros for a missing F_ext, then the integrator scratch
+        arena{n, 12 + Integrator::kScratchFields},
+        x{arena.Field(0)},
+        y{arena.Field(1)},
+        z{arena.Field(2)},
+        m{arena.Field(3)},
+        Gm{arena.Field(4)},
+        vx{arena.Field(5)},
+        vy{arena.Field(6)},
+        vz{arena.Field(7)},
+        Fx{arena.Field(8)},
+        Fy{arena.Field(9)},
+        Fz{arena.Field(10)} {
+    Randomize(seed);
   }
 
   ParticlesRawPointer(const ParticlesRawPointer&) = delete;
   ParticlesRawPointer& operator=(const ParticlesRawPointer&) = delete;
   ParticlesRawPointer(ParticlesRawPointer&&) noexcept = delete;
   ParticlesRawPointer& operator=(ParticlesRawPointer&&) noexcept = delete;
-  ~ParticlesRawPointer() {
-    if (x) delete[] x;
-    if (y) delete[] y;
-    if (z) delete[] z;
-    if (m) delete[] m;
-    if (Gm) delete[] Gm;
-    if (vx) delete[] vx;
-    if (vy) delete[] vy;
-    if (vz) delete[] vz;
-    if (ax) delete[] ax;
-    if (ay) delete[] ay;
-    if (az) delete[] az;
-    if (Fx) delete[] Fx;
-    if (Fy) delete[] Fy;
-    if (Fz) delete[] Fz;
+  ~ParticlesRawPointer() = default;
+
+  /**
+   * @brief Selects the algorithm for the inter-particle forces.
+   * @param theta Opening angle of the Barnes-Hut solver; ignored by kDirect.
+   */
+  void SetForceSolver(const ForceSolver force_solver, const T theta = T(0.5)) {
+    solver = force_solver;
+    tree.SetTheta(theta);
+    forces_current = false;
   }
 
   /**
-   * @brief Updates this particle's velocity and position, using a semi-Euler
-   * method
-   *
+   * @brief Advances velocities and positions by d_t with the Integrator.
+   * @param F_ext_x External force per particle, may be null (same for y, z).
+   * External and global forces are constant during the step. After changing
+   * x/y/z or m from outside, reset forces_current.
    */
   // @todo: Make different options for Force, F. such as gravity between
   // particles, no inner-force just initial velocity and global (earth) gravity,
   // etc.
   void Update(const T* F_ext_x, const T* F_ext_y, const T* F_ext_z,
               const T F_global_x, const T F_global_y, const T F_global_z) {
-    UpdateForces(F_ext_x, F_ext_y, F_ext_z, F_global_x, F_global_y, F_global_z);
-
-    UpdateState();
+    TRACE_ZONE("ParticlesRawPointer::Update");
+    const T* zero{arena.Field(11)};
+    const SoaState<T> state{.n = n,
+                            .x = x,
+                            .y = y,
+                            .z = z,
+                            .vx = vx,
+                            .vy = vy,
+                            .vz = vz,
+                            .m = m,
+                            .Fx = Fx,
+                            .Fy = Fy,
+                            .Fz = Fz,
+                            .ex = F_ext_x ? F_ext_x : zero,
+                            .ey = F_ext_y ? F_ext_y : zero,
+                            .ez = F_ext_z ? F_ext_z : zero,
+                            .gx = F_global_x,
+                            .gy = F_global_y,
+                            .gz = F_global_z,
+                            .scratch = arena.Field(12),
+                            .stride = arena.Stride()};
+    integrator.Step(state, d_t, forces_current,
+                    [this](auto... active) { UpdateForces(active...); });
   }
 
  private:
-  void UpdateForces(const T* F_ext_x, const T* F_ext_y, const T* F_ext_z,
-                    const T F_global_x, const T F_global_y,
-                    const T F_global_z) {
-    std::fill_n(Fx, n, T(0));
-    std::fill_n(Fy, n, T(0));
-    std::fill_n(Fz, n, T(0));
-
-    for (size_t i = 0; i < n; ++i) {
-      for (size_t j = i + 1; j < n; ++j) {
-        const T rx{x[j] - x[i]};
-        const T ry{y[j] - y[i]};
-        const T rz{z[j] - z[i]};
-
-        const T r2{rx * rx + ry * ry + rz * rz + eps2};
-        const T inv_r2{T(1.) / r2};
-        using std::sqrt;
-        T inv_r = sqrt(inv_r2);
-
-        T F = Gm[i] * m[j] * inv_r2 * inv_r;
-        T fx{F * rx};
-        T fy{F * ry};
-        T fz{F * rz};
-
-        // Update forces
-        Fx[i] += fx;
-        Fx[j] -= fx;
-        Fy[i] += fy;
-        Fy[j] -= fy;
-        Fz[i] += fz;
-        Fz[j] -= fz;
-      }
+  // Inter-particle forces of the current positions
+  void UpdateForces() {
+    TRACE_ZONE("ParticlesRawPointer::UpdateForces");
+    ParallelFor(n, [this](const size_t begin, const size_t end) {
+      std::fill(Fx + begin, Fx + end, T(0));
+      std::fill(Fy + begin, Fy + end, T(0));
+      std::fill(Fz + begin, Fz + end, T(0));
+    });
+
+    if (solver == ForceSolver::kBarnesHut) {
+      tree.Build(x, y, z, m, n);
+      tree.AddForces(Gm, Fx, Fy, Fz, eps2);
+    } else {
+      direct.AddForces(x, y, z, m, Gm, n, Fx, Fy, Fz, eps2);
     }
+  }
+
+  // Inter-particle forces on the active particles only, block time-stepping
+  void UpdateForces(const std::span<const std::uint32_t> active) {
+    TRACE_ZONE("ParticlesRawPointer::UpdateForces");
+    for (const std::uint32_t i : active) Fx[i] = Fy[i] = Fz[i] = T(0);
 
-    // Add external Force to each particle, if exists
-    if (F_ext_x)
-      for (size_t i = 0; i < n; ++i) Fx[i] += F_ext_x[i];
-    if (F_ext_y)
-      for (size_t i = 0; i < n; ++i) Fy[i] += F_ext_y[i];
-    if (F_ext_z)
-      for (size_t i = 0; i < n; ++i) Fz[i] += F_ext_z[i];
-    // Add global force
-    for (size_t i = 0; i < n; ++i) {
-      Fx[i] += F_global_x;
-      Fy[i] += F_global_y;
-      Fz[i] += F_global_z;
+    if (solver == ForceSolver::kBarnesHut) {
+      tree.Build(x, y, z, m, n);
+      tree.AddForcesOn(active, Gm, Fx, Fy, Fz, eps2);
+    } else {
+      direct.AddForcesOn(x, y, z, m, Gm, n, active, Fx, Fy, Fz, eps2);
     }
   }
 
+ public:
   /**
-   * @brief Semi-Euler update on this particle's velocity and position.
+   * @brief Positions uniform in [-2, 2)³, masses in [1, 200) and velocities
+   * in [-20, 20)³. The same seed gives the same particles bit for bit,
+   * whatever the number of threads.
    */
-  void UpdateState() {
-    // Update acceleration of each particle
-    for (size_t i = 0; i < n; ++i) {
-      T inv_mi = T(1.) / m[i];
-      ax[i] = Fx[i] * inv_mi;
-      ay[i] = Fy[i] * inv_mi;
-      az[i] = Fz[i] * inv_mi;
-    }
-    for (size_t i = 0; i < n; ++i) {
-      vx[i] += ax[i] * d_t;
-      vy[i] += ay[i] * d_t;
-      vz[i] += az[i] * d_t;
-
-      x[i] += vx[i] * d_t;
-      y[i] += vy[i] * d_t;
-      z[i] += vz[i] * d_t;
-    }
-  }
-
-  // Temporary for testing purposes
-  // TODO: parametrize. Maybe not a very bad function to have, after all.
-  void Randomize() {
-    RNG<T> rng;
+  void Randomize(const std::uint64_t seed = RNG<T>::kDefaultSeed) {
+    RNG<T> rng(seed);
     rng.GenerateUniformRandom(x, n, -2., 2.);
     rng.GenerateUniformRandom(y, n, -2., 2.);
     rng.GenerateUniformRandom(z, n, -2., 2.);
@@ -178,9 +177,12 @@ struct ParticlesRawPointer {
     rng.GenerateUniformRandom(vx, n, -20., 20.);
     rng.GenerateUniformRandom(vy, n, -20., 20.);
     rng.GenerateUniformRandom(vz, n, -20., 20.);
+    ParallelFor(n, [this](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) Gm[i] = G * m[i];
+    });
+    forces_current = false;
   }
 
- public:
   // TODO: Possibly useless after debug. Clean-up
   void Print(const size_t begin, const size_t end) const {
     for (size_t i = begin; i <= end; ++i) {
@@ -197,8 +199,7 @@ struct ParticlesRawPointer {
       std::printf(
           "particle %zd\tp(%.2f,%.2f, %.2f)\tm: %.2f\tv(%.2f, %.2f,%.2f)\n", i,
           x[i], y[i], z[i], m[i], vx[i], vy[i], vz[i]);
-      std::printf("\t\ta(%.2f,%.2f, %.2f)\tF(%.2f, %.2f,%.2f)\n", ax[i], ay[i],
-                  az[i], Fx[i], Fy[i], Fz[i]);
+      std::printf("\tF(%.2f, %.2f,%.2f)\n", Fx[i], Fy[i], Fz[i]);
     }
   }
 };
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "sim/types.hpp"
+#include "utils/parallel.h"
+
+/**
+ * Space-filling curve keys and the orders they induce, to lay particles out
+ * in memory so that particles close in space are close in memory.
+ *
+ * Keys have 63 bits: the bounding box is split into 2^21 cells per axis and
+ * the key is the position of a cell along the curve. Morton (Z-order) keys
+ * are the interleaved cell coordinates; Hilbert keys also rotate and reflect
+ * every octant so that consecutive cells along the curve are always adjacent.
+ */
+
+inline constexpr unsigned kKeyBits{21};
+
+// Spreads the low 21 bits of v to every third bit
+constexpr std::uint64_t SpreadBits(std::uint64_t v) noexcept {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffff;
+  v = (v | v << 16) & 0x1f0000ff0000ff;
+  v = (v | v << 8) & 0x100f00f00f00f00f;
+  v = (v | v << 4) & 0x10c30c30c30c30c3;
+  v = (v | v << 2) & 0x1249249249249249;
+  return v;
+}
+
+// Cell coordinates of 21 bits each to a Morton key, x in the highest bit
+constexpr std::uint64_t MortonKey(const std::uint32_t ix,
+                                  const std::uint32_t iy,
+                                  const std::uint32_t iz) noexcept {
+  return SpreadBits(ix) << 2 | SpreadBits(iy) << 1 | SpreadBits(iz);
+}
+
+/**
+ * @brief Cell coordinates of 21 bits each to a Hilbert key: Skilling's
+ * transform of the coordinates ("Programming the Hilbert curve", 2004), then
+ * the Morton interleave.
+ */
+constexpr std::uint64_t HilbertKey(const std::uint32_t ix,
+                                   const std::uint32_t iy,
+                                   const std::uint32_t iz) noexcept {
+  std::uint32_t X[3]{ix, iy, iz};
+  constexpr std::uint32_t M{1u << (kKeyBits - 1)};
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1) {
+    const std::uint32_t P{Q - 1};
+    for (auto& Xi : X) {
+      if (Xi & Q) {
+        X[0] ^= P;
+      } else {
+        const std::uint32_t t{(X[0] ^ Xi) & P};
+        X[0] ^= t;
+        Xi ^= t;
+      }
+    }
+  }
+  X[1] ^= X[0];
+  X[2] ^= X[1];
+  std::uint32_t t{0};
+  for (std::uint32_t Q = M; Q > 1; Q >>= 1)
+    if (X[2] & Q) t ^= Q - 1;
+  return MortonKey(X[0] ^ t, X[1] ^ t, X[2] ^ t);
+}
+
+/**
+ * @brief Stable parallel least significant digit radix sort, 8 bits per pass.
+ * Sorts keys and returns order, order[k] the index of the k-th key before
+ * the sort. Passes over a digit that all keys share are skipped.
+ */
+std::vector<std::uint32_t> RadixSort(std::span<std::uint64_t> keys);
+
+/**
+ * @brief Order of the n particles along the curve: order[k] is the particle
+ * to store k-th.
+ */
+template <std::floating_point T>
+std::vector<std::uint32_t> SpatialOrder(const T* x, const T* y, const T* z,
+                                        const size_t n,
+                                        const SpaceFillingCurve curve) {
+  if (n == 0) return {};
+  const auto [x_min, x_max] = ParallelMinMax(x, n);
+  const auto [y_min, y_max] = ParallelMinMax(y, n);
+  const auto [z_min, z_max] = ParallelMinMax(z, n);
+  const T extent{std::max({x_max - x_min, y_max - y_min, z_max - z_min})};
+  // one scale for all axes, so the cells are cubes
+  static constexpr std::uint32_t kMaxCell{(1u << kKeyBits) - 1};
+  const double scale{extent > T(0) ? double(kMaxCell) / double(extent) : 0.};
+  auto cell = [scale](const T v, const T v_min) {
+    return std::min(kMaxCell, std::uint32_t(double(v - v_min) * scale));
+  };
+
+  std::vector<std::uint64_t> keys(n);
+  ParallelFor(n, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const std::uint32_t ix{cell(x[i], x_min)}, iy{cell(y[i], y_min)},
+          iz{cell(z[i], z_min)};
+      keys[i] = curve == SpaceFillingCurve::kHilbert ? HilbertKey(ix, iy, iz)
+                                                     : MortonKey(ix, iy, iz);
+    }
+  });
+  return RadixSort(keys);
+}
@@ -1,5 +1,33 @@
 #pragma once
 
+#include <cstdint>
+
 // clang-19 still doesn't support float32_t
 using DType = double;
-using IType = std::int32_t;
\ No newline at end of file
+using IType = std::int32_t;
+
+// Algorithm used for the inter-particle (gravity) forces
+enum class ForceSolver {
+  // all-pairs summation, O(n²)
+  kDirect,
+  // Barnes-Hut octree with quadrupole moments, O(n log n)
+  kBarnesHut
+};
+
+
+// Arithmetic of the direct force summation
+enum class ForcePrecision {
+  // pair interactions in T
+  kNative,
+  // Particles<double> only: separations and 1/sqrt in float (rsqrt plus one
+  // Newton step), per-particle sums in double. Relative error ~1e-6.
+  kMixed
+};
+
+// Curve of the spatial reordering of the particle arrays
+enum class SpaceFillingCurve {
+  // bit-interleaved cell coordinates, cheapest keys
+  kMorton,
+  // consecutive cells always adjacent, better locality
+  kHilbert
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "sim/cell_list.h"
+#include "utils/parallel.h"
+
+/**
+ * Verlet neighbour lists: for every particle, the particles within
+ * cutoff + skin at the last Build(), in CSR form (each pair under both ends,
+ * so particles are processed in parallel without write conflicts).
+ *
+ * Lists are kept in the cell order of the build, as slots rather than
+ * particle indices: an evaluation copies the positions into that order once,
+ * and the neighbours of a particle are then close in memory, instead of one
+ * cache miss per pair when the particles are stored in random order.
+ *
+ * The lists stay valid until some particle has moved by more than skin / 2
+ * since the build: no pair can have closed in from beyond cutoff + skin to
+ * the cutoff before that. NeedsRebuild() checks this with one parallel pass
+ * over the positions, so a force evaluation rebuilds only every few steps.
+ */
+template <std::floating_point T = double>
+class VerletList {
+ public:
+  using Index = std::uint32_t;
+
+ private:
+  T skin_;
+  bool valid_{false};
+  // particle of every slot and slot of every particle, at the last build
+  std::vector<Index> order_{};
+  std::vector<Index> slot_of_{};
+  // neighbour slots of slot a: neighbour_[offset_[a], offset_[a + 1])
+  std::vector<size_t> offset_{0};
+  std::vector<Index> neighbour_{};
+  // positions at the last build
+  std::vector<T> x0_{}, y0_{}, z0_{};
+  // positions in slot order, filled by AddPairForces()
+  std::vector<T> xs_{}, ys_{}, zs_{};
+  size_t builds_{0};
+
+ public:
+  explicit VerletList(const T skin = T(0.3)) : skin_{skin} {}
+
+  void SetSkin(const T skin) {
+    skin_ = skin;
+    Invalidate();
+  }
+  T Skin() const noexcept { return skin_; }
+  // Forces a rebuild at the next check, e.g. after reordering the particles
+  void Invalidate() noexcept { valid_ = false; }
+
+  size_t Size() const noexcept { return offset_.size() - 1; }
+  // Number of ordered pairs (i, j) in the lists
+  size_t NumEntries() const noexcept { return neighbour_.size(); }
+  size_t Builds() const noexcept { return builds_; }
+
+  // Calls visit(j) for every listed neighbour j of particle i
+  template <class Visit>
+  void ForEachNeighbour(const size_t i, Visit&& visit) const {
+    const Index a{slot_of_[i]};
+    for (size_t k = offset_[a]; k < offset_[a + 1]; ++k)
+      visit(order_[neighbour_[k]]);
+  }
+
+  /**
+   * @brief Whether some particle has moved by more than skin / 2 since the
+   * last Build(), or the lists do not belong to these n particles.
+   */
+  bool NeedsRebuild(const T* x, const T* y, const T* z, const size_t n) const {
+    if (!valid_ || n != x0_.size()) return true;
+    constexpr size_t kChunk{4096};
+    std::vector<T> max_d2((n + kChunk - 1) / kChunk, T(0));
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          max_d2[begin / kChunk] = MaxDisplacement2(begin, end, x, y, z);
+        },
+        kChunk);
+    const T limit{skin_ / 2};
+    return *std::max_element(max_d2.begin(), max_d2.end()) > limit * limit;
+  }
+
+  /**
+   * @brief Rebuilds the lists with radius cutoff + skin from a cell list of
+   * the same positions whose cells are at least that large.
+   */
+  void Build(const CellList<T>& cells, const T* x, const T* y, const T* z,
+             const size_t n, const T cutoff) {
+    const T radius{cutoff + skin_};
+    const T radius2{radius * radius};
+    order_.assign(cells.Order().begin(), cells.Order().end());
+    slot_of_.resize(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t a = begin; a < end; ++a) slot_of_[order_[a]] = Index(a);
+    });
+
+    // count, then fill at the offsets, both in parallel over slots
+    offset_.assign(n + 1, 0);
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          for (size_t a = begin; a < end; ++a) {
+            size_t count{0};
+            cells.ForEachCandidate(order_[a], [&](Index, const T r2) {
+              count += r2 < radius2;
+            });
+            offset_[a + 1] = count;
+          }
+        },
+        256);
+    std::inclusive_scan(offset_.begin(), offset_.end(), offset_.begin());
+    neighbour_.resize(offset_[n]);
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          for (size_t a = begin; a < end; ++a) {
+            size_t k{offset_[a]};
+            cells.ForEachCandidate(order_[a], [&](const Index j, const T r2) {
+              if (r2 < radius2) neighbour_[k++] = slot_of_[j];
+            });
+          }
+        },
+        256);
+
+    x0_.assign(x, x + n);
+    y0_.assign(y, y + n);
+    z0_.assign(z, z + n);
+    valid_ = true;
+    ++builds_;
+  }
+
+  /**
+   * @brief F_i += f r_ij, f = pair(r2, i, j), over the listed neighbours j of
+   * every particle i, r_ij = x_j - x_i. pair must be 0 beyond the cutoff.
+   */
+  template <class Pair>
+  void AddPairForces(const T* x, const T* y, const T* z, T* Fx, T* Fy, T* Fz,
+                     const Pair& pair) {
+    const size_t n{Size()};
+    xs_.resize(n);
+    ys_.resize(n);
+    zs_.resize(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t a = begin; a < end; ++a) {
+        xs_[a] = x[order_[a]];
+        ys_[a] = y[order_[a]];
+        zs_[a] = z[order_[a]];
+      }
+    });
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          for (size_t a = begin; a < end; ++a)
+            AddPairForce<false>(Index(a), xs_.data(), ys_.data(), zs_.data(),
+                                Fx, Fy, Fz, pair);
+        },
+        1024);
+  }
+
+  /**
+   * @brief As AddPairForces(), for the particles in active only. The
+   * positions are read in place, as there may be few of them.
+   */
+  template <class Pair>
+  void AddPairForcesOn(const std::span<const Index> active, const T* x,
+                       const T* y, const T* z, T* Fx, T* Fy, T* Fz,
+                       const Pair& pair) const {
+    ParallelFor(
+        active.size(),
+        [&](const size_t begin, const size_t end) {
+          for (size_t k = begin; k < end; ++k)
+            AddPairForce<true>(slot_of_[active[k]], x, y, z, Fx, Fy, Fz,
+                               pair);
+        },
+        1024);
+  }
+
+ private:
+  T MaxDisplacement2(const size_t begin, const size_t end, const T* x,
+                     const T* y, const T* z) const {
+    T max_d2{0};
+    for (size_t i = begin; i < end; ++i) {
+      const T dx{x[i] - x0_[i]};
+      const T dy{y[i] - y0_[i]};
+      const T dz{z[i] - z0_[i]};
+      max_d2 = std::max(max_d2, dx * dx + dy * dy + dz * dz);
+    }
+    return max_d2;
+  }
+
+  // Forces on the particle of slot a. Positions are in slot order, or in
+  // particle order when in_place.
+  template <bool in_place, class Pair>
+  void AddPairForce(const Index a, const T* x, const T* y, const T* z, T* Fx,
+                    T* Fy, T* Fz, const Pair& pair) const {
+    const Index ia{in_place ? order_[a] : a};
+    const T xi{x[ia]}, yi{y[ia]}, zi{z[ia]};
+    T fx{0}, fy{0}, fz{0};
+    for (size_t k = offset_[a]; k < offset_[a + 1]; ++k) {
+      const Index b{neighbour_[k]};
+      const Index ib{in_place ? order_[b] : b};
+      const T rx{x[ib] - xi};
+      const T ry{y[ib] - yi};
+      const T rz{z[ib] - zi};
+      const T f{pair(rx * rx + ry * ry + rz * rz, order_[a], order_[b])};
+      fx += f * rx;
+      fy += f * ry;
+      fz += f * rz;
+    }
+    const Index i{order_[a]};
+    Fx[i] += fx;
+    Fy[i] += fy;
+    Fz[i] += fz;
+  }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <utility>
+
+#include "utils/parallel.h"
+#include "utils/soa_arena.h"
+
+/**
+ * Array of Structs of Arrays: the elements in blocks of W, each block holding
+ * W consecutive values of every field, field after field.
+ *
+ * A block of a few fields spans a handful of cache lines, so a sweep over
+ * all fields streams through one array instead of one per field, which the
+ * prefetcher follows more easily and which touches fewer pages; the W values
+ * of a field are still contiguous and load as one register when W is the
+ * SIMD width. The storage is one AllocateArena() allocation, zeroed block by
+ * block with the ParallelFor chunks of the integrators, and the last block is
+ * padded with zeros.
+ *
+ * Element i, field k is at (i / W) * Pitch() + k * W + i % W. operator()
+ * is the mdspan-style accessor of that layout, with extents (Size(),
+ * NumFields()); Lanes() gives the W values of a field in one block, and the
+ * iterators go over the elements as Element proxies.
+ */
+template <std::floating_point T, size_t W = SoaArena<T>::kLanes>
+class AoSoA {
+  static_assert(W > 0 && (W & (W - 1)) == 0, "W must be a power of two");
+
+ public:
+  static constexpr size_t kWidth{W};
+
+  // One element: its fields, W apart
+  class Element {
+    T* p_;
+
+   public:
+    explicit Element(T* p) noexcept : p_{p} {}
+    T& operator[](const size_t field) const noexcept { return p_[field * W]; }
+  };
+
+  class Iterator {
+    T* data_{nullptr};
+    size_t pitch_{0};
+    size_t i_{0};
+
+   public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type = Element;
+    using reference = Element;
+    using difference_type = std::ptrdiff_t;
+
+    Iterator() = default;
+    Iterator(T* data, const size_t pitch, const size_t i) noexcept
+        : data_{data}, pitch_{pitch}, i_{i} {}
+
+    Element operator*() const noexcept {
+      return Element{data_ + i_ / W * pitch_ + i_ % W};
+    }
+    Element operator[](const difference_type d) const noexcept {
+      return *(*this + d);
+    }
+    Iterator& operator++() noexcept {
+      ++i_;
+      return *this;
+    }
+    Iterator operator++(int) noexcept { return {data_, pitch_, i_++}; }
+    Iterator& operator--() noexcept {
+      --i_;
+      return *this;
+    }
+    Iterator operator--(int) noexcept { return {data_, pitch_, i_--}; }
+    Iterator& operator+=(const difference_type d) noexcept {
+      i_ += size_t(d);
+      return *this;
+    }
+    Iterator& operator-=(const difference_type d) noexcept {
+      i_ -= size_t(d);
+      return *this;
+    }
+    friend Iterator operator+(Iterator it, const difference_type d) noexcept {
+      return it += d;
+    }
+    friend Iterator operator+(const difference_type d, Iterator it) noexcept {
+      return it += d;
+    }
+    friend Iterator operator-(Iterator it, const difference_type d) noexcept {
+      return it -= d;
+    }
+    friend difference_type operator-(const Iterator& a,
+                                     const Iterator& b) noexcept {
+      return difference_type(a.i_) - difference_type(b.i_);
+    }
+    friend bool operator==(const Iterator& a, const Iterator& b) noexcept {
+      return a.i_ == b.i_;
+    }
+    friend auto operator<=>(const Iterator& a, const Iterator& b) noexcept {
+      return a.i_ <=> b.i_;
+    }
+  };
+
+ private:
+  T* data_{nullptr};
+  size_t n_{0};
+  size_t num_fields_{0};
+  size_t num_blocks_{0};
+
+ public:
+  AoSoA() = default;
+
+  /**
+   * @param n Number of elements
+   * @param huge_pages Ask for transparent huge pages, see AllocateArena()
+   */
+  AoSoA(const size_t n, const size_t num_fields, const bool huge_pages = true)
+      : n_{n}, num_fields_{num_fields}, num_blocks_{(n + W - 1) / W} {
+    if (Bytes() == 0) return;
+    data_ = static_cast<T*>(AllocateArena(Bytes(), huge_pages));
+    ParallelFor(num_blocks_ * W, [this](const size_t begin, const size_t end) {
+      std::fill(data_ + begin / W * Pitch(), data_ + end / W * Pitch(), T(0));
+    });
+  }
+
+  AoSoA(const AoSoA&) = delete;
+  AoSoA& operator=(const AoSoA&) = delete;
+  AoSoA(AoSoA&& other) noexcept
+      : data_{std::exchange(other.data_, nullptr)},
+        n_{std::exchange(other.n_, 0)},
+        num_fields_{std::exchange(other.num_fields_, 0)},
+        num_blocks_{std::exchange(other.num_blocks_, 0)} {}
+  AoSoA& operator=(AoSoA&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(n_, other.n_);
+    std::swap(num_fields_, other.num_fields_);
+    std::swap(num_blocks_, other.num_blocks_);
+    return *this;
+  }
+  ~AoSoA() { FreeArena(data_); }
+
+  T& operator()(const size_t i, const size_t field) const noexcept {
+    return data_[i / W * Pitch() + field * W + i % W];
+  }
+  size_t Extent(const size_t rank) const noexcept {
+    return rank == 0 ? n_ : num_fields_;
+  }
+
+  // The W values of a field in a block, padding included
+  std::span<T, W> Lanes(const size_t block, const size_t field) const noexcept {
+    return std::span<T, W>{data_ + block * Pitch() + field * W, W};
+  }
+
+  Iterator begin() const noexcept { return {data_, Pitch(), 0}; }
+  Iterator end() const noexcept { return {data_, Pitch(), n_}; }
+
+  size_t Size() const noexcept { return n_; }
+  size_t NumFields() const noexcept { return num_fields_; }
+  size_t NumBlocks() const noexcept { return num_blocks_; }
+  // Elements from a block to the next
+  size_t Pitch() const noexcept { return num_fields_ * W; }
+  size_t Bytes() const noexcept { return num_blocks_ * Pitch() * sizeof(T); }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Binary checkpoint files: named arrays (fields) of particle state, laid out
+ * to be mapped into memory and used in place.
+ *
+ *   header      CheckpointHeader, 64 bytes
+ *   field table num_fields x CheckpointField, 64 bytes each
+ *   blocks      the fields, the first on a page, every one on 64 bytes
+ *
+ * Everything is in the native (little endian) byte order. The header holds a
+ * checksum of itself and the table, and every field a checksum of its block,
+ * so a truncated or corrupted file is caught before it is used. Files are
+ * written under a temporary name, synced and renamed: a crash while writing
+ * leaves the previous checkpoint intact.
+ *
+ * Errors (I/O, bad files) throw std::runtime_error naming the file.
+ */
+
+inline constexpr char kCheckpointMagic[8]{'P', 'A', 'R', 'T', 'C', 'K', 'P',
+                                          'T'};
+// 2: checksums cover every byte of a chunk's tail
+inline constexpr std::uint32_t kCheckpointVersion{2};
+
+// Element type of a field
+enum class FieldType : std::uint32_t {
+  kFloat32 = 1,
+  kFloat64,
+  kUint32,
+  kUint64
+};
+
+template <class U>
+constexpr FieldType FieldTypeOf() noexcept {
+  if constexpr (std::same_as<U, float>)
+    return FieldType::kFloat32;
+  else if constexpr (std::same_as<U, double>)
+    return FieldType::kFloat64;
+  else if constexpr (std::same_as<U, std::uint32_t>)
+    return FieldType::kUint32;
+  else {
+    static_assert(std::same_as<U, std::uint64_t>, "no field type");
+    return FieldType::kUint64;
+  }
+}
+
+constexpr size_t FieldTypeBytes(const FieldType type) noexcept {
+  return type == FieldType::kFloat32 || type == FieldType::kUint32 ? 4 : 8;
+}
+
+struct CheckpointHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t num_fields;
+  // particles; fields may hold more elements (padding)
+  std::uint64_t n;
+  std::uint64_t file_bytes;
+  // of the header, with this member 0, and the field table
+  std::uint64_t checksum;
+  // state of the particle system: time step, steps taken, and its flags
+  double d_t;
+  std::uint64_t steps;
+  std::uint64_t flags;
+};
+static_assert(sizeof(CheckpointHeader) == 64);
+
+struct CheckpointField {
+  // NUL terminated
+  char name[32];
+  FieldType type;
+  std::uint32_t reserved;
+  std::uint64_t count;
+  // from the start of the file
+  std::uint64_t offset;
+  std::uint64_t checksum;
+};
+static_assert(sizeof(CheckpointField) == 64);
+
+/**
+ * @brief 64-bit checksum of bytes, computed in parallel over 1 MiB chunks.
+ * Not cryptographic: it catches corruption, not tampering.
+ */
+std::uint64_t Checksum(std::span<const std::byte> bytes);
+
+/**
+ * Collects views of the fields, then writes them. The data must stay alive
+ * and unchanged until Write() returns.
+ */
+class CheckpointWriter {
+  struct Source {
+    std::string name;
+    FieldType type;
+    const void* data;
+    size_t count;
+  };
+  std::vector<Source> fields_{};
+
+ public:
+  template <class U>
+  void Add(const std::string_view name, std::span<const U> data) {
+    AddRaw(name, FieldTypeOf<U>(), data.data(), data.size());
+  }
+  void AddRaw(std::string_view name, FieldType type, const void* data,
+              size_t count);
+
+  // Fields in the order added. The blocks are copied in parallel.
+  void Write(const std::string& path, std::uint64_t n, double d_t,
+             std::uint64_t steps, std::uint64_t flags) const;
+};
+
+/**
+ * A checkpoint file mapped into memory, privately: the fields can be read
+ * and written in place, pages are read on first use and writes never reach
+ * the file. The mapping lives as long as the Checkpoint or any owner handle
+ * taken from it.
+ */
+class Checkpoint {
+  std::string path_{};
+  std::shared_ptr<std::byte> mapping_{};
+
+ public:
+  /**
+   * @param verify Compare the checksums of every field, reading the whole
+   * file, in parallel. The header and table are always checked.
+   */
+  explicit Checkpoint(const std::string& path, bool verify = true);
+
+  const CheckpointHeader& Header() const noexcept {
+    return *reinterpret_cast<const CheckpointHeader*>(mapping_.get());
+  }
+  std::span<const CheckpointField> Fields() const noexcept {
+    return {reinterpret_cast<const CheckpointField*>(mapping_.get() +
+                                                     sizeof(CheckpointHeader)),
+            Header().num_fields};
+  }
+  // The field called name, nullptr if there is none
+  const CheckpointField* Find(std::string_view name) const noexcept;
+
+  // Elements of a field, which must be of type U
+  template <class U>
+  std::span<U> Data(const CheckpointField& field) const {
+    CheckType(field, FieldTypeOf<U>());
+    return {reinterpret_cast<U*>(mapping_.get() + field.offset),
+            size_t(field.count)};
+  }
+
+  // Keeps the mapping alive, e.g. for memory adopted from it
+  std::shared_ptr<const void> Owner() const noexcept { return mapping_; }
+  const std::string& Path() const noexcept { return path_; }
+
+ private:
+  void CheckType(const CheckpointField& field, FieldType type) const;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "utils/thread_pool.h"
+
+/**
+ * @brief Calls f(begin, end) on consecutive chunks of [0, n), in parallel on
+ * ThreadPool::Global(). Chunks are large enough for the loop inside f to be
+ * vectorised and to amortise the scheduling.
+ */
+template <typename F>
+void ParallelFor(const size_t n, F&& f, const size_t chunk = 4096) {
+  if (n <= chunk) {
+    if (n > 0) f(size_t(0), n);
+    return;
+  }
+  ThreadPool::Global().Run((n + chunk - 1) / chunk, [&](const size_t c) {
+    f(c * chunk, std::min(n, (c + 1) * chunk));
+  });
+}
+
+/**
+ * @brief Reduces [0, n) in chunks: map(begin, end) returns the value of a
+ * chunk, combine(total, value) folds the chunk values in chunk order, from
+ * init. The chunks are fixed by n and chunk, so the result does not depend on
+ * the number of threads.
+ */
+template <typename S, typename Map, typename Combine>
+S ParallelReduce(const size_t n, S init, Map&& map, Combine&& combine,
+                 const size_t chunk = 4096) {
+  std::vector<S> values((n + chunk - 1) / chunk);
+  ParallelFor(
+      n,
+      [&](const size_t begin, const size_t end) {
+        values[begin / chunk] = map(begin, end);
+      },
+      chunk);
+  for (const S& value : values) combine(init, value);
+  return init;
+}
+
+// Smallest and largest of v[0, n), n > 0
+template <typename T>
+std::pair<T, T> ParallelMinMax(const T* v, const size_t n) {
+  constexpr std::pair<T, T> kEmpty{std::numeric_limits<T>::max(),
+                                   std::numeric_limits<T>::lowest()};
+  return ParallelReduce(
+      n, kEmpty,
+      [v](const size_t begin, const size_t end) {
+        const auto [lo, hi] = std::minmax_element(v + begin, v + end);
+        return std::pair{*lo, *hi};
+      },
+      [](std::pair<T, T>& total, const std::pair<T, T>& value) {
+        total.first = std::min(total.first, value.first);
+        total.second = std::max(total.second, value.second);
+      });
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+ * 3", SC 2011): a counter-based generator. The i-th block of random bits is
+ * a keyed bijection of the counter i, with no state carried from one block
+ * to the next, so any part of a sequence can be generated on its own, by
+ * any thread, with the same result.
+ */
+struct Philox4x32 {
+  using Counter = std::array<std::uint32_t, 4>;
+  using Key = std::array<std::uint32_t, 2>;
+
+  static constexpr std::uint32_t kM0{0xD2511F53}, kM1{0xCD9E8D57};
+  static constexpr std::uint32_t kW0{0x9E3779B9}, kW1{0xBB67AE85};
+  static constexpr size_t kRounds{10};
+
+  // Four random 32-bit words of one counter
+  static constexpr Counter Block(Counter c, Key k) noexcept {
+    for (size_t r = 0; r < kRounds; ++r) {
+      if (r > 0) {
+        k[0] += kW0;
+        k[1] += kW1;
+      }
+      const std::uint64_t p0{std::uint64_t(kM0) * c[0]};
+      const std::uint64_t p1{std::uint64_t(kM1) * c[2]};
+      c = {std::uint32_t(p1 >> 32) ^ c[1] ^ k[0], std::uint32_t(p1),
+           std::uint32_t(p0 >> 32) ^ c[3] ^ k[1], std::uint32_t(p0)};
+    }
+    return c;
+  }
+
+  /**
+   * @brief Blocks of kLanes consecutive counters at once, lane l from
+   * counter {first + l, c1, c2, c3}: out[w][l] is word w of that block.
+   * The lanes are independent, so the rounds vectorise over them.
+   */
+  template <size_t kLanes>
+  static void Blocks(const std::uint32_t first, const std::uint32_t c1,
+                     const std::uint32_t c2, const std::uint32_t c3,
+                     const Key key,
+                     std::array<std::array<std::uint32_t, kLanes>, 4>& out)
+      noexcept {
+    std::array<std::uint32_t, kLanes> x0, x1, x2, x3;
+    for (size_t l = 0; l < kLanes; ++l) {
+      x0[l] = first + std::uint32_t(l);
+      x1[l] = c1;
+      x2[l] = c2;
+      x3[l] = c3;
+    }
+    Key k{key};
+    for (size_t r = 0; r < kRounds; ++r) {
+      if (r > 0) {
+        k[0] += kW0;
+        k[1] += kW1;
+      }
+      // kept a loop: fully unrolled at -O3 it is no longer vectorised
+#pragma GCC unroll 1
+      for (size_t l = 0; l < kLanes; ++l) {
+        const std::uint64_t p0{std::uint64_t(kM0) * x0[l]};
+        const std::uint64_t p1{std::uint64_t(kM1) * x2[l]};
+        const std::uint32_t y0{std::uint32_t(p1 >> 32) ^ x1[l] ^ k[0]};
+        const std::uint32_t y2{std::uint32_t(p0 >> 32) ^ x3[l] ^ k[1]};
+        x1[l] = std::uint32_t(p1);
+        x3[l] = std::uint32_t(p0);
+        x0[l] = y0;
+        x2[l] = y2;
+      }
+    }
+    out = {x0, x1, x2, x3};
+  }
+};
@@ -1,16 +1,37 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <random>
 #include <type_traits>
 #include <vector>
 
+#include "utils/philox.h"
+
 using std::uniform_real_distribution;
 using std::vector;
 
+/**
+ * Uniform random numbers from Philox4x32 (utils/philox.h), reproducible from
+ * a seed and a stream id. Every call draws from counters of its own: value i
+ * of the k-th call of a generator comes from the counter {i / per block,
+ * k, stream}, keyed by the seed. The values are filled in parallel chunks,
+ * and are the same whatever the number of threads.
+ */
 template <typename T>
 class RNG {
  public:
+  static constexpr std::uint64_t kDefaultSeed{0x5EED'0F'9A27'1C1E};
+
+  /**
+   * @param seed Key of the generator
+   * @param stream Independent sequences of one seed, e.g. one per rank
+   */
+  explicit RNG(const std::uint64_t seed = kDefaultSeed,
+               const std::uint32_t stream = 0) noexcept
+      : key_{std::uint32_t(seed), std::uint32_t(seed >> 32)},
+        stream_{stream} {}
+
   /**
    * @brief Returns std::vector of the type T with values uniformly distributed
    * between low and high. In the case of T a compound-type, low and high will
@@ -22,10 +43,16 @@ class RNG {
 
   /**
    * @brief Populates a raw array of size n with uniformly distributed values
-   * between low and high
+   * in [low, high)
    * @param data : the raw array
    */
   void GenerateUniformRandom(T* data, const size_t n, const T& low,
                              const T& high)
     requires std::floating_point<T>;
+
+ private:
+  Philox4x32::Key key_;
+  std::uint32_t stream_;
+  // Calls so far
+  std::uint32_t draw_{0};
 };
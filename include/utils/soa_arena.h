@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "utils/parallel.h"
+
+// Raw memory of SoaArena, aligned to at least 64 bytes. Throws std::bad_alloc.
+void* AllocateArena(size_t bytes, bool huge_pages);
+void FreeArena(void* p) noexcept;
+
+/**
+ * One allocation holding all the arrays (fields) of a Struct of Arrays
+ * particle set.
+ *
+ * Every field starts on a cache line and is padded to a multiple of kLanes
+ * elements, one 512-bit register, so a kernel may run full aligned registers
+ * over [0, Stride()) without a remainder loop. The memory, padding included,
+ * is zeroed by a ParallelFor sweep with the same chunks the integrator uses.
+ * Under the default first-touch policy this spreads the pages over the
+ * nodes of the pool's threads, on a best-effort basis: only with
+ * PARTICLES_AFFINITY pinning the workers do threads stay on one node, and
+ * as the pool steals chunks, neither the sweep nor a later loop is bound
+ * to run a chunk on the thread that touched it. Arenas of a few MiB are
+ * backed by transparent huge pages where the OS supports it.
+ *
+ * An arena may also adopt memory it does not own, e.g. a checkpoint file
+ * mapped into memory: the owner handle keeps it alive and releases it.
+ */
+template <std::floating_point T>
+class SoaArena {
+ public:
+  static constexpr size_t kAlignment{64};
+  static constexpr size_t kLanes{kAlignment / sizeof(T)};
+
+ private:
+  T* data_{nullptr};
+  size_t n_{0};
+  size_t stride_{0};
+  size_t num_fields_{0};
+  // Set for adopted memory, which is not freed here
+  std::shared_ptr<const void> owner_{};
+
+ public:
+  SoaArena() = default;
+
+  /**
+   * @param n Number of particles, i.e. used elements of every field
+   * @param huge_pages Ask for transparent huge pages (madvise) when the arena
+   * is large enough to use them
+   */
+  SoaArena(const size_t n, const size_t num_fields,
+           const bool huge_pages = true)
+      : n_{n},
+        stride_{(n + kLanes - 1) / kLanes * kLanes},
+        num_fields_{num_fields} {
+    if (stride_ * num_fields_ == 0) return;
+    data_ = static_cast<T*>(AllocateArena(Bytes(), huge_pages));
+    ParallelFor(stride_, [this](const size_t begin, const size_t end) {
+      for (size_t k = 0; k < num_fields_; ++k)
+        std::fill(data_ + k * stride_ + begin, data_ + k * stride_ + end, T(0));
+    });
+  }
+
+  /**
+   * @brief Adopts num_fields fields of stride elements, one after the other
+   * from data, as laid out by an arena. Nothing is zeroed or copied.
+   * @param owner Keeps the memory alive as long as the arena
+   */
+  SoaArena(T* data, const size_t n, const size_t stride,
+           const size_t num_fields, std::shared_ptr<const void> owner)
+      : data_{data},
+        n_{n},
+        stride_{stride},
+        num_fields_{num_fields},
+        owner_{std::move(owner)} {}
+
+  SoaArena(const SoaArena&) = delete;
+  SoaArena& operator=(const SoaArena&) = delete;
+  SoaArena(SoaArena&& other) noexcept
+      : data_{std::exchange(other.data_, nullptr)},
+        n_{std::exchange(other.n_, 0)},
+        stride_{std::exchange(other.stride_, 0)},
+        num_fields_{std::exchange(other.num_fields_, 0)},
+        owner_{std::move(other.owner_)} {}
+  SoaArena& operator=(SoaArena&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(n_, other.n_);
+    std::swap(stride_, other.stride_);
+    std::swap(num_fields_, other.num_fields_);
+    std::swap(owner_, other.owner_);
+    return *this;
+  }
+  ~SoaArena() {
+    if (!owner_) FreeArena(data_);
+  }
+
+  // Start of field k, kAlignment aligned, Stride() elements
+  T* Field(const size_t k) const noexcept { return data_ + k * stride_; }
+
+  size_t Size() const noexcept { return n_; }
+  size_t Stride() const noexcept { return stride_; }
+  size_t NumFields() const noexcept { return num_fields_; }
+  size_t Bytes() const noexcept { return stride_ * num_fields_ * sizeof(T); }
+  // The memory belongs to someone else, see the adopting constructor
+  bool Adopted() const noexcept { return bool(owner_); }
+};
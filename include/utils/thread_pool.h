@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "utils/topology.h"
+
+/**
+ * Persistent work-stealing pool behind ParallelFor and ParallelReduce.
+ *
+ * Run(tasks, task) calls task(i) for every i in [0, tasks), on the calling
+ * thread and the workers. The range is split evenly among them up front,
+ * the caller taking the first part; each takes tasks from the front of its
+ * own range and, once it runs out, steals the back half of the largest range
+ * left. Workers live as long as the pool and spin a little before sleeping
+ * between jobs, so a job costs microseconds to start and join instead of a
+ * thread launch.
+ *
+ * On request, the workers are pinned by a ThreadAffinity policy over the
+ * NUMA topology (utils/topology.h), each to one CPU. Since a loop of the same
+ * length is split the same way every time, the pages an arena zeroes in a
+ * ParallelFor stay on the node of the threads that sweep them afterwards.
+ * Pinning is off by default: pools of several processes on one machine
+ * would all pin to the same first CPUs. The thread that calls Run() is
+ * never pinned.
+ *
+ * A Run() from inside a task, or while another thread's job is running,
+ * runs its tasks inline on the caller.
+ *
+ * If tasks throw, the tasks not yet started are skipped, the job is joined
+ * as usual and Run() rethrows the first exception on the caller.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @param threads Threads of a job, the caller included; 0 for the CPUs the
+   * process may run on
+   */
+  explicit ThreadPool(size_t threads = 0,
+                      ThreadAffinity affinity = ThreadAffinity::kNone);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // The pool of ParallelFor. PARTICLES_THREADS sets its initial size and
+  // PARTICLES_AFFINITY (none, compact, scatter) its policy, none if unset.
+  static ThreadPool& Global();
+
+  // Threads of a job, the caller included
+  size_t NumThreads() const noexcept { return slots_.size(); }
+  ThreadAffinity Affinity() const noexcept { return affinity_; }
+  // CPU of every thread, empty when not pinned. The first is the caller's
+  // share, left free for it but not pinned to.
+  const std::vector<int>& Cpus() const noexcept { return cpus_; }
+
+  // Stops the workers and starts `threads` - 1 new ones (0: all CPUs)
+  void Resize(size_t threads);
+  void Resize(size_t threads, ThreadAffinity affinity);
+
+  template <class F>
+  void Run(const size_t tasks, F&& task) {
+    using Fn = std::remove_reference_t<F>;
+    RunTasks(
+        tasks,
+        [](void* f, const size_t i) { (*static_cast<Fn*>(f))(i); },
+        const_cast<void*>(static_cast<const void*>(&task)));
+  }
+
+ private:
+  using TaskFn = void (*)(void*, size_t);
+
+  // A range of tasks, begin in the low and end in the high 32 bits, alone
+  // on its cache line
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> range{0};
+  };
+
+  void RunTasks(size_t tasks, TaskFn fn, void* context);
+  void Start(size_t threads, ThreadAffinity affinity);
+  void Stop();
+  // Runs tasks of the current job until no range has any left
+  void Work(size_t slot);
+  bool Pop(size_t slot, std::uint32_t& task);
+  bool Steal(size_t slot);
+
+  std::vector<Slot> slots_;
+  std::vector<std::thread> workers_;
+  ThreadAffinity affinity_{ThreadAffinity::kNone};
+  std::vector<int> cpus_;
+  // Odd while a job is open; workers join a job only while it is
+  std::atomic<std::uint64_t> epoch_{0};
+  // Workers inside Work(); the next job waits for none
+  std::atomic<size_t> busy_{0};
+  std::atomic<size_t> remaining_{0};
+  std::atomic<bool> stop_{false};
+  // The current job, read only after claiming one of its tasks
+  TaskFn fn_{nullptr};
+  void* context_{nullptr};
+  // The first exception of a task of the current job
+  std::atomic<bool> failed_{false};
+  std::exception_ptr error_{};
+  std::mutex error_mutex_;
+  // One job at a time
+  std::mutex run_;
+};
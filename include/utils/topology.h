@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * NUMA topology and thread placement, read from sysfs. The nodes and their
+ * CPUs come from /sys/devices/system/node, restricted to the CPUs this
+ * process may run on; without that directory (or NUMA) all allowed CPUs
+ * form one node.
+ */
+
+struct NumaNode {
+  int id{0};
+  std::vector<int> cpus;
+};
+
+/**
+ * How ThreadPool pins its threads:
+ *   kNone     not at all, the OS places them; the default
+ *   kCompact  fills the CPUs of node 0, then node 1, ...
+ *   kScatter  deals the threads round robin over the nodes
+ * Only the pool's workers are pinned, not the thread that calls Run(). A
+ * loop's contiguous chunks start out dealt over the threads in order, so
+ * under kCompact neighbouring chunks tend to share a node, but idle threads
+ * steal chunks: the thread that first touches a page is not always the one
+ * that processes it later.
+ */
+enum class ThreadAffinity { kNone, kCompact, kScatter };
+
+// "none", "compact" or "scatter"; throws std::runtime_error otherwise
+ThreadAffinity ParseThreadAffinity(std::string_view name);
+
+// CPUs of a sysfs cpulist, e.g. "0-3,8,10-11"; throws std::runtime_error
+std::vector<int> ParseCpuList(std::string_view list);
+
+// The CPUs this process may run on, in ascending order
+std::vector<int> AllowedCpus();
+
+/**
+ * @brief NUMA nodes with at least one allowed CPU, by id.
+ * @param root The sysfs node directory, another one for tests
+ */
+std::vector<NumaNode> NumaTopology(
+    const std::string& root = "/sys/devices/system/node");
+
+/**
+ * @brief CPU of each of `threads` threads under a policy; empty for kNone
+ * and when there are more threads than CPUs, which would stack threads on
+ * CPUs.
+ */
+std::vector<int> PlaceThreads(const std::vector<NumaNode>& nodes,
+                              size_t threads, ThreadAffinity affinity);
+
+// The node of a CPU, -1 if none has it
+int NodeOfCpu(const std::vector<NumaNode>& nodes, int cpu);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Hot path tracing: scoped zones timed with the time stamp counter into one
+ * ring buffer per thread, exported as Chrome trace JSON (chrome://tracing,
+ * ui.perfetto.dev).
+ *
+ * TRACE_ZONE("name") times the rest of the enclosing scope. It compiles to
+ * nothing unless PARTICLES_TRACE is defined (CMake ENABLE_TRACING). A zone
+ * costs two counter reads and one store into the buffer of its thread: no
+ * locks and no atomic read-modify-write. Only the first zone of a thread
+ * takes a lock, to register its buffer. Every buffer keeps the last
+ * kTraceCapacity zones. Names must be string literals, or outlive the
+ * export.
+ *
+ * Export and clear while the traced threads are between zones, e.g. after
+ * the step loop: a zone closing during the export may be missed.
+ */
+
+inline constexpr size_t kTraceCapacity{size_t(1) << 16};
+
+struct TraceEvent {
+  const char* name;
+  // TraceTicks() at the start and the end of the zone
+  std::uint64_t begin;
+  std::uint64_t end;
+};
+
+// Ring buffer of one thread: written by it alone, read by the exporter
+struct TraceBuffer {
+  // zones written, ever
+  std::atomic<std::uint64_t> head{0};
+  // first zone not cleared, moved by ClearTrace() only
+  std::atomic<std::uint64_t> tail{0};
+  std::uint32_t tid{0};
+  std::unique_ptr<TraceEvent[]> events{new TraceEvent[kTraceCapacity]};
+
+  void Push(const TraceEvent& event) noexcept {
+    const std::uint64_t h{head.load(std::memory_order_relaxed)};
+    events[h % kTraceCapacity] = event;
+    head.store(h + 1, std::memory_order_release);
+  }
+};
+
+// The time stamp counter where there is one, else nanoseconds
+inline std::uint64_t TraceTicks() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count());
+#endif
+}
+
+// New buffer of the calling thread, kept until the program exits
+TraceBuffer* RegisterTraceBuffer();
+
+inline TraceBuffer& ThisThreadTraceBuffer() {
+  thread_local TraceBuffer* const buffer{RegisterTraceBuffer()};
+  return *buffer;
+}
+
+class TraceZone {
+  const char* name_;
+  std::uint64_t begin_;
+
+ public:
+  explicit TraceZone(const char* name) noexcept
+      : name_{name}, begin_{TraceTicks()} {}
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+  ~TraceZone() { ThisThreadTraceBuffer().Push({name_, begin_, TraceTicks()}); }
+};
+
+/**
+ * @brief Writes the zones of every thread as Chrome trace JSON: one complete
+ * ("X") event per zone, in microseconds, and the thread names. Throws
+ * std::runtime_error when the file cannot be written.
+ */
+void WriteChromeTrace(const std::string& path);
+
+// Drops the zones recorded so far
+void ClearTrace();
+
+// Zones recorded and not cleared, over all threads
+size_t TraceEventCount();
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef PARTICLES_TRACE
+#define TRACE_ZONE(name) \
+  const TraceZone TRACE_CONCAT(trace_zone_, __LINE__) { name }
+#else
+#define TRACE_ZONE(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/parallel.h"
+
+/**
+ * Trajectory files: a stream of frames of positions, velocities and IDs.
+ *
+ *   file header   "PARTTRAJ", version
+ *   frame         TrajectoryFrameHeader, then every field in chunks of at
+ *                 most kTrajectoryChunk elements, each after a
+ *                 TrajectoryChunkHeader
+ *
+ * Values are stored as float32 or float64. A compressed frame XORs every
+ * value with the same value of the previous frame, which leaves mostly zero
+ * high bytes for particles that moved little, and keeps only the significant
+ * low bytes of every word: a 4-bit count per word, then the bytes. This is
+ * lossless. A frame with a new particle count, or the first one, is XORed
+ * with zeros.
+ */
+
+inline constexpr char kTrajectoryMagic[8]{'P', 'A', 'R', 'T', 'T', 'R', 'A',
+                                          'J'};
+inline constexpr std::uint32_t kTrajectoryVersion{1};
+inline constexpr size_t kTrajectoryChunk{size_t(1) << 16};
+// x, y, z, vx, vy, vz, id
+inline constexpr size_t kTrajectoryFields{7};
+
+struct TrajectoryFrameHeader {
+  char magic[4];
+  // kFloat32, kXorDelta
+  std::uint32_t flags;
+  std::uint64_t step;
+  std::uint64_t n;
+  static constexpr std::uint32_t kFloat32{1}, kXorDelta{2};
+};
+
+struct TrajectoryChunkHeader {
+  std::uint32_t field;
+  // 0 raw, 1 XOR and significant bytes
+  std::uint32_t encoding;
+  std::uint64_t count;
+  std::uint64_t bytes;
+};
+
+struct TrajectoryOptions {
+  // Stores float32 whatever the simulation precision
+  bool float32{false};
+  // Lossless XOR against the previous frame, see the file comment
+  bool compress{true};
+  // Snapshot buffers: Record() only waits when all are queued for writing
+  size_t buffers{2};
+};
+
+/**
+ * Writes trajectory frames from a background thread. Record() copies the
+ * arrays into a free snapshot buffer from a pool and queues it; encoding and
+ * file output happen on the writer thread, so the caller pays for the copy
+ * only, unless it outpaces the disk by more than the pool.
+ *
+ * Errors of the writer thread are rethrown by the next Record(), Flush() or
+ * Close(); the destructor closes and swallows them.
+ */
+class TrajectoryWriter {
+  struct Snapshot {
+    std::uint64_t step{0};
+    size_t n{0};
+    // raw words of every field
+    std::array<std::vector<std::byte>, kTrajectoryFields> fields{};
+  };
+
+  TrajectoryOptions options_;
+  std::ofstream out_;
+  std::string path_;
+  // owned by the writer thread: the last frame written, and encoding space
+  Snapshot previous_{};
+  std::vector<std::byte> encoded_{};
+
+  mutable std::mutex mutex_{};
+  std::condition_variable changed_{};
+  std::vector<std::unique_ptr<Snapshot>> free_{};
+  std::deque<std::unique_ptr<Snapshot>> queue_{};
+  size_t in_flight_{0};
+  bool closing_{false};
+  std::exception_ptr error_{};
+  std::uint64_t frames_{0};
+  std::uint64_t bytes_{0};
+  std::thread thread_{};
+
+ public:
+  explicit TrajectoryWriter(const std::string& path,
+                            TrajectoryOptions options = {});
+  TrajectoryWriter(const TrajectoryWriter&) = delete;
+  TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+  ~TrajectoryWriter();
+
+  /**
+   * @brief Queues a frame of n particles: positions, velocities and the ID
+   * of every particle. The arrays may change as soon as this returns.
+   * @throws std::invalid_argument unless all seven have the same size
+   */
+  template <std::floating_point T>
+  void Record(std::uint64_t step, std::span<const T> x, std::span<const T> y,
+              std::span<const T> z, std::span<const T> vx,
+              std::span<const T> vy, std::span<const T> vz,
+              std::span<const std::uint32_t> ids) {
+    const size_t n{x.size()};
+    for (const size_t size : {y.size(), z.size(), vx.size(), vy.size(),
+                              vz.size(), ids.size()})
+      if (size != n)
+        throw std::invalid_argument(
+            "TrajectoryWriter::Record: arrays of " + std::to_string(n) +
+            " and " + std::to_string(size) + " elements");
+    std::unique_ptr<Snapshot> snapshot{Acquire()};
+    snapshot->step = step;
+    snapshot->n = n;
+    const std::span<const T> values[]{x, y, z, vx, vy, vz};
+    for (size_t f = 0; f < 6; ++f) {
+      if (options_.float32)
+        Copy<float>(values[f], snapshot->fields[f]);
+      else
+        Copy<double>(values[f], snapshot->fields[f]);
+    }
+    Copy<std::uint32_t>(ids, snapshot->fields[6]);
+    Submit(std::move(snapshot));
+  }
+
+  // Waits until every queued frame is written
+  void Flush();
+  // Flushes and stops the writer thread; Record() must not follow
+  void Close();
+
+  std::uint64_t Frames() const;
+  // File bytes written so far
+  std::uint64_t Bytes() const;
+
+ private:
+  template <class Stored, class U>
+  static void Copy(const std::span<const U> in, std::vector<std::byte>& out) {
+    out.resize(in.size() * sizeof(Stored));
+    auto* const words{reinterpret_cast<Stored*>(out.data())};
+    ParallelFor(in.size(), [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) words[i] = Stored(in[i]);
+    });
+  }
+
+  std::unique_ptr<Snapshot> Acquire();
+  void Submit(std::unique_ptr<Snapshot> snapshot);
+  void Run();
+  void WriteFrame(const Snapshot& snapshot);
+  void RethrowLocked();
+};
+
+/**
+ * Reads the frames of a trajectory file back, in order. Throws
+ * std::runtime_error on a damaged file.
+ */
+class TrajectoryReader {
+ public:
+  struct Frame {
+    std::uint64_t step{0};
+    bool float32{false};
+    // values widened to double, exactly
+    std::vector<double> x, y, z, vx, vy, vz;
+    std::vector<std::uint32_t> ids;
+  };
+
+ private:
+  std::ifstream in_;
+  std::string path_;
+  // raw words of the previous frame, per field
+  std::array<std::vector<std::byte>, kTrajectoryFields> previous_{};
+
+ public:
+  explicit TrajectoryReader(const std::string& path);
+
+  // Next frame into frame; false at the end of the file
+  bool Next(Frame& frame);
+};
@@ -1,6 +1,33 @@
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
 
 #include "sim/aos_particle_system.h"
+#include "sim/constants.hpp"
+#include "sim/gravity_kernels.h"
+#include "utils/parallel.h"
+#include "utils/trace.h"
+
+namespace {
+// Field `name` of a checkpoint as doubles, at least n of them
+std::vector<DType> ReadField(const Checkpoint& checkpoint,
+                             const std::string& name, const size_t n) {
+  const CheckpointField* const field{checkpoint.Find(name)};
+  if (!field || field->count < n)
+    throw std::runtime_error("checkpoint " + checkpoint.Path() + ": field " +
+                             name + " missing or short");
+  std::vector<DType> values(n);
+  auto copy = [&](const auto in) {
+    std::copy(in.begin(), in.begin() + n, values.begin());
+  };
+  if (field->type == FieldType::kFloat32)
+    copy(checkpoint.Data<float>(*field));
+  else
+    copy(checkpoint.Data<double>(*field));
+  return values;
+}
+}  // namespace
 
 ParticleSystemAoS::ParticleSystemAoS(const size_t n) { particles_.reserve(n); }
 ParticleSystemAoS::ParticleSystemAoS(
@@ -8,6 +35,61 @@ ParticleSystemAoS::ParticleSystemAoS(
   particles_ = std::move(particles);
 }
 
+ParticleSystemAoS::ParticleSystemAoS(const Checkpoint& checkpoint) {
+  const size_t n{checkpoint.Header().n};
+  const std::vector<DType> x{ReadField(checkpoint, "x", n)},
+      y{ReadField(checkpoint, "y", n)}, z{ReadField(checkpoint, "z", n)},
+      m{ReadField(checkpoint, "m", n)}, vx{ReadField(checkpoint, "vx", n)},
+      vy{ReadField(checkpoint, "vy", n)}, vz{ReadField(checkpoint, "vz", n)};
+  // IDs are 64-bit here, 32-bit in Particles, and optional
+  std::vector<size_t> id(n);
+  for (size_t i = 0; i < n; ++i) id[i] = i;
+  if (const CheckpointField* const field{checkpoint.Find("id")}) {
+    if (field->count < n)
+      throw std::runtime_error("checkpoint " + checkpoint.Path() +
+                               ": field id short");
+    auto copy = [&](const auto in) {
+      std::copy(in.begin(), in.begin() + n, id.begin());
+    };
+    if (field->type == FieldType::kUint32)
+      copy(checkpoint.Data<std::uint32_t>(*field));
+    else
+      copy(checkpoint.Data<std::uint64_t>(*field));
+  }
+  particles_.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    particles_.emplace_back(PointType{x[i], y[i], z[i]}, m[i],
+                            VectorType{vx[i], vy[i], vz[i]}, id[i]);
+}
+
+void ParticleSystemAoS::Save(const std::string& path) const {
+  const size_t n{particles_.size()};
+  std::vector<DType> x(n), y(n), z(n), m(n), vx(n), vy(n), vz(n);
+  std::vector<std::uint64_t> id(n);
+  for (size_t i = 0; i < n; ++i) {
+    const ParticleStructure& p{particles_[i]};
+    x[i] = p.p.x;
+    y[i] = p.p.y;
+    z[i] = p.p.z;
+    m[i] = p.m;
+    vx[i] = p.v.x;
+    vy[i] = p.v.y;
+    vz[i] = p.v.z;
+    id[i] = p.id;
+  }
+  CheckpointWriter writer;
+  writer.Add<DType>("x", x);
+  writer.Add<DType>("y", y);
+  writer.Add<DType>("z", z);
+  writer.Add<DType>("m", m);
+  writer.Add<DType>("vx", vx);
+  writer.Add<DType>("vy", vy);
+  writer.Add<DType>("vz", vz);
+  writer.Add<std::uint64_t>("id", id);
+  // no time step of its own: UpdateN2 takes it
+  writer.Write(path, n, 0., 0, 0);
+}
+
 void ParticleSystemAoS::AddParticles(
     std::vector<ParticleStructure>&& particles) {
   std::move(particles.begin(), particles.end(), std::back_inserter(particles_));
@@ -15,9 +97,71 @@ void ParticleSystemAoS::AddParticles(
 
 void ParticleSystemAoS::UpdateN2(const std::vector<VectorType>& F_ext,
                                  const VectorType& F_global, const DType& d_t) {
-  for (ParticleStructure& el : particles_) {
-    el.Update(particles_, F_ext, F_global, d_t);
-  }
+  TRACE_ZONE("ParticleSystemAoS::UpdateN2");
+  const size_t n{particles_.size()};
+  forces_.resize(n);
+  ParallelFor(n, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const size_t id{particles_[i].id};
+      forces_[i] = id < F_ext.size() ? F_ext[id] + F_global : F_global;
+    }
+  });
+  // Each tile transposed into plain arrays for the SIMD kernel, with the
+  // coupling and softening of ForceFrom()
+  constexpr size_t kMaxBlock{DirectSum<DType>::kMaxBlock};
+  struct Block {
+    std::array<DType, kMaxBlock> x, y, z, Gm, m, fx, fy, fz;
+  };
+  auto gather = [this](const size_t begin, const size_t end, Block& b) {
+    for (size_t i = begin; i < end; ++i) {
+      const ParticleStructure& p{particles_[i]};
+      const size_t k{i - begin};
+      b.x[k] = p.p.x;
+      b.y[k] = p.p.y;
+      b.z[k] = p.p.z;
+      b.Gm[k] = p.Gm();
+      b.m[k] = p.m;
+      b.fx[k] = b.fy[k] = b.fz[k] = DType(0);
+    }
+  };
+  auto scatter = [this](const size_t begin, const size_t end, Block& b) {
+    for (size_t i = begin; i < end; ++i) {
+      const size_t k{i - begin};
+      forces_[i] += VectorType{b.fx[k], b.fy[k], b.fz[k]};
+    }
+  };
+  const TileKernel<DType> kernel{GetTileKernel<DType>()};
+  using Tile = DirectSum<DType>::Tile;
+  tiles_.ForEachTile(n, [&](const Tile& t) {
+    Block i, j;
+    const bool diagonal{t.i0 == t.j0};
+    gather(t.j0, t.j1, j);
+    if (!diagonal) gather(t.i0, t.i1, i);
+    Block& bi{diagonal ? j : i};
+    kernel({.xi = bi.x.data(),
+            .yi = bi.y.data(),
+            .zi = bi.z.data(),
+            .Gmi = bi.Gm.data(),
+            .ni = t.i1 - t.i0,
+            .xj = j.x.data(),
+            .yj = j.y.data(),
+            .zj = j.z.data(),
+            .mj = j.m.data(),
+            .nj = t.j1 - t.j0,
+            .fxi = bi.fx.data(),
+            .fyi = bi.fy.data(),
+            .fzi = bi.fz.data(),
+            .fxj = j.fx.data(),
+            .fyj = j.fy.data(),
+            .fzj = j.fz.data(),
+            .eps2 = ParticleStructure::kEpsilon2,
+            .diagonal = diagonal});
+    scatter(t.j0, t.j1, j);
+    if (!diagonal) scatter(t.i0, t.i1, i);
+  });
+  ParallelFor(n, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) particles_[i].Update(forces_[i], d_t);
+  });
 }
 
 std::ostream& operator<<(std::ostream& os, const ParticleSystemAoS& ps) {
@@ -0,0 +1,120 @@
+#include <atomic>
+#include <cmath>
+
+#include "gravity_tile.h"
+#include "sim/gravity_kernels.h"
+
+namespace {
+// Portable fallback, one lane; left to the auto-vectoriser of the baseline
+template <typename TT>
+struct Scalar {
+  using T = TT;
+  using Reg = T;
+  static constexpr size_t kWidth{1};
+  static Reg Zero() { return T(0); }
+  static Reg Set1(const T t) { return t; }
+  static Reg Load(const T* p) { return *p; }
+  static void Store(T* p, const Reg r) { *p = r; }
+  static Reg Add(const Reg a, const Reg b) { return a + b; }
+  static Reg Sub(const Reg a, const Reg b) { return a - b; }
+  static Reg Mul(const Reg a, const Reg b) { return a * b; }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) { return a * b + c; }
+  static Reg InvSqrt(const Reg r) {
+    using std::sqrt;
+    return T(1) / sqrt(r);
+  }
+  static T Sum(const Reg r) { return r; }
+};
+
+struct ScalarMixed : Scalar<float> {
+  static double SumWide(const Reg r) { return double(r); }
+};
+
+template <typename T>
+void GravityTileScalar(const TileArgs<T>& a) {
+  GravityTile<Scalar<T>>(a);
+}
+
+void MixedGravityTileScalar(const TileArgs<double>& a) {
+  MixedGravityTile<ScalarMixed>(a);
+}
+
+// -1: not set, use DetectSimdIsa()
+std::atomic<int> active_isa{-1};
+}  // namespace
+
+SimdIsa DetectSimdIsa() noexcept {
+#ifdef PARTICLES_X86_KERNELS
+  static const SimdIsa isa{[] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdIsa::kAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return SimdIsa::kAvx2;
+    if (__builtin_cpu_supports("sse4.2")) return SimdIsa::kSse42;
+    return SimdIsa::kScalar;
+  }()};
+  return isa;
+#else
+  return SimdIsa::kScalar;
+#endif
+}
+
+SimdIsa ActiveSimdIsa() noexcept {
+  const int isa{active_isa.load(std::memory_order_relaxed)};
+  return isa < 0 ? DetectSimdIsa() : static_cast<SimdIsa>(isa);
+}
+
+void SetSimdIsa(const SimdIsa isa) noexcept {
+  const SimdIsa best{DetectSimdIsa()};
+  active_isa.store(static_cast<int>(isa <= best ? isa : best),
+                   std::memory_order_relaxed);
+}
+
+const char* SimdIsaName(const SimdIsa isa) noexcept {
+  switch (isa) {
+    case SimdIsa::kSse42:
+      return "sse4.2";
+    case SimdIsa::kAvx2:
+      return "avx2";
+    case SimdIsa::kAvx512:
+      return "avx512";
+    case SimdIsa::kScalar:
+      break;
+  }
+  return "scalar";
+}
+
+template <std::floating_point T>
+TileKernel<T> GetTileKernel(const ForcePrecision precision) noexcept {
+  if constexpr (std::same_as<T, double>) {
+    if (precision == ForcePrecision::kMixed) {
+      switch (ActiveSimdIsa()) {
+#ifdef PARTICLES_X86_KERNELS
+        case SimdIsa::kAvx512:
+          return MixedGravityTileAvx512;
+        case SimdIsa::kAvx2:
+          return MixedGravityTileAvx2;
+        case SimdIsa::kSse42:
+          return MixedGravityTileSse42;
+#endif
+        default:
+          return MixedGravityTileScalar;
+      }
+    }
+  }
+  switch (ActiveSimdIsa()) {
+#ifdef PARTICLES_X86_KERNELS
+    case SimdIsa::kAvx512:
+      return GravityTileAvx512;
+    case SimdIsa::kAvx2:
+      return GravityTileAvx2;
+    case SimdIsa::kSse42:
+      return GravityTileSse42;
+#endif
+    default:
+      return GravityTileScalar<T>;
+  }
+}
+
+template TileKernel<float> GetTileKernel<float>(ForcePrecision) noexcept;
+template TileKernel<double> GetTileKernel<double>(ForcePrecision) noexcept;
@@ -0,0 +1,82 @@
+// Compiled with -mavx2 -mfma
+#include <immintrin.h>
+
+#include "gravity_tile.h"
+
+namespace {
+struct Avx2F {
+  using T = float;
+  using Reg = __m256;
+  static constexpr size_t kWidth{8};
+  static Reg Zero() { return _mm256_setzero_ps(); }
+  static Reg Set1(const T t) { return _mm256_set1_ps(t); }
+  static Reg Load(const T* p) { return _mm256_loadu_ps(p); }
+  static void Store(T* p, const Reg r) { _mm256_storeu_ps(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm256_add_ps(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm256_sub_ps(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm256_mul_ps(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(r));
+  }
+  static T Sum(const Reg r) {
+    __m128 s{
+        _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1))};
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+};
+
+struct Avx2D {
+  using T = double;
+  using Reg = __m256d;
+  static constexpr size_t kWidth{4};
+  static Reg Zero() { return _mm256_setzero_pd(); }
+  static Reg Set1(const T t) { return _mm256_set1_pd(t); }
+  static Reg Load(const T* p) { return _mm256_loadu_pd(p); }
+  static void Store(T* p, const Reg r) { _mm256_storeu_pd(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm256_add_pd(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm256_sub_pd(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm256_mul_pd(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm256_div_pd(_mm256_set1_pd(1.), _mm256_sqrt_pd(r));
+  }
+  static T Sum(const Reg r) {
+    const __m128d s{
+        _mm_add_pd(_mm256_castpd256_pd128(r), _mm256_extractf128_pd(r, 1))};
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+  }
+};
+
+// float pairs, double per-particle sums
+struct Avx2Mixed : Avx2F {
+  // rsqrt (12 bits) refined by one Newton step: y (3 - r y²) / 2
+  static Reg InvSqrt(const Reg r) {
+    const Reg y{_mm256_rsqrt_ps(r)};
+    const Reg ry2{_mm256_mul_ps(_mm256_mul_ps(r, y), y)};
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y),
+                         _mm256_sub_ps(_mm256_set1_ps(3.f), ry2));
+  }
+  static __m256d Low(const Reg r) {
+    return _mm256_cvtps_pd(_mm256_castps256_ps128(r));
+  }
+  static __m256d High(const Reg r) {
+    return _mm256_cvtps_pd(_mm256_extractf128_ps(r, 1));
+  }
+  static double SumWide(const Reg r) {
+    return Avx2D::Sum(_mm256_add_pd(Low(r), High(r)));
+  }
+};
+}  // namespace
+
+void GravityTileAvx2(const TileArgs<float>& a) { GravityTile<Avx2F>(a); }
+void GravityTileAvx2(const TileArgs<double>& a) { GravityTile<Avx2D>(a); }
+void MixedGravityTileAvx2(const TileArgs<double>& a) {
+  MixedGravityTile<Avx2Mixed>(a);
+}
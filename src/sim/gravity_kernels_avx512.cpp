@@ -0,0 +1,77 @@
+// Compiled with -mavx512f -mavx2 -mfma
+// gcc-12 warns inside its own avx512fintrin.h (_mm512_undefined_*, PR105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+
+#include "gravity_tile.h"
+
+namespace {
+struct Avx512F {
+  using T = float;
+  using Reg = __m512;
+  static constexpr size_t kWidth{16};
+  static Reg Zero() { return _mm512_setzero_ps(); }
+  static Reg Set1(const T t) { return _mm512_set1_ps(t); }
+  static Reg Load(const T* p) { return _mm512_loadu_ps(p); }
+  static void Store(T* p, const Reg r) { _mm512_storeu_ps(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm512_add_ps(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm512_sub_ps(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm512_mul_ps(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm512_div_ps(_mm512_set1_ps(1.f), _mm512_sqrt_ps(r));
+  }
+  static T Sum(const Reg r) { return _mm512_reduce_add_ps(r); }
+};
+
+struct Avx512D {
+  using T = double;
+  using Reg = __m512d;
+  static constexpr size_t kWidth{8};
+  static Reg Zero() { return _mm512_setzero_pd(); }
+  static Reg Set1(const T t) { return _mm512_set1_pd(t); }
+  static Reg Load(const T* p) { return _mm512_loadu_pd(p); }
+  static void Store(T* p, const Reg r) { _mm512_storeu_pd(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm512_add_pd(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm512_sub_pd(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm512_mul_pd(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm512_fmadd_pd(a, b, c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm512_div_pd(_mm512_set1_pd(1.), _mm512_sqrt_pd(r));
+  }
+  static T Sum(const Reg r) { return _mm512_reduce_add_pd(r); }
+};
+
+// float pairs, double per-particle sums
+struct Avx512Mixed : Avx512F {
+  // rsqrt14 refined by one Newton step: y (3 - r y²) / 2
+  static Reg InvSqrt(const Reg r) {
+    const Reg y{_mm512_rsqrt14_ps(r)};
+    const Reg ry2{_mm512_mul_ps(_mm512_mul_ps(r, y), y)};
+    return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), y),
+                         _mm512_sub_ps(_mm512_set1_ps(3.f), ry2));
+  }
+  static __m512d Low(const Reg r) {
+    return _mm512_cvtps_pd(_mm512_castps512_ps256(r));
+  }
+  static __m512d High(const Reg r) {
+    return _mm512_cvtps_pd(_mm256_castpd_ps(
+        _mm512_extractf64x4_pd(_mm512_castps_pd(r), 1)));
+  }
+  static double SumWide(const Reg r) {
+    return _mm512_reduce_add_pd(_mm512_add_pd(Low(r), High(r)));
+  }
+};
+}  // namespace
+
+void GravityTileAvx512(const TileArgs<float>& a) { GravityTile<Avx512F>(a); }
+void GravityTileAvx512(const TileArgs<double>& a) { GravityTile<Avx512D>(a); }
+void MixedGravityTileAvx512(const TileArgs<double>& a) {
+  MixedGravityTile<Avx512Mixed>(a);
+}
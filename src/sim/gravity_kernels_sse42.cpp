@@ -0,0 +1,73 @@
+// Compiled with -msse4.2
+#include <immintrin.h>
+
+#include "gravity_tile.h"
+
+namespace {
+struct Sse42F {
+  using T = float;
+  using Reg = __m128;
+  static constexpr size_t kWidth{4};
+  static Reg Zero() { return _mm_setzero_ps(); }
+  static Reg Set1(const T t) { return _mm_set1_ps(t); }
+  static Reg Load(const T* p) { return _mm_loadu_ps(p); }
+  static void Store(T* p, const Reg r) { _mm_storeu_ps(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm_add_ps(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm_sub_ps(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm_mul_ps(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(r));
+  }
+  static T Sum(Reg r) {
+    r = _mm_add_ps(r, _mm_movehl_ps(r, r));
+    r = _mm_add_ss(r, _mm_shuffle_ps(r, r, 1));
+    return _mm_cvtss_f32(r);
+  }
+};
+
+struct Sse42D {
+  using T = double;
+  using Reg = __m128d;
+  static constexpr size_t kWidth{2};
+  static Reg Zero() { return _mm_setzero_pd(); }
+  static Reg Set1(const T t) { return _mm_set1_pd(t); }
+  static Reg Load(const T* p) { return _mm_loadu_pd(p); }
+  static void Store(T* p, const Reg r) { _mm_storeu_pd(p, r); }
+  static Reg Add(const Reg a, const Reg b) { return _mm_add_pd(a, b); }
+  static Reg Sub(const Reg a, const Reg b) { return _mm_sub_pd(a, b); }
+  static Reg Mul(const Reg a, const Reg b) { return _mm_mul_pd(a, b); }
+  static Reg MulAdd(const Reg a, const Reg b, const Reg c) {
+    return _mm_add_pd(_mm_mul_pd(a, b), c);
+  }
+  static Reg InvSqrt(const Reg r) {
+    return _mm_div_pd(_mm_set1_pd(1.), _mm_sqrt_pd(r));
+  }
+  static T Sum(const Reg r) {
+    return _mm_cvtsd_f64(_mm_add_sd(r, _mm_unpackhi_pd(r, r)));
+  }
+};
+
+// float pairs, double per-particle sums
+struct Sse42Mixed : Sse42F {
+  // rsqrt (12 bits) refined by one Newton step: y (3 - r y²) / 2
+  static Reg InvSqrt(const Reg r) {
+    const Reg y{_mm_rsqrt_ps(r)};
+    const Reg ry2{_mm_mul_ps(_mm_mul_ps(r, y), y)};
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y),
+                      _mm_sub_ps(_mm_set1_ps(3.f), ry2));
+  }
+  static double SumWide(const Reg r) {
+    return Sse42D::Sum(
+        _mm_add_pd(_mm_cvtps_pd(r), _mm_cvtps_pd(_mm_movehl_ps(r, r))));
+  }
+};
+}  // namespace
+
+void GravityTileSse42(const TileArgs<float>& a) { GravityTile<Sse42F>(a); }
+void GravityTileSse42(const TileArgs<double>& a) { GravityTile<Sse42D>(a); }
+void MixedGravityTileSse42(const TileArgs<double>& a) {
+  MixedGravityTile<Sse42Mixed>(a);
+}
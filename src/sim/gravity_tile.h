@@ -0,0 +1,216 @@
+#pragma once
+
+// Private to the gravity kernel translation units. Every instruction set
+// instantiates GravityTile with a register description V that lives in an
+// anonymous namespace, so the instantiations never merge across translation
+// units compiled with different -m flags. For the same reason this header
+// uses no inline library code (e.g. std::min).
+//
+// V provides, for kWidth lanes of type T held in a Reg:
+//   Zero(), Set1(t), Load(p), Store(p, r), Add, Sub, Mul,
+//   MulAdd(a, b, c) = a * b + c, InvSqrt(r) = 1 / sqrt(r), Sum(r) -> T
+//
+// The mixed precision kernel takes a float description M (T = float) with
+// the same members plus SumWide(r) -> double, the lanes summed in double.
+
+#include <cstddef>
+
+#include "sim/gravity_kernels.h"
+
+// kPotential: also sums Gm_i m_j / r per pair, for TileArgs::potential
+template <class V, bool kPotential>
+inline void GravityTilePass(const TileArgs<typename V::T>& a) {
+  using T = typename V::T;
+  using Reg = typename V::Reg;
+  constexpr size_t W{V::kWidth};
+  const Reg eps2{V::Set1(a.eps2)};
+  double potential{0};
+
+  for (size_t i = 0; i < a.ni; ++i) {
+    const Reg xi{V::Set1(a.xi[i])};
+    const Reg yi{V::Set1(a.yi[i])};
+    const Reg zi{V::Set1(a.zi[i])};
+    const Reg Gmi{V::Set1(a.Gmi[i])};
+    Reg fxi{V::Zero()}, fyi{V::Zero()}, fzi{V::Zero()};
+    Reg ui{V::Zero()};
+
+    // W pairs (i, j..j+W), reaction subtracted from the j accumulators
+    auto interact = [&](const T* xj, const T* yj, const T* zj, const T* mj,
+                        T* fxj, T* fyj, T* fzj) {
+      const Reg rx{V::Sub(V::Load(xj), xi)};
+      const Reg ry{V::Sub(V::Load(yj), yi)};
+      const Reg rz{V::Sub(V::Load(zj), zi)};
+      const Reg r2{
+          V::MulAdd(rx, rx, V::MulAdd(ry, ry, V::MulAdd(rz, rz, eps2)))};
+      const Reg inv_r{V::InvSqrt(r2)};
+      const Reg inv_r3{V::Mul(inv_r, V::Mul(inv_r, inv_r))};
+      const Reg Gmm{V::Mul(Gmi, V::Load(mj))};
+      const Reg F{V::Mul(Gmm, inv_r3)};
+      if constexpr (kPotential) ui = V::MulAdd(Gmm, inv_r, ui);
+      const Reg fx{V::Mul(F, rx)};
+      const Reg fy{V::Mul(F, ry)};
+      const Reg fz{V::Mul(F, rz)};
+      fxi = V::Add(fxi, fx);
+      fyi = V::Add(fyi, fy);
+      fzi = V::Add(fzi, fz);
+      V::Store(fxj, V::Sub(V::Load(fxj), fx));
+      V::Store(fyj, V::Sub(V::Load(fyj), fy));
+      V::Store(fzj, V::Sub(V::Load(fzj), fz));
+    };
+
+    size_t j{a.diagonal ? i + 1 : 0};
+    for (; j + W <= a.nj; j += W)
+      interact(a.xj + j, a.yj + j, a.zj + j, a.mj + j, a.fxj + j, a.fyj + j,
+               a.fzj + j);
+
+    // Remainder: pad to a full register with massless particles one unit
+    // away from i, so the padding contributes exactly zero.
+    if (j < a.nj) {
+      const size_t rem{a.nj - j};
+      T px[W], py[W], pz[W], pm[W], pfx[W], pfy[W], pfz[W];
+      for (size_t k = 0; k < W; ++k) {
+        const bool real{k < rem};
+        px[k] = real ? a.xj[j + k] : a.xi[i] + T(1);
+        py[k] = real ? a.yj[j + k] : a.yi[i];
+        pz[k] = real ? a.zj[j + k] : a.zi[i];
+        pm[k] = real ? a.mj[j + k] : T(0);
+        pfx[k] = pfy[k] = pfz[k] = T(0);
+      }
+      interact(px, py, pz, pm, pfx, pfy, pfz);
+      for (size_t k = 0; k < rem; ++k) {
+        a.fxj[j + k] += pfx[k];
+        a.fyj[j + k] += pfy[k];
+        a.fzj[j + k] += pfz[k];
+      }
+    }
+
+    a.fxi[i] += V::Sum(fxi);
+    a.fyi[i] += V::Sum(fyi);
+    a.fzi[i] += V::Sum(fzi);
+    if constexpr (kPotential) potential += double(V::Sum(ui));
+  }
+  if constexpr (kPotential) *a.potential -= potential;
+}
+
+template <class V>
+inline void GravityTile(const TileArgs<typename V::T>& a) {
+  if (a.potential)
+    GravityTilePass<V, true>(a);
+  else
+    GravityTilePass<V, false>(a);
+}
+
+/**
+ * Double state, float pair arithmetic. The j-block is converted to float in
+ * chunks of kChunk particles, relative to the first i particle of the tile so
+ * that clustered tiles keep the precision of their separations. Within a
+ * chunk the forces are summed in float, at most kChunk terms for any
+ * particle; the chunk sums are then added to the double accumulators.
+ */
+template <class M, bool kPotential>
+inline void MixedGravityTilePass(const TileArgs<double>& a) {
+  using Reg = typename M::Reg;
+  constexpr size_t W{M::kWidth};
+  constexpr size_t kChunk{256};
+  if (a.ni == 0) return;
+
+  const double ox{a.xi[0]}, oy{a.yi[0]}, oz{a.zi[0]};
+  const Reg eps2{M::Set1(float(a.eps2))};
+  double potential{0};
+  // padded to a multiple of W with massless particles far away, so that the
+  // padding contributes exactly zero even for eps2 = 0
+  alignas(64) float xj[kChunk + W], yj[kChunk + W], zj[kChunk + W],
+      mj[kChunk + W];
+  alignas(64) float fxj[kChunk + W], fyj[kChunk + W], fzj[kChunk + W];
+
+  for (size_t c0 = 0; c0 < a.nj; c0 += kChunk) {
+    const size_t nc{c0 + kChunk < a.nj ? kChunk : a.nj - c0};
+    for (size_t k = 0; k < nc + W; ++k) {
+      const bool real{k < nc};
+      xj[k] = real ? float(a.xj[c0 + k] - ox) : 1e18f;
+      yj[k] = real ? float(a.yj[c0 + k] - oy) : 0.f;
+      zj[k] = real ? float(a.zj[c0 + k] - oz) : 0.f;
+      mj[k] = real ? float(a.mj[c0 + k]) : 0.f;
+      fxj[k] = fyj[k] = fzj[k] = 0.f;
+    }
+
+    for (size_t i = 0; i < a.ni; ++i) {
+      size_t j{a.diagonal && i + 1 > c0 ? i + 1 - c0 : 0};
+      if (j >= nc) continue;
+      const float xif{float(a.xi[i] - ox)};
+      const Reg xi{M::Set1(xif)};
+      const Reg yi{M::Set1(float(a.yi[i] - oy))};
+      const Reg zi{M::Set1(float(a.zi[i] - oz))};
+      const Reg Gmi{M::Set1(float(a.Gmi[i]))};
+      Reg fxi{M::Zero()}, fyi{M::Zero()}, fzi{M::Zero()};
+      Reg ui{M::Zero()};
+
+      auto interact = [&](const float* px, const float* pm, const size_t k) {
+        const Reg rx{M::Sub(M::Load(px), xi)};
+        const Reg ry{M::Sub(M::Load(yj + k), yi)};
+        const Reg rz{M::Sub(M::Load(zj + k), zi)};
+        const Reg r2{
+            M::MulAdd(rx, rx, M::MulAdd(ry, ry, M::MulAdd(rz, rz, eps2)))};
+        const Reg inv_r{M::InvSqrt(r2)};
+        const Reg inv_r3{M::Mul(inv_r, M::Mul(inv_r, inv_r))};
+        const Reg Gmm{M::Mul(Gmi, M::Load(pm))};
+        const Reg F{M::Mul(Gmm, inv_r3)};
+        if constexpr (kPotential) ui = M::MulAdd(Gmm, inv_r, ui);
+        const Reg fx{M::Mul(F, rx)};
+        const Reg fy{M::Mul(F, ry)};
+        const Reg fz{M::Mul(F, rz)};
+        fxi = M::Add(fxi, fx);
+        fyi = M::Add(fyi, fy);
+        fzi = M::Add(fzi, fz);
+        M::Store(fxj + k, M::Sub(M::Load(fxj + k), fx));
+        M::Store(fyj + k, M::Sub(M::Load(fyj + k), fy));
+        M::Store(fzj + k, M::Sub(M::Load(fzj + k), fz));
+      };
+
+      // On the diagonal j may start inside a register: the lanes j' <= i
+      // become massless particles one unit away from i.
+      if (j % W != 0) {
+        const size_t k{j - j % W};
+        alignas(64) float px[W], pm[W];
+        for (size_t l = 0; l < W; ++l) {
+          px[l] = k + l < j ? xif + 1.f : xj[k + l];
+          pm[l] = k + l < j ? 0.f : mj[k + l];
+        }
+        interact(px, pm, k);
+        j = k + W;
+      }
+      for (; j < nc; j += W) interact(xj + j, mj + j, j);
+
+      a.fxi[i] += M::SumWide(fxi);
+      a.fyi[i] += M::SumWide(fyi);
+      a.fzi[i] += M::SumWide(fzi);
+      if constexpr (kPotential) potential += M::SumWide(ui);
+    }
+
+    for (size_t k = 0; k < nc; ++k) {
+      a.fxj[c0 + k] += double(fxj[k]);
+      a.fyj[c0 + k] += double(fyj[k]);
+      a.fzj[c0 + k] += double(fzj[k]);
+    }
+  }
+  if constexpr (kPotential) *a.potential -= potential;
+}
+
+template <class M>
+inline void MixedGravityTile(const TileArgs<double>& a) {
+  if (a.potential)
+    MixedGravityTilePass<M, true>(a);
+  else
+    MixedGravityTilePass<M, false>(a);
+}
+
+// Entry points of the instruction set specific translation units
+void GravityTileSse42(const TileArgs<float>& a);
+void GravityTileSse42(const TileArgs<double>& a);
+void GravityTileAvx2(const TileArgs<float>& a);
+void GravityTileAvx2(const TileArgs<double>& a);
+void GravityTileAvx512(const TileArgs<float>& a);
+void GravityTileAvx512(const TileArgs<double>& a);
+void MixedGravityTileSse42(const TileArgs<double>& a);
+void MixedGravityTileAvx2(const TileArgs<double>& a);
+void MixedGravityTileAvx512(const TileArgs<double>& a);
@@ -0,0 +1,276 @@
+#include "sim/initial_conditions.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+
+#include "utils/parallel.h"
+#include "utils/philox.h"
+
+namespace {
+using std::numbers::pi;
+
+// Particles per ParallelFor chunk; a particle costs a few Philox blocks
+constexpr size_t kChunk{1024};
+
+/**
+ * Uniform and normal numbers of one particle, from the Philox blocks
+ * {i, k, stream} for k = 0, 1, ..., two doubles a block.
+ */
+class ParticleDraws {
+  Philox4x32::Key key_;
+  Philox4x32::Counter counter_;
+  Philox4x32::Counter block_{};
+  size_t used_{2};
+
+ public:
+  ParticleDraws(const std::uint64_t seed, const std::uint32_t stream,
+                const std::uint64_t i) noexcept
+      : key_{std::uint32_t(seed), std::uint32_t(seed >> 32)},
+        counter_{std::uint32_t(i), std::uint32_t(i >> 32), 0, stream} {}
+
+  // [0, 1)
+  double Uniform() noexcept {
+    if (used_ == 2) {
+      block_ = Philox4x32::Block(counter_, key_);
+      ++counter_[2];
+      used_ = 0;
+    }
+    const size_t w{2 * used_++};
+    return double(std::uint64_t(block_[w]) << 21 ^ block_[w + 1] >> 11) *
+           0x1p-53;
+  }
+
+  // (0, 1)
+  double OpenUniform() noexcept { return (Uniform() * 0x1p53 + 0.5) * 0x1p-53; }
+
+  // Standard normal, Box-Muller
+  double Normal() noexcept {
+    const double r{std::sqrt(-2 * std::log(OpenUniform()))};
+    return r * std::cos(2 * pi * Uniform());
+  }
+
+  // A point of the unit sphere
+  std::array<double, 3> Direction() noexcept {
+    const double cos_theta{2 * Uniform() - 1};
+    const double sin_theta{std::sqrt(1 - cos_theta * cos_theta)};
+    const double phi{2 * pi * Uniform()};
+    return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+  }
+};
+
+// Position and velocity of one particle
+struct Phase {
+  std::array<double, 3> r, v;
+};
+
+/**
+ * Fills particles [begin, end) of p with sample(draws), the draws of each
+ * particle its own, and masses m_each; then moves them by the offset r0 and
+ * the velocity v0.
+ */
+template <class T, class Sample>
+void Fill(const ParticleArrays<T>& p, const size_t begin, const size_t end,
+          const double m_each, const std::uint64_t seed,
+          const std::uint32_t stream, const std::array<double, 3>& r0,
+          const std::array<double, 3>& v0, const Sample& sample) {
+  ParallelFor(
+      end - begin,
+      [&](const size_t b, const size_t e) {
+        for (size_t i = begin + b; i < begin + e; ++i) {
+          ParticleDraws draws{seed, stream, i};
+          const Phase s{sample(draws)};
+          p.x[i] = T(r0[0] + s.r[0]);
+          p.y[i] = T(r0[1] + s.r[1]);
+          p.z[i] = T(r0[2] + s.r[2]);
+          p.vx[i] = T(v0[0] + s.v[0]);
+          p.vy[i] = T(v0[1] + s.v[1]);
+          p.vz[i] = T(v0[2] + s.v[2]);
+          p.m[i] = T(m_each);
+        }
+      },
+      kChunk);
+}
+
+// Moves the centre of mass to the origin, at rest
+template <class T>
+void Center(const ParticleArrays<T>& p) {
+  using Sums = std::array<double, 7>;
+  const Sums s{ParallelReduce(
+      p.n, Sums{},
+      [&](const size_t begin, const size_t end) {
+        Sums c{};
+        for (size_t i = begin; i < end; ++i) {
+          const double m{p.m[i]};
+          c[0] += m;
+          c[1] += m * p.x[i];
+          c[2] += m * p.y[i];
+          c[3] += m * p.z[i];
+          c[4] += m * p.vx[i];
+          c[5] += m * p.vy[i];
+          c[6] += m * p.vz[i];
+        }
+        return c;
+      },
+      [](Sums& total, const Sums& c) {
+        for (size_t k = 0; k < total.size(); ++k) total[k] += c[k];
+      })};
+  if (!(s[0] > 0)) return;
+  const T x0(s[1] / s[0]), y0(s[2] / s[0]), z0(s[3] / s[0]),
+      vx0(s[4] / s[0]), vy0(s[5] / s[0]), vz0(s[6] / s[0]);
+  ParallelFor(p.n, [&](const size_t begin, const size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      p.x[i] -= x0;
+      p.y[i] -= y0;
+      p.z[i] -= z0;
+      p.vx[i] -= vx0;
+      p.vy[i] -= vy0;
+      p.vz[i] -= vz0;
+    }
+  });
+}
+
+std::array<double, 3> Scaled(const std::array<double, 3>& d, const double s) {
+  return {s * d[0], s * d[1], s * d[2]};
+}
+
+// Plummer sphere of mass m and scale a
+Phase SamplePlummer(ParticleDraws& draws, const double m, const double a) {
+  constexpr double kMassCut{0.999};
+  const double x{kMassCut * draws.Uniform()};
+  const double r{a / std::sqrt(std::pow(x, -2. / 3.) - 1)};
+  // speed in units of the escape speed: q² (1 - q²)^(7/2), whose maximum is
+  // below 0.1, by rejection
+  double q{0};
+  do {
+    q = draws.Uniform();
+  } while (0.1 * draws.Uniform() > q * q * std::pow(1 - q * q, 3.5));
+  const double v_escape{std::sqrt(2 * m / a) *
+                        std::pow(1 + r * r / (a * a), -0.25)};
+  return {Scaled(draws.Direction(), r),
+          Scaled(draws.Direction(), q * v_escape)};
+}
+}  // namespace
+
+template <std::floating_point T>
+void Plummer::operator()(const ParticleArrays<T>& p) const {
+  if (p.n == 0) return;
+  Fill(p, 0, p.n, mass / double(p.n), seed, stream, {}, {},
+       [this](ParticleDraws& draws) {
+         return SamplePlummer(draws, mass, scale);
+       });
+  Center(p);
+}
+
+template <std::floating_point T>
+void Hernquist::operator()(const ParticleArrays<T>& p) const {
+  if (p.n == 0) return;
+  const double a{scale};
+  Fill(p, 0, p.n, mass / double(p.n), seed, stream, {}, {},
+       [this, a](ParticleDraws& draws) {
+         // M(r) / M = r² / (r + a)²
+         constexpr double kMassCut{0.99};
+         const double s{std::sqrt(kMassCut * draws.Uniform())};
+         const double r{a * s / (1 - s)};
+         // isotropic Jeans dispersion, Hernquist (1990) eq. 10
+         const double x{r / a};
+         const double sigma2{std::max(
+             0., mass / (12 * a) *
+                     (12 * x * std::pow(1 + x, 3) * std::log((1 + x) / x) -
+                      x / (1 + x) * (25 + x * (52 + x * (42 + 12 * x)))))};
+         const double sigma{std::sqrt(sigma2)};
+         const double v_max{0.95 * std::sqrt(2 * mass / (r + a))};
+         std::array<double, 3> v;
+         for (size_t attempt = 0;; ++attempt) {
+           v = {sigma * draws.Normal(), sigma * draws.Normal(),
+                sigma * draws.Normal()};
+           const double speed{
+               std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2])};
+           if (speed < v_max) break;
+           // where the dispersion reaches the escape speed
+           if (attempt == 100) {
+             v = Scaled(v, v_max / speed * draws.Uniform());
+             break;
+           }
+         }
+         return Phase{Scaled(draws.Direction(), r), v};
+       });
+  Center(p);
+}
+
+template <std::floating_point T>
+void UniformSphere::operator()(const ParticleArrays<T>& p) const {
+  if (p.n == 0) return;
+  const double sigma{std::sqrt(mass / (5 * radius))};
+  Fill(p, 0, p.n, mass / double(p.n), seed, stream, {}, {},
+       [this, sigma](ParticleDraws& draws) {
+         const double r{radius * std::cbrt(draws.Uniform())};
+         return Phase{Scaled(draws.Direction(), r),
+                      {sigma * draws.Normal(), sigma * draws.Normal(),
+                       sigma * draws.Normal()}};
+       });
+  Center(p);
+}
+
+template <std::floating_point T>
+void ExponentialDisk::operator()(const ParticleArrays<T>& p) const {
+  if (p.n == 0) return;
+  const double rd{scale_length}, h{scale_height};
+  Fill(p, 0, p.n, mass / double(p.n), seed, stream, {}, {},
+       [this, rd, h](ParticleDraws& draws) {
+         // R e^(-R / rd) is a Gamma(2, rd) density
+         double R{0};
+         do {
+           R = -rd * std::log(draws.OpenUniform() * draws.OpenUniform());
+         } while (R > 10 * rd);
+         const double z{h * std::atanh(2 * draws.OpenUniform() - 1)};
+         const double phi{2 * pi * draws.Uniform()};
+         const double inside{mass * (1 - (1 + R / rd) * std::exp(-R / rd))};
+         const double v_c{
+             std::sqrt(inside * R * R / std::pow(R * R + h * h, 1.5))};
+         const double sigma{dispersion * v_c};
+         const double c{std::cos(phi)}, s{std::sin(phi)};
+         return Phase{{R * c, R * s, z},
+                      {-v_c * s + sigma * draws.Normal(),
+                       v_c * c + sigma * draws.Normal(),
+                       sigma * draws.Normal()}};
+       });
+  Center(p);
+}
+
+template <std::floating_point T>
+void PlummerMerger::operator()(const ParticleArrays<T>& p) const {
+  if (p.n == 0 || clusters == 0) return;
+  const size_t k{std::min(clusters, p.n)};
+  const double m_cluster{mass / double(k)};
+  const double ring{k > 1 ? separation / 2 : 0.};
+  // inward pull on one corner of the polygon: m² / ring² times
+  // sum_j 1 / (4 sin(pi j / k))
+  double pull{0};
+  for (size_t j = 1; j < k; ++j)
+    pull += 1 / (4 * std::sin(pi * double(j) / double(k)));
+  const double v_orbit{ring > 0 ? orbit * std::sqrt(m_cluster * pull / ring)
+                                : 0.};
+  for (size_t c = 0; c < k; ++c) {
+    const double angle{2 * pi * double(c) / double(k)};
+    const double ca{std::cos(angle)}, sa{std::sin(angle)};
+    Fill(p, p.n * c / k, p.n * (c + 1) / k, mass / double(p.n), seed, stream,
+         {ring * ca, ring * sa, 0}, {-v_orbit * sa, v_orbit * ca, 0},
+         [this, m_cluster](ParticleDraws& draws) {
+           return SamplePlummer(draws, m_cluster, scale);
+         });
+  }
+  Center(p);
+}
+
+template void Plummer::operator()(const ParticleArrays<float>&) const;
+template void Plummer::operator()(const ParticleArrays<double>&) const;
+template void Hernquist::operator()(const ParticleArrays<float>&) const;
+template void Hernquist::operator()(const ParticleArrays<double>&) const;
+template void UniformSphere::operator()(const ParticleArrays<float>&) const;
+template void UniformSphere::operator()(const ParticleArrays<double>&) const;
+template void ExponentialDisk::operator()(const ParticleArrays<float>&) const;
+template void ExponentialDisk::operator()(const ParticleArrays<double>&) const;
+template void PlummerMerger::operator()(const ParticleArrays<float>&) const;
+template void PlummerMerger::operator()(const ParticleArrays<double>&) const;
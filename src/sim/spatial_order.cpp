@@ -0,0 +1,84 @@
+#include "sim/spatial_order.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "utils/parallel.h"
+
+namespace {
+constexpr unsigned kDigitBits{8};
+constexpr size_t kBuckets{size_t(1) << kDigitBits};
+// Every chunk counts and scatters its own keys: the chunks are fixed, so the
+// order of equal digits, and the result, do not depend on the threads.
+constexpr size_t kChunk{size_t(1) << 16};
+
+using Histogram = std::array<size_t, kBuckets>;
+}  // namespace
+
+std::vector<std::uint32_t> RadixSort(std::span<std::uint64_t> keys) {
+  const size_t n{keys.size()};
+  std::vector<std::uint32_t> order(n);
+  std::iota(order.begin(), order.end(), std::uint32_t(0));
+  if (n < 2) return order;
+
+  const size_t chunks{(n + kChunk - 1) / kChunk};
+  std::vector<Histogram> counts(chunks);
+  std::vector<std::uint64_t> keys_tmp(n);
+  std::vector<std::uint32_t> order_tmp(n);
+  std::span<std::uint64_t> src{keys}, dst{keys_tmp};
+  std::span<std::uint32_t> src_order{order}, dst_order{order_tmp};
+
+  for (unsigned shift = 0; shift < 64; shift += kDigitBits) {
+    auto digit = [shift](const std::uint64_t key) {
+      return size_t(key >> shift) & (kBuckets - 1);
+    };
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          Histogram& count{counts[begin / kChunk]};
+          count.fill(0);
+          for (size_t i = begin; i < end; ++i) ++count[digit(src[i])];
+        },
+        kChunk);
+
+    // skip a digit all keys share
+    const size_t d0{digit(src[0])};
+    size_t with_d0{0};
+    for (const Histogram& count : counts) with_d0 += count[d0];
+    if (with_d0 == n) continue;
+
+    // exclusive offsets in (digit, chunk) order: stable across chunks
+    size_t offset{0};
+    for (size_t d = 0; d < kBuckets; ++d)
+      for (Histogram& count : counts) offset += std::exchange(count[d], offset);
+
+    ParallelFor(
+        n,
+        [&](const size_t begin, const size_t end) {
+          Histogram& next{counts[begin / kChunk]};
+          for (size_t i = begin; i < end; ++i) {
+            const size_t to{next[digit(src[i])]++};
+            dst[to] = src[i];
+            dst_order[to] = src_order[i];
+          }
+        },
+        kChunk);
+    std::swap(src, dst);
+    std::swap(src_order, dst_order);
+  }
+
+  if (src.data() != keys.data()) {
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      std::copy(src.begin() + begin, src.begin() + end, keys.begin() + begin);
+      std::copy(src_order.begin() + begin, src_order.begin() + end,
+                order.begin() + begin);
+    });
+  }
+  return order;
+}
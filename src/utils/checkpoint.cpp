@@ -0,0 +1,240 @@
+#include "utils/checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/parallel.h"
+
+namespace {
+constexpr size_t kChecksumChunk{size_t(1) << 20};
+constexpr size_t kBlockAlignment{64};
+constexpr size_t kPage{4096};
+constexpr std::uint64_t kPrime{0x9e3779b97f4a7c15};
+
+size_t AlignUp(const size_t v, const size_t alignment) {
+  return (v + alignment - 1) / alignment * alignment;
+}
+
+[[noreturn]] void Fail(const std::string& path, const std::string& what) {
+  throw std::runtime_error("checkpoint " + path + ": " + what);
+}
+
+[[noreturn]] void FailErrno(const std::string& path, const std::string& what) {
+  Fail(path, what + ": " + std::strerror(errno));
+}
+
+std::uint64_t Mix(std::uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  return h;
+}
+
+// Four independent multiply-xor lanes, so the multiplications overlap; the
+// last 8-byte words of a chunk go to the first lanes, the last bytes to tail
+std::uint64_t ChunkChecksum(const std::byte* p, const size_t bytes) {
+  std::uint64_t lane[4]{1, 2, 3, 4};
+  size_t k{0};
+  for (; k + 32 <= bytes; k += 32)
+    for (size_t l = 0; l < 4; ++l) {
+      std::uint64_t w;
+      std::memcpy(&w, p + k + 8 * l, 8);
+      lane[l] = (lane[l] ^ w) * kPrime;
+    }
+  for (size_t l = 0; k + 8 <= bytes; k += 8, ++l) {
+    std::uint64_t w;
+    std::memcpy(&w, p + k, 8);
+    lane[l] = (lane[l] ^ w) * kPrime;
+  }
+  std::uint64_t tail{0};
+  std::memcpy(&tail, p + k, bytes - k);
+  std::uint64_t h{Mix(tail ^ bytes)};
+  for (const std::uint64_t v : lane) h = Mix(h ^ v) * kPrime;
+  return h;
+}
+
+// Header plus table checksum, with the header's own checksum taken as 0
+std::uint64_t TableChecksum(const std::byte* file, const size_t num_fields) {
+  CheckpointHeader header;
+  std::memcpy(&header, file, sizeof(header));
+  header.checksum = 0;
+  std::vector<std::byte> bytes(sizeof(header) +
+                               num_fields * sizeof(CheckpointField));
+  std::memcpy(bytes.data(), &header, sizeof(header));
+  std::memcpy(bytes.data() + sizeof(header), file + sizeof(header),
+              bytes.size() - sizeof(header));
+  return Checksum(bytes);
+}
+
+class File {
+  int fd_{-1};
+
+ public:
+  File(const std::string& path, const int flags)
+      : fd_{open(path.c_str(), flags, 0644)} {
+    if (fd_ < 0) FailErrno(path, "cannot open");
+  }
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+  ~File() { close(fd_); }
+  int Get() const noexcept { return fd_; }
+};
+}  // namespace
+
+std::uint64_t Checksum(const std::span<const std::byte> bytes) {
+  const size_t chunks{(bytes.size() + kChecksumChunk - 1) / kChecksumChunk};
+  std::vector<std::uint64_t> sums(chunks);
+  ParallelFor(
+      chunks,
+      [&](const size_t begin, const size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+          const size_t first{c * kChecksumChunk};
+          sums[c] = ChunkChecksum(
+              bytes.data() + first,
+              std::min(kChecksumChunk, bytes.size() - first));
+        }
+      },
+      1);
+  std::uint64_t h{Mix(bytes.size())};
+  for (const std::uint64_t s : sums) h = Mix(h ^ s) * kPrime;
+  return h;
+}
+
+void CheckpointWriter::AddRaw(const std::string_view name,
+                              const FieldType type, const void* data,
+                              const size_t count) {
+  if (name.size() >= sizeof(CheckpointField::name))
+    throw std::invalid_argument("checkpoint field name too long: " +
+                                std::string(name));
+  fields_.push_back({std::string(name), type, data, count});
+}
+
+void CheckpointWriter::Write(const std::string& path, const std::uint64_t n,
+                             const double d_t, const std::uint64_t steps,
+                             const std::uint64_t flags) const {
+  CheckpointHeader header{};
+  std::memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+  header.version = kCheckpointVersion;
+  header.num_fields = std::uint32_t(fields_.size());
+  header.n = n;
+  header.d_t = d_t;
+  header.steps = steps;
+  header.flags = flags;
+
+  std::vector<CheckpointField> table(fields_.size());
+  size_t offset{AlignUp(
+      sizeof(CheckpointHeader) + table.size() * sizeof(CheckpointField),
+      kPage)};
+  for (size_t f = 0; f < fields_.size(); ++f) {
+    const Source& source{fields_[f]};
+    CheckpointField& field{table[f]};
+    std::strncpy(field.name, source.name.c_str(), sizeof(field.name) - 1);
+    field.type = source.type;
+    field.count = source.count;
+    field.offset = offset;
+    field.checksum = Checksum(
+        {static_cast<const std::byte*>(source.data),
+         source.count * FieldTypeBytes(source.type)});
+    offset = AlignUp(offset + source.count * FieldTypeBytes(source.type),
+                     kBlockAlignment);
+  }
+  header.file_bytes = offset;
+
+  // Written through a shared mapping so that the blocks are copied in
+  // parallel, under a temporary name until complete
+  const std::string temporary{path + ".tmp"};
+  {
+    const File file(temporary, O_RDWR | O_CREAT | O_TRUNC);
+    if (ftruncate(file.Get(), off_t(offset)) != 0)
+      FailErrno(temporary, "cannot resize");
+    void* const mapped{mmap(nullptr, offset, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, file.Get(), 0)};
+    if (mapped == MAP_FAILED) FailErrno(temporary, "cannot map");
+    auto* const out{static_cast<std::byte*>(mapped)};
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), table.data(),
+                table.size() * sizeof(CheckpointField));
+    const std::uint64_t checksum{TableChecksum(out, table.size())};
+    std::memcpy(out + offsetof(CheckpointHeader, checksum), &checksum,
+                sizeof(checksum));
+    for (size_t f = 0; f < fields_.size(); ++f) {
+      const auto* const in{static_cast<const std::byte*>(fields_[f].data)};
+      const size_t bytes{fields_[f].count * FieldTypeBytes(fields_[f].type)};
+      ParallelFor(
+          bytes,
+          [&](const size_t begin, const size_t end) {
+            std::memcpy(out + table[f].offset + begin, in + begin, end - begin);
+          },
+          kChecksumChunk);
+    }
+    const bool synced{msync(mapped, offset, MS_SYNC) == 0};
+    munmap(mapped, offset);
+    if (!synced) FailErrno(temporary, "cannot write");
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    FailErrno(path, "cannot rename " + temporary);
+}
+
+Checkpoint::Checkpoint(const std::string& path, const bool verify)
+    : path_{path} {
+  const File file(path, O_RDONLY);
+  struct stat status;
+  if (fstat(file.Get(), &status) != 0) FailErrno(path, "cannot stat");
+  const size_t bytes{size_t(status.st_size)};
+  if (bytes < sizeof(CheckpointHeader)) Fail(path, "too short");
+  // Private and writable: the arrays are used in place, copy on write
+  void* const mapped{mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, file.Get(), 0)};
+  if (mapped == MAP_FAILED) FailErrno(path, "cannot map");
+  mapping_ = std::shared_ptr<std::byte>(
+      static_cast<std::byte*>(mapped),
+      [bytes](std::byte* p) { munmap(p, bytes); });
+
+  const CheckpointHeader& header{Header()};
+  if (std::memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) != 0)
+    Fail(path, "not a checkpoint");
+  if (header.version != kCheckpointVersion)
+    Fail(path, "version " + std::to_string(header.version) + ", expected " +
+                   std::to_string(kCheckpointVersion));
+  if (header.file_bytes != bytes ||
+      sizeof(CheckpointHeader) +
+              size_t(header.num_fields) * sizeof(CheckpointField) >
+          bytes)
+    Fail(path, "truncated");
+  if (TableChecksum(mapping_.get(), header.num_fields) != header.checksum)
+    Fail(path, "corrupt header");
+  for (const CheckpointField& field : Fields()) {
+    // the size is bounded before it is computed, so that it cannot wrap
+    if (field.name[sizeof(field.name) - 1] != '\0' ||
+        field.offset % kBlockAlignment != 0 || field.offset > bytes ||
+        field.count > (bytes - field.offset) / FieldTypeBytes(field.type))
+      Fail(path, "bad field table");
+    const size_t end{field.offset + field.count * FieldTypeBytes(field.type)};
+    if (verify &&
+        Checksum({mapping_.get() + field.offset, end - field.offset}) !=
+            field.checksum)
+      Fail(path, std::string("corrupt field ") + field.name);
+  }
+}
+
+const CheckpointField* Checkpoint::Find(
+    const std::string_view name) const noexcept {
+  for (const CheckpointField& field : Fields())
+    if (name == field.name) return &field;
+  return nullptr;
+}
+
+void Checkpoint::CheckType(const CheckpointField& field,
+                           const FieldType type) const {
+  if (field.type != type)
+    Fail(path_, std::string("field ") + field.name + " has another type");
+}
@@ -1,45 +1,86 @@
+#include <algorithm>
+#include <concepts>
 #include <random>
 #include <type_traits>
 
 #include "sim/linear_algebra.h"
+#include "utils/parallel.h"
 #include "utils/rng.h"
 
+namespace {
+// Philox blocks generated together
+constexpr size_t kLanes{8};
+// Groups of kLanes blocks per ParallelFor chunk
+constexpr size_t kChunk{512};
+
+/**
+ * Fills out[0, n) with uniform values in [low, high). Value i takes the
+ * words of block i / per: one 32-bit word for a float (24 bits used), two
+ * for a double (53 bits). The blocks are independent, so the chunks need
+ * not run in any particular order or on any particular thread.
+ */
+template <std::floating_point S>
+void FillUniform(S* const out, const size_t n, const S low, const S high,
+                 const Philox4x32::Key key, const std::uint32_t draw,
+                 const std::uint32_t stream) {
+  constexpr size_t kPer{sizeof(S) == 4 ? 4 : 2};
+  constexpr size_t kGroup{kLanes * kPer};
+  const S scale{high - low};
+  ParallelFor(
+      (n + kGroup - 1) / kGroup,
+      [&](const size_t begin, const size_t end) {
+        std::array<std::array<std::uint32_t, kLanes>, 4> w;
+        std::array<S, kGroup> u;
+        for (size_t g = begin; g < end; ++g) {
+          const std::uint64_t first{g * kLanes};
+          Philox4x32::Blocks<kLanes>(std::uint32_t(first),
+                                     std::uint32_t(first >> 32), draw, stream,
+                                     key, w);
+          for (size_t l = 0; l < kLanes; ++l)
+            for (size_t q = 0; q < kPer; ++q) {
+              if constexpr (kPer == 4)
+                u[l * kPer + q] = S(w[q][l] >> 8) * S(0x1p-24);
+              else
+                u[l * kPer + q] = S(std::uint64_t(w[2 * q][l]) << 21 ^
+                                    w[2 * q + 1][l] >> 11) *
+                                  S(0x1p-53);
+            }
+          const size_t i0{g * kGroup};
+          const size_t count{std::min(kGroup, n - i0)};
+          for (size_t j = 0; j < count; ++j) out[i0 + j] = low + scale * u[j];
+        }
+      },
+      kChunk);
+}
+}  // namespace
+
 template <typename T>
 vector<T> RNG<T>::GenerateUniformRandom(const size_t n, const T& low,
                                         const T& high) {
-  vector<T> res;
-  res.reserve(n);
-  // Will be used to obtain a seed for the random number engine
-  std::random_device rd;
-  // Standard mersenne_twister_engine seeded with rd()
-  std::mt19937 gen{rd()};
-
+  const std::uint32_t draw{draw_++};
   if constexpr (!std::is_floating_point_v<T>) {  // Vec3d/Point3d
     const size_t N{3};
     // check if the low-high range is correct
     for (size_t i = 0; i < N; ++i)
       if (low[i] >= high[i]) return {};
-
-    vector<uniform_real_distribution<decltype(low[0])>> dis(N);
-    for (size_t i = 0; i < N; ++i)
-      dis[i] = uniform_real_distribution<decltype(low[0])>(low[i], high[i]);
-
-    for (size_t i = 0; i < n; ++i) {
-      // Use disX to transform the random unsigned int generated by gen into a
-      // DType
-      res.emplace_back(T(dis[0](gen), dis[1](gen), dis[2](gen)));
-    }
-
+    using S = std::remove_cvref_t<decltype(low[0])>;
+    // component d of element i is value 3 i + d of [0, 1)
+    vector<S> u(N * n);
+    FillUniform(u.data(), N * n, S(0), S(1), key_, draw, stream_);
+    vector<T> res(n);
+    ParallelFor(n, [&](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        res[i] = T(low[0] + (high[0] - low[0]) * u[N * i],
+                   low[1] + (high[1] - low[1]) * u[N * i + 1],
+                   low[2] + (high[2] - low[2]) * u[N * i + 2]);
+    });
+    return res;
   } else {  // DType (double/float)
     if (low >= high) return {T(0)};
-
-    uniform_real_distribution<T> dis(low, high);
-    for (size_t i = 0; i < n; ++i) {
-      res.emplace_back(dis(gen));
-    }
+    vector<T> res(n);
+    FillUniform(res.data(), n, low, high, key_, draw, stream_);
+    return res;
   }
-
-  return res;
 }
 
 template <typename T>
@@ -47,22 +88,13 @@ void RNG<T>::GenerateUniformRandom(T* data, const size_t n, const T& low,
                                    const T& high)
   requires std::floating_point<T>
 {
+  const std::uint32_t draw{draw_++};
   // check if the low-high range is correct
   if (!(low < high)) return;
-  // Will be used to obtain a seed for the random number engine
-  std::random_device rd;
-  // Standard mersenne_twister_engine seeded with rd()
-  std::mt19937 gen{rd()};
-
-  uniform_real_distribution<T> dis(low, high);
-  for (size_t i = 0; i < n; ++i) {
-    // Use disX to transform the random unsigned
-    // int generated by gen into a DType
-    data[i] = dis(gen);
-  }
+  FillUniform(data, n, low, high, key_, draw, stream_);
 }
 
 template class RNG<double>;
 template class RNG<float>;
 template class RNG<Point3d>;
-template class RNG<Vec3d>;
\ No newline at end of file
+template class RNG<Vec3d>;
@@ -0,0 +1,31 @@
+#include "utils/soa_arena.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+constexpr size_t kCacheLine{64};
+constexpr size_t kHugePage{size_t(2) << 20};
+}  // namespace
+
+void* AllocateArena(const size_t bytes, const bool huge_pages) {
+  if (bytes == 0) return nullptr;
+  // Huge pages only pay off (and only fit) once the arena spans a few of them
+  const bool huge{huge_pages && bytes >= 2 * kHugePage};
+  const size_t align{huge ? kHugePage : kCacheLine};
+  // aligned_alloc wants the size to be a multiple of the alignment
+  const size_t size{(bytes + align - 1) / align * align};
+  void* p{std::aligned_alloc(align, size)};
+  if (!p) throw std::bad_alloc{};
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  // Only a hint: without THP support the arena stays on regular pages
+  if (huge) madvise(p, size, MADV_HUGEPAGE);
+#endif
+  return p;
+}
+
+void FreeArena(void* p) noexcept { std::free(p); }
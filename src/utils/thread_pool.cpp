@@ -0,0 +1,215 @@
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+// Set on the workers, and on the caller while it runs tasks of a job
+thread_local bool in_task{false};
+
+// Spins before a worker sleeps until the next job, a few microseconds
+constexpr size_t kSpins{1 << 12};
+
+std::uint64_t Pack(const std::uint64_t begin, const std::uint64_t end) {
+  return begin | end << 32;
+}
+std::uint32_t Begin(const std::uint64_t range) {
+  return std::uint32_t(range);
+}
+std::uint32_t End(const std::uint64_t range) {
+  return std::uint32_t(range >> 32);
+}
+
+// Pauses in a spin loop: a pause instruction at first, then yields the CPU
+void CpuRelax([[maybe_unused]] const size_t k) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (k < 64) {
+    __builtin_ia32_pause();
+    return;
+  }
+#endif
+  std::this_thread::yield();
+}
+
+// Binds the calling thread to a set of CPUs. Only a hint: a thread that
+// cannot be pinned still runs.
+void Pin([[maybe_unused]] const std::vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int cpu : cpus) CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+}  // namespace
+
+ThreadPool::ThreadPool(const size_t threads, const ThreadAffinity affinity) {
+  Start(threads, affinity);
+}
+
+ThreadPool::~ThreadPool() { Stop(); }
+
+ThreadPool& ThreadPool::Global() {
+  static ThreadPool pool{
+      [] {
+        const char* const threads{std::getenv("PARTICLES_THREADS")};
+        return threads ? size_t(std::strtoul(threads, nullptr, 10))
+                       : size_t(0);
+      }(),
+      [] {
+        const char* const affinity{std::getenv("PARTICLES_AFFINITY")};
+        return affinity ? ParseThreadAffinity(affinity)
+                        : ThreadAffinity::kNone;
+      }()};
+  return pool;
+}
+
+void ThreadPool::Resize(const size_t threads) { Resize(threads, affinity_); }
+
+void ThreadPool::Resize(const size_t threads, const ThreadAffinity affinity) {
+  const std::lock_guard lock{run_};
+  Stop();
+  Start(threads, affinity);
+}
+
+void ThreadPool::Start(size_t threads, const ThreadAffinity affinity) {
+  const std::vector<NumaNode> nodes{NumaTopology()};
+  if (threads == 0)
+    for (const NumaNode& node : nodes) threads += node.cpus.size();
+  affinity_ = affinity;
+  cpus_ = PlaceThreads(nodes, threads, affinity);
+  stop_.store(false);
+  slots_ = std::vector<Slot>(threads);
+  const std::uint64_t epoch{epoch_.load()};
+  for (size_t k = 1; k < threads; ++k)
+    workers_.emplace_back([this, k, epoch] {
+      in_task = true;
+      if (!cpus_.empty()) Pin({cpus_[k]});
+      std::uint64_t seen{epoch};
+      while (true) {
+        std::uint64_t e{epoch_.load(std::memory_order_acquire)};
+        for (size_t s = 0; e == seen && s < kSpins; ++s) {
+          CpuRelax(s);
+          e = epoch_.load(std::memory_order_acquire);
+        }
+        if (e == seen) {
+          epoch_.wait(seen, std::memory_order_acquire);
+          e = epoch_.load(std::memory_order_acquire);
+        }
+        if (stop_.load(std::memory_order_acquire)) return;
+        seen = e;
+        if (e % 2 == 0) continue;
+        // joins only if the job is still open once it counts as busy, so a
+        // caller that saw no busy worker may reuse the slots
+        busy_.fetch_add(1);
+        if (epoch_.load() == e) Work(k);
+        busy_.fetch_sub(1, std::memory_order_release);
+      }
+    });
+}
+
+void ThreadPool::Stop() {
+  stop_.store(true);
+  // a change of the epoch that keeps it even, i.e. no job
+  epoch_.fetch_add(2, std::memory_order_release);
+  epoch_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+  workers_.clear();
+}
+
+void ThreadPool::RunTasks(const size_t tasks, const TaskFn fn,
+                          void* const context) {
+  if (tasks == 0) return;
+  std::unique_lock lock{run_, std::defer_lock};
+  if (tasks == 1 || slots_.size() == 1 || in_task || !lock.try_lock()) {
+    for (size_t i = 0; i < tasks; ++i) fn(context, i);
+    return;
+  }
+  if (tasks > std::numeric_limits<std::uint32_t>::max())
+    throw std::runtime_error("ThreadPool: more than 2^32 - 1 tasks");
+
+  fn_ = fn;
+  context_ = context;
+  failed_.store(false, std::memory_order_relaxed);
+  remaining_.store(tasks, std::memory_order_relaxed);
+  const size_t p{slots_.size()};
+  for (size_t k = 0; k < p; ++k)
+    slots_[k].range.store(Pack(tasks * k / p, tasks * (k + 1) / p),
+                          std::memory_order_relaxed);
+  epoch_.fetch_add(1, std::memory_order_release);
+  epoch_.notify_all();
+
+  in_task = true;
+  Work(0);
+  for (size_t s = 0; remaining_.load(std::memory_order_acquire) != 0; ++s)
+    CpuRelax(s);
+  epoch_.fetch_add(1);
+  for (size_t s = 0; busy_.load() != 0; ++s) CpuRelax(s);
+  in_task = false;
+  if (failed_.load()) {
+    const std::exception_ptr error{std::exchange(error_, nullptr)};
+    lock.unlock();
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::Work(const size_t slot) {
+  std::uint32_t task;
+  do {
+    while (Pop(slot, task)) {
+      // after a failure the rest of the job is only counted down
+      if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+          fn_(context_, task);
+        } catch (...) {
+          const std::lock_guard lock{error_mutex_};
+          if (!failed_.exchange(true)) error_ = std::current_exception();
+        }
+      }
+      remaining_.fetch_sub(1, std::memory_order_release);
+    }
+  } while (Steal(slot));
+}
+
+bool ThreadPool::Pop(const size_t slot, std::uint32_t& task) {
+  std::atomic<std::uint64_t>& range{slots_[slot].range};
+  std::uint64_t r{range.load(std::memory_order_acquire)};
+  while (Begin(r) < End(r))
+    if (range.compare_exchange_weak(r, Pack(Begin(r) + 1, End(r)),
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+      task = Begin(r);
+      return true;
+    }
+  return false;
+}
+
+bool ThreadPool::Steal(const size_t slot) {
+  while (true) {
+    size_t victim{slot};
+    std::uint64_t r{0};
+    for (size_t k = 0; k < slots_.size(); ++k) {
+      const std::uint64_t v{slots_[k].range.load(std::memory_order_acquire)};
+      if (End(v) - Begin(v) > End(r) - Begin(r)) {
+        victim = k;
+        r = v;
+      }
+    }
+    if (victim == slot) return false;
+    // the back half; a single task whole
+    const std::uint32_t mid{Begin(r) + (End(r) - Begin(r)) / 2};
+    if (slots_[victim].range.compare_exchange_strong(
+            r, Pack(Begin(r), mid), std::memory_order_acq_rel)) {
+      slots_[slot].range.store(Pack(mid, End(r)), std::memory_order_release);
+      return true;
+    }
+  }
+}
@@ -0,0 +1,116 @@
+#include "utils/topology.h"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace {
+int ParseCpu(const std::string_view s, const std::string_view list) {
+  int cpu{-1};
+  const auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), cpu);
+  if (error != std::errc{} || end != s.data() + s.size() || cpu < 0)
+    throw std::runtime_error("bad cpu list '" + std::string(list) + "'");
+  return cpu;
+}
+}  // namespace
+
+ThreadAffinity ParseThreadAffinity(const std::string_view name) {
+  if (name == "none") return ThreadAffinity::kNone;
+  if (name == "compact") return ThreadAffinity::kCompact;
+  if (name == "scatter") return ThreadAffinity::kScatter;
+  throw std::runtime_error("unknown thread affinity '" + std::string(name) +
+                           "', expected none, compact or scatter");
+}
+
+std::vector<int> ParseCpuList(std::string_view list) {
+  while (!list.empty() && (list.back() == '\n' || list.back() == ' '))
+    list.remove_suffix(1);
+  std::vector<int> cpus;
+  size_t begin{0};
+  while (begin < list.size()) {
+    const size_t end{std::min(list.find(',', begin), list.size())};
+    const std::string_view item{list.substr(begin, end - begin)};
+    const size_t dash{item.find('-')};
+    const int first{ParseCpu(item.substr(0, dash), list)};
+    const int last{dash == std::string_view::npos
+                       ? first
+                       : ParseCpu(item.substr(dash + 1), list)};
+    if (last < first)
+      throw std::runtime_error("bad cpu list '" + std::string(list) + "'");
+    for (int c = first; c <= last; ++c) cpus.push_back(c);
+    begin = end + 1;
+  }
+  return cpus;
+}
+
+std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+      if (CPU_ISSET(c, &set)) cpus.push_back(c);
+#endif
+  if (cpus.empty())
+    for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency());
+         ++c)
+      cpus.push_back(int(c));
+  return cpus;
+}
+
+std::vector<NumaNode> NumaTopology(const std::string& root) {
+  const std::vector<int> allowed{AllowedCpus()};
+  std::vector<NumaNode> nodes;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(root, error)) {
+    const std::string name{entry.path().filename().string()};
+    if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+        !std::all_of(name.begin() + 4, name.end(),
+                     [](const char c) { return c >= '0' && c <= '9'; }))
+      continue;
+    std::ifstream file(entry.path() / "cpulist");
+    std::string list;
+    if (!std::getline(file, list)) continue;
+    NumaNode node{.id = std::stoi(name.substr(4)), .cpus = {}};
+    for (const int cpu : ParseCpuList(list))
+      if (std::binary_search(allowed.begin(), allowed.end(), cpu))
+        node.cpus.push_back(cpu);
+    if (!node.cpus.empty()) nodes.push_back(std::move(node));
+  }
+  if (nodes.empty()) return {NumaNode{.id = 0, .cpus = allowed}};
+  std::ranges::sort(nodes, {}, &NumaNode::id);
+  return nodes;
+}
+
+std::vector<int> PlaceThreads(const std::vector<NumaNode>& nodes,
+                              const size_t threads,
+                              const ThreadAffinity affinity) {
+  size_t total{0};
+  for (const NumaNode& node : nodes) total += node.cpus.size();
+  if (affinity == ThreadAffinity::kNone || threads > total) return {};
+  std::vector<int> order;
+  if (affinity == ThreadAffinity::kCompact) {
+    for (const NumaNode& node : nodes)
+      order.insert(order.end(), node.cpus.begin(), node.cpus.end());
+  } else {
+    for (size_t k = 0; order.size() < total; ++k)
+      for (const NumaNode& node : nodes)
+        if (k < node.cpus.size()) order.push_back(node.cpus[k]);
+  }
+  order.resize(threads);
+  return order;
+}
+
+int NodeOfCpu(const std::vector<NumaNode>& nodes, const int cpu) {
+  for (const NumaNode& node : nodes)
+    if (std::ranges::find(node.cpus, cpu) != node.cpus.end()) return node.id;
+  return -1;
+}
@@ -0,0 +1,137 @@
+#include "utils/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Every buffer ever registered, with the clock pair the ticks are
+// calibrated against
+struct TraceRegistry {
+  std::mutex mutex{};
+  std::vector<std::unique_ptr<TraceBuffer>> buffers{};
+  std::uint64_t ticks0{TraceTicks()};
+  std::chrono::steady_clock::time_point time0{std::chrono::steady_clock::now()};
+};
+
+TraceRegistry& Registry() {
+  static TraceRegistry registry;
+  return registry;
+}
+
+// Calibrates at startup rather than at the first zone, which began before
+const TraceRegistry& kStartup{Registry()};
+
+// Microseconds per tick, from the ticks and the steady clock since the
+// registry was made; at least 10 ms apart for a stable ratio
+double MicrosecondsPerTick(TraceRegistry& registry) {
+#if defined(__x86_64__) || defined(__i386__)
+  using std::chrono::steady_clock;
+  steady_clock::time_point now{steady_clock::now()};
+  while (now - registry.time0 < std::chrono::milliseconds(10))
+    now = steady_clock::now();
+  const std::uint64_t ticks{TraceTicks()};
+  const double us{
+      std::chrono::duration<double, std::micro>(now - registry.time0).count()};
+  return us / double(ticks - registry.ticks0);
+#else
+  static_cast<void>(registry);
+  return 1e-3;
+#endif
+}
+
+// Zones of buffer not cleared and not overwritten: [first, last)
+std::pair<std::uint64_t, std::uint64_t> Live(const TraceBuffer& buffer) {
+  const std::uint64_t last{buffer.head.load(std::memory_order_acquire)};
+  const std::uint64_t first{
+      std::max(buffer.tail.load(std::memory_order_relaxed),
+               last > kTraceCapacity ? last - kTraceCapacity : 0)};
+  return {first, last};
+}
+
+// name as a JSON string body
+void WriteEscaped(std::ofstream& out, const char* name) {
+  for (; *name; ++name) {
+    const unsigned char c{static_cast<unsigned char>(*name)};
+    if (c == '"' || c == '\\') {
+      out << '\\' << *name;
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    } else {
+      out << *name;
+    }
+  }
+}
+}  // namespace
+
+TraceBuffer* RegisterTraceBuffer() {
+  TraceRegistry& registry{Registry()};
+  const std::lock_guard lock{registry.mutex};
+  registry.buffers.push_back(std::make_unique<TraceBuffer>());
+  TraceBuffer* const buffer{registry.buffers.back().get()};
+  buffer->tid = std::uint32_t(registry.buffers.size());
+  return buffer;
+}
+
+void WriteChromeTrace(const std::string& path) {
+  TraceRegistry& registry{Registry()};
+  const std::lock_guard lock{registry.mutex};
+  std::ofstream out(path);
+  if (!out) throw std::runtime_error("trace " + path + ": cannot open");
+  const double us_per_tick{MicrosecondsPerTick(registry)};
+  out.precision(3);
+  out << std::fixed << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first_event{true};
+  const auto separator{[&] {
+    if (!first_event) out << ',';
+    first_event = false;
+    out << '\n';
+  }};
+  for (const auto& buffer : registry.buffers) {
+    separator();
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << buffer->tid << ",\"args\":{\"name\":\"thread " << buffer->tid
+        << "\"}}";
+    const auto [first, last]{Live(*buffer)};
+    for (std::uint64_t k = first; k < last; ++k) {
+      const TraceEvent& event{buffer->events[k % kTraceCapacity]};
+      separator();
+      out << "{\"name\":\"";
+      WriteEscaped(out, event.name);
+      // signed: the first zone of the program may start before ticks0
+      const auto begin{std::int64_t(event.begin - registry.ticks0)};
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"ts\":" << double(begin) * us_per_tick
+          << ",\"dur\":" << double(event.end - event.begin) * us_per_tick
+          << '}';
+    }
+  }
+  out << "\n]}\n";
+  if (!out.flush())
+    throw std::runtime_error("trace " + path + ": write failed");
+}
+
+void ClearTrace() {
+  TraceRegistry& registry{Registry()};
+  const std::lock_guard lock{registry.mutex};
+  for (const auto& buffer : registry.buffers)
+    buffer->tail.store(buffer->head.load(std::memory_order_acquire),
+                       std::memory_order_relaxed);
+}
+
+size_t TraceEventCount() {
+  TraceRegistry& registry{Registry()};
+  const std::lock_guard lock{registry.mutex};
+  size_t count{0};
+  for (const auto& buffer : registry.buffers) {
+    const auto [first, last]{Live(*buffer)};
+    count += size_t(last - first);
+  }
+  return count;
+}
@@ -0,0 +1,299 @@
+#include "utils/trajectory.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+// File header after the magic: version, then flags (unused so far)
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t flags;
+};
+
+// Word size of field f in a frame of the given precision
+size_t WordBytes(const size_t f, const bool float32) {
+  return f == 6 || float32 ? 4 : 8;
+}
+
+/**
+ * XOR of cur and prev (zeros when null) per word, stored as 4-bit counts of
+ * significant bytes, two per byte, then those low bytes. Returns the bytes
+ * written to out, which needs count / 2 + 1 + count * sizeof(W).
+ */
+template <class W>
+size_t Encode(const std::byte* cur, const std::byte* prev, const size_t count,
+              std::byte* out) {
+  std::byte* const counts{out};
+  std::byte* payload{out + (count + 1) / 2};
+  std::fill(counts, payload, std::byte{0});
+  for (size_t i = 0; i < count; ++i) {
+    W w, p{0};
+    std::memcpy(&w, cur + i * sizeof(W), sizeof(W));
+    if (prev) std::memcpy(&p, prev + i * sizeof(W), sizeof(W));
+    w ^= p;
+    const size_t bytes{(sizeof(W) * 8 - size_t(std::countl_zero(w)) + 7) / 8};
+    counts[i / 2] |= std::byte(bytes << (i % 2 * 4));
+    // little endian: the low bytes come first
+    std::memcpy(payload, &w, bytes);
+    payload += bytes;
+  }
+  return size_t(payload - out);
+}
+
+template <class W>
+void Decode(const std::byte* in, const size_t in_bytes, const std::byte* prev,
+            const size_t count, std::byte* cur) {
+  const std::byte* const counts{in};
+  const std::byte* payload{in + (count + 1) / 2};
+  const std::byte* const end{in + in_bytes};
+  if (payload > end) throw std::runtime_error("short chunk");
+  for (size_t i = 0; i < count; ++i) {
+    const size_t bytes{(size_t(counts[i / 2]) >> (i % 2 * 4)) & 0xf};
+    if (bytes > sizeof(W) || payload + bytes > end)
+      throw std::runtime_error("bad chunk");
+    W w{0}, p{0};
+    std::memcpy(&w, payload, bytes);
+    payload += bytes;
+    if (prev) std::memcpy(&p, prev + i * sizeof(W), sizeof(W));
+    w ^= p;
+    std::memcpy(cur + i * sizeof(W), &w, sizeof(W));
+  }
+}
+}  // namespace
+
+TrajectoryWriter::TrajectoryWriter(const std::string& path,
+                                   const TrajectoryOptions options)
+    : options_{options},
+      out_{path, std::ios::binary | std::ios::trunc},
+      path_{path} {
+  if (!out_) throw std::runtime_error("trajectory " + path + ": cannot open");
+  FileHeader header{};
+  std::memcpy(header.magic, kTrajectoryMagic, sizeof(header.magic));
+  header.version = kTrajectoryVersion;
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  bytes_ = sizeof(header);
+  for (size_t b = 0; b < std::max<size_t>(options_.buffers, 1); ++b)
+    free_.push_back(std::make_unique<Snapshot>());
+  thread_ = std::thread([this] { Run(); });
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  try {
+    Close();
+  } catch (...) {
+    // nowhere to report it
+  }
+}
+
+void TrajectoryWriter::Flush() {
+  std::unique_lock lock{mutex_};
+  changed_.wait(lock, [this] {
+    return (queue_.empty() && in_flight_ == 0) || error_;
+  });
+  RethrowLocked();
+}
+
+void TrajectoryWriter::Close() {
+  if (!thread_.joinable()) return;
+  {
+    std::lock_guard lock{mutex_};
+    closing_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+  out_.close();
+  std::lock_guard lock{mutex_};
+  RethrowLocked();
+}
+
+std::uint64_t TrajectoryWriter::Frames() const {
+  std::lock_guard lock{mutex_};
+  return frames_;
+}
+
+std::uint64_t TrajectoryWriter::Bytes() const {
+  std::lock_guard lock{mutex_};
+  return bytes_;
+}
+
+std::unique_ptr<TrajectoryWriter::Snapshot> TrajectoryWriter::Acquire() {
+  std::unique_lock lock{mutex_};
+  changed_.wait(lock, [this] { return !free_.empty() || error_; });
+  RethrowLocked();
+  std::unique_ptr<Snapshot> snapshot{std::move(free_.back())};
+  free_.pop_back();
+  return snapshot;
+}
+
+void TrajectoryWriter::Submit(std::unique_ptr<Snapshot> snapshot) {
+  {
+    std::lock_guard lock{mutex_};
+    queue_.push_back(std::move(snapshot));
+  }
+  changed_.notify_all();
+}
+
+void TrajectoryWriter::RethrowLocked() {
+  if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+void TrajectoryWriter::Run() {
+  for (;;) {
+    std::unique_ptr<Snapshot> snapshot;
+    {
+      std::unique_lock lock{mutex_};
+      changed_.wait(lock, [this] { return !queue_.empty() || closing_; });
+      if (queue_.empty()) return;
+      snapshot = std::move(queue_.front());
+      queue_.pop_front();
+      ++in_flight_;
+    }
+    try {
+      WriteFrame(*snapshot);
+      // the snapshot becomes the base of the next XOR
+      std::swap(previous_, *snapshot);
+    } catch (...) {
+      std::lock_guard lock{mutex_};
+      error_ = std::current_exception();
+    }
+    {
+      std::lock_guard lock{mutex_};
+      free_.push_back(std::move(snapshot));
+      --in_flight_;
+    }
+    changed_.notify_all();
+  }
+}
+
+void TrajectoryWriter::WriteFrame(const Snapshot& snapshot) {
+  const bool delta{options_.compress && previous_.n == snapshot.n &&
+                   previous_.fields[0].size() == snapshot.fields[0].size()};
+  TrajectoryFrameHeader header{};
+  std::memcpy(header.magic, "FRAM", sizeof(header.magic));
+  header.flags = (options_.float32 ? TrajectoryFrameHeader::kFloat32 : 0) |
+                 (delta ? TrajectoryFrameHeader::kXorDelta : 0);
+  header.step = snapshot.step;
+  header.n = snapshot.n;
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  std::uint64_t bytes{sizeof(header)};
+
+  for (size_t f = 0; f < kTrajectoryFields; ++f) {
+    const size_t word{WordBytes(f, options_.float32)};
+    for (size_t first = 0; first < snapshot.n; first += kTrajectoryChunk) {
+      const size_t count{std::min(kTrajectoryChunk, snapshot.n - first)};
+      const std::byte* const cur{snapshot.fields[f].data() + first * word};
+      TrajectoryChunkHeader chunk{.field = std::uint32_t(f),
+                                  .encoding = options_.compress ? 1u : 0u,
+                                  .count = count,
+                                  .bytes = count * word};
+      const std::byte* payload{cur};
+      if (options_.compress) {
+        encoded_.resize(count / 2 + 1 + count * word);
+        const std::byte* const prev{
+            delta ? previous_.fields[f].data() + first * word : nullptr};
+        chunk.bytes = word == 4
+                          ? Encode<std::uint32_t>(cur, prev, count,
+                                                  encoded_.data())
+                          : Encode<std::uint64_t>(cur, prev, count,
+                                                  encoded_.data());
+        payload = encoded_.data();
+      }
+      out_.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+      out_.write(reinterpret_cast<const char*>(payload),
+                 std::streamsize(chunk.bytes));
+      bytes += sizeof(chunk) + chunk.bytes;
+    }
+  }
+  out_.flush();
+  if (!out_) throw std::runtime_error("trajectory " + path_ + ": write failed");
+  std::lock_guard lock{mutex_};
+  ++frames_;
+  bytes_ += bytes;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : in_{path, std::ios::binary}, path_{path} {
+  FileHeader header{};
+  in_.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in_ ||
+      std::memcmp(header.magic, kTrajectoryMagic, sizeof(header.magic)) != 0)
+    throw std::runtime_error("trajectory " + path + ": not a trajectory");
+  if (header.version != kTrajectoryVersion)
+    throw std::runtime_error("trajectory " + path + ": version " +
+                             std::to_string(header.version));
+}
+
+bool TrajectoryReader::Next(Frame& frame) {
+  TrajectoryFrameHeader header{};
+  in_.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (in_.gcount() == 0 && in_.eof()) return false;
+  auto fail = [&](const std::string& what) {
+    throw std::runtime_error("trajectory " + path_ + ": " + what);
+  };
+  if (!in_ || std::memcmp(header.magic, "FRAM", 4) != 0) fail("bad frame");
+  const bool float32{bool(header.flags & TrajectoryFrameHeader::kFloat32)};
+  const bool delta{bool(header.flags & TrajectoryFrameHeader::kXorDelta)};
+  const size_t n{header.n};
+  frame.step = header.step;
+  frame.float32 = float32;
+
+  std::array<std::vector<std::byte>, kTrajectoryFields> fields;
+  std::vector<std::byte> encoded;
+  for (size_t f = 0; f < kTrajectoryFields; ++f) {
+    const size_t word{WordBytes(f, float32)};
+    fields[f].resize(n * word);
+    if (delta && previous_[f].size() != fields[f].size())
+      fail("delta frame without its base");
+    for (size_t first = 0; first < n; first += kTrajectoryChunk) {
+      TrajectoryChunkHeader chunk{};
+      in_.read(reinterpret_cast<char*>(&chunk), sizeof(chunk));
+      const size_t count{std::min(kTrajectoryChunk, n - first)};
+      if (!in_ || chunk.field != f || chunk.count != count ||
+          chunk.bytes > count / 2 + 1 + count * word)
+        fail("bad chunk");
+      encoded.resize(chunk.bytes);
+      in_.read(reinterpret_cast<char*>(encoded.data()),
+               std::streamsize(chunk.bytes));
+      if (!in_) fail("truncated");
+      std::byte* const cur{fields[f].data() + first * word};
+      if (chunk.encoding == 0) {
+        if (chunk.bytes != count * word) fail("bad chunk");
+        std::memcpy(cur, encoded.data(), chunk.bytes);
+        continue;
+      }
+      const std::byte* const prev{
+          delta ? previous_[f].data() + first * word : nullptr};
+      try {
+        if (word == 4)
+          Decode<std::uint32_t>(encoded.data(), chunk.bytes, prev, count, cur);
+        else
+          Decode<std::uint64_t>(encoded.data(), chunk.bytes, prev, count, cur);
+      } catch (const std::runtime_error& e) {
+        fail(e.what());
+      }
+    }
+  }
+
+  std::vector<double>* const values[]{&frame.x,  &frame.y,  &frame.z,
+                                      &frame.vx, &frame.vy, &frame.vz};
+  for (size_t f = 0; f < 6; ++f) {
+    values[f]->resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      if (float32) {
+        float v;
+        std::memcpy(&v, fields[f].data() + 4 * i, 4);
+        (*values[f])[i] = v;
+      } else {
+        std::memcpy(&(*values[f])[i], fields[f].data() + 8 * i, 8);
+      }
+    }
+  }
+  frame.ids.resize(n);
+  std::memcpy(frame.ids.data(), fields[6].data(), 4 * n);
+  previous_ = std::move(fields);
+  return true;
+}
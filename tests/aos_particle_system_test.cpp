@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sim/aos_particle_system.h"
+#include "test_util.h"
+#include "utils/checkpoint.h"
+
+namespace {
+// n particles in a cube, with random masses and velocities
+std::vector<ParticleStructure> Cloud(const size_t n) {
+  std::mt19937 gen{5};
+  std::uniform_real_distribution<double> u(-1., 1.), mass(0.5, 2.);
+  std::vector<ParticleStructure> particles;
+  for (size_t i = 0; i < n; ++i) {
+    const PointType p{u(gen), u(gen), u(gen)};
+    const VectorType v{u(gen), u(gen), u(gen)};
+    particles.emplace_back(p, mass(gen) / double(n), v, i);
+  }
+  return particles;
+}
+
+// The particles of a system, through a checkpoint
+std::vector<ParticleStructure> Read(const ParticleSystemAoS& system) {
+  const std::string path{TempPath("aos_particle_system_test.ckpt")};
+  system.Save(path);
+  const Checkpoint checkpoint(path);
+  const size_t n{checkpoint.Header().n};
+  auto field = [&](const char* name) {
+    return checkpoint.Data<double>(*checkpoint.Find(name));
+  };
+  const auto x{field("x")}, y{field("y")}, z{field("z")}, m{field("m")},
+      vx{field("vx")}, vy{field("vy")}, vz{field("vz")};
+  std::vector<ParticleStructure> particles;
+  for (size_t i = 0; i < n; ++i)
+    particles.emplace_back(PointType{x[i], y[i], z[i]}, m[i],
+                           VectorType{vx[i], vy[i], vz[i]}, i);
+  std::remove(path.c_str());
+  return particles;
+}
+
+// One step the straightforward way: the forces of all other particles from
+// the start of the step, then semi-Euler
+std::vector<ParticleStructure> Reference(
+    std::vector<ParticleStructure> particles,
+    const std::vector<VectorType>& F_ext, const VectorType& F_global,
+    const DType d_t) {
+  std::vector<VectorType> F(particles.size(), F_global);
+  for (size_t i = 0; i < particles.size(); ++i) {
+    if (particles[i].id < F_ext.size()) F[i] += F_ext[particles[i].id];
+    for (size_t j = 0; j < particles.size(); ++j)
+      if (j != i) F[i] += particles[i].ForceFrom(particles[j]);
+  }
+  for (size_t i = 0; i < particles.size(); ++i) particles[i].Update(F[i], d_t);
+  return particles;
+}
+
+void ExpectNear(const std::vector<ParticleStructure>& got,
+                const std::vector<ParticleStructure>& want, const double tol) {
+  ASSERT_EQ(got.size(), want.size());
+  for (size_t i = 0; i < got.size(); ++i)
+    for (size_t d = 0; d < 3; ++d) {
+      ASSERT_NEAR(got[i].p[d], want[i].p[d], tol) << "particle " << i;
+      ASSERT_NEAR(got[i].v[d], want[i].v[d], tol) << "particle " << i;
+    }
+}
+}  // namespace
+
+// Several tiles, each pair once, against all pairs from a frozen snapshot
+TEST(ParticleSystemAoSTest, StepMatchesFrozenSnapshot) {
+  const std::vector<ParticleStructure> start{Cloud(1000)};
+  ParticleSystemAoS system{std::vector<ParticleStructure>(start)};
+  const std::vector<VectorType> none;
+  const VectorType g{0., 0., -0.5};
+  system.UpdateN2(none, g, 1e-3);
+  ExpectNear(Read(system), Reference(start, none, g, 1e-3), 1e-12);
+  // the snapshot of the second step is the first step's result
+  std::vector<ParticleStructure> want{Read(system)};
+  system.UpdateN2(none, g, 1e-3);
+  ExpectNear(Read(system), Reference(std::move(want), none, g, 1e-3), 1e-12);
+}
+
+// F_ext is looked up by id, and ids past its end get none
+TEST(ParticleSystemAoSTest, ExternalForces) {
+  std::vector<ParticleStructure> start{Cloud(100)};
+  std::vector<VectorType> F_ext;
+  for (size_t i = 0; i < 100; ++i) F_ext.emplace_back(0.1 * double(i), 0., 1.);
+  ParticleSystemAoS system{std::vector<ParticleStructure>(start)};
+  system.UpdateN2(F_ext, VectorType{}, 1e-2);
+  ExpectNear(Read(system), Reference(start, F_ext, VectorType{}, 1e-2), 1e-12);
+
+  // ids in reverse order, and no force for the last 40 of them
+  for (size_t i = 0; i < 100; ++i) start[i].id = 99 - i;
+  F_ext.resize(60);
+  ParticleSystemAoS partial{std::vector<ParticleStructure>(start)};
+  partial.UpdateN2(F_ext, VectorType{}, 1e-2);
+  const std::vector<ParticleStructure> want{
+      Reference(start, F_ext, VectorType{}, 1e-2)};
+  ExpectNear(Read(partial), want, 1e-12);
+  EXPECT_EQ(want[0].v.z, Reference(start, {}, VectorType{}, 1e-2)[0].v.z);
+  EXPECT_NE(want[99].v.z, Reference(start, {}, VectorType{}, 1e-2)[99].v.z);
+}
+
+// Action and reaction come from the same evaluation
+TEST(ParticleSystemAoSTest, MomentumConserved) {
+  const std::vector<ParticleStructure> start{Cloud(700)};
+  ParticleSystemAoS system{std::vector<ParticleStructure>(start)};
+  for (size_t k = 0; k < 5; ++k) system.UpdateN2({}, VectorType{}, 1e-3);
+  VectorType before{0, 0, 0}, after{0, 0, 0};
+  for (const ParticleStructure& p : start) before += p.m * p.v;
+  for (const ParticleStructure& p : Read(system)) after += p.m * p.v;
+  for (size_t d = 0; d < 3; ++d) EXPECT_NEAR(after[d], before[d], 1e-13);
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "sim/block_leapfrog.h"
+#include "sim/particles_aosoa.h"
+#include "sim/particles_rawpointer.h"
+#include "utils/aosoa.h"
+
+static_assert(std::random_access_iterator<AoSoA<double>::Iterator>);
+
+TEST(AoSoATest, LayoutAndPadding) {
+  AoSoA<double, 4> a(10, 3);
+  EXPECT_EQ(a.Size(), 10u);
+  EXPECT_EQ(a.Extent(0), 10u);
+  EXPECT_EQ(a.Extent(1), 3u);
+  EXPECT_EQ(a.NumBlocks(), 3u);
+  EXPECT_EQ(a.Pitch(), 12u);
+  EXPECT_EQ(a.Bytes(), 3 * 12 * sizeof(double));
+  for (size_t i = 0; i < 10; ++i)
+    for (size_t k = 0; k < 3; ++k) a(i, k) = double(10 * i + k);
+  // element i, field k at (i / W) * pitch + k * W + i % W
+  const double* const data{a.Lanes(0, 0).data()};
+  for (size_t i = 0; i < 10; ++i)
+    for (size_t k = 0; k < 3; ++k)
+      ASSERT_EQ(data[i / 4 * 12 + k * 4 + i % 4], double(10 * i + k));
+  EXPECT_EQ(a.Lanes(2, 1)[1], 91.);
+  // two padding lanes in the last block, still zero
+  for (size_t k = 0; k < 3; ++k) {
+    EXPECT_EQ(a.Lanes(2, k)[2], 0.);
+    EXPECT_EQ(a.Lanes(2, k)[3], 0.);
+  }
+}
+
+TEST(AoSoATest, IteratorsVisitEveryElement) {
+  AoSoA<float, 8> a(1000, 2);
+  size_t i{0};
+  for (auto e : a) {
+    e[0] = float(i);
+    e[1] = float(2 * i++);
+  }
+  EXPECT_EQ(i, 1000u);
+  EXPECT_EQ(std::distance(a.begin(), a.end()), 1000);
+  for (size_t k = 0; k < 1000; ++k) {
+    ASSERT_EQ(a(k, 0), float(k));
+    ASSERT_EQ(a(k, 1), float(2 * k));
+  }
+  EXPECT_EQ((a.begin() + 517)[0][1], 1034.f);
+  EXPECT_EQ((*(a.end() - 1))[0], 999.f);
+  EXPECT_TRUE(std::is_sorted(a.begin(), a.end(),
+                             [](auto l, auto r) { return l[0] < r[0]; }));
+}
+
+TEST(AoSoATest, MoveKeepsTheStorage) {
+  AoSoA<double> a(20, 2);
+  a(13, 1) = 5.;
+  AoSoA<double> b(std::move(a));
+  EXPECT_EQ(b(13, 1), 5.);
+  EXPECT_EQ(a.Bytes(), 0u);
+  AoSoA<double> empty;
+  empty = std::move(b);
+  EXPECT_EQ(empty(13, 1), 5.);
+}
+
+namespace {
+// The state of an AoSoA system copied into a raw pointer one, which has the
+// same softening and integrators
+template <class A, class R>
+void CopyState(const A& a, R& r) {
+  for (size_t i = 0; i < a.n; ++i) {
+    r.x[i] = a.particles(i, A::kX);
+    r.y[i] = a.particles(i, A::kY);
+    r.z[i] = a.particles(i, A::kZ);
+    r.m[i] = a.particles(i, A::kM);
+    r.Gm[i] = a.particles(i, A::kGm);
+    r.vx[i] = a.particles(i, A::kVx);
+    r.vy[i] = a.particles(i, A::kVy);
+    r.vz[i] = a.particles(i, A::kVz);
+  }
+}
+
+template <class A, class R>
+void ExpectSameState(const A& a, const R& r) {
+  for (size_t i = 0; i < a.n; ++i) {
+    const double scale{std::abs(r.x[i]) + std::abs(r.vx[i]) + 1};
+    ASSERT_NEAR(a.particles(i, A::kX), r.x[i], 1e-10 * scale) << i;
+    ASSERT_NEAR(a.particles(i, A::kZ), r.z[i], 1e-10 * scale) << i;
+    ASSERT_NEAR(a.particles(i, A::kVx), r.vx[i], 1e-10 * scale) << i;
+    ASSERT_NEAR(a.particles(i, A::kVy), r.vy[i], 1e-10 * scale) << i;
+  }
+}
+
+// Steps of the AoSoA and the raw pointer layout from the same state agree
+template <class Integrator, size_t W>
+void ExpectMatchesRawPointer(const size_t n, const bool external) {
+  using A = ParticlesAoSoA<double, W, Integrator>;
+  A a(n, 1e-4);
+  ParticlesRawPointer<double, Integrator> r(n, 1e-4);
+  CopyState(a, r);
+  std::vector<double> ex(n), ez(n);
+  for (size_t i = 0; i < n; ++i) {
+    ex[i] = double(i % 7) - 3.;
+    ez[i] = 100. / double(i + 1);
+  }
+  const double* const fx{external ? ex.data() : nullptr};
+  const double* const fz{external ? ez.data() : nullptr};
+  for (size_t k = 0; k < 3; ++k) {
+    a.Update(fx, nullptr, fz, 0., -9.8, 0.);
+    r.Update(fx, nullptr, fz, 0., -9.8, 0.);
+  }
+  ExpectSameState(a, r);
+}
+}  // namespace
+
+// A partial last block, several tiles of blocks, and the RK4 scratch
+TEST(ParticlesAoSoATest, MatchesRawPointer) {
+  ExpectMatchesRawPointer<SemiImplicitEuler, 8>(1001, false);
+  ExpectMatchesRawPointer<LeapfrogKDK, 4>(333, true);
+  ExpectMatchesRawPointer<RungeKutta4, 8>(517, true);
+  ExpectMatchesRawPointer<Yoshida4, 2>(60, false);
+}
+
+// The raw pointer layout's direct forces, over all particles and over an
+// active set, against a plain pair loop
+TEST(ParticlesRawPointerTest, DirectForces) {
+  const size_t n{301};
+  ParticlesRawPointer<double> p(n, 1e-4);
+  const std::vector<double> x(p.x, p.x + n), y(p.y, p.y + n),
+      z(p.z, p.z + n);
+  p.Update(nullptr, nullptr, nullptr, 0., 0., 0.);
+  for (size_t i = 0; i < n; i += 7) {
+    double fx{0}, fz{0};
+    for (size_t j = 0; j < n; ++j) {
+      const double rx{x[j] - x[i]}, ry{y[j] - y[i]}, rz{z[j] - z[i]};
+      const double r2{rx * rx + ry * ry + rz * rz + p.eps2};
+      const double f{p.Gm[i] * p.m[j] / (r2 * std::sqrt(r2))};
+      fx += f * rx;
+      fz += f * rz;
+    }
+    ASSERT_NEAR(p.Fx[i], fx, 1e-9 * std::abs(fx) + 1e-9) << i;
+    ASSERT_NEAR(p.Fz[i], fz, 1e-9 * std::abs(fz) + 1e-9) << i;
+  }
+
+  // every particle on level 0 steps as the plain leapfrog, through the
+  // active-set evaluation
+  ParticlesRawPointer<double, LeapfrogKDK> global(n, 1e-4);
+  ParticlesRawPointer<double, BlockLeapfrog> block(n, 1e-4);
+  block.integrator.SetMaxLevel(0);
+  for (size_t k = 0; k < 3; ++k) {
+    global.Update(nullptr, nullptr, nullptr, 0., 0., 0.);
+    block.Update(nullptr, nullptr, nullptr, 0., 0., 0.);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    ASSERT_NEAR(block.x[i], global.x[i], 1e-10 * (std::abs(global.x[i]) + 1));
+    ASSERT_NEAR(block.vy[i], global.vy[i],
+                1e-9 * (std::abs(global.vy[i]) + 1));
+  }
+}
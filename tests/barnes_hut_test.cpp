@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "sim/barnes_hut.h"
+#include "test_util.h"
+
+namespace {
+constexpr double kEps2{1e-8};
+
+void DirectForces(const RandomCloud<>& c, std::vector<double>& Fx,
+                  std::vector<double>& Fy, std::vector<double>& Fz) {
+  const size_t n{c.x.size()};
+  Fx.assign(n, 0.);
+  Fy.assign(n, 0.);
+  Fz.assign(n, 0.);
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < n; ++j) {
+      if (i == j) continue;
+      const double rx{c.x[j] - c.x[i]}, ry{c.y[j] - c.y[i]},
+          rz{c.z[j] - c.z[i]};
+      const double inv_r{1. / std::sqrt(rx * rx + ry * ry + rz * rz + kEps2)};
+      const double F{c.m[i] * c.m[j] * inv_r * inv_r * inv_r};
+      Fx[i] += F * rx;
+      Fy[i] += F * ry;
+      Fz[i] += F * rz;
+    }
+}
+
+// RMS of |F_bh - F_direct| over RMS of |F_direct|
+double RelativeError(const RandomCloud<>& c, const double theta) {
+  const size_t n{c.x.size()};
+  std::vector<double> Fx, Fy, Fz;
+  DirectForces(c, Fx, Fy, Fz);
+
+  BarnesHut<double> tree{theta};
+  tree.Build(c.x.data(), c.y.data(), c.z.data(), c.m.data(), n);
+  std::vector<double> Bx(n), By(n), Bz(n);
+  tree.AddForces(c.m.data(), Bx.data(), By.data(), Bz.data(), kEps2);
+
+  double err2{0.}, norm2{0.};
+  for (size_t i = 0; i < n; ++i) {
+    const double dx{Bx[i] - Fx[i]}, dy{By[i] - Fy[i]}, dz{Bz[i] - Fz[i]};
+    err2 += dx * dx + dy * dy + dz * dz;
+    norm2 += Fx[i] * Fx[i] + Fy[i] * Fy[i] + Fz[i] * Fz[i];
+  }
+  return std::sqrt(err2 / norm2);
+}
+}  // namespace
+
+TEST(BarnesHutTest, ZeroThetaIsDirectSummation) {
+  const RandomCloud<> c(500, {-2, 2}, 42, {1, 200});
+  EXPECT_LT(RelativeError(c, 0.), 1e-10);
+}
+
+TEST(BarnesHutTest, ErrorDecreasesWithTheta) {
+  const RandomCloud<> c(2000, {-2, 2}, 42, {1, 200});
+  const double coarse{RelativeError(c, 0.8)};
+  const double fine{RelativeError(c, 0.3)};
+  EXPECT_LT(fine, coarse);
+  EXPECT_LT(fine, 5e-4);
+  EXPECT_LT(coarse, 2e-2);
+}
+
+TEST(BarnesHutTest, CoincidentParticles) {
+  const size_t n{64};
+  std::vector<double> x(n, 1.), y(n, 1.), z(n, 1.), m(n, 1.);
+  BarnesHut<double> tree{0.5, 4};
+  tree.Build(x.data(), y.data(), z.data(), m.data(), n);
+  std::vector<double> Fx(n), Fy(n), Fz(n);
+  tree.AddForces(m.data(), Fx.data(), Fy.data(), Fz.data(), kEps2);
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(Fx[i], 0.);
+    EXPECT_EQ(Fy[i], 0.);
+    EXPECT_EQ(Fz[i], 0.);
+  }
+}
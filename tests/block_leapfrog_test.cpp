@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "sim/block_leapfrog.h"
+#include "sim/integrators.h"
+
+namespace {
+// A tight binary of two unit masses at the centre and light particles on
+// circular orbits around it further out, G = 1. Direct forces, evaluated here.
+template <class Integrator>
+struct Cluster {
+  size_t n;
+  std::vector<double> x, y, z, vx, vy, vz, m, Fx, Fy, Fz, zero;
+  static constexpr double eps2{1e-8};
+  Integrator integrator{};
+  bool forces_current{false};
+  size_t evaluations{0};
+
+  explicit Cluster(const size_t n_field)
+      : n{n_field + 2},
+        x(n),
+        y(n),
+        z(n),
+        vx(n),
+        vy(n),
+        vz(n),
+        m(n, 1e-6),
+        Fx(n),
+        Fy(n),
+        Fz(n),
+        zero(n) {
+    // binary: separation 0.02, circular
+    m[0] = m[1] = 1.;
+    x[0] = -0.01;
+    x[1] = 0.01;
+    const double v{0.5 * std::sqrt(2. / 0.02)};
+    vy[0] = -v;
+    vy[1] = v;
+    std::mt19937 gen{3};
+    std::uniform_real_distribution<double> radius(2., 5.), angle(0., 6.28);
+    for (size_t i = 2; i < n; ++i) {
+      const double r{radius(gen)}, phi{angle(gen)};
+      const double v_c{std::sqrt(2. / r)};
+      x[i] = r * std::cos(phi);
+      y[i] = r * std::sin(phi);
+      vx[i] = -v_c * std::sin(phi);
+      vy[i] = v_c * std::cos(phi);
+    }
+  }
+
+  void Force(const size_t i) {
+    Fx[i] = Fy[i] = Fz[i] = 0.;
+    for (size_t j = 0; j < n; ++j) {
+      if (j == i) continue;
+      const double rx{x[j] - x[i]}, ry{y[j] - y[i]}, rz{z[j] - z[i]};
+      const double inv_r{1. / std::sqrt(rx * rx + ry * ry + rz * rz + eps2)};
+      const double f{m[i] * m[j] * inv_r * inv_r * inv_r};
+      Fx[i] += f * rx;
+      Fy[i] += f * ry;
+      Fz[i] += f * rz;
+    }
+    ++evaluations;
+  }
+  void Forces() {
+    for (size_t i = 0; i < n; ++i) Force(i);
+  }
+  void Forces(const std::span<const std::uint32_t> active) {
+    for (const std::uint32_t i : active) Force(i);
+  }
+
+  double Energy() const {
+    double e{0};
+    for (size_t i = 0; i < n; ++i) {
+      e += 0.5 * m[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+      for (size_t j = i + 1; j < n; ++j) {
+        const double rx{x[j] - x[i]}, ry{y[j] - y[i]}, rz{z[j] - z[i]};
+        e -= m[i] * m[j] / std::sqrt(rx * rx + ry * ry + rz * rz + eps2);
+      }
+    }
+    return e;
+  }
+
+  void Step(const double dt) {
+    const SoaState<double> s{.n = n,
+                             .x = x.data(),
+                             .y = y.data(),
+                             .z = z.data(),
+                             .vx = vx.data(),
+                             .vy = vy.data(),
+                             .vz = vz.data(),
+                             .m = m.data(),
+                             .Fx = Fx.data(),
+                             .Fy = Fy.data(),
+                             .Fz = Fz.data(),
+                             .ex = zero.data(),
+                             .ey = zero.data(),
+                             .ez = zero.data(),
+                             .gx = 0.,
+                             .gy = 0.,
+                             .gz = 0.,
+                             .scratch = nullptr,
+                             .stride = 0};
+    integrator.Step(s, dt, forces_current,
+                    [this](auto... active) { Forces(active...); });
+  }
+
+  // Relative energy error after `steps` steps of dt
+  double Run(const size_t steps, const double dt) {
+    const double e0{Energy()};
+    for (size_t k = 0; k < steps; ++k) Step(dt);
+    return std::abs((Energy() - e0) / e0);
+  }
+};
+}  // namespace
+
+// With every particle on level 0 the scheme is the plain leapfrog
+TEST(BlockLeapfrogTest, SingleLevelIsLeapfrog) {
+  Cluster<LeapfrogKDK> global(20);
+  Cluster<BlockLeapfrog> block(20);
+  block.integrator.SetMaxLevel(0);
+  global.Run(50, 1e-3);
+  block.Run(50, 1e-3);
+  for (size_t i = 0; i < global.n; ++i) {
+    EXPECT_NEAR(block.x[i], global.x[i], 1e-12);
+    EXPECT_NEAR(block.vy[i], global.vy[i], 1e-10);
+  }
+  EXPECT_EQ(block.evaluations, global.evaluations);
+}
+
+// The binary needs small steps, the field does not: block steps reach the
+// accuracy of a global step at the binary's level for a fraction of the
+// force evaluations
+TEST(BlockLeapfrogTest, ClusteredSystem) {
+  const double t{0.2};
+  Cluster<LeapfrogKDK> global(200);
+  const double global_error{global.Run(2000, t / 2000)};
+
+  Cluster<BlockLeapfrog> block(200);
+  block.integrator.SetAccuracy(0.02, 0.01);
+  const double block_error{block.Run(20, t / 20)};
+
+  RecordProperty("global_error", testing::PrintToString(global_error));
+  RecordProperty("block_error", testing::PrintToString(block_error));
+  RecordProperty("global_evaluations", int(global.evaluations));
+  RecordProperty("block_evaluations", int(block.evaluations));
+  EXPECT_EQ(block.evaluations, block.integrator.ForceEvaluations());
+  EXPECT_LT(block_error, global_error);
+  EXPECT_LT(10 * block.evaluations, global.evaluations);
+  // binary on a fine level, field on coarse ones
+  EXPECT_GT(block.integrator.Levels()[0], block.integrator.Levels()[100]);
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "sim/cell_list.h"
+#include "test_util.h"
+
+namespace {
+// Smooth inside the cutoff, 0 beyond and for r2 = inf; depends on the indices
+// to check that they reach the pair function.
+struct TestPair {
+  double cutoff2;
+  double operator()(const double r2, const size_t i, const size_t j) const {
+    return r2 < cutoff2 ? (cutoff2 - r2) * double(1 + i + 2 * j) : 0.;
+  }
+};
+
+std::vector<double> PairLoop(const RandomCloud<>& p, const double cutoff) {
+  const TestPair pair{cutoff * cutoff};
+  std::vector<double> F(3 * p.n);
+  for (size_t i = 0; i < p.n; ++i)
+    for (size_t j = 0; j < p.n; ++j) {
+      if (j == i) continue;
+      const double rx{p.x[j] - p.x[i]}, ry{p.y[j] - p.y[i]},
+          rz{p.z[j] - p.z[i]};
+      const double f{pair(rx * rx + ry * ry + rz * rz, i, j)};
+      F[3 * i] += f * rx;
+      F[3 * i + 1] += f * ry;
+      F[3 * i + 2] += f * rz;
+    }
+  return F;
+}
+
+void ExpectMatchesPairLoop(const RandomCloud<>& p, const double cutoff) {
+  CellList<double> cells;
+  cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, cutoff);
+  std::vector<double> Fx(p.n), Fy(p.n), Fz(p.n);
+  cells.AddPairForces(Fx.data(), Fy.data(), Fz.data(),
+                      TestPair{cutoff * cutoff});
+  const std::vector<double> F{PairLoop(p, cutoff)};
+  auto tol = [](const double f) { return 1e-9 * (1 + std::abs(f)); };
+  for (size_t i = 0; i < p.n; ++i) {
+    ASSERT_NEAR(Fx[i], F[3 * i], tol(F[3 * i])) << "particle " << i;
+    ASSERT_NEAR(Fy[i], F[3 * i + 1], tol(F[3 * i + 1])) << "particle " << i;
+    ASSERT_NEAR(Fz[i], F[3 * i + 2], tol(F[3 * i + 2])) << "particle " << i;
+  }
+}
+}  // namespace
+
+TEST(CellListTest, BinsEveryParticleOnceInIndexOrder) {
+  RandomCloud<> p(3000, {0, 10}, 5);
+  // bounding box [0, 10]^3
+  p.x[0] = p.y[0] = p.z[0] = 0.;
+  p.x[1] = p.y[1] = p.z[1] = 10.;
+  CellList<double> cells;
+  cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, 1.);
+  const auto dims{cells.Dims()};
+  EXPECT_EQ(dims[0], 10u);
+  EXPECT_EQ(cells.NumCells(), 1000u);
+
+  const auto order{cells.Order()};
+  const auto start{cells.Starts()};
+  ASSERT_EQ(order.size(), p.n);
+  ASSERT_EQ(start.size(), cells.NumCells() + 1);
+  EXPECT_EQ(start.back(), p.n);
+  std::vector<bool> seen(p.n);
+  for (size_t c = 0; c < cells.NumCells(); ++c) {
+    EXPECT_TRUE(std::is_sorted(order.begin() + start[c],
+                               order.begin() + start[c + 1]));
+    for (size_t s = start[c]; s < start[c + 1]; ++s) {
+      ASSERT_FALSE(seen[order[s]]);
+      seen[order[s]] = true;
+    }
+  }
+}
+
+TEST(CellListTest, MatchesPairLoop) {
+  ExpectMatchesPairLoop(RandomCloud<>(2000, {0, 10}, 5), 1.);
+  // cutoff not a divisor of the box, a few cells per axis
+  ExpectMatchesPairLoop(RandomCloud<>(500, {0, 3}, 5), 0.7);
+  // a single cell
+  ExpectMatchesPairLoop(RandomCloud<>(200, {0, 1}, 5), 5.);
+}
+
+TEST(CellListTest, DegenerateSets) {
+  CellList<double> cells;
+  cells.Build(nullptr, nullptr, nullptr, 0, 1.);
+  EXPECT_EQ(cells.NumCells(), 0u);
+  cells.AddPairForces(nullptr, nullptr, nullptr, TestPair{1.});
+
+  ExpectMatchesPairLoop(RandomCloud<>(1, {0, 1}, 5), 0.5);
+
+  // flat in z
+  RandomCloud<> flat(1000, {0, 10}, 5);
+  std::fill(flat.z.begin(), flat.z.end(), 2.);
+  ExpectMatchesPairLoop(flat, 1.);
+
+  // a tiny cutoff does not blow up the grid
+  const RandomCloud<> p(100, {0, 10}, 5);
+  cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, 1e-6);
+  EXPECT_LE(cells.NumCells(), 2 * p.n + 27);
+  ExpectMatchesPairLoop(p, 1e-6);
+}
+
+TEST(CellListTest, ActiveSubsetMatchesAll) {
+  const RandomCloud<> p(2000, {0, 10}, 5);
+  const double cutoff{1.2};
+  CellList<double> cells;
+  cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, cutoff);
+  std::vector<double> Fx(p.n), Fy(p.n), Fz(p.n);
+  cells.AddPairForces(Fx.data(), Fy.data(), Fz.data(),
+                      TestPair{cutoff * cutoff});
+
+  std::vector<std::uint32_t> active;
+  for (std::uint32_t i = 0; i < p.n; i += 7) active.push_back(i);
+  std::vector<double> ax(p.n), ay(p.n), az(p.n);
+  cells.AddPairForcesOn(active, ax.data(), ay.data(), az.data(),
+                        TestPair{cutoff * cutoff});
+  for (size_t i = 0; i < p.n; ++i) {
+    if (i % 7 == 0) {
+      // same cells, same summation order
+      EXPECT_EQ(ax[i], Fx[i]);
+      EXPECT_EQ(ay[i], Fy[i]);
+      EXPECT_EQ(az[i], Fz[i]);
+    } else {
+      EXPECT_EQ(ax[i], 0.);
+    }
+  }
+}
+
+TEST(CellListTest, RebuildIsDeterministic) {
+  const RandomCloud<> p(20000, {0, 20}, 5);
+  auto forces = [&p] {
+    CellList<double> cells;
+    cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, 1.);
+    std::vector<double> Fx(p.n), Fy(p.n), Fz(p.n);
+    cells.AddPairForces(Fx.data(), Fy.data(), Fz.data(), TestPair{1.});
+    return Fx;
+  };
+  EXPECT_EQ(forces(), forces());
+}
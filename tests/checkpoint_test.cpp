@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "sim/aos_particle_system.h"
+#include "sim/force_models.h"
+#include "sim/particles.h"
+#include "test_util.h"
+#include "utils/checkpoint.h"
+
+namespace {
+// Overwrites one byte of a file
+void Poke(const std::string& path, const size_t offset, const char value) {
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(std::streamoff(offset));
+  file.put(value);
+}
+
+using System = Particles<double, LeapfrogKDK, Gravity<double>>;
+const std::vector<double> kNone;
+}  // namespace
+
+// A restarted run continues exactly as the uninterrupted one
+TEST(CheckpointTest, RestartContinuesBitForBit) {
+  const std::string path{TempPath("checkpoint_test_restart.ckpt")};
+  System p(300, 0.001);
+  p.SetReordering(SpaceFillingCurve::kHilbert, 3);
+  for (size_t k = 0; k < 4; ++k) p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  p.Save(path);
+  EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+  System q(Checkpoint{path});
+  q.SetReordering(SpaceFillingCurve::kHilbert, 3);
+  for (size_t k = 0; k < 5; ++k) {
+    p.Update(kNone, kNone, kNone, 0., 0., 0.);
+    q.Update(kNone, kNone, kNone, 0., 0., 0.);
+  }
+  for (size_t i = 0; i < 300; ++i) {
+    ASSERT_EQ(q.x[i], p.x[i]) << "particle " << i;
+    ASSERT_EQ(q.z[i], p.z[i]) << "particle " << i;
+    ASSERT_EQ(q.Ids()[i], p.Ids()[i]);
+  }
+  std::remove(path.c_str());
+}
+
+// The arrays are the mapped file, and writing them leaves the file alone
+TEST(CheckpointTest, ArraysAreUsedInPlace) {
+  const std::string path{TempPath("checkpoint_test_in_place.ckpt")};
+  System(1000, 0.01).Save(path);
+  const Checkpoint checkpoint{path};
+  System p(checkpoint);
+  const CheckpointField* const x{checkpoint.Find("x")};
+  ASSERT_NE(x, nullptr);
+  EXPECT_EQ(p.x.data(), checkpoint.Data<double>(*x).data());
+  EXPECT_EQ(x->offset % 4096, 0u);
+
+  const double x0{p.x[0]};
+  p.x[0] = x0 + 1.;
+  EXPECT_EQ(System(Checkpoint{path}).x[0], x0);
+  std::remove(path.c_str());
+}
+
+TEST(CheckpointTest, ConvertsBetweenFloatAndDouble) {
+  const std::string path{TempPath("checkpoint_test_convert.ckpt")};
+  const System p(100, 0.25);
+  p.Save(path);
+  const Particles<float, LeapfrogKDK, Gravity<float>> q(Checkpoint{path});
+  for (size_t i = 0; i < 100; ++i) EXPECT_EQ(q.y[i], float(p.y[i]));
+  std::remove(path.c_str());
+}
+
+TEST(CheckpointTest, RejectsDamagedFiles) {
+  const std::string path{TempPath("checkpoint_test_damaged.ckpt")};
+  System(100, 0.01).Save(path);
+  const size_t bytes{std::filesystem::file_size(path)};
+  {
+    const Checkpoint checkpoint{path};
+    EXPECT_EQ(checkpoint.Header().n, 100u);
+    EXPECT_EQ(checkpoint.Header().file_bytes, bytes);
+    // a byte of the velocities
+    Poke(path, checkpoint.Find("vx")->offset + 3, 'x');
+  }
+  EXPECT_THROW(Checkpoint{path}, std::runtime_error);
+  // the table and header still check out
+  EXPECT_NO_THROW(Checkpoint(path, false));
+
+  Poke(path, 0, 'Q');
+  EXPECT_THROW(Checkpoint(path, false), std::runtime_error);
+  std::filesystem::resize_file(path, bytes - 8);
+  EXPECT_THROW(Checkpoint(path, false), std::runtime_error);
+  std::remove(path.c_str());
+  EXPECT_THROW(Checkpoint{path}, std::runtime_error);
+}
+
+// Fields whose size is not a multiple of the 32-byte checksum stride: the
+// 4-byte IDs of 1, 3 and 5 particles
+TEST(CheckpointTest, RejectsDamageInTheLastBytes) {
+  const std::string path{TempPath("checkpoint_test_tail.ckpt")};
+  for (const size_t n : {1, 3, 5}) {
+    System(n, 0.01).Save(path);
+    size_t end{0};
+    {
+      const Checkpoint checkpoint{path};
+      const CheckpointField& id{*checkpoint.Find("id")};
+      EXPECT_EQ(id.count, n);
+      end = id.offset + 4 * n;
+    }
+    for (size_t back = 1; back <= std::min<size_t>(4 * n, 12); ++back) {
+      std::ifstream file(path, std::ios::binary);
+      file.seekg(std::streamoff(end - back));
+      const char byte{char(file.get())};
+      file.close();
+      Poke(path, end - back, char(byte ^ 1));
+      EXPECT_THROW(Checkpoint{path}, std::runtime_error)
+          << "n " << n << ", byte " << back << " from the end";
+      Poke(path, end - back, byte);
+      EXPECT_NO_THROW(Checkpoint{path});
+    }
+  }
+  std::remove(path.c_str());
+}
+
+// A field table that checks out but whose count wraps the size of the field
+// to a few bytes, and IDs that are in range but not a permutation
+TEST(CheckpointTest, RejectsBadFieldTablesAndIds) {
+  const std::string path{TempPath("checkpoint_test_table.ckpt")};
+  System(100, 0.01).Save(path);
+  std::vector<std::byte> file(std::filesystem::file_size(path));
+  std::ifstream(path, std::ios::binary)
+      .read(reinterpret_cast<char*>(file.data()), std::streamsize(file.size()));
+  CheckpointHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  std::vector<CheckpointField> table(header.num_fields);
+  std::memcpy(table.data(), file.data() + sizeof(header),
+              table.size() * sizeof(CheckpointField));
+  // as the writer does: the checksum of the header, itself as 0, and table
+  auto write = [&] {
+    header.checksum = 0;
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), table.data(),
+                table.size() * sizeof(CheckpointField));
+    header.checksum = Checksum(
+        {file.data(), sizeof(header) + table.size() * sizeof(CheckpointField)});
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::ofstream(path, std::ios::binary)
+        .write(reinterpret_cast<const char*>(file.data()),
+               std::streamsize(file.size()));
+  };
+  const auto vx{std::ranges::find_if(table, [](const CheckpointField& f) {
+    return std::string_view(f.name) == "vx";
+  })};
+  const std::uint64_t count{vx->count};
+  vx->count = (std::uint64_t(1) << 61) + 1;
+  write();
+  EXPECT_THROW(Checkpoint(path, false), std::runtime_error);
+  vx->count = count;
+  write();
+  EXPECT_NO_THROW(Checkpoint{path});
+
+  // particle 1 takes the ID of particle 0
+  const Checkpoint good{path};
+  EXPECT_NO_THROW(System{good});
+  Poke(path, good.Find("id")->offset + 4, 0);
+  EXPECT_THROW(System(Checkpoint(path, false)), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(CheckpointTest, ChecksumSeesEveryByte) {
+  std::vector<std::byte> bytes((3 << 20) + 5, std::byte{7});
+  const std::uint64_t sum{Checksum(bytes)};
+  for (const size_t at : {size_t(0), size_t(1) << 20, bytes.size() - 1}) {
+    bytes[at] = std::byte{8};
+    EXPECT_NE(Checksum(bytes), sum) << "byte " << at;
+    bytes[at] = std::byte{7};
+  }
+  EXPECT_EQ(Checksum(bytes), sum);
+  // every byte of short buffers, across the 8- and 32-byte strides
+  for (size_t size = 1; size <= 72; ++size) {
+    std::vector<std::byte> small(size, std::byte{7});
+    const std::uint64_t small_sum{Checksum(small)};
+    for (size_t at = 0; at < size; ++at) {
+      small[at] = std::byte{8};
+      ASSERT_NE(Checksum(small), small_sum) << "size " << size << ", byte "
+                                            << at;
+      small[at] = std::byte{7};
+    }
+  }
+}
+
+TEST(CheckpointTest, AosRoundTrip) {
+  const std::string path{TempPath("checkpoint_test_aos.ckpt")};
+  std::vector<ParticleStructure> particles;
+  for (size_t i = 0; i < 10; ++i)
+    particles.emplace_back(Point3d{1. * i, 2., 3.}, 0.5 + i,
+                           Vec3d{-1., 0., double(i)}, 100 + i);
+  const ParticleSystemAoS aos(std::move(particles));
+  aos.Save(path);
+  std::ostringstream before, after;
+  before << aos;
+  after << ParticleSystemAoS(Checkpoint{path});
+  EXPECT_EQ(after.str(), before.str());
+
+  // Particles checkpoints read as AoS too, 32-bit IDs and padding included
+  System(20, 0.01).Save(path);
+  EXPECT_NO_THROW(ParticleSystemAoS{Checkpoint{path}});
+  std::remove(path.c_str());
+}
@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sim/block_leapfrog.h"
+#include "sim/diagnostics.h"
+#include "sim/force_models.h"
+#include "sim/particles.h"
+#include "test_util.h"
+#include "utils/checkpoint.h"
+
+namespace {
+const std::vector<double> kNone;
+
+// Particle state by field, as written to and read from checkpoints
+struct Snapshot {
+  std::vector<double> x, y, z, m, vx, vy, vz, Fx, Fy, Fz;
+
+  // n particles of total mass 1 in a cube, with random velocities
+  explicit Snapshot(const size_t n) {
+    std::mt19937 gen{11};
+    std::uniform_real_distribution<double> u(-1., 1.);
+    std::normal_distribution<double> v(0., 0.3);
+    for (auto* f : {&x, &y, &z}) f->resize(n);
+    for (auto* f : {&vx, &vy, &vz, &Fx, &Fy, &Fz}) f->resize(n);
+    m.assign(n, 1. / double(n));
+    for (size_t i = 0; i < n; ++i) {
+      x[i] = u(gen);
+      y[i] = u(gen);
+      z[i] = u(gen);
+      vx[i] = v(gen);
+      vy[i] = v(gen);
+      vz[i] = v(gen);
+    }
+  }
+
+  // The state of a Particles, through a checkpoint
+  template <class P>
+  static Snapshot Of(const P& p) {
+    Snapshot s(0);
+    s.Read(p);
+    return s;
+  }
+
+  template <class P>
+  void Read(const P& p) {
+    const std::string path{TempPath("diagnostics_test_read.ckpt")};
+    p.Save(path);
+    const Checkpoint checkpoint(path);
+    const size_t n{checkpoint.Header().n};
+    auto read = [&](const char* name, std::vector<double>& out) {
+      const auto data{checkpoint.Data<double>(*checkpoint.Find(name))};
+      out.assign(data.begin(), data.begin() + std::ptrdiff_t(n));
+    };
+    read("x", x);
+    read("y", y);
+    read("z", z);
+    read("m", m);
+    read("vx", vx);
+    read("vy", vy);
+    read("vz", vz);
+    read("Fx", Fx);
+    read("Fy", Fy);
+    read("Fz", Fz);
+    std::remove(path.c_str());
+  }
+
+  // A Particles of this state, through a checkpoint
+  template <class P>
+  P Load() const {
+    const std::string path{TempPath("diagnostics_test_write.ckpt")};
+    std::vector<double> Gm(m.size());
+    for (size_t i = 0; i < m.size(); ++i) Gm[i] = G * m[i];
+    CheckpointWriter writer;
+    const char* names[]{"x", "y", "z", "m", "Gm", "vx", "vy", "vz"};
+    const std::vector<double>* fields[]{&x, &y, &z, &m, &Gm, &vx, &vy, &vz};
+    for (size_t k = 0; k < 8; ++k)
+      writer.Add(names[k], std::span<const double>(*fields[k]));
+    writer.Write(path, m.size(), 1e-3, 0, 0);
+    P p{Checkpoint{path}};
+    std::remove(path.c_str());
+    return p;
+  }
+
+  // Everything but the potential, directly
+  StepStats Motion() const {
+    StepStats s;
+    for (size_t i = 0; i < m.size(); ++i) {
+      s.kinetic += m[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]) / 2;
+      s.momentum[0] += m[i] * vx[i];
+      s.momentum[1] += m[i] * vy[i];
+      s.momentum[2] += m[i] * vz[i];
+      s.angular_momentum[0] += m[i] * (y[i] * vz[i] - z[i] * vy[i]);
+      s.angular_momentum[1] += m[i] * (z[i] * vx[i] - x[i] * vz[i]);
+      s.angular_momentum[2] += m[i] * (x[i] * vy[i] - y[i] * vx[i]);
+      s.virial += x[i] * Fx[i] + y[i] * Fy[i] + z[i] * Fz[i];
+    }
+    return s;
+  }
+
+  // Softened gravitational potential energy, all pairs
+  double Gravitational(const double eps2) const {
+    double u{0};
+    for (size_t i = 0; i < m.size(); ++i)
+      for (size_t j = i + 1; j < m.size(); ++j) {
+        const double rx{x[j] - x[i]}, ry{y[j] - y[i]}, rz{z[j] - z[i]};
+        u -= G * m[i] * m[j] / std::sqrt(rx * rx + ry * ry + rz * rz + eps2);
+      }
+    return u;
+  }
+};
+
+using Kdk = Particles<double, LeapfrogKDK, Gravity<double>>;
+constexpr double kEps2{1e-8};
+}  // namespace
+
+TEST(DiagnosticsTest, CompensatedSumKeepsSmallTerms) {
+  CompensatedSum sum;
+  double naive{0};
+  for (const double v : {1e16, 1., 1., -1e16}) {
+    sum.Add(v);
+    naive += v;
+  }
+  EXPECT_EQ(sum.Value(), 2.);
+  EXPECT_EQ(naive, 0.);
+}
+
+// Every quantity against a direct computation on the state after the step
+TEST(DiagnosticsTest, StatsMatchDirectSums) {
+  // several tiles of the direct solver
+  Kdk p{Snapshot(300).Load<Kdk>()};
+  p.SetDiagnostics(true);
+  for (size_t k = 0; k < 3; ++k) p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  const StepStats& stats{p.Stats()};
+  const Snapshot after{Snapshot::Of(p)};
+  const StepStats direct{after.Motion()};
+  EXPECT_EQ(stats.step, 3u);
+  EXPECT_NEAR(stats.kinetic, direct.kinetic, 1e-12 * direct.kinetic);
+  const double u{after.Gravitational(kEps2)};
+  EXPECT_NEAR(stats.potential, u, 1e-12 * std::abs(u));
+  EXPECT_NEAR(stats.virial, direct.virial, 1e-12 * std::abs(direct.virial));
+  for (size_t d = 0; d < 3; ++d) {
+    EXPECT_NEAR(stats.momentum[d], direct.momentum[d], 1e-12);
+    EXPECT_NEAR(stats.angular_momentum[d], direct.angular_momentum[d], 1e-12);
+  }
+  EXPECT_DOUBLE_EQ(stats.Energy(), stats.kinetic + stats.potential);
+}
+
+// The potential of every solver and precision, and of block time-stepping,
+// whose last evaluation has all particles active
+TEST(DiagnosticsTest, PotentialOfEverySolver) {
+  const Snapshot start(500);
+  auto potential = [&](auto p, auto configure) {
+    configure(p);
+    p.SetDiagnostics(true);
+    p.Update(kNone, kNone, kNone, 0., 0., 0.);
+    return std::pair{p.Stats().potential,
+                     Snapshot::Of(p).Gravitational(kEps2)};
+  };
+  const auto none = [](auto&) {};
+  const auto tree = [](auto& p) {
+    p.SetForceSolver(ForceSolver::kBarnesHut, 0.3);
+  };
+  const auto mixed = [](auto& p) {
+    p.SetForcePrecision(ForcePrecision::kMixed);
+  };
+  using Block = Particles<double, BlockLeapfrog, Gravity<double>>;
+  using Euler = Particles<double, SemiImplicitEuler, Gravity<double>>;
+  using Rk4 = Particles<double, RungeKutta4, Gravity<double>>;
+
+  for (const auto& [got, want] :
+       {potential(start.Load<Block>(), none),
+        potential(start.Load<Euler>(), none),
+        potential(start.Load<Rk4>(), none)})
+    EXPECT_NEAR(got, want, 1e-11 * std::abs(want));
+  const auto [mixed_got, mixed_want]{potential(start.Load<Kdk>(), mixed)};
+  EXPECT_NEAR(mixed_got, mixed_want, 1e-5 * std::abs(mixed_want));
+  const auto [tree_got, tree_want]{potential(start.Load<Kdk>(), tree)};
+  EXPECT_NEAR(tree_got, tree_want, 1e-3 * std::abs(tree_want));
+  const auto [block_tree, block_want]{potential(start.Load<Block>(), tree)};
+  EXPECT_NEAR(block_tree, block_want, 1e-3 * std::abs(block_want));
+}
+
+// The potential is summed alongside the forces, which stay bit for bit
+TEST(DiagnosticsTest, DiagnosticsLeaveTheTrajectory) {
+  const Snapshot start(200);
+  using Euler = Particles<double, SemiImplicitEuler, Gravity<double>>;
+  auto run = [&](auto p, const bool diagnostics) {
+    p.SetDiagnostics(diagnostics);
+    for (size_t k = 0; k < 5; ++k) p.Update(kNone, kNone, kNone, 0., 0., 0.);
+    return std::vector<double>(p.x.begin(), p.x.end());
+  };
+  EXPECT_EQ(run(start.Load<Kdk>(), true), run(start.Load<Kdk>(), false));
+  EXPECT_EQ(run(start.Load<Euler>(), true), run(start.Load<Euler>(), false));
+}
+
+TEST(DiagnosticsTest, EnergyAndMomentumConserved) {
+  Kdk p{Snapshot(200).Load<Kdk>()};
+  p.SetDiagnostics(true);
+  p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  const StepStats first{p.Stats()};
+  for (size_t k = 0; k < 100; ++k) p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  const StepStats& last{p.Stats()};
+  EXPECT_NEAR(last.Energy(), first.Energy(), 1e-4 * std::abs(first.Energy()));
+  for (size_t d = 0; d < 3; ++d) {
+    EXPECT_NEAR(last.momentum[d], first.momentum[d], 1e-12);
+    EXPECT_NEAR(last.angular_momentum[d], first.angular_momentum[d], 1e-10);
+  }
+}
+
+TEST(DiagnosticsTest, SpringEnergy) {
+  using Springs = Particles<double, LeapfrogKDK, HarmonicSprings<double>>;
+  const Snapshot start(50);
+  Springs p{start.Load<Springs>()};
+  std::vector<HarmonicSprings<double>::Bond> bonds;
+  for (std::uint32_t i = 0; i + 1 < 50; ++i)
+    bonds.push_back({i, i + 1, 2. + i, 0.5});
+  p.GetForceModel().SetBonds(bonds, 50);
+  p.SetDiagnostics(true);
+  p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  const Snapshot after{Snapshot::Of(p)};
+  double u{0};
+  for (const auto& b : bonds) {
+    const double r{std::hypot(after.x[b.j] - after.x[b.i],
+                              after.y[b.j] - after.y[b.i],
+                              after.z[b.j] - after.z[b.i])};
+    u += b.k * (r - b.r0) * (r - b.r0) / 2;
+  }
+  EXPECT_NEAR(p.Stats().potential, u, 1e-12 * u);
+}
+
+TEST(DiagnosticsTest, ModelsWithoutPotential) {
+  using Free = Particles<double, LeapfrogKDK, NoPairForces>;
+  const Snapshot start(20);
+  Free free{start.Load<Free>()};
+  free.SetDiagnostics(true);
+  free.Update(kNone, kNone, kNone, 0., 0., 0.);
+  EXPECT_EQ(free.Stats().potential, 0.);
+  EXPECT_NEAR(free.Stats().kinetic, start.Motion().kinetic, 1e-12);
+}
+
+TEST(DiagnosticsTest, LennardJonesEnergy) {
+  using Lj = Particles<double, LeapfrogKDK, LennardJones<double>>;
+  const Snapshot start(200);
+  Lj p{start.Load<Lj>()};
+  p.GetForceModel().SetParameters(1e-3, 0.05, 0.5);
+  p.SetDiagnostics(true);
+  p.Update(kNone, kNone, kNone, 0., 0., 0.);
+  const Snapshot after{Snapshot::Of(p)};
+  double u{0};
+  for (size_t i = 0; i < 200; ++i)
+    for (size_t j = i + 1; j < 200; ++j) {
+      const double r{std::hypot(after.x[j] - after.x[i],
+                                after.y[j] - after.y[i],
+                                after.z[j] - after.z[i])};
+      if (r < 0.5) u += 4e-3 * (std::pow(0.05 / r, 12) - std::pow(0.05 / r, 6));
+    }
+  EXPECT_NEAR(p.Stats().potential, u, 1e-9 * std::abs(u));
+  EXPECT_TRUE(std::isfinite(p.Stats().Energy()));
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "sim/direct_sum.h"
+#include "sim/gravity_kernels.h"
+#include "test_util.h"
+#include "utils/thread_pool.h"
+
+namespace {
+// The serial i < j loop of Particles<T> before tiling
+template <typename T>
+void SerialForces(const RandomCloud<T>& c, const T eps2, std::vector<T>& Fx,
+                  std::vector<T>& Fy, std::vector<T>& Fz) {
+  const size_t n{c.x.size()};
+  Fx.assign(n, T(0));
+  Fy.assign(n, T(0));
+  Fz.assign(n, T(0));
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = i + 1; j < n; ++j) {
+      const T rx{c.x[j] - c.x[i]}, ry{c.y[j] - c.y[i]}, rz{c.z[j] - c.z[i]};
+      const T inv_r{T(1) / std::sqrt(rx * rx + ry * ry + rz * rz + eps2)};
+      const T F{c.m[i] * c.m[j] * inv_r * inv_r * inv_r};
+      Fx[i] += F * rx;
+      Fx[j] -= F * rx;
+      Fy[i] += F * ry;
+      Fy[j] -= F * ry;
+      Fz[i] += F * rz;
+      Fz[j] -= F * rz;
+    }
+}
+
+template <typename T>
+void ExpectSameAsSerial(const size_t n, const T tolerance) {
+  const T eps2{T(1e-8)};
+  const RandomCloud<T> c(n, {-2, 2}, 7, {1, 200});
+  std::vector<T> Fx, Fy, Fz;
+  SerialForces(c, eps2, Fx, Fy, Fz);
+
+  DirectSum<T> direct;
+  std::vector<T> Dx(n), Dy(n), Dz(n);
+  // Gm == m, G = 1
+  direct.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(),
+                   c.m.data(), n, Dx.data(), Dy.data(), Dz.data(), eps2);
+
+  T norm2{0}, err2{0};
+  for (size_t i = 0; i < n; ++i) {
+    norm2 += Fx[i] * Fx[i] + Fy[i] * Fy[i] + Fz[i] * Fz[i];
+    err2 += (Dx[i] - Fx[i]) * (Dx[i] - Fx[i]) +
+            (Dy[i] - Fy[i]) * (Dy[i] - Fy[i]) +
+            (Dz[i] - Fz[i]) * (Dz[i] - Fz[i]);
+  }
+  if (n > 1) {
+    EXPECT_LT(std::sqrt(err2 / norm2), tolerance) << "n = " << n;
+  }
+}
+}  // namespace
+
+TEST(DirectSumTest, MatchesSerialLoopDouble) {
+  for (size_t n : {0, 1, 2, 33, 257, 700, 1000, 3001})
+    ExpectSameAsSerial<double>(n, 1e-12);
+}
+
+TEST(DirectSumTest, MatchesSerialLoopFloat) {
+  for (size_t n : {2, 513, 2000}) ExpectSameAsSerial<float>(n, 1e-4f);
+}
+
+TEST(DirectSumTest, EveryInstructionSetMatchesSerialLoop) {
+  for (SimdIsa isa : {SimdIsa::kScalar, SimdIsa::kSse42, SimdIsa::kAvx2,
+                      SimdIsa::kAvx512}) {
+    if (isa > DetectSimdIsa()) continue;
+    SetSimdIsa(isa);
+    EXPECT_EQ(ActiveSimdIsa(), isa);
+    SCOPED_TRACE(SimdIsaName(isa));
+    for (size_t n : {3, 17, 300, 1001}) {
+      ExpectSameAsSerial<double>(n, 1e-12);
+      ExpectSameAsSerial<float>(n, 1e-4f);
+    }
+  }
+  SetSimdIsa(DetectSimdIsa());
+}
+
+// Accuracy of the mixed precision kernels against the pure double path. The
+// errors are recorded as test properties (--gtest_output=json).
+TEST(DirectSumTest, MixedPrecisionAccuracy) {
+  const double eps2{1e-8};
+  for (SimdIsa isa : {SimdIsa::kScalar, SimdIsa::kSse42, SimdIsa::kAvx2,
+                      SimdIsa::kAvx512}) {
+    if (isa > DetectSimdIsa()) continue;
+    SetSimdIsa(isa);
+    SCOPED_TRACE(SimdIsaName(isa));
+    for (size_t n : {5, 300, 2000}) {
+      RandomCloud<double> c(n, {-2, 2}, 7, {1, 200});
+      // shift the cloud: float separations must not depend on the offset
+      for (auto& xi : c.x) xi += 1000.;
+      std::vector<double> Dx(n), Dy(n), Dz(n), Mx(n), My(n), Mz(n);
+      DirectSum<double> native, mixed;
+      mixed.SetPrecision(ForcePrecision::kMixed);
+      native.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(),
+                       c.m.data(), n, Dx.data(), Dy.data(), Dz.data(), eps2);
+      mixed.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(),
+                      c.m.data(), n, Mx.data(), My.data(), Mz.data(), eps2);
+      double err2{0}, norm2{0}, max_rel{0};
+      for (size_t i = 0; i < n; ++i) {
+        const double e2{(Mx[i] - Dx[i]) * (Mx[i] - Dx[i]) +
+                        (My[i] - Dy[i]) * (My[i] - Dy[i]) +
+                        (Mz[i] - Dz[i]) * (Mz[i] - Dz[i])};
+        const double d2{Dx[i] * Dx[i] + Dy[i] * Dy[i] + Dz[i] * Dz[i]};
+        err2 += e2;
+        norm2 += d2;
+        max_rel = std::max(max_rel, std::sqrt(e2 / d2));
+      }
+      const std::string key{std::string(SimdIsaName(isa)) + "_n" +
+                            std::to_string(n)};
+      RecordProperty("rms_rel_error_" + key,
+                     testing::PrintToString(std::sqrt(err2 / norm2)));
+      RecordProperty("max_rel_error_" + key, testing::PrintToString(max_rel));
+      EXPECT_LT(std::sqrt(err2 / norm2), 1e-5) << "n = " << n;
+      EXPECT_LT(max_rel, 1e-4) << "n = " << n;
+    }
+  }
+  SetSimdIsa(DetectSimdIsa());
+}
+
+TEST(DirectSumTest, ScheduleIsReusedAndDeterministic) {
+  const size_t n{1500};
+  const RandomCloud<double> c(n, {-2, 2}, 7, {1, 200});
+  DirectSum<double> direct;
+  std::vector<double> F1x(n), F1y(n), F1z(n), F2x(n), F2y(n), F2z(n);
+  direct.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(), c.m.data(),
+                   n, F1x.data(), F1y.data(), F1z.data(), 1e-8);
+  direct.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(), c.m.data(),
+                   n, F2x.data(), F2y.data(), F2z.data(), 1e-8);
+  EXPECT_EQ(F1x, F2x);
+  EXPECT_EQ(F1y, F2y);
+  EXPECT_EQ(F1z, F2z);
+}
+
+// Blocks sized for the pool's threads, rebuilt when the pool is resized
+TEST(DirectSumTest, ScheduleFollowsPoolSize) {
+  const size_t threads{ThreadPool::Global().NumThreads()};
+  const size_t n{2000};
+  const RandomCloud<double> c(n, {-2, 2}, 7);
+  DirectSum<double> direct;
+  auto run = [&](const size_t pool) {
+    ThreadPool::Global().Resize(pool);
+    std::vector<double> Fx(n), Fy(n), Fz(n);
+    direct.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(),
+                     c.m.data(), n, Fx.data(), Fy.data(), Fz.data(), 1e-8);
+    return direct.BlockSize();
+  };
+  EXPECT_EQ(run(1), DirectSum<double>::kMaxBlock);
+  EXPECT_EQ(run(8), n / 32);
+  ThreadPool::Global().Resize(threads);
+}
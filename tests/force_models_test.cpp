@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "sim/force_models.h"
+#include "sim/particles.h"
+#include "test_util.h"
+
+TEST(ForceModelsTest, LennardJonesMatchesPairLoop) {
+  RandomCloud<> c(500, {0, 8}, 11);
+  LennardJones<double> lj(1., 0.3, 1.);
+  lj.AddForces(c.State());
+
+  std::vector<double> Fx(c.n), Fy(c.n), Fz(c.n);
+  for (size_t i = 0; i < c.n; ++i)
+    for (size_t j = 0; j < c.n; ++j) {
+      if (j == i) continue;
+      const double rx{c.x[j] - c.x[i]}, ry{c.y[j] - c.y[i]},
+          rz{c.z[j] - c.z[i]};
+      const double r{std::sqrt(rx * rx + ry * ry + rz * rz)};
+      if (r >= 1.) continue;
+      // U'(r) / r
+      const double s{0.3 / r};
+      const double f{4 * (-12 * std::pow(s, 12) + 6 * std::pow(s, 6)) / r / r};
+      Fx[i] += f * rx;
+      Fy[i] += f * ry;
+      Fz[i] += f * rz;
+    }
+  auto tol = [](const double f) { return 1e-9 * (1 + std::abs(f)); };
+  for (size_t i = 0; i < c.n; ++i) {
+    EXPECT_NEAR(c.Fx[i], Fx[i], tol(Fx[i])) << i;
+    EXPECT_NEAR(c.Fy[i], Fy[i], tol(Fy[i])) << i;
+    EXPECT_NEAR(c.Fz[i], Fz[i], tol(Fz[i])) << i;
+  }
+
+  // the active-particle path gives the same forces
+  const std::vector<std::uint32_t> active{0, 7, 499};
+  RandomCloud<> d(500, {0, 8}, 11);
+  lj.AddForcesOn(d.State(), active);
+  for (const auto i : active) EXPECT_NEAR(d.Fx[i], Fx[i], tol(Fx[i])) << i;
+}
+
+// The potential energy of the Verlet lists and of all pairs, from all
+// particles and from the active ones
+TEST(ForceModelsTest, LennardJonesPotential) {
+  for (const double box : {8., 1.5}) {
+    RandomCloud<> c(300, {0, box}, 13);
+    double want{0};
+    for (size_t i = 0; i < c.n; ++i)
+      for (size_t j = i + 1; j < c.n; ++j) {
+        const double r{std::sqrt(c.Distance2(i, j))};
+        if (r < 1.) want += 4 * (std::pow(0.3 / r, 12) - std::pow(0.3 / r, 6));
+      }
+    LennardJones<double> lj(1., 0.3, 1.);
+    double u{0};
+    ForceState<double> s{c.State()};
+    s.potential = &u;
+    lj.AddForces(s);
+    EXPECT_NEAR(u, want, 1e-9 * std::abs(want)) << box;
+    std::vector<std::uint32_t> all(c.n);
+    for (size_t i = 0; i < c.n; ++i) all[i] = std::uint32_t(i);
+    u = 0;
+    lj.AddForcesOn(s, all);
+    EXPECT_NEAR(u, want, 1e-9 * std::abs(want)) << box;
+  }
+}
+
+TEST(ForceModelsTest, LennardJonesMinimumAndCutoff) {
+  const LennardJones<double> lj(1., 1., 2.5);
+  EXPECT_NEAR(lj.PairFactor(std::pow(2., 1. / 3)), 0., 1e-12);
+  // repulsive inside the minimum (pushes i away from j), attractive outside
+  EXPECT_LT(lj.PairFactor(1.), 0.);
+  EXPECT_GT(lj.PairFactor(4.), 0.);
+  EXPECT_EQ(lj.PairFactor(2.5 * 2.5 + 1e-9), 0.);
+}
+
+// Without softening a particle's pair with itself would be 0/0
+TEST(ForceModelsTest, GravityNeedsSoftening) {
+  EXPECT_THROW(Gravity<double>(0.), std::invalid_argument);
+  EXPECT_THROW(Gravity<float>(-1.f), std::invalid_argument);
+  EXPECT_THROW(Gravity<double>(std::nan("")), std::invalid_argument);
+  EXPECT_NO_THROW(Gravity<double>(1e-3));
+}
+
+TEST(ForceModelsTest, HarmonicSprings) {
+  RandomCloud<> c(3, {0, 1}, 11);
+  c.x = {0., 2., 0.};
+  c.y = {0., 0., 0.5};
+  c.z = {0., 0., 0.};
+  HarmonicSprings<double> springs;
+  springs.SetBonds({{0, 1, 3., 1.5}, {0, 2, 2., 1.}}, 3);
+  EXPECT_EQ(springs.NumBonds(), 2u);
+  springs.AddForces(c.State());
+  // 0-1 stretched by 0.5 pulls 0 towards 1; 0-2 compressed by 0.5 pushes 0
+  // away from 2
+  EXPECT_DOUBLE_EQ(c.Fx[0], 1.5);
+  EXPECT_DOUBLE_EQ(c.Fy[0], -1.);
+  EXPECT_DOUBLE_EQ(c.Fx[1], -1.5);
+  EXPECT_DOUBLE_EQ(c.Fy[2], 1.);
+  EXPECT_DOUBLE_EQ(c.Fx[0] + c.Fx[1] + c.Fx[2], 0.);
+
+  // a bad bond is rejected and the old ones kept
+  EXPECT_THROW(springs.SetBonds({{0, 3, 1., 1.}}, 3), std::out_of_range);
+  EXPECT_THROW(springs.SetBonds({{0, 1, 1., 1.}, {7, 2, 1., 1.}}, 3),
+               std::out_of_range);
+  EXPECT_THROW(springs.SetBonds({{1, 1, 1., 1.}}, 3), std::out_of_range);
+  EXPECT_EQ(springs.NumBonds(), 2u);
+}
+
+// Without pair forces and without global force nothing moves
+TEST(ForceModelsTest, NoPairForcesIsBallistic) {
+  Particles<double, SemiImplicitEuler, NoPairForces> p(100, 0.1);
+  const std::vector<double> x0(p.x.begin(), p.x.end());
+  const std::vector<double> z0(p.z.begin(), p.z.end());
+  const std::vector<double> none;
+  for (size_t k = 0; k < 10; ++k) p.Update(none, none, none, 0., 0., 0.);
+  for (size_t i = 0; i < 100; ++i) EXPECT_EQ(p.x[i], x0[i]);
+  for (size_t k = 0; k < 10; ++k) p.Update(none, none, none, 0., 0., -1.);
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(p.x[i], x0[i]);
+    EXPECT_LT(p.z[i], z0[i]);
+  }
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "sim/initial_conditions.h"
+#include "sim/particles.h"
+#include "utils/thread_pool.h"
+
+namespace {
+// Particle arrays of a generator, kept in vectors
+template <typename T>
+struct Sample {
+  std::vector<T> x, y, z, vx, vy, vz, m;
+
+  template <class Generator>
+  Sample(const size_t n, const Generator& generate)
+      : x(n), y(n), z(n), vx(n), vy(n), vz(n), m(n) {
+    generate(ParticleArrays<T>{.n = n,
+                               .x = x.data(),
+                               .y = y.data(),
+                               .z = z.data(),
+                               .vx = vx.data(),
+                               .vy = vy.data(),
+                               .vz = vz.data(),
+                               .m = m.data()});
+  }
+
+  size_t size() const { return m.size(); }
+
+  double Mass() const {
+    double total{0};
+    for (const T mi : m) total += mi;
+    return total;
+  }
+
+  double Kinetic() const {
+    double kinetic{0};
+    for (size_t i = 0; i < size(); ++i)
+      kinetic += 0.5 * m[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    return kinetic;
+  }
+
+  // Unsoftened, by direct summation
+  double Potential() const {
+    double potential{0};
+    for (size_t i = 0; i < size(); ++i)
+      for (size_t j = i + 1; j < size(); ++j) {
+        const double dx{x[i] - x[j]}, dy{y[i] - y[j]}, dz{z[i] - z[j]};
+        potential -= m[i] * m[j] / std::sqrt(dx * dx + dy * dy + dz * dz);
+      }
+    return potential;
+  }
+
+  double VirialRatio() const { return 2 * Kinetic() / -Potential(); }
+};
+
+template <typename T>
+void ExpectCentered(const Sample<T>& s) {
+  double c[6]{};
+  for (size_t i = 0; i < s.size(); ++i) {
+    c[0] += s.m[i] * s.x[i];
+    c[1] += s.m[i] * s.y[i];
+    c[2] += s.m[i] * s.z[i];
+    c[3] += s.m[i] * s.vx[i];
+    c[4] += s.m[i] * s.vy[i];
+    c[5] += s.m[i] * s.vz[i];
+  }
+  for (const double ci : c) EXPECT_NEAR(ci, 0., 1e-5);
+}
+}  // namespace
+
+// Every model in virial equilibrium, 2 K = |W|, with the requested mass
+TEST(InitialConditionsTest, VirialEquilibrium) {
+  const size_t n{2000};
+  const Sample<double> plummer(n, Plummer{.scale = 2, .mass = 3});
+  const Sample<double> hernquist(n, Hernquist{});
+  const Sample<double> sphere(n, UniformSphere{.radius = 0.5});
+  EXPECT_NEAR(plummer.Mass(), 3., 1e-12);
+  EXPECT_NEAR(hernquist.Mass(), 1., 1e-12);
+  EXPECT_NEAR(plummer.VirialRatio(), 1., 0.1);
+  // the mass cut drops the outer halo, and the Gaussian velocities are
+  // truncated at the escape speed
+  EXPECT_NEAR(hernquist.VirialRatio(), 1., 0.15);
+  EXPECT_NEAR(sphere.VirialRatio(), 1., 0.1);
+  for (const Sample<double>* s : {&plummer, &hernquist, &sphere})
+    ExpectCentered(*s);
+}
+
+// A rotating disk, thin and with more mass inside the scale length than out
+// at 3 of them
+TEST(InitialConditionsTest, ExponentialDisk) {
+  const size_t n{20000};
+  const Sample<double> disk(n, ExponentialDisk{.scale_height = 0.05});
+  ExpectCentered(disk);
+  double lz{0}, z2{0};
+  size_t inner{0}, outer{0};
+  for (size_t i = 0; i < n; ++i) {
+    lz += disk.m[i] * (disk.x[i] * disk.vy[i] - disk.y[i] * disk.vx[i]);
+    z2 += disk.z[i] * disk.z[i] / double(n);
+    const double R{std::hypot(disk.x[i], disk.y[i])};
+    inner += R < 1;
+    outer += R > 3;
+  }
+  EXPECT_GT(lz, 0.3);
+  EXPECT_LT(std::sqrt(z2), 0.1);
+  // 1 - 2/e and 4/e³ of the mass
+  EXPECT_NEAR(double(inner) / double(n), 0.264, 0.02);
+  EXPECT_NEAR(double(outer) / double(n), 0.199, 0.02);
+}
+
+// The clusters of a merger each in equilibrium, around the corners of the
+// polygon, and bound to each other for orbit < 1
+TEST(InitialConditionsTest, PlummerMerger) {
+  const size_t n{3000};
+  const PlummerMerger merger{.clusters = 3, .separation = 20, .scale = 0.5};
+  const Sample<double> all(n, merger);
+  ExpectCentered(all);
+  for (size_t c = 0; c < 3; ++c) {
+    const size_t begin{n * c / 3}, end{n * (c + 1) / 3};
+    Sample<double> cluster(0, merger);
+    for (size_t i = begin; i < end; ++i) {
+      cluster.x.push_back(all.x[i]);
+      cluster.y.push_back(all.y[i]);
+      cluster.z.push_back(all.z[i]);
+      cluster.m.push_back(all.m[i]);
+    }
+    double x0{0}, y0{0}, vx0{0}, vy0{0};
+    for (size_t i = begin; i < end; ++i) {
+      x0 += all.x[i] / double(end - begin);
+      y0 += all.y[i] / double(end - begin);
+      vx0 += all.vx[i] / double(end - begin);
+      vy0 += all.vy[i] / double(end - begin);
+    }
+    for (size_t i = begin; i < end; ++i) {
+      cluster.vx.push_back(all.vx[i] - vx0);
+      cluster.vy.push_back(all.vy[i] - vy0);
+      cluster.vz.push_back(all.vz[i]);
+    }
+    EXPECT_NEAR(std::hypot(x0, y0), 10., 0.3);
+    EXPECT_NEAR(cluster.VirialRatio(), 1., 0.15);
+  }
+  EXPECT_LT(all.Kinetic() + all.Potential(), 0.);
+}
+
+// The same particles whatever the number of threads, and in either precision
+TEST(InitialConditionsTest, IndependentOfThreads) {
+  const size_t threads{ThreadPool::Global().NumThreads()};
+  const size_t n{10007};
+  const Hernquist model{.seed = 5, .stream = 1};
+  ThreadPool::Global().Resize(1);
+  const Sample<double> serial(n, model);
+  const Sample<float> serial_float(n, model);
+  ThreadPool::Global().Resize(4);
+  const Sample<double> parallel(n, model);
+  ThreadPool::Global().Resize(threads);
+  EXPECT_EQ(serial.x, parallel.x);
+  EXPECT_EQ(serial.vz, parallel.vz);
+  for (size_t i = 0; i < n; ++i)
+    ASSERT_NEAR(serial_float.x[i], serial.x[i],
+                1e-5 * std::max(1., std::abs(serial.x[i])));
+  EXPECT_NE(serial.x, Sample<double>(n, Hernquist{.seed = 5}).x);
+}
+
+// Particles set up by a generator, ready to step
+TEST(InitialConditionsTest, Particles) {
+  const size_t n{1000};
+  const Plummer model{.seed = 9};
+  Particles<double> p(n, 1e-3, model);
+  const Sample<double> s(n, model);
+  EXPECT_TRUE(std::ranges::equal(p.x, s.x));
+  EXPECT_TRUE(std::ranges::equal(p.z, s.z));
+  p.SetDiagnostics(true);
+  const std::vector<double> none;
+  p.Update(none, none, none, 0., 0., 0.);
+  EXPECT_NEAR(p.Stats().kinetic, s.Kinetic(), 0.01 * s.Kinetic());
+  EXPECT_LT(p.Stats().Energy(), 0.);
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#include "sim/integrators.h"
+
+namespace {
+// Two equal masses on an orbit of eccentricity 1/2, G = 1, starting at the
+// apocentre with separation 1: semi-major axis 2/3, period 2 pi sqrt(4/27).
+// The forces are evaluated here rather than by a solver.
+template <class Integrator>
+struct Kepler {
+  static constexpr size_t n{2};
+  static constexpr size_t kStride{8};
+  std::array<double, n> x{-0.5, 0.5}, y{0., 0.}, z{0., 0.};
+  std::array<double, n> vx{}, vy{}, vz{}, m{1., 1.};
+  std::array<double, n> Fx{}, Fy{}, Fz{}, zero{};
+  std::array<double, kStride * (Integrator::kScratchFields + 1)> scratch{};
+  bool forces_current{false};
+  size_t evaluations{0};
+
+  static double Period() { return 2 * std::numbers::pi * std::sqrt(4. / 27); }
+
+  // relative speed at the apocentre sqrt(M (1 - e) / r) = 1
+  Kepler() { vy = {-0.5, 0.5}; }
+
+  void Forces() {
+    ++evaluations;
+    const double rx{x[1] - x[0]}, ry{y[1] - y[0]}, rz{z[1] - z[0]};
+    const double r{std::sqrt(rx * rx + ry * ry + rz * rz)};
+    const double f{m[0] * m[1] / (r * r * r)};
+    Fx = {f * rx, -f * rx};
+    Fy = {f * ry, -f * ry};
+    Fz = {f * rz, -f * rz};
+  }
+
+  double Energy() const {
+    const double rx{x[1] - x[0]}, ry{y[1] - y[0]}, rz{z[1] - z[0]};
+    double e{-m[0] * m[1] / std::sqrt(rx * rx + ry * ry + rz * rz)};
+    for (size_t i = 0; i < n; ++i)
+      e += 0.5 * m[i] * (vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    return e;
+  }
+
+  void Step(const double dt) {
+    const SoaState<double> s{.n = n,
+                             .x = x.data(),
+                             .y = y.data(),
+                             .z = z.data(),
+                             .vx = vx.data(),
+                             .vy = vy.data(),
+                             .vz = vz.data(),
+                             .m = m.data(),
+                             .Fx = Fx.data(),
+                             .Fy = Fy.data(),
+                             .Fz = Fz.data(),
+                             .ex = zero.data(),
+                             .ey = zero.data(),
+                             .ez = zero.data(),
+                             .gx = 0.,
+                             .gy = 0.,
+                             .gz = 0.,
+                             .scratch = scratch.data(),
+                             .stride = kStride};
+    Integrator::Step(s, dt, forces_current, [this] { Forces(); });
+  }
+
+  // Distance from the start after one period in `steps` steps, and the
+  // largest energy error on the way
+  std::pair<double, double> Orbit(const size_t steps) {
+    const double e0{Energy()};
+    double max_de{0};
+    for (size_t k = 0; k < steps; ++k) {
+      Step(Period() / double(steps));
+      max_de = std::max(max_de, std::abs(Energy() - e0));
+    }
+    return {std::hypot(x[0] + 0.5, y[0], z[0]), max_de};
+  }
+};
+
+template <class Integrator>
+double ConvergenceOrder(const size_t steps) {
+  const double coarse{Kepler<Integrator>{}.Orbit(steps).second};
+  const double fine{Kepler<Integrator>{}.Orbit(2 * steps).second};
+  return std::log2(coarse / fine);
+}
+}  // namespace
+
+TEST(IntegratorsTest, ConvergenceOrder) {
+  EXPECT_NEAR(ConvergenceOrder<SemiImplicitEuler>(400), 1., 0.2);
+  EXPECT_NEAR(ConvergenceOrder<LeapfrogKDK>(200), 2., 0.2);
+  EXPECT_NEAR(ConvergenceOrder<RungeKutta4>(200), 4., 0.4);
+  EXPECT_NEAR(ConvergenceOrder<Yoshida4>(100), 4., 0.4);
+}
+
+TEST(IntegratorsTest, ForceEvaluationsPerStep) {
+  auto evaluations = [](auto kepler) {
+    kepler.Orbit(10);
+    return kepler.evaluations;
+  };
+  // the kick-drift-kick schemes reuse the forces of the end of the last step
+  EXPECT_EQ(evaluations(Kepler<SemiImplicitEuler>{}), 10u);
+  EXPECT_EQ(evaluations(Kepler<LeapfrogKDK>{}), 11u);
+  EXPECT_EQ(evaluations(Kepler<Yoshida4>{}), 31u);
+  EXPECT_EQ(evaluations(Kepler<RungeKutta4>{}), 40u);
+}
+
+// Energy error of the higher order schemes at larger steps, per force
+// evaluation spent
+TEST(IntegratorsTest, LargerStepsForTheSameEnergyError) {
+  const double euler{Kepler<SemiImplicitEuler>{}.Orbit(1000).second};
+  const double kdk{Kepler<LeapfrogKDK>{}.Orbit(250).second};
+  const double yoshida{Kepler<Yoshida4>{}.Orbit(100).second};
+  const double rk4{Kepler<RungeKutta4>{}.Orbit(100).second};
+  RecordProperty("euler", testing::PrintToString(euler));
+  RecordProperty("kdk_4x_dt", testing::PrintToString(kdk));
+  RecordProperty("yoshida_10x_dt", testing::PrintToString(yoshida));
+  RecordProperty("rk4_10x_dt", testing::PrintToString(rk4));
+  EXPECT_LT(kdk, euler);
+  EXPECT_LT(yoshida, euler);
+  EXPECT_LT(rk4, euler);
+}
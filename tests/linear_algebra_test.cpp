@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <cmath>
+#include <cstring>
+#include <span>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "sim/linear_algebra.h"
 #include "sim/types.hpp"
@@ -75,3 +80,67 @@ TEST(VectorTest, BasicOperations) {
   Vec3d w(0, 3, 4);
   EXPECT_EQ(w.Norm(), 5);
 }
+
+TEST(VectorTest, PlainValueTypes) {
+  static_assert(std::is_trivially_copyable_v<Vec3d>);
+  static_assert(std::is_standard_layout_v<Vec3d>);
+  static_assert(std::is_trivially_copyable_v<Point3f>);
+  static_assert(std::is_standard_layout_v<Point3f>);
+  static_assert(sizeof(Vec3d) == 3 * sizeof(double));
+  static_assert(sizeof(Point3f) == 3 * sizeof(float));
+  // an array of vectors is an array of scalars
+  const Vec3d v[2]{{1, 2, 3}, {4, 5, 6}};
+  double flat[6];
+  std::memcpy(flat, v, sizeof(v));
+  EXPECT_EQ(flat[4], 5.);
+}
+
+TEST(VectorTest, Expressions) {
+  const Vec3d a(1, 2, 3), b(-2, 0.5, 4);
+  const double k{2.5}, m{4};
+  // evaluated component by component, as written
+  const Vec3d e = (a + b) * k / m - (-a);
+  EXPECT_EQ(e.x, (1. + -2.) * k / m + 1.);
+  EXPECT_EQ(e.y, (2. + 0.5) * k / m + 2.);
+  EXPECT_EQ(e.z, (3. + 4.) * k / m + 3.);
+  // an expression kept in a variable owns its operands
+  const auto lazy = Vec3d(1, 1, 1) + a;
+  EXPECT_TRUE(lazy.IsAlmostEqual(Vec3d(2, 3, 4)));
+  EXPECT_EQ(Dot(a, b - a), Dot(a, Vec3d(-3, -1.5, 1)));
+  EXPECT_EQ((a - a).Norm2(), 0.);
+
+  Point3d p(1, 1, 1);
+  p += 2. * a;
+  EXPECT_TRUE(p.IsAlmostEqual(Point3d(3, 5, 7)));
+  EXPECT_TRUE((p - a).IsAlmostEqual(Point3d(2, 3, 4)));
+  Vec3d w(a);
+  w -= b * 2.;
+  w /= 2.;
+  EXPECT_TRUE(w.IsAlmostEqual(Vec3d(2.5, 0.5, -2.5)));
+  // between precisions only explicitly
+  static_assert(!std::is_convertible_v<Vec3d, Vec3f>);
+  EXPECT_TRUE(Vec3f(a + b).IsAlmostEqual(Vec3f(-1, 2.5, 7)));
+  constexpr Vec3d c{Vec3d(1, 2, 3) * 2.};
+  static_assert(c.Get<2>() == 6.);
+}
+
+TEST(VectorTest, BatchOperations) {
+  std::vector<Vec3d> x, y;
+  for (size_t i = 0; i < 37; ++i) {
+    x.emplace_back(double(i), 1., -double(i) / 2);
+    y.emplace_back(1., double(i % 5), 2.);
+  }
+  std::vector<Vec3d> z(y);
+  Axpy(0.5, std::span<const Vec3d>(x), std::span<Vec3d>(z));
+  double dot{0};
+  std::vector<double> norm2(37);
+  Norm2(std::span<const Vec3d>(z), std::span<double>(norm2));
+  for (size_t i = 0; i < 37; ++i) {
+    const Vec3d want = y[i] + 0.5 * x[i];
+    EXPECT_TRUE(z[i].IsAlmostEqual(want));
+    EXPECT_EQ(norm2[i], want.Norm2());
+    dot += Dot(x[i], y[i]);
+  }
+  EXPECT_NEAR(Dot(std::span<const Vec3d>(x), std::span<const Vec3d>(y)), dot,
+              1e-12 * std::abs(dot));
+}
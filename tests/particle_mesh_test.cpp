@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include "sim/fft.h"
+#include "sim/force_models.h"
+#include "sim/particle_mesh.h"
+#include "sim/particles.h"
+#include "test_util.h"
+
+namespace {
+using Complex = std::complex<double>;
+
+std::vector<Complex> RandomGrid(const size_t size) {
+  std::mt19937 gen{4};
+  std::normal_distribution<double> u;
+  std::vector<Complex> v(size);
+  for (auto& c : v) c = {u(gen), u(gen)};
+  return v;
+}
+
+// Zeroes the forces of the cloud and adds those of the mesh; G = 1
+void Forces(RandomCloud<>& c, ParticleMesh<double>& pm) {
+  std::fill(c.Fx.begin(), c.Fx.end(), 0.);
+  std::fill(c.Fy.begin(), c.Fy.end(), 0.);
+  std::fill(c.Fz.begin(), c.Fz.end(), 0.);
+  pm.AddForces(c.x.data(), c.y.data(), c.z.data(), c.m.data(), c.m.data(),
+               c.n, c.Fx.data(), c.Fy.data(), c.Fz.data());
+}
+}  // namespace
+
+TEST(ParticleMeshTest, FftMatchesDft) {
+  const size_t n0{4}, n1{8}, n2{2}, size{n0 * n1 * n2};
+  const std::vector<Complex> v{RandomGrid(size)};
+  std::vector<Complex> f{v};
+  const Fft3d<double> fft(n0, n1, n2);
+  fft.Forward(f.data());
+  for (size_t a = 0; a < n0; ++a)
+    for (size_t b = 0; b < n1; ++b)
+      for (size_t c = 0; c < n2; ++c) {
+        Complex sum{};
+        for (size_t i = 0; i < n0; ++i)
+          for (size_t j = 0; j < n1; ++j)
+            for (size_t k = 0; k < n2; ++k) {
+              const double phase{-2 * std::numbers::pi *
+                                  (double(a * i) / n0 + double(b * j) / n1 +
+                                   double(c * k) / n2)};
+              sum += v[(i * n1 + j) * n2 + k] * std::polar(1., phase);
+            }
+        const Complex got{f[(a * n1 + b) * n2 + c]};
+        EXPECT_NEAR(got.real(), sum.real(), 1e-12);
+        EXPECT_NEAR(got.imag(), sum.imag(), 1e-12);
+      }
+}
+
+TEST(ParticleMeshTest, InverseFftUndoesForward) {
+  const Fft3d<double> fft(32, 16, 64);
+  EXPECT_EQ(fft.Size(), 32u * 16 * 64);
+  const std::vector<Complex> v{RandomGrid(fft.Size())};
+  std::vector<Complex> f{v};
+  fft.Forward(f.data());
+  fft.Inverse(f.data());
+  for (size_t c = 0; c < v.size(); ++c)
+    ASSERT_NEAR(std::abs(f[c] / double(fft.Size()) - v[c]), 0., 1e-12);
+
+  // sizes round up to powers of two
+  EXPECT_EQ(Fft3d<double>(5, 16, 1).Dims()[0], 8u);
+}
+
+// Well inside the box and beyond a few cells the mesh force is Newtonian
+TEST(ParticleMeshTest, PairForceIsNewtonianAtIntermediateRange) {
+  ParticleMesh<double> pm(1., 128);
+  for (const double r : {0.05, 0.1, 0.15}) {
+    std::vector<double> x{0.4, 0.4 + r}, y{0.5, 0.5}, z{0.5, 0.5};
+    std::vector<double> m{1., 1.}, Fx(2), Fy(2), Fz(2);
+    pm.AddForces(x.data(), y.data(), z.data(), m.data(), m.data(), 2,
+                 Fx.data(), Fy.data(), Fz.data());
+    // attraction 1 / r^2, the images and the neutralising background change
+    // it by less than 1% at these distances
+    EXPECT_NEAR(Fx[0], 1 / (r * r), 0.03 / (r * r)) << "r " << r;
+    EXPECT_NEAR(Fx[1], -Fx[0], 1e-9 * Fx[0]);
+    EXPECT_NEAR(Fy[0], 0., 1e-6 / (r * r));
+  }
+}
+
+TEST(ParticleMeshTest, MomentumConservedAndPeriodic) {
+  const double box{2.};
+  RandomCloud<> c(5000, {0, box}, 8, {1, 2});
+  ParticleMesh<double> pm(box, 32);
+  Forces(c, pm);
+  double px{0}, py{0}, pz{0}, scale{0};
+  for (size_t i = 0; i < c.n; ++i) {
+    px += c.Fx[i];
+    py += c.Fy[i];
+    pz += c.Fz[i];
+    scale += std::abs(c.Fx[i]);
+  }
+  EXPECT_LT(std::abs(px), 1e-10 * scale);
+  EXPECT_LT(std::abs(py), 1e-10 * scale);
+  EXPECT_LT(std::abs(pz), 1e-10 * scale);
+
+  // shifting everything by whole cells and periods changes nothing
+  const std::vector<double> Fx{c.Fx}, Fy{c.Fy};
+  const double h{box / 32};
+  for (size_t i = 0; i < c.n; ++i) {
+    c.x[i] += 5 * h;
+    c.y[i] -= box;
+    c.z[i] += 3 * box;
+  }
+  Forces(c, pm);
+  for (size_t i = 0; i < c.n; ++i) {
+    ASSERT_NEAR(c.Fx[i], Fx[i], 1e-9 * scale / double(c.n));
+    ASSERT_NEAR(c.Fy[i], Fy[i], 1e-9 * scale / double(c.n));
+  }
+}
+
+TEST(ParticleMeshTest, ActiveSubsetMatchesAll) {
+  RandomCloud<> c(2000, {0, 1}, 8, {1, 2});
+  ParticleMesh<double> pm(1., 16);
+  Forces(c, pm);
+  std::vector<std::uint32_t> active{3, 10, 1999};
+  std::vector<double> Fx(c.n), Fy(c.n), Fz(c.n);
+  pm.AddForcesOn(c.x.data(), c.y.data(), c.z.data(), c.m.data(), c.m.data(),
+                 c.n, active, Fx.data(), Fy.data(), Fz.data());
+  for (const std::uint32_t i : active) {
+    EXPECT_EQ(Fx[i], c.Fx[i]);
+    EXPECT_EQ(Fz[i], c.Fz[i]);
+  }
+  EXPECT_EQ(Fx[4], 0.);
+}
+
+TEST(ParticleMeshTest, ParticlesStayInThePeriodicBox) {
+  Particles<double, LeapfrogKDK, PeriodicGravity<double>> p(1000, 0.01);
+  p.GetForceModel().SetMesh(1., 16);
+  const std::vector<double> none;
+  // a drift out of the box through the global force
+  for (size_t k = 0; k < 20; ++k) p.Update(none, none, none, 0., 0., -1e5);
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_GE(p.x[i], 0.);
+    ASSERT_LT(p.x[i], 1.);
+    ASSERT_GE(p.z[i], 0.);
+    ASSERT_LT(p.z[i], 1.);
+  }
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "sim/linear_algebra.h"
+#include "sim/particles.h"
+#include "utils/philox.h"
+#include "utils/rng.h"
+#include "utils/thread_pool.h"
+
+// Known answers of Philox4x32-10 from the Random123 distribution
+TEST(PhiloxTest, KnownAnswers) {
+  using C = Philox4x32::Counter;
+  EXPECT_EQ(Philox4x32::Block({0, 0, 0, 0}, {0, 0}),
+            (C{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  EXPECT_EQ(Philox4x32::Block({~0u, ~0u, ~0u, ~0u}, {~0u, ~0u}),
+            (C{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  EXPECT_EQ(Philox4x32::Block({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                              {0xa4093822, 0x299f31d0}),
+            (C{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+  // lane l of Blocks() is the block of counter first + l
+  std::array<std::array<std::uint32_t, 8>, 4> w;
+  Philox4x32::Blocks<8>(40, 1, 2, 3, {5, 6}, w);
+  for (std::uint32_t l = 0; l < 8; ++l) {
+    const C c{Philox4x32::Block({40 + l, 1, 2, 3}, {5, 6})};
+    for (size_t k = 0; k < 4; ++k) ASSERT_EQ(w[k][l], c[k]);
+  }
+}
+
+namespace {
+template <typename T>
+std::vector<T> Draw(const std::uint64_t seed, const std::uint32_t stream,
+                    const size_t n) {
+  RNG<T> rng(seed, stream);
+  std::vector<T> first(n), second(n);
+  rng.GenerateUniformRandom(first.data(), n, T(-2), T(2));
+  rng.GenerateUniformRandom(second.data(), n, T(-2), T(2));
+  first.insert(first.end(), second.begin(), second.end());
+  return first;
+}
+}  // namespace
+
+TEST(RngTest, ReproducibleAndInRange) {
+  const size_t n{100003};
+  const std::vector<double> a{Draw<double>(7, 0, n)};
+  EXPECT_EQ(a, Draw<double>(7, 0, n));
+  EXPECT_NE(a, Draw<double>(8, 0, n));
+  EXPECT_NE(a, Draw<double>(7, 1, n));
+  // consecutive calls draw different values
+  EXPECT_FALSE(std::equal(a.begin(), a.begin() + n, a.begin() + n));
+  // a prefix is the prefix of a longer fill
+  const std::vector<double> b{Draw<double>(7, 0, 1000)};
+  EXPECT_TRUE(std::equal(b.begin(), b.begin() + 1000, a.begin()));
+
+  for (const std::vector<float>& v :
+       {Draw<float>(3, 0, n), Draw<float>(3, 0, 5)}) {
+    EXPECT_GE(*std::min_element(v.begin(), v.end()), -2.f);
+    EXPECT_LT(*std::max_element(v.begin(), v.end()), 2.f);
+  }
+  double mean{0};
+  for (const double v : a) mean += v / double(a.size());
+  EXPECT_NEAR(mean, 0., 0.02);
+}
+
+// The same values whatever the number of threads
+TEST(RngTest, IndependentOfThreads) {
+  const size_t threads{ThreadPool::Global().NumThreads()};
+  ThreadPool::Global().Resize(1);
+  const std::vector<float> serial{Draw<float>(11, 2, 1 << 20)};
+  const std::vector<Vec3d> serial3{
+      RNG<Vec3d>(11).GenerateUniformRandom(5000, {0, 0, 0}, {1, 2, 3})};
+  ThreadPool::Global().Resize(4);
+  const std::vector<float> parallel{Draw<float>(11, 2, 1 << 20)};
+  const std::vector<Vec3d> parallel3{
+      RNG<Vec3d>(11).GenerateUniformRandom(5000, {0, 0, 0}, {1, 2, 3})};
+  ThreadPool::Global().Resize(threads);
+  EXPECT_EQ(serial, parallel);
+  for (size_t i = 0; i < serial3.size(); ++i) {
+    ASSERT_EQ(serial3[i].x, parallel3[i].x);
+    ASSERT_EQ(serial3[i].z, parallel3[i].z);
+    ASSERT_LT(serial3[i].z, 3.);
+  }
+}
+
+// The initial conditions of a seed, bit for bit
+TEST(RngTest, SeededParticles) {
+  Particles<double> a(1000, 1e-3, 42), b(1000, 1e-3, 42), c(1000, 1e-3, 43);
+  auto same = [](const Particles<double>& p, const Particles<double>& q) {
+    return std::ranges::equal(p.x, q.x) && std::ranges::equal(p.y, q.y) &&
+           std::ranges::equal(p.z, q.z);
+  };
+  EXPECT_TRUE(same(a, b));
+  EXPECT_FALSE(same(a, c));
+  c.Randomize(42);
+  EXPECT_TRUE(same(a, c));
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+
+#include "utils/soa_arena.h"
+
+namespace {
+template <typename T>
+bool IsAligned(const T* p) {
+  return reinterpret_cast<std::uintptr_t>(p) % SoaArena<T>::kAlignment == 0;
+}
+}  // namespace
+
+TEST(SoaArenaTest, FieldsAreAlignedPaddedAndZeroed) {
+  for (const size_t n : {1, 7, 8, 9, 1000}) {
+    SoaArena<double> arena(n, 5);
+    EXPECT_EQ(arena.Size(), n);
+    EXPECT_GE(arena.Stride(), n);
+    EXPECT_EQ(arena.Stride() % SoaArena<double>::kLanes, 0u);
+    for (size_t k = 0; k < arena.NumFields(); ++k) {
+      EXPECT_TRUE(IsAligned(arena.Field(k))) << "n " << n << " field " << k;
+      for (size_t i = 0; i < arena.Stride(); ++i)
+        ASSERT_EQ(arena.Field(k)[i], 0.);
+    }
+  }
+  SoaArena<float> arena(17, 3);
+  EXPECT_EQ(arena.Stride(), 32u);
+  EXPECT_TRUE(IsAligned(arena.Field(2)));
+}
+
+TEST(SoaArenaTest, FieldsDoNotOverlap) {
+  SoaArena<float> arena(100, 4);
+  for (size_t k = 0; k < 4; ++k)
+    for (size_t i = 0; i < arena.Stride(); ++i) arena.Field(k)[i] = float(k);
+  for (size_t k = 0; k < 4; ++k)
+    for (size_t i = 0; i < arena.Stride(); ++i)
+      ASSERT_EQ(arena.Field(k)[i], float(k));
+}
+
+// Large enough for the huge page path
+TEST(SoaArenaTest, LargeArena) {
+  SoaArena<double> arena(1 << 20, 3);
+  EXPECT_TRUE(IsAligned(arena.Field(1)));
+  arena.Field(2)[(1 << 20) - 1] = 1.;
+  EXPECT_EQ(arena.Field(2)[(1 << 20) - 1], 1.);
+}
+
+TEST(SoaArenaTest, MoveKeepsTheStorage) {
+  SoaArena<double> a(10, 2);
+  a.Field(1)[3] = 4.;
+  double* const field{a.Field(1)};
+  SoaArena<double> b(std::move(a));
+  EXPECT_EQ(b.Field(1), field);
+  EXPECT_EQ(b.Field(1)[3], 4.);
+  EXPECT_EQ(a.Bytes(), 0u);
+
+  SoaArena<double> empty(0, 2);
+  EXPECT_EQ(empty.Bytes(), 0u);
+  empty = std::move(b);
+  EXPECT_EQ(empty.Field(1), field);
+}
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "sim/force_models.h"
+#include "sim/particles.h"
+#include "sim/spatial_order.h"
+
+namespace {
+// Mean distance between particles stored next to each other
+template <class P>
+double MeanStep(const P& p, const size_t n) {
+  double sum{0};
+  for (size_t i = 1; i < n; ++i)
+    sum += std::hypot(p.x[i] - p.x[i - 1], p.y[i] - p.y[i - 1],
+                      p.z[i] - p.z[i - 1]);
+  return sum / double(n - 1);
+}
+}  // namespace
+
+TEST(SpatialOrderTest, MortonKeyInterleavesXYZ) {
+  EXPECT_EQ(MortonKey(0, 0, 1), 1u);
+  EXPECT_EQ(MortonKey(0, 1, 0), 2u);
+  EXPECT_EQ(MortonKey(1, 0, 0), 4u);
+  EXPECT_EQ(MortonKey(3, 0, 0), 0b100100u);
+  const std::uint32_t max{(1u << kKeyBits) - 1};
+  EXPECT_EQ(MortonKey(max, max, max), (std::uint64_t(1) << 63) - 1);
+  // bits beyond 21 are dropped
+  EXPECT_EQ(MortonKey(1u << kKeyBits, 0, 0), 0u);
+}
+
+// At every level the Hilbert curve visits the sub-cubes one after the other,
+// and consecutive sub-cubes share a face
+TEST(SpatialOrderTest, HilbertCurveStepsToAdjacentCells) {
+  constexpr unsigned kLevel{3};
+  constexpr std::uint32_t kSide{1u << kLevel};
+  constexpr unsigned kShift{kKeyBits - kLevel};
+  struct Cell {
+    std::uint64_t key;
+    int x, y, z;
+  };
+  std::vector<Cell> cells;
+  for (std::uint32_t x = 0; x < kSide; ++x)
+    for (std::uint32_t y = 0; y < kSide; ++y)
+      for (std::uint32_t z = 0; z < kSide; ++z) {
+        // any point inside the sub-cube
+        const std::uint32_t o{(1u << kShift) / 3};
+        cells.push_back({HilbertKey(x << kShift | o, y << kShift | 2 * o,
+                                    z << kShift | o / 2),
+                         int(x), int(y), int(z)});
+      }
+  std::sort(cells.begin(), cells.end(),
+            [](const Cell& a, const Cell& b) { return a.key < b.key; });
+  for (size_t k = 1; k < cells.size(); ++k) {
+    const Cell &a{cells[k - 1]}, &b{cells[k]};
+    EXPECT_EQ(std::abs(a.x - b.x) + std::abs(a.y - b.y) + std::abs(a.z - b.z),
+              1)
+        << "step " << k;
+    // the sub-cubes own disjoint key ranges
+    EXPECT_EQ(b.key >> 3 * kShift, (a.key >> 3 * kShift) + 1);
+  }
+}
+
+TEST(SpatialOrderTest, RadixSortIsAStableSort) {
+  std::mt19937_64 gen{3};
+  for (const size_t n : {0, 1, 100, 200000}) {
+    std::vector<std::uint64_t> keys(n);
+    // few distinct low digits for ties, and random high bits
+    for (auto& key : keys) key = (gen() & ~std::uint64_t(0xffff)) | gen() % 7;
+    if (n == 200000)
+      for (size_t i = 0; i < n; i += 2) keys[i] = keys[i] % 7;
+    const std::vector<std::uint64_t> original{keys};
+    const std::vector<std::uint32_t> order{RadixSort(keys)};
+
+    std::vector<std::uint32_t> expected(n);
+    std::iota(expected.begin(), expected.end(), std::uint32_t(0));
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&](const std::uint32_t a, const std::uint32_t b) {
+                       return original[a] < original[b];
+                     });
+    EXPECT_EQ(order, expected) << "n " << n;
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+  }
+}
+
+TEST(SpatialOrderTest, RadixSortSkipsSharedDigits) {
+  // only the second byte differs
+  std::vector<std::uint64_t> keys{0xab00ff0000000300, 0xab00ff0000000100,
+                                  0xab00ff0000000200, 0xab00ff0000000100};
+  EXPECT_EQ(RadixSort(keys), (std::vector<std::uint32_t>{1, 3, 2, 0}));
+  EXPECT_EQ(keys[3], 0xab00ff0000000300u);
+}
+
+TEST(SpatialOrderTest, ReorderImprovesLocalityAndKeepsIds) {
+  const size_t n{20000};
+  Particles<double, LeapfrogKDK, NoPairForces> p(n, 0.01);
+  const std::vector<double> x0(p.x.begin(), p.x.end());
+  const double before{MeanStep(p, n)};
+  p.SetReordering(SpaceFillingCurve::kHilbert, 1);
+  const std::vector<double> none;
+  p.Update(none, none, none, 0., 0., 0.);
+  EXPECT_LT(MeanStep(p, n), before / 10);
+
+  std::vector<bool> seen(n);
+  for (size_t i = 0; i < n; ++i) {
+    const std::uint32_t id{p.Ids()[i]};
+    ASSERT_FALSE(seen[id]);
+    seen[id] = true;
+    EXPECT_EQ(p.IndexOf(id), i);
+    EXPECT_EQ(p.x[i], x0[id]);
+  }
+
+  Particles<double, LeapfrogKDK, NoPairForces> q(n, 0.01);
+  q.SetReordering(SpaceFillingCurve::kMorton, 1);
+  q.Update(none, none, none, 0., 0., 0.);
+  EXPECT_LT(MeanStep(q, n), before / 10);
+}
+
+// External forces are indexed by ID whatever the storage order
+TEST(SpatialOrderTest, ExternalForcesFollowTheIds) {
+  const size_t n{1000};
+  Particles<double, SemiImplicitEuler, NoPairForces> p(n, 0.1);
+  const std::vector<double> x0(p.x.begin(), p.x.end());
+  std::vector<double> F_ext_x(n, 0.);
+  F_ext_x[7] = 1e3;
+  const std::vector<double> none;
+  p.SetReordering(SpaceFillingCurve::kHilbert, 2);
+  for (size_t k = 0; k < 5; ++k) p.Update(F_ext_x, none, none, 0., 0., 0.);
+  for (size_t i = 0; i < n; ++i) {
+    const std::uint32_t id{p.Ids()[i]};
+    if (id == 7)
+      EXPECT_GT(p.x[i], x0[id]);
+    else
+      EXPECT_EQ(p.x[i], x0[id]) << "id " << id;
+  }
+}
+
+TEST(SpatialOrderTest, SpringsFollowTheReorder) {
+  const size_t n{50};
+  std::mt19937 gen{1};
+  std::uniform_real_distribution<double> pos(0., 1.);
+  std::vector<double> x(n), y(n), z(n), m(n, 1.);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = pos(gen);
+    y[i] = pos(gen);
+    z[i] = pos(gen);
+  }
+  std::vector<HarmonicSprings<double>::Bond> bonds;
+  for (std::uint32_t i = 0; i + 1 < n; ++i)
+    bonds.push_back({i, std::uint32_t((i * 7 + 3) % n), 2., 0.1});
+  HarmonicSprings<double> springs;
+  springs.SetBonds(bonds, n);
+
+  auto forces = [&](const std::vector<double>& x,
+                    const std::vector<double>& y,
+                    const std::vector<double>& z) {
+    std::vector<double> Fx(n), Fy(n), Fz(n);
+    springs.AddForces({.n = n,
+                       .x = x.data(),
+                       .y = y.data(),
+                       .z = z.data(),
+                       .m = m.data(),
+                       .Gm = m.data(),
+                       .Fx = Fx.data(),
+                       .Fy = Fy.data(),
+                       .Fz = Fz.data()});
+    return Fx;
+  };
+  const std::vector<double> before{forces(x, y, z)};
+
+  const std::vector<std::uint32_t> order{
+      SpatialOrder(x.data(), y.data(), z.data(), n, SpaceFillingCurve::kMorton)};
+  std::vector<double> px(n), py(n), pz(n);
+  for (size_t k = 0; k < n; ++k) {
+    px[k] = x[order[k]];
+    py[k] = y[order[k]];
+    pz[k] = z[order[k]];
+  }
+  springs.Reorder(order);
+  EXPECT_EQ(springs.NumBonds(), bonds.size());
+  const std::vector<double> after{forces(px, py, pz)};
+  for (size_t k = 0; k < n; ++k)
+    EXPECT_NEAR(after[k], before[order[k]], 1e-12) << "particle " << k;
+}
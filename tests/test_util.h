@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sim/force_models.h"
+
+/**
+ * Fixtures shared by the tests.
+ */
+
+// A file name in the temporary directory
+inline std::string TempPath(const std::string& name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// [lo, hi)
+struct Interval {
+  double lo, hi;
+};
+
+/**
+ * n particles at positions uniform in box³, with masses uniform in `mass`,
+ * or all mass.lo when the interval is empty, and force accumulators. The
+ * same seed gives the same cloud; Jiggle() draws from where it left off.
+ */
+template <std::floating_point T = double>
+struct RandomCloud {
+  size_t n;
+  std::vector<T> x, y, z, m, Fx, Fy, Fz;
+  std::mt19937 gen;
+
+  RandomCloud(const size_t n, const Interval box, const unsigned seed,
+              const Interval mass = {1, 1})
+      : n{n},
+        x(n),
+        y(n),
+        z(n),
+        m(n, T(mass.lo)),
+        Fx(n),
+        Fy(n),
+        Fz(n),
+        gen{seed} {
+    std::uniform_real_distribution<double> pos(box.lo, box.hi),
+        masses(mass.lo, mass.hi);
+    for (size_t i = 0; i < n; ++i) {
+      x[i] = T(pos(gen));
+      y[i] = T(pos(gen));
+      z[i] = T(pos(gen));
+      if (mass.lo < mass.hi) m[i] = T(masses(gen));
+    }
+  }
+
+  // Moves every particle by a random vector of length < d
+  void Jiggle(const double d) {
+    std::uniform_real_distribution<double> u(-1., 1.);
+    const double component{d / std::sqrt(3.) * 0.999};
+    for (size_t i = 0; i < n; ++i) {
+      x[i] += T(component * u(gen));
+      y[i] += T(component * u(gen));
+      z[i] += T(component * u(gen));
+    }
+  }
+
+  T Distance2(const size_t i, const size_t j) const {
+    const T rx{x[j] - x[i]}, ry{y[j] - y[i]}, rz{z[j] - z[i]};
+    return rx * rx + ry * ry + rz * rz;
+  }
+
+  // G = 1: the masses are the sources
+  ForceState<T> State() {
+    return {.n = n,
+            .x = x.data(),
+            .y = y.data(),
+            .z = z.data(),
+            .m = m.data(),
+            .Gm = m.data(),
+            .Fx = Fx.data(),
+            .Fy = Fy.data(),
+            .Fz = Fz.data()};
+  }
+};
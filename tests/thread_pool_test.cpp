@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "utils/parallel.h"
+#include "utils/thread_pool.h"
+
+// More threads than the machine may have: stealing and sleeping still work
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.NumThreads(), 4u);
+  for (const size_t tasks : {0, 1, 3, 4, 1000, 100000}) {
+    std::vector<std::atomic<int>> runs(tasks);
+    pool.Run(tasks, [&](const size_t i) { runs[i].fetch_add(1); });
+    for (size_t i = 0; i < tasks; ++i) ASSERT_EQ(runs[i].load(), 1) << i;
+  }
+}
+
+// Tasks of very different cost, the slow ones all in the first thread's range
+TEST(ThreadPoolTest, UnevenTasks) {
+  ThreadPool pool(3);
+  std::vector<std::atomic<int>> runs(60);
+  pool.Run(runs.size(), [&](const size_t i) {
+    if (i < 10) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    runs[i].fetch_add(1);
+  });
+  for (const std::atomic<int>& r : runs) EXPECT_EQ(r.load(), 1);
+}
+
+// A Run() from a task runs inline, and jobs follow each other back to back
+TEST(ThreadPoolTest, NestedAndRepeatedJobs) {
+  ThreadPool pool(4);
+  std::atomic<size_t> sum{0};
+  for (size_t k = 0; k < 200; ++k)
+    pool.Run(8, [&](const size_t i) {
+      pool.Run(4, [&](const size_t j) { sum.fetch_add(i * 4 + j); });
+    });
+  EXPECT_EQ(sum.load(), 200u * (31 * 32 / 2));
+}
+
+// Jobs from several threads at once: one runs on the pool, the others inline
+TEST(ThreadPoolTest, ConcurrentCallers) {
+  ThreadPool pool(3);
+  std::atomic<size_t> total{0};
+  std::vector<std::thread> callers;
+  for (size_t c = 0; c < 4; ++c)
+    callers.emplace_back([&] {
+      for (size_t k = 0; k < 50; ++k)
+        pool.Run(100, [&](size_t) { total.fetch_add(1); });
+    });
+  for (std::thread& caller : callers) caller.join();
+  EXPECT_EQ(total.load(), 4u * 50 * 100);
+}
+
+TEST(ThreadPoolTest, Resize) {
+  ThreadPool pool(2);
+  pool.Resize(5);
+  EXPECT_EQ(pool.NumThreads(), 5u);
+  std::atomic<size_t> count{0};
+  pool.Run(1000, [&](size_t) { count.fetch_add(1); });
+  pool.Resize(1);
+  pool.Run(1000, [&](size_t) { count.fetch_add(1); });
+  EXPECT_EQ(count.load(), 2000u);
+}
+
+// The chunks of a reduction are fixed by n, whatever the pool size
+TEST(ParallelTest, ReduceIndependentOfThreads) {
+  const size_t n{100000};
+  std::vector<double> v(n);
+  for (size_t i = 0; i < n; ++i) v[i] = std::sin(double(i)) * 1e10;
+  auto sum = [&] {
+    return ParallelReduce(
+        n, 0.,
+        [&](const size_t begin, const size_t end) {
+          double s{0};
+          for (size_t i = begin; i < end; ++i) s += v[i];
+          return s;
+        },
+        [](double& total, const double s) { total += s; }, 1000);
+  };
+  const size_t threads{ThreadPool::Global().NumThreads()};
+  ThreadPool::Global().Resize(1);
+  const double serial{sum()};
+  ThreadPool::Global().Resize(4);
+  const double parallel{sum()};
+  ThreadPool::Global().Resize(threads);
+  EXPECT_EQ(serial, parallel);
+
+  const auto [lo, hi] = ParallelMinMax(v.data(), n);
+  EXPECT_EQ(lo, *std::min_element(v.begin(), v.end()));
+  EXPECT_EQ(hi, *std::max_element(v.begin(), v.end()));
+}
+
+// A throwing task, on the caller or a worker, comes out of Run() and leaves
+// the pool ready for parallel jobs
+TEST(ThreadPoolTest, TaskExceptions) {
+  ThreadPool pool(4);
+  for (const size_t bad : {size_t(0), size_t(99)}) {
+    std::atomic<size_t> count{0};
+    EXPECT_THROW(pool.Run(100,
+                          [&](const size_t i) {
+                            if (i == bad) throw std::runtime_error("task");
+                            count.fetch_add(1);
+                          }),
+                 std::runtime_error);
+    EXPECT_LT(count.load(), 100u);
+
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.Run(40, [&](size_t) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      const std::lock_guard lock{mutex};
+      threads.insert(std::this_thread::get_id());
+    });
+    EXPECT_GT(threads.size(), 1u) << "task " << bad;
+  }
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "utils/thread_pool.h"
+#include "utils/topology.h"
+
+TEST(TopologyTest, ParseCpuList) {
+  EXPECT_EQ(ParseCpuList("0"), (std::vector<int>{0}));
+  EXPECT_EQ(ParseCpuList("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_TRUE(ParseCpuList("").empty());
+  EXPECT_THROW(ParseCpuList("3-1"), std::runtime_error);
+  EXPECT_THROW(ParseCpuList("a-b"), std::runtime_error);
+  EXPECT_EQ(ParseThreadAffinity("scatter"), ThreadAffinity::kScatter);
+  EXPECT_THROW(ParseThreadAffinity("spread"), std::runtime_error);
+}
+
+// A sysfs node directory of our own: nodes without allowed CPUs and other
+// entries are left out
+TEST(TopologyTest, NodesFromSysfs) {
+  const std::vector<int> allowed{AllowedCpus()};
+  ASSERT_FALSE(allowed.empty());
+  const std::filesystem::path root{std::filesystem::temp_directory_path() /
+                                   "topology_test_nodes"};
+  std::filesystem::remove_all(root);
+  auto node = [&](const std::string& name, const std::string& cpulist) {
+    std::filesystem::create_directories(root / name);
+    std::ofstream(root / name / "cpulist") << cpulist << "\n";
+  };
+  node("node3", std::to_string(allowed.front()));
+  node("node1", "100000-100003");
+  node("power", "0");
+  std::ofstream(root / "online") << "1,3\n";
+  const std::vector<NumaNode> nodes{NumaTopology(root.string())};
+  ASSERT_EQ(nodes.size(), 1u);
+  EXPECT_EQ(nodes[0].id, 3);
+  EXPECT_EQ(nodes[0].cpus, (std::vector<int>{allowed.front()}));
+  std::filesystem::remove_all(root);
+
+  // no sysfs: one node of all allowed CPUs
+  const std::vector<NumaNode> flat{NumaTopology(root.string())};
+  ASSERT_EQ(flat.size(), 1u);
+  EXPECT_EQ(flat[0].cpus, allowed);
+}
+
+TEST(TopologyTest, PlaceThreads) {
+  const std::vector<NumaNode> nodes{{.id = 0, .cpus = {0, 1, 2, 3}},
+                                    {.id = 1, .cpus = {4, 5, 6, 7}}};
+  EXPECT_EQ(PlaceThreads(nodes, 6, ThreadAffinity::kCompact),
+            (std::vector<int>{0, 1, 2, 3, 4, 5}));
+  EXPECT_EQ(PlaceThreads(nodes, 6, ThreadAffinity::kScatter),
+            (std::vector<int>{0, 4, 1, 5, 2, 6}));
+  EXPECT_TRUE(PlaceThreads(nodes, 4, ThreadAffinity::kNone).empty());
+  EXPECT_TRUE(PlaceThreads(nodes, 9, ThreadAffinity::kCompact).empty());
+  EXPECT_EQ(NodeOfCpu(nodes, 5), 1);
+  EXPECT_EQ(NodeOfCpu(nodes, 8), -1);
+}
+
+// Pinned or not, every policy runs every task
+TEST(TopologyTest, PoolUnderEveryPolicy) {
+  const size_t cpus{AllowedCpus().size()};
+  for (const ThreadAffinity affinity :
+       {ThreadAffinity::kNone, ThreadAffinity::kCompact,
+        ThreadAffinity::kScatter}) {
+    ThreadPool pool(cpus, affinity);
+    EXPECT_EQ(pool.Affinity(), affinity);
+    EXPECT_EQ(pool.Cpus().size(),
+              affinity == ThreadAffinity::kNone ? 0u : cpus);
+    std::atomic<size_t> count{0};
+    pool.Run(1000, [&](size_t) { count.fetch_add(1); });
+    EXPECT_EQ(count.load(), 1000u);
+  }
+}
+
+// Only the workers are pinned: the thread that runs a job keeps its CPUs,
+// and pools are unpinned unless asked
+TEST(TopologyTest, CallerStaysUnpinned) {
+  EXPECT_EQ(ThreadPool(2).Affinity(), ThreadAffinity::kNone);
+  const std::vector<int> before{AllowedCpus()};
+  for (const ThreadAffinity affinity :
+       {ThreadAffinity::kCompact, ThreadAffinity::kScatter}) {
+    ThreadPool pool(std::min<size_t>(2, before.size()), affinity);
+    pool.Run(100, [](size_t) {});
+    EXPECT_EQ(AllowedCpus(), before);
+  }
+}
@@ -0,0 +1,114 @@
+// Zones are recorded in this file whatever the build option
+#ifndef PARTICLES_TRACE
+#define PARTICLES_TRACE
+#endif
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_util.h"
+#include "utils/trace.h"
+
+namespace {
+std::string ReadFile(const std::string& path) {
+  std::ifstream in(path);
+  return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+size_t Count(const std::string& text, const std::string& what) {
+  size_t count{0};
+  for (size_t at = text.find(what); at != std::string::npos;
+       at = text.find(what, at + what.size()))
+    ++count;
+  return count;
+}
+
+// The zones of this thread, oldest first
+std::vector<TraceEvent> Zones() {
+  const TraceBuffer& buffer{ThisThreadTraceBuffer()};
+  std::vector<TraceEvent> zones;
+  const std::uint64_t head{buffer.head.load()};
+  for (std::uint64_t k = buffer.tail.load(); k < head; ++k)
+    zones.push_back(buffer.events[k % kTraceCapacity]);
+  return zones;
+}
+}  // namespace
+
+TEST(TraceTest, NestedZonesCloseInnerFirst) {
+  ClearTrace();
+  {
+    TRACE_ZONE("outer");
+    {
+      TRACE_ZONE("inner");
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  const std::vector<TraceEvent> zones{Zones()};
+  ASSERT_EQ(zones.size(), 2u);
+  EXPECT_STREQ(zones[0].name, "inner");
+  EXPECT_STREQ(zones[1].name, "outer");
+  EXPECT_LE(zones[1].begin, zones[0].begin);
+  EXPECT_GE(zones[1].end, zones[0].end);
+  EXPECT_LT(zones[0].begin, zones[0].end);
+  EXPECT_EQ(TraceEventCount(), 2u);
+}
+
+TEST(TraceTest, ThreadsExportSeparately) {
+  ClearTrace();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 3; ++t)
+    threads.emplace_back([] {
+      for (int k = 0; k < 10; ++k) TRACE_ZONE("work \"quoted\"");
+    });
+  for (std::thread& thread : threads) thread.join();
+  // zones of finished threads are kept
+  EXPECT_EQ(TraceEventCount(), 30u);
+
+  const std::string path{TempPath("trace_test.json")};
+  WriteChromeTrace(path);
+  const std::string json{ReadFile(path)};
+  EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0u);
+  EXPECT_EQ(Count(json, "\"ph\":\"X\""), 30u);
+  EXPECT_EQ(Count(json, "\"name\":\"work \\\"quoted\\\"\""), 30u);
+  std::set<std::string> tids;
+  for (size_t at = json.find("\"ph\":\"X\",\"pid\":1,\"tid\":");
+       at != std::string::npos;
+       at = json.find("\"ph\":\"X\",\"pid\":1,\"tid\":", at + 1)) {
+    const size_t begin{json.find("tid\":", at) + 5};
+    tids.insert(json.substr(begin, json.find(',', begin) - begin));
+  }
+  EXPECT_EQ(tids.size(), 3u);
+  EXPECT_EQ(json.substr(json.size() - 3), "]}\n");
+  std::remove(path.c_str());
+}
+
+TEST(TraceTest, FullBufferKeepsTheNewestZones) {
+  ClearTrace();
+  for (size_t k = 0; k < kTraceCapacity + 5; ++k) TRACE_ZONE("spin");
+  EXPECT_EQ(TraceEventCount(), kTraceCapacity);
+  const TraceBuffer& buffer{ThisThreadTraceBuffer()};
+  const std::uint64_t head{buffer.head.load()};
+  EXPECT_STREQ(buffer.events[(head - 1) % kTraceCapacity].name, "spin");
+}
+
+TEST(TraceTest, ClearDropsZones) {
+  { TRACE_ZONE("dropped"); }
+  ClearTrace();
+  EXPECT_EQ(TraceEventCount(), 0u);
+  EXPECT_TRUE(Zones().empty());
+}
+
+TEST(TraceTest, UnwritablePathThrows) {
+  EXPECT_THROW(WriteChromeTrace("/nonexistent/dir/trace.json"),
+               std::runtime_error);
+}
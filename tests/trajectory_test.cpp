@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sim/force_models.h"
+#include "sim/particles.h"
+#include "test_util.h"
+#include "utils/trajectory.h"
+
+namespace {
+// Particles on a slow random walk, as the fields of a frame
+struct Walk {
+  std::vector<double> f[6];
+  std::vector<std::uint32_t> ids;
+  std::mt19937 gen{5};
+
+  explicit Walk(const size_t n) : ids(n) {
+    std::uniform_real_distribution<double> u(-1., 1.);
+    for (auto& v : f) {
+      v.resize(n);
+      for (double& e : v) e = u(gen);
+    }
+    for (size_t i = 0; i < n; ++i) ids[i] = std::uint32_t(n - 1 - i);
+  }
+  void Step() {
+    std::normal_distribution<double> du(0., 1e-6);
+    for (auto& v : f)
+      for (double& e : v) e += du(gen);
+  }
+  void Record(TrajectoryWriter& writer, const std::uint64_t step) const {
+    writer.Record<double>(step, f[0], f[1], f[2], f[3], f[4], f[5], ids);
+  }
+};
+
+const std::vector<double>& Field(const TrajectoryReader::Frame& frame,
+                                 const size_t k) {
+  const std::vector<double>* const fields[]{&frame.x,  &frame.y,  &frame.z,
+                                            &frame.vx, &frame.vy, &frame.vz};
+  return *fields[k];
+}
+}  // namespace
+
+TEST(TrajectoryTest, FramesReadBackExactly) {
+  const std::string path{TempPath("trajectory_test_exact.traj")};
+  // more than one chunk, and an odd count for the 4-bit packing
+  Walk walk(kTrajectoryChunk + 3);
+  std::vector<Walk> expected;
+  {
+    TrajectoryWriter writer(path);
+    for (std::uint64_t step = 0; step < 4; ++step) {
+      walk.Record(writer, 10 * step);
+      expected.push_back(walk);
+      walk.Step();
+    }
+    // a new particle count restarts the XOR
+    Walk small(7);
+    small.Record(writer, 40);
+    expected.push_back(small);
+    writer.Close();
+    EXPECT_EQ(writer.Frames(), 5u);
+    EXPECT_EQ(writer.Bytes(), std::filesystem::file_size(path));
+  }
+  TrajectoryReader reader(path);
+  TrajectoryReader::Frame frame;
+  for (size_t k = 0; k < expected.size(); ++k) {
+    ASSERT_TRUE(reader.Next(frame));
+    EXPECT_EQ(frame.step, 10 * k);
+    EXPECT_FALSE(frame.float32);
+    EXPECT_EQ(frame.ids, expected[k].ids);
+    for (size_t f = 0; f < 6; ++f) ASSERT_EQ(Field(frame, f), expected[k].f[f]);
+  }
+  EXPECT_FALSE(reader.Next(frame));
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryTest, Float32AndRawOutput) {
+  const std::string path{TempPath("trajectory_test_float.traj")};
+  Walk walk(1000);
+  for (const bool compress : {false, true}) {
+    {
+      TrajectoryWriter writer(path, {.float32 = true, .compress = compress});
+      walk.Record(writer, 0);
+      walk.Step();
+      walk.Record(writer, 1);
+    }
+    TrajectoryReader reader(path);
+    TrajectoryReader::Frame frame;
+    ASSERT_TRUE(reader.Next(frame));
+    ASSERT_TRUE(reader.Next(frame));
+    EXPECT_TRUE(frame.float32);
+    for (size_t i = 0; i < 1000; ++i)
+      ASSERT_EQ(frame.vz[i], double(float(walk.f[5][i])));
+    EXPECT_FALSE(reader.Next(frame));
+  }
+  std::remove(path.c_str());
+}
+
+// Small moves leave the high bytes of the XOR zero
+TEST(TrajectoryTest, CompressionShrinksSlowMotion) {
+  const std::string path{TempPath("trajectory_test_size.traj")};
+  std::uint64_t bytes[2];
+  for (const bool compress : {false, true}) {
+    Walk walk(10000);
+    TrajectoryWriter writer(path, {.compress = compress});
+    for (std::uint64_t step = 0; step < 8; ++step) {
+      walk.Record(writer, step);
+      walk.Step();
+    }
+    writer.Flush();
+    bytes[compress] = writer.Bytes();
+  }
+  EXPECT_LT(bytes[1], bytes[0] * 3 / 4);
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryTest, RejectsArraysOfDifferentSizes) {
+  const std::string path{TempPath("trajectory_test_sizes.traj")};
+  {
+    Walk walk(100);
+    TrajectoryWriter writer(path);
+    walk.ids.pop_back();
+    EXPECT_THROW(walk.Record(writer, 0), std::invalid_argument);
+    walk.ids.push_back(0);
+    walk.f[4].resize(50);
+    EXPECT_THROW(walk.Record(writer, 0), std::invalid_argument);
+    walk.f[4].resize(100);
+    walk.Record(writer, 1);
+    writer.Close();
+    EXPECT_EQ(writer.Frames(), 1u);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryTest, ParticlesRecordEveryNSteps) {
+  const std::string path{TempPath("trajectory_test_particles.traj")};
+  Particles<double, LeapfrogKDK, Gravity<double>> p(200, 0.001);
+  p.SetReordering(SpaceFillingCurve::kMorton, 4);
+  const std::vector<double> none;
+  std::vector<std::vector<double>> x;
+  {
+    // one buffer: every frame waits for the one before it
+    TrajectoryWriter writer(path, {.buffers = 1});
+    p.SetTrajectoryOutput(&writer, 3);
+    for (size_t k = 1; k <= 10; ++k) {
+      p.Update(none, none, none, 0., 0., 0.);
+      if (k % 3 == 0) x.emplace_back(p.x.begin(), p.x.end());
+    }
+    p.SetTrajectoryOutput(nullptr, 0);
+  }
+  TrajectoryReader reader(path);
+  TrajectoryReader::Frame frame;
+  for (size_t k = 0; k < x.size(); ++k) {
+    ASSERT_TRUE(reader.Next(frame));
+    EXPECT_EQ(frame.step, 3 * (k + 1));
+    EXPECT_EQ(frame.x, x[k]);
+  }
+  EXPECT_EQ(std::vector<std::uint32_t>(p.Ids().begin(), p.Ids().end()),
+            frame.ids);
+  EXPECT_FALSE(reader.Next(frame));
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryTest, BadFilesThrow) {
+  EXPECT_THROW(TrajectoryWriter("/nonexistent/dir/x.traj"),
+               std::runtime_error);
+  const std::string path{TempPath("trajectory_test_bad.traj")};
+  {
+    Walk walk(100);
+    TrajectoryWriter writer(path);
+    walk.Record(writer, 0);
+  }
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  TrajectoryReader reader(path);
+  TrajectoryReader::Frame frame;
+  EXPECT_THROW(reader.Next(frame), std::runtime_error);
+  std::remove(path.c_str());
+}
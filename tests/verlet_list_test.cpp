@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "sim/cell_list.h"
+#include "sim/force_models.h"
+#include "sim/verlet_list.h"
+#include "test_util.h"
+
+namespace {
+VerletList<double> Build(const RandomCloud<>& p, const double cutoff,
+                         const double skin) {
+  CellList<double> cells;
+  cells.Build(p.x.data(), p.y.data(), p.z.data(), p.n, cutoff + skin);
+  VerletList<double> verlet(skin);
+  verlet.Build(cells, p.x.data(), p.y.data(), p.z.data(), p.n, cutoff);
+  return verlet;
+}
+}  // namespace
+
+TEST(VerletListTest, ListsHoldThePairsWithinCutoffPlusSkin) {
+  const RandomCloud<> p(2000, {0, 10}, 9);
+  const VerletList<double> verlet{Build(p, 1., 0.25)};
+  ASSERT_EQ(verlet.Size(), p.n);
+  size_t entries{0};
+  for (size_t i = 0; i < p.n; ++i) {
+    std::vector<std::uint32_t> expected;
+    for (size_t j = 0; j < p.n; ++j)
+      if (j != i && p.Distance2(i, j) < 1.25 * 1.25)
+        expected.push_back(std::uint32_t(j));
+    std::vector<std::uint32_t> listed;
+    verlet.ForEachNeighbour(i, [&](const std::uint32_t j) {
+      listed.push_back(j);
+    });
+    std::sort(listed.begin(), listed.end());
+    ASSERT_EQ(listed, expected) << "particle " << i;
+    entries += listed.size();
+  }
+  EXPECT_EQ(verlet.NumEntries(), entries);
+  EXPECT_EQ(verlet.Builds(), 1u);
+}
+
+TEST(VerletListTest, RebuildOnlyBeyondHalfTheSkin) {
+  RandomCloud<> p(100, {0, 5}, 9);
+  VerletList<double> verlet{Build(p, 1., 0.4)};
+  EXPECT_FALSE(verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n));
+  p.x[17] += 0.19;
+  EXPECT_FALSE(verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n));
+  p.x[17] += 0.02;
+  EXPECT_TRUE(verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n));
+  p.x[17] -= 0.21;
+
+  EXPECT_TRUE(
+      verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n - 1));
+  verlet.Invalidate();
+  EXPECT_TRUE(verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n));
+  EXPECT_TRUE(VerletList<double>{}.NeedsRebuild(nullptr, nullptr, nullptr, 0));
+}
+
+// Up to skin / 2 of motion per particle, the stale lists still hold every
+// pair within the cutoff
+TEST(VerletListTest, StaleListsGiveExactForces) {
+  RandomCloud<> p(2000, {0, 10}, 9);
+  const double cutoff{1.}, skin{0.3};
+  VerletList<double> verlet{Build(p, cutoff, skin)};
+  p.Jiggle(skin / 2);
+  ASSERT_FALSE(verlet.NeedsRebuild(p.x.data(), p.y.data(), p.z.data(), p.n));
+
+  auto pair = [](const double r2, size_t, size_t) {
+    return r2 < 1. ? 1. - r2 : 0.;
+  };
+  verlet.AddPairForces(p.x.data(), p.y.data(), p.z.data(), p.Fx.data(),
+                       p.Fy.data(), p.Fz.data(), pair);
+  for (size_t i = 0; i < p.n; ++i) {
+    double fx{0}, fy{0}, fz{0};
+    for (size_t j = 0; j < p.n; ++j) {
+      if (j == i) continue;
+      const double f{pair(p.Distance2(i, j), i, j)};
+      fx += f * (p.x[j] - p.x[i]);
+      fy += f * (p.y[j] - p.y[i]);
+      fz += f * (p.z[j] - p.z[i]);
+    }
+    ASSERT_NEAR(p.Fx[i], fx, 1e-12) << "particle " << i;
+    ASSERT_NEAR(p.Fy[i], fy, 1e-12) << "particle " << i;
+    ASSERT_NEAR(p.Fz[i], fz, 1e-12) << "particle " << i;
+  }
+}
+
+TEST(VerletListTest, LennardJonesRebuildsOnlyWhenStale) {
+  RandomCloud<> p(3000, {0, 20}, 9);
+  LennardJones<double> lj(1., 0.3, 1., 0.4);
+  for (size_t step = 0; step < 20; ++step) {
+    lj.AddForces(p.State());
+    p.Jiggle(0.05);
+  }
+  // less than 0.05 per step against a limit of 0.2: at least 5 steps apart
+  EXPECT_GE(lj.Neighbours().Builds(), 2u);
+  EXPECT_LE(lj.Neighbours().Builds(), 4u);
+
+  // the forces of the stale lists are those of a fresh model
+  std::fill(p.Fx.begin(), p.Fx.end(), 0.);
+  lj.AddForces(p.State());
+  const std::vector<double> stale{p.Fx};
+  std::fill(p.Fx.begin(), p.Fx.end(), 0.);
+  LennardJones<double>(1., 0.3, 1., 0.4).AddForces(p.State());
+  for (size_t i = 0; i < p.n; ++i)
+    ASSERT_NEAR(stale[i], p.Fx[i], 1e-9 * (1 + std::abs(p.Fx[i])));
+}